@@ -0,0 +1,61 @@
+#include "execution_context.h"
+
+#include "graph.h"
+
+
+Execution_context::Execution_context(const Graph &graph): graph(&graph), input_number(-1)
+{
+    /*
+     * 为前向传播中间结果分配内存
+     */
+    Tensor_trace_site trace_site("intermediate_results");
+    for(const Node* node: graph.node_list) {
+        dtype_list.push_back(node->dtype);
+        if(input_number == -1 && (node->name == OPN_INPUT || node->name == OPN_QINPUT)) {
+            input_number = (int)intermediate_results.size();
+        }
+        if(node->dtype == "float32") {
+            Tensor<float32> *inter_res = new Tensor<float32>{node->output_shape};
+            inter_res->set_zero();
+            intermediate_results.push_back(inter_res);
+        }
+        else if(node->dtype == "uint8") {
+            Tensor<uint8> *inter_res = new Tensor<uint8>{node->output_shape};
+            inter_res->set_zero();
+            intermediate_results.push_back(inter_res);
+        }
+        else {
+            fprintf(stderr, "File: execution_context.cpp, line: %d. Unsupported node dtype: %s\n",
+                    __LINE__, node->dtype.c_str());
+            exit(-1);
+        }
+    }
+}
+
+Execution_context::~Execution_context()
+{
+    /*
+     * 释放前向传播中间结果的内存
+     */
+    for(int i = 0; i<(int)dtype_list.size(); i++) {
+        if(dtype_list[i] == "float32") {
+            delete((Tensor<float32>*)intermediate_results[i]);
+        }
+        if(dtype_list[i] == "uint8") {
+            delete((Tensor<uint8>*)intermediate_results[i]);
+        }
+    }
+}
+
+void Execution_context::print_schedule_report(const char * phase)
+{
+    /*
+     * 打印上一次打印以来forward的调度统计(见Graph_scheduler::print_report)
+     */
+    scheduler.print_report(phase);
+}
+
+void * Execution_context::input_result() const
+{
+    return input_number == -1 ? nullptr : intermediate_results[input_number];
+}
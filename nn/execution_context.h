@@ -0,0 +1,62 @@
+#ifndef QUANT_EXECUTION_CONTEXT_H
+#define QUANT_EXECUTION_CONTEXT_H
+
+/*
+ * 一次推理的执行上下文
+ * 设计思路：
+ * 原来Graph同时保存权重和forward用的中间结果(intermediate_results)以及调度状态，一个Graph同一时间只能执行一次forward，
+ * 多个线程同时推理只能各自加载一份模型(权重重复)。现在把两者分开：
+ * 1. Graph是编译好的模型：节点列表和权重。构建、fuse_op、set_weight_dtype、quantization完成后不再修改，
+ *    forward是const的，多个线程可以共享同一个Graph
+ * 2. Execution_context保存一次推理的可变状态：各节点输出的中间结果和节点调度器(含调度统计)。
+ *    每个同时推理的线程使用自己的上下文，一个上下文同一时间只能用于一次forward。
+ *    上下文创建时按各节点的dtype和output_shape申请中间结果，之后的forward重复使用这些空间
+ * 上下文依赖创建时Graph的节点列表，Graph被修改(fuse_op等)后需要重新创建上下文
+ */
+
+#include <vector>
+#include <string>
+
+#include "tensor.h"
+#include "scheduler.h"
+
+
+class Graph;
+
+
+class Execution_context {
+public:
+    explicit Execution_context(const Graph &graph);     // 为graph的每个节点申请中间结果
+    ~Execution_context();                                // 释放中间结果
+    Execution_context(const Execution_context &) = delete;
+    Execution_context & operator=(const Execution_context &) = delete;
+
+    /*
+     * 打印上一次打印以来forward的调度统计：墙钟时间、节点耗时之和、关键路径耗时(见scheduler.h)，然后清零
+     */
+    void print_schedule_report(const char * phase);
+
+    /*
+     * Input(QInput)节点的中间结果，尺寸为Input节点的output_shape，计算图没有输入节点时返回nullptr
+     * 调用者可以把输入数据直接写入它的data，再把它作为forward的input(Input节点的forward对同一个张量只是自赋值)，
+     * 不需要为每次输入申请张量
+     */
+    void * input_result() const;
+
+    const Graph * graph;                    // 创建此上下文的计算图
+
+    /*
+     * 各节点的输出，下标为节点编号
+     * vector里存储的实际类型是Tensor<>*，但由于graph不处理类型，所以将它设为void*。使用者需要根据节点的dtype处理类型
+     */
+    std::vector<void*> intermediate_results;
+
+    Graph_scheduler scheduler;              // 节点调度，每个上下文独立
+
+private:
+    std::vector<std::string> dtype_list;    // 各中间结果的类型，析构时使用(不依赖graph此时的状态)
+    int input_number;                       // Input(QInput)节点的编号，没有时为-1
+};
+
+
+#endif //QUANT_EXECUTION_CONTEXT_H
@@ -6,87 +6,197 @@
 #include "cblas.h"
 #include "fixed_point.h"
 #include "tensor.h"
-#include <thread>
 
-extern System_info * sys_info;
 
 
-void im2col(float32 * data_col, float32 * data_im, int height, int width, int channels_col, 
-            int height_col, int width_col, int kernel_h, int kernel_w, int stride_h, int stride_w, 
-            int pad_h, int pad_w, int dilation_h, int dilation_w)
+template<typename T>
+static void prepare_output(Tensor<T> &output, const Tensor_shape &size)
+{
+    /*
+     * 准备写入结果的output：已有连续存储且尺寸相同时直接使用，否则按size重新申请
+     */
+    if(output.data != nullptr && output.size == size && output.is_contiguous()) {
+        return;
+    }
+    output = Tensor<T>(size);
+}
+
+template<typename T>
+static T * workspace(int slot, const Tensor_shape &size)
+{
+    /*
+     * 当前线程的第slot个临时缓冲区，至少能存放size.len()个T，按TENSOR_ALIGN对齐
+     * 缓冲区在线程内保留，只在不够大时重新申请。同一算子中同时使用的临时数据要用不同的slot
+     */
+    static thread_local Tensor<T> buffer[FUNCTIONAL_WORKSPACE_SLOTS];
+    if(buffer[slot].data == nullptr || buffer[slot].len() < size.len()) {
+        buffer[slot] = Tensor<T>(size);
+    }
+    return buffer[slot].data;
+}
+
+template<typename T>
+static void pad_data(T * y_ptr, const T * x_ptr, const Tensor_shape &size, int ph, int pw, T zero)
+{
+    /*
+     * 把NCHW的x四周填充ph行、pw列的zero，写入y
+     */
+    int batch_size = size[0];
+    int channel = size[1];
+    int height = size[2];
+    int width = size[3];
+    int padded_width = width + pw * 2;
+    for(int n = 0; n<batch_size; n++) {
+        for(int c = 0; c<channel; c++) {
+            // 对于前ph行，直接在y中填充zero
+            for(int h = 0; h<ph; h++) {
+                std::fill_n(y_ptr, padded_width, zero);
+                y_ptr += padded_width;
+            }
+            // 对于之后的xh行，先在y中填充长度为pw的zero，然后memcpy x的一行，然后再填充长度为pw的zero
+            for(int h = 0; h<height; h++) {
+                std::fill_n(y_ptr, pw, zero);
+                y_ptr += pw;
+                memcpy(y_ptr, x_ptr, sizeof(T)*width);
+                y_ptr += width;
+                x_ptr += width;
+                std::fill_n(y_ptr, pw, zero);
+                y_ptr += pw;
+            }
+            // 对于最后的ph行，直接在y中填充zero
+            for(int h = 0; h<ph; h++) {
+                std::fill_n(y_ptr, padded_width, zero);
+                y_ptr += padded_width;
+            }
+        }
+    }
+}
+
+template<typename T>
+static const T * padded_input(Tensor<T> *input, const std::vector<int> &padding_size, T zero, int slot,
+                              int &padded_height, int &padded_width)
+{
+    /*
+     * pool使用的padding结果：不需要padding时直接使用input的数据，否则padding到当前线程的临时缓冲区
+     */
+    padded_height = input->size[2] + padding_size[0] * 2;
+    padded_width = input->size[3] + padding_size[1] * 2;
+    if(padding_size[0] == 0 && padding_size[1] == 0) {
+        return input->data;
+    }
+    T * padded = workspace<T>(slot, Tensor_shape{input->size[0], input->size[1], padded_height, padded_width});
+    pad_data(padded, input->data, input->size, padding_size[0], padding_size[1], zero);
+    return padded;
+}
+
+
+void functional::im2col(float32 * data_col, float32 * data_im, int height, int width, int channels_col,
+                        int height_col, int width_col, int kernel_h, int kernel_w, int stride_h, int stride_w,
+                        int pad_h, int pad_w, int dilation_h, int dilation_w, int ld_col)
 {
     /*
      * im2col float32
+     * data_col为 channels_col * (height_col*width_col) 的矩阵，行距为ld_col(0表示不补齐，行距即height_col*width_col)
+     * data_col按TENSOR_ALIGN对齐且ld_col由padded_row_len()得到时，每一行的起始地址都是对齐的
      */
-    #ifdef _OPENMP
-    #pragma omp parallel for
-    #endif
-    for (int c = 0; c < channels_col; ++c) {
-        int w_offset = c % kernel_w;
-        int h_offset = (c / kernel_w) % kernel_h;
-        int c_im = c / kernel_h / kernel_w;
-
-        const int hc0 = h_offset * dilation_h - pad_h;
-        const int wc0 = w_offset * dilation_w - pad_w;
-        for (int h = 0; h < height_col; ++h) {
-            int h_pad = h * stride_h + hc0;
-
-            const int row_offset = (c * height_col + h) * width_col;
-            const int srow_offset = (c_im * height + h_pad) * width;
-            for (int w = 0; w < width_col; ++w) {
-                int w_pad = w * stride_w + wc0;
-                if ((((unsigned)h_pad) < ((unsigned)height)) && (((unsigned)w_pad) < ((unsigned)width)))
-                    data_col[row_offset + w] = data_im[srow_offset + w_pad];
-                else {
-                    data_col[row_offset + w] = 0;
+    if(ld_col == 0) {
+        ld_col = height_col * width_col;
+    }
+    int64_t grain = tensor_parallel_grain(channels_col, (int64_t)height_col * width_col);  // 按通道多线程
+    parallel_for(0, channels_col, grain, [&](int64_t from, int64_t to) {
+        for(int c = (int)from; c<(int)to; c++) {
+            int w_offset = c % kernel_w;
+            int h_offset = (c / kernel_w) % kernel_h;
+            int c_im = c / kernel_h / kernel_w;
+
+            const int hc0 = h_offset * dilation_h - pad_h;
+            const int wc0 = w_offset * dilation_w - pad_w;
+            for (int h = 0; h < height_col; ++h) {
+                int h_pad = h * stride_h + hc0;
+
+                const int row_offset = c * ld_col + h * width_col;
+                const int srow_offset = (c_im * height + h_pad) * width;
+                for (int w = 0; w < width_col; ++w) {
+                    int w_pad = w * stride_w + wc0;
+                    if ((((unsigned)h_pad) < ((unsigned)height)) && (((unsigned)w_pad) < ((unsigned)width)))
+                        data_col[row_offset + w] = data_im[srow_offset + w_pad];
+                    else {
+                        data_col[row_offset + w] = 0;
+                    }
                 }
             }
         }
-    }
+    });
 }
 
 
-void im2col(uint8 * data_col, uint8 * data_im, int height, int width, int channels_col, 
-            int height_col, int width_col, int kernel_h, int kernel_w, int stride_h, int stride_w, 
-            int pad_h, int pad_w, int dilation_h, int dilation_w, int zero)
+void functional::im2col(uint8 * data_col, uint8 * data_im, int height, int width, int channels_col,
+                        int height_col, int width_col, int kernel_h, int kernel_w, int stride_h, int stride_w,
+                        int pad_h, int pad_w, int dilation_h, int dilation_w, int zero, int ld_col)
 {
     /*
      * im2col uint8
+     * data_col的行距为ld_col(0表示不补齐)，见float32版本
      */
-    #ifdef _OPENMP
-    #pragma omp parallel for
-    #endif
-    for (int c = 0; c < channels_col; ++c) {
-        int w_offset = c % kernel_w;
-        int h_offset = (c / kernel_w) % kernel_h;
-        int c_im = c / kernel_h / kernel_w;
-
-        const int hc0 = h_offset * dilation_h - pad_h;
-        const int wc0 = w_offset * dilation_w - pad_w;
-        for (int h = 0; h < height_col; ++h) {
-            int h_pad = h * stride_h + hc0;
-
-            const int row_offset = (c * height_col + h) * width_col;
-            const int srow_offset = (c_im * height + h_pad) * width;
-            for (int w = 0; w < width_col; ++w) {
-                int w_pad = w * stride_w + wc0;
-                if ((((unsigned)h_pad) < ((unsigned)height)) && (((unsigned)w_pad) < ((unsigned)width)))
-                    data_col[row_offset + w] = data_im[srow_offset + w_pad];
-                else {
-                    data_col[row_offset + w] = zero;
+    if(ld_col == 0) {
+        ld_col = height_col * width_col;
+    }
+    int64_t grain = tensor_parallel_grain(channels_col, (int64_t)height_col * width_col);  // 按通道多线程
+    parallel_for(0, channels_col, grain, [&](int64_t from, int64_t to) {
+        for(int c = (int)from; c<(int)to; c++) {
+            int w_offset = c % kernel_w;
+            int h_offset = (c / kernel_w) % kernel_h;
+            int c_im = c / kernel_h / kernel_w;
+
+            const int hc0 = h_offset * dilation_h - pad_h;
+            const int wc0 = w_offset * dilation_w - pad_w;
+            for (int h = 0; h < height_col; ++h) {
+                int h_pad = h * stride_h + hc0;
+
+                const int row_offset = c * ld_col + h * width_col;
+                const int srow_offset = (c_im * height + h_pad) * width;
+                for (int w = 0; w < width_col; ++w) {
+                    int w_pad = w * stride_w + wc0;
+                    if ((((unsigned)h_pad) < ((unsigned)height)) && (((unsigned)w_pad) < ((unsigned)width)))
+                        data_col[row_offset + w] = data_im[srow_offset + w_pad];
+                    else {
+                        data_col[row_offset + w] = zero;
+                    }
                 }
             }
         }
-    }
+    });
 }
 
 
-Tensor<float32>
-functional::conv2d(Tensor<float32> *input, Tensor<float32> *weight, Tensor<float32> *bias, const std::vector<int>& stride,
-                   const std::vector<int>& padding_size, const std::vector<int>& dilation)
+static const float32 * weight_matrix(Tensor<float32> *weight, int slot)
+{
+    /*
+     * float32的weight展开为矩阵后数据顺序不变，直接使用
+     */
+    (void)slot;
+    return weight->data;
+}
+
+template<typename W>
+static const float32 * weight_matrix(Tensor<W> *weight, int slot)
 {
     /*
-     * Conv2d
+     * 半精度weight转为float32(向量化内核)，放在当前线程的临时缓冲区
+     */
+    float32 * matrix = workspace<float32>(slot, weight->size);
+    kernel_cast(matrix, weight->data, weight->len());
+    return matrix;
+}
+
+template<typename W>
+static void
+conv2d_impl(Tensor<float32> *input, Tensor<float32> &output, Tensor<W> *weight, Tensor<float32> *bias,
+            const std::vector<int>& stride, const std::vector<int>& padding_size, const std::vector<int>& dilation)
+{
+    /*
+     * Conv2d。weight可以是float32或半精度(展开为矩阵时转为float32)
+     * 临时数据使用当前线程的缓冲区：slot 0为padding结果，slot 1为input展开的矩阵，slot 2为转换后的weight
      */
     // 对输入尺寸进行校验
     if(input->size.size() != 4) {
@@ -121,88 +231,98 @@ functional::conv2d(Tensor<float32> *input, Tensor<float32> *weight, Tensor<float
         exit(-1);
     }
     // padding
-    Tensor<float32> padded = padding(input, padding_size);
+    Tensor<float32> in = input->contiguous();
+    int padded_height;
+    int padded_width;
+    const float32 * padded = padded_input(&in, padding_size, 0.0f, 0, padded_height, padded_width);
     // 计算输出尺寸
     std::vector<int> kernel_size{weight->size[2], weight->size[3]};
-    int batch_size = padded.size[0];
+    int batch_size = in.size[0];
     int channel = weight->size[0];
-    int height = (padded.size[2] - (dilation[0] * (kernel_size[0]- 1) + 1)) / stride[0] + 1;
-    int width = (padded.size[3] - (dilation[1] * (kernel_size[1]-1) + 1)) / stride[1] + 1;    
-    // 创建返回对象
-    Tensor<float32> result{std::vector<int>{batch_size, channel, height, width}};
+    int height = (padded_height - (dilation[0] * (kernel_size[0]- 1) + 1)) / stride[0] + 1;
+    int width = (padded_width - (dilation[1] * (kernel_size[1]-1) + 1)) / stride[1] + 1;
+    prepare_output(output, Tensor_shape{batch_size, channel, height, width});
+    // weight展开为矩阵: OIHW:   (O) * (I*H*W)
+    const float32 * w_matrix = weight_matrix(weight, 2);
+    int w_cols = weight->size[1] * weight->size[2] * weight->size[3];
+    // input展开后的矩阵: NCHW:    (C*KH*KW) * (OH*OW)，行距col_ld
+    // 行长度补齐到TENSOR_ALIGN，使每一行的起始地址都对齐。补齐部分不参与计算
+    int col_len = height * width;
+    int col_ld = padded_row_len(col_len, sizeof(float32));
+    int channels_col = in.size[1] * kernel_size[0] * kernel_size[1];
+    float32 * input_matrix = workspace<float32>(1, Tensor_shape{channels_col, col_ld});
     // 计算conv2d
     for(int n = 0; n<batch_size; n++) {     // 每次计算1张
-        // 1. 展开为矩阵
-        // 1.1 weight展开为矩阵
-        Tensor<float32> weight_matrix{
-                std::vector<int>{weight->size[0], weight->size[1] * weight->size[2] * weight->size[3]}
-        };  // OIHW:   (O) * (I*H*W)
-        memcpy(weight_matrix.data, weight->data, sizeof(float32) * weight_matrix.len());  // 似乎展开之后数据顺序不变，那么直接复制过来就好啦
-        // 1.2 input展开为矩阵
-        Tensor<float32> temp_padded = padded[n];   // 取出input中的第n张图片
-        Tensor<float32> input_matrix{
-                std::vector<int>{padded.size[1] * kernel_size[0] * kernel_size[1], height * width}
-        };  // NCHW:    (C*KH*KW) * (OH*OW)
-        int start_h = 0;    // 从input取数时，h方向上的起点。每次增加stride_h
-        for (int oh = 0; oh < height; oh++, start_h += stride[0]) {
-            int start_w = 0;
-            for (int ow = 0; ow < width; ow++, start_w += stride[1]) {
-                for (int c = 0; c < padded.size[1]; c++) {
-                    int start_kh = 0;   // 从input取数时，卷积核笼罩范围内的h方向上的起点，每次增加dilation_h
-                    for (int kh = 0; kh < kernel_size[0]; kh++, start_kh += dilation[0]) {
-                        int start_kw = 0;
-                        for (int kw = 0; kw < kernel_size[1]; kw++, start_kw += dilation[1]) {
-                            // matrix[c*kernel_size[0]*kernel_size[1] + kh*kernel_size[1] * kw][oh*width + ow] = input[c][start_h+start_kh][start_w+start_kw]
-                            input_matrix.data[
-                                    (c * kernel_size[0] * kernel_size[1] + kh * kernel_size[1] + kw) * height * width +
-                                    (oh * width + ow)]
-                                    =
-                            temp_padded.data[
-                                    c * padded.size[2] * padded.size[3] +
-                                    (start_h + start_kh) * padded.size[3] +
-                                    (start_w + start_kw)];
-                        }
-                    }
-                }
-            }
-        }
-        // 2. 矩阵相乘
-        // Tensor<float32> result_matrix = weight_matrix.dot(input_matrix);
-        // 改用openblas
-        Tensor<float32> result_matrix(std::vector<int>{weight_matrix.size[0], input_matrix.size[1]});
-        result_matrix.set_zero();
+        // 1. input中的第n张图片展开为矩阵
+        const float32 * temp_padded = padded + (int64_t)n * in.size[1] * padded_height * padded_width;
+        functional::im2col(input_matrix, (float32*)temp_padded, padded_height, padded_width, channels_col,
+               height, width, kernel_size[0], kernel_size[1], stride[0], stride[1],
+               0, 0, dilation[0], dilation[1], col_ld);
+        // 2. 矩阵相乘(openblas)，结果直接写入output的第n张
+        float32 * result_matrix = output.data + (int64_t)n * channel * col_len;
         cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
-            weight_matrix.size[0], input_matrix.size[1], weight_matrix.size[1],
-            1.0f, weight_matrix.data, weight_matrix.size[1], 
-            input_matrix.data, input_matrix.size[1], 1.0f,
-            result_matrix.data, result_matrix.size[1]);
+            channel, col_len, w_cols,
+            1.0f, w_matrix, w_cols,
+            input_matrix, col_ld, 0.0f,
+            result_matrix, col_len);
         // 3. +bias
         for(int c = 0; c<channel; c++) {
-            result_matrix[c] += (*bias)[c].to_num();
+            float32 b = bias->data[c];
+            float32 * row = result_matrix + (int64_t)c * col_len;
+            for(int i = 0; i<col_len; i++) {
+                row[i] += b;
+            }
         }
-        // 4. 变回4维结构
-        memcpy(result[n].data, result_matrix.data, sizeof(float32)*result_matrix.len());
     }
+}
+
+Tensor<float32>
+functional::conv2d(Tensor<float32> *input, Tensor<float32> *weight, Tensor<float32> *bias, const std::vector<int>& stride,
+                   const std::vector<int>& padding_size, const std::vector<int>& dilation)
+{
+    Tensor<float32> result;
+    conv2d_impl(input, result, weight, bias, stride, padding_size, dilation);
     return result;
 }
 
-void mt_relu(float32 * R, float32 * I, int len)
+Tensor<float32>
+functional::conv2d(Tensor<float32> *input, Tensor<fp16> *weight, Tensor<float32> *bias, const std::vector<int>& stride,
+                   const std::vector<int>& padding_size, const std::vector<int>& dilation)
 {
-    /*
-     * 多线程relu的子线程
-     */
-    int new_len = len / 4 * 4;
-    for(int i = 0; i<len; i+=4) {
-        R[i] = (I[i] > 0) ? I[i] : 0;
-        R[i+1] = (I[i+1] > 0) ? I[i+1] : 0;
-        R[i+2] = (I[i+2] > 0) ? I[i+2] : 0;
-        R[i+3] = (I[i+3] > 0) ? I[i+3] : 0;
-    }
-    for(int i = new_len; i<len; i++) {
-        R[i] = (I[i] > 0) ? I[i] : 0;
-    }
+    Tensor<float32> result;
+    conv2d_impl(input, result, weight, bias, stride, padding_size, dilation);
+    return result;
 }
 
+Tensor<float32>
+functional::conv2d(Tensor<float32> *input, Tensor<bf16> *weight, Tensor<float32> *bias, const std::vector<int>& stride,
+                   const std::vector<int>& padding_size, const std::vector<int>& dilation)
+{
+    Tensor<float32> result;
+    conv2d_impl(input, result, weight, bias, stride, padding_size, dilation);
+    return result;
+}
+
+void functional::conv2d(Tensor<float32> *input, Tensor<float32> &output, Tensor<float32> *weight, Tensor<float32> *bias,
+                        const std::vector<int>& stride, const std::vector<int>& padding_size,
+                        const std::vector<int>& dilation)
+{
+    conv2d_impl(input, output, weight, bias, stride, padding_size, dilation);
+}
+
+void functional::conv2d(Tensor<float32> *input, Tensor<float32> &output, Tensor<fp16> *weight, Tensor<float32> *bias,
+                        const std::vector<int>& stride, const std::vector<int>& padding_size,
+                        const std::vector<int>& dilation)
+{
+    conv2d_impl(input, output, weight, bias, stride, padding_size, dilation);
+}
+
+void functional::conv2d(Tensor<float32> *input, Tensor<float32> &output, Tensor<bf16> *weight, Tensor<float32> *bias,
+                        const std::vector<int>& stride, const std::vector<int>& padding_size,
+                        const std::vector<int>& dilation)
+{
+    conv2d_impl(input, output, weight, bias, stride, padding_size, dilation);
+}
 
 //Tensor<float32>
 //functional::relu(Tensor<float32> *input) {
@@ -223,44 +343,34 @@ void mt_relu(float32 * R, float32 * I, int len)
 
 Tensor<float32>
 functional::relu(Tensor<float32> *input) {
+    Tensor<float32> result;
+    relu(input, result);
+    return result;
+}
+
+void functional::relu(Tensor<float32> *input, Tensor<float32> &output) {
     /*
      * 多线程优化Relu
      */
-    Tensor<float32> result{input->size};
+    prepare_output(output, input->size);
     float32 * I = input->data;          // 输入的数据地址
-    float32 * R = result.data;          // 输出的数据地址
-    int len = result.len();             // 总的要计算的元素数量
-
-    if(len > 500000) {  // 一般大于此值，多线程才有加速效果
-        int n_proc = sys_info->n_proc;      // 处理器数量
-        int len_per_proc = len / n_proc;    // 每个处理器要计算的元素数量(可能由于不能整除而有剩余)
-        std::thread t[n_proc];              // 创建子线程
-        for (int i = 0; i < n_proc; i++) {     // 为子线程分配任务
-            t[i] = std::thread(mt_relu, R + i * len_per_proc, I + i * len_per_proc, len_per_proc);
-        }
-        for (int i = n_proc * len_per_proc; i < len; i++) {    // 让主线程处理剩余的一点任务
-            R[i] = (I[i] > 0) ? I[i] : 0;
-        }
-        for (int i = 0; i < n_proc; i++) {     // 等待子线程结束
-            t[i].join();
-        }
-    }
-    else {
-        int new_len = len / 4 * 4;
-        for(int i = 0; i<len; i+=4) {
-            R[i] = (I[i] > 0) ? I[i] : 0;
-            R[i+1] = (I[i+1] > 0) ? I[i+1] : 0;
-            R[i+2] = (I[i+2] > 0) ? I[i+2] : 0;
-            R[i+3] = (I[i+3] > 0) ? I[i+3] : 0;
-        }
-        for(int i = new_len; i<len; i++) {
-            R[i] = (I[i] > 0) ? I[i] : 0;
-        }
-    }
-    return result;
+    float32 * R = output.data;          // 输出的数据地址
+    int64_t len = output.len();         // 总的要计算的元素数量
+
+    // 每块FUNCTIONAL_RELU_GRAIN个元素，元素较少时在当前线程计算
+    parallel_for(0, len, FUNCTIONAL_RELU_GRAIN, [&](int64_t from, int64_t to) {
+        get_tensor_kernels()->relu(R + from, I + from, to - from);
+    });
 }
 
 Tensor<float32> functional::padding(Tensor<float32> *input, const std::vector<int> &padding_size)
+{
+    Tensor<float32> padded;
+    padding(input, padded, padding_size);
+    return padded;
+}
+
+void functional::padding(Tensor<float32> *input, Tensor<float32> &output, const std::vector<int> &padding_size)
 {
     /*
      * padding
@@ -268,42 +378,10 @@ Tensor<float32> functional::padding(Tensor<float32> *input, const std::vector<in
     int ph = padding_size[0];
     int pw = padding_size[1];
     // 计算padding后尺寸
-    int batch_size = input->size[0];
-    int channel = input->size[1];
-    int height = input->size[2];
-    int width = input->size[3];
-    int padded_height = height + ph * 2;
-    int padded_width = width + pw * 2;
-    // 创建padding后对象
-    Tensor<float32> padded{std::vector<int>{batch_size, channel, padded_height, padded_width}};
+    prepare_output(output, Tensor_shape{input->size[0], input->size[1],
+                                        input->size[2] + ph * 2, input->size[3] + pw * 2});
     // padding
-    float32 * y_ptr = padded.data;
-    float32 * x_ptr = input->data;
-    for(int n = 0; n<batch_size; n++) {
-        for(int c = 0; c<channel; c++) {
-            // 对于前padding_height行，直接memset0
-            for(int h = 0; h<ph; h++) {
-                memset(y_ptr, 0, sizeof(float32)*padded_width);
-                y_ptr += padded_width;
-            }
-            // 对于之后的xh行，先在y中memset长度为pw的0，然后memcpy x的一行，然后再mamset长度为pw的0
-            for(int h = 0; h<height; h++) {
-                memset(y_ptr, 0, sizeof(float32)*pw);
-                y_ptr += pw;
-                memcpy(y_ptr, x_ptr, sizeof(float32)*width);
-                y_ptr += width;
-                x_ptr += width;
-                memset(y_ptr, 0, sizeof(float32)*pw);
-                y_ptr += pw;
-            }
-            // 对于最后的ph行，直接在y中memset0
-            for(int h = 0; h<ph; h++) {
-                memset(y_ptr, 0, sizeof(float)*padded_width);
-                y_ptr += padded_width;
-            }
-        }
-    }
-    return padded;
+    pad_data(output.data, input->data, input->size, ph, pw, 0.0f);
 }
 //Tensor<float32> functional::padding(Tensor<float32> *input, const std::vector<int> &padding_size) {
 //    /*
@@ -358,6 +436,15 @@ functional::maxpool2d(Tensor<float32> *input, const std::vector<int>& kernel_siz
                       std::vector<int> stride,
                       const std::vector<int>& padding_size,
                       const std::vector<int>& dilation) {
+    Tensor<float32> result;
+    maxpool2d(input, result, kernel_size, std::move(stride), padding_size, dilation);
+    return result;
+}
+
+void functional::maxpool2d(Tensor<float32> *input, Tensor<float32> &output, const std::vector<int>& kernel_size,
+                           std::vector<int> stride,
+                           const std::vector<int>& padding_size,
+                           const std::vector<int>& dilation) {
     /*
      * maxpool2d
      */
@@ -387,20 +474,15 @@ functional::maxpool2d(Tensor<float32> *input, const std::vector<int>& kernel_siz
         stride[1] = kernel_size[1];
     }
     // padding
-    Tensor<float32> padded;
-    if(padding_size[0] == 0 && padding_size[1] == 0) {
-        padded = *input;
-    }
-    else {
-        padded = padding(input, padding_size);
-    }
+    int padded_height;
+    int padded_width;
+    const float32 * padded = padded_input(input, padding_size, (float32)0, 0, padded_height, padded_width);
     // 计算pool后尺寸
     int batch_size = input->size[0];
     int channel = input->size[1];
-    int height = (padded.size[2] - (dilation[0]*(kernel_size[0]-1)+1)) / stride[0] + 1;
-    int width = (padded.size[3] - (dilation[1]*(kernel_size[1]-1)+1)) / stride[1] + 1;
-    // 创建返回对象
-    Tensor<float32> result{std::vector<int>{batch_size, channel, height, width}};
+    int height = (padded_height - (dilation[0]*(kernel_size[0]-1)+1)) / stride[0] + 1;
+    int width = (padded_width - (dilation[1]*(kernel_size[1]-1)+1)) / stride[1] + 1;
+    prepare_output(output, Tensor_shape{batch_size, channel, height, width});
     // pool
     for(int n = 0; n<batch_size; n++) {
         for(int c = 0; c<channel; c++) {
@@ -413,30 +495,30 @@ functional::maxpool2d(Tensor<float32> *input, const std::vector<int>& kernel_siz
                     int start_kh = 0;               // 相对于kernel的偏移
                     int start_kw = 0;
                     // max = padded[n][c][start_h+start_kh][start_w+start_kw]
-                    float32 max = padded.data[
-                            n * channel * padded.size[2] * padded.size[3] +
-                            c * padded.size[2] * padded.size[3] +
-                            start_h * padded.size[3] +
+                    float32 max = padded[
+                            (int64_t)n * channel * padded_height * padded_width +
+                            c * padded_height * padded_width +
+                            start_h * padded_width +
                             start_w];
                     for(int kh = 0; kh < kernel_size[0]; kh++, start_kh += dilation[0]) {
                         start_kw = 0;
                         for(int kw = 0; kw < kernel_size[1]; kw++, start_kw += dilation[1]) {
-                            if(padded.data[
-                                    n * channel * padded.size[2] * padded.size[3] +
-                                    c * padded.size[2] * padded.size[3] +
-                                    (start_h + start_kh) * padded.size[3] +
+                            if(padded[
+                                    (int64_t)n * channel * padded_height * padded_width +
+                                    c * padded_height * padded_width +
+                                    (start_h + start_kh) * padded_width +
                                     (start_w + start_kw)] > max) {
-                                max = padded.data[
-                                        n * channel * padded.size[2] * padded.size[3] +
-                                        c * padded.size[2] * padded.size[3] +
-                                        (start_h + start_kh) * padded.size[3] +
+                                max = padded[
+                                        (int64_t)n * channel * padded_height * padded_width +
+                                        c * padded_height * padded_width +
+                                        (start_h + start_kh) * padded_width +
                                         (start_w + start_kw)];
                             }
                         }
                     }
                     // result[n][c][h][w] = max
-                    result.data[
-                            n * channel * height * width +
+                    output.data[
+                            (int64_t)n * channel * height * width +
                             c * height * width +
                             h * width +
                             w] = max;
@@ -444,7 +526,6 @@ functional::maxpool2d(Tensor<float32> *input, const std::vector<int>& kernel_siz
             }
         }
     }
-    return result;
 }
 
 Tensor<float32> functional::flatten(Tensor<float32> *input) {
@@ -455,7 +536,21 @@ Tensor<float32> functional::flatten(Tensor<float32> *input) {
     return result;
 }
 
+void functional::flatten(Tensor<float32> *input, Tensor<float32> &output) {
+    /*
+     * flatten: output成为input的视图，不复制数据
+     */
+    output = input->reshape(Tensor_shape{input->size[0], -1});
+}
+
 Tensor<float32> functional::dense(Tensor<float32> *input, Tensor<float32> *weight, Tensor<float32> *bias) {
+    Tensor<float32> result;
+    dense(input, result, weight, bias);
+    return result;
+}
+
+void functional::dense(Tensor<float32> *input, Tensor<float32> &output, Tensor<float32> *weight,
+                       Tensor<float32> *bias) {
     /*
      * dense
      */
@@ -472,15 +567,90 @@ Tensor<float32> functional::dense(Tensor<float32> *input, Tensor<float32> *weigh
         fprintf(stderr, "File functional.cpp, line %d. Only 1 dimension bias is allowed in dense\n", __LINE__);
         exit(-1);
     }
-    // 矩阵乘法
-    Tensor<float32> dot_res = (*input).dot(*weight);
+    // 矩阵乘法，结果直接写入output
+    Tensor<float32> in = input->contiguous();
+    Tensor<float32> w = weight->contiguous();
+    prepare_output(output, Tensor_shape{in.size[0], w.size[1]});
+    tensor_dot(output.data, in.data, w.data, in.size[0], in.size[1], w.size[1]);
     // +bias
     for(int n = 0; n<input->size[0]; n++) {
         for(int l = 0; l<weight->size[1]; l++) {
-            dot_res.data[n * weight->size[1] + l] += bias->data[l];
+            output.data[(int64_t)n * weight->size[1] + l] += bias->data[l];
         }
     }
-    return dot_res;
+}
+
+template<typename W>
+static void dense_half(Tensor<float32> *input, Tensor<float32> &output, Tensor<W> *weight, Tensor<float32> *bias)
+{
+    /*
+     * 半精度weight的dense
+     * 不把整个weight转为float32(大模型的全连接层权重有几百MB)：每次把weight的若干行(共DENSE_HALF_BLOCK_BYTES字节的float32)
+     * 转换到缓冲区(当前线程的临时缓冲区slot 0)，与input对应的列相乘并累加到结果。weight只按半精度读一遍，缓冲区留在缓存中
+     */
+    // 检查参数
+    if(input->size.size() != 2) {
+        fprintf(stderr, "File functional.cpp, line %d. Only 2 dimension input is allowed in dense\n", __LINE__);
+        exit(-1);
+    }
+    if(weight->size.size() != 2) {
+        fprintf(stderr, "File functional.cpp, line %d. Only 2 dimension weight is allowed in dense\n", __LINE__);
+        exit(-1);
+    }
+    if(bias->size.size() != 1) {
+        fprintf(stderr, "File functional.cpp, line %d. Only 1 dimension bias is allowed in dense\n", __LINE__);
+        exit(-1);
+    }
+    if(input->size[1] != weight->size[0]) {
+        fprintf(stderr, "File functional.cpp, line %d. Shape of input and weight don't match in dense\n", __LINE__);
+        exit(-1);
+    }
+    Tensor<float32> in = input->contiguous();
+    int batch_size = in.size[0];
+    int in_len = weight->size[0];
+    int out_len = weight->size[1];
+    int block_rows = std::max(1, DENSE_HALF_BLOCK_BYTES / (int)sizeof(float32) / out_len);
+    block_rows = std::min(block_rows, in_len);
+    prepare_output(output, Tensor_shape{batch_size, out_len});
+    output.set_zero();
+    float32 * block = workspace<float32>(0, Tensor_shape{block_rows, out_len});
+    for(int k = 0; k<in_len; k+=block_rows) {
+        int rows = std::min(block_rows, in_len - k);
+        kernel_cast(block, weight->data + (int64_t)k * out_len, (int64_t)rows * out_len);
+        cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
+                    batch_size, out_len, rows,
+                    1.0f, in.data + k, in_len,
+                    block, out_len, 1.0f,
+                    output.data, out_len);
+    }
+    // +bias
+    for(int n = 0; n<batch_size; n++) {
+        for(int l = 0; l<out_len; l++) {
+            output.data[(int64_t)n * out_len + l] += bias->data[l];
+        }
+    }
+}
+
+Tensor<float32> functional::dense(Tensor<float32> *input, Tensor<fp16> *weight, Tensor<float32> *bias) {
+    Tensor<float32> result;
+    dense_half(input, result, weight, bias);
+    return result;
+}
+
+Tensor<float32> functional::dense(Tensor<float32> *input, Tensor<bf16> *weight, Tensor<float32> *bias) {
+    Tensor<float32> result;
+    dense_half(input, result, weight, bias);
+    return result;
+}
+
+void functional::dense(Tensor<float32> *input, Tensor<float32> &output, Tensor<fp16> *weight,
+                       Tensor<float32> *bias) {
+    dense_half(input, output, weight, bias);
+}
+
+void functional::dense(Tensor<float32> *input, Tensor<float32> &output, Tensor<bf16> *weight,
+                       Tensor<float32> *bias) {
+    dense_half(input, output, weight, bias);
 }
 
 Tensor<float32> functional::add(Tensor<float32> *input1, Tensor<float32> *input2) {
@@ -490,6 +660,15 @@ Tensor<float32> functional::add(Tensor<float32> *input1, Tensor<float32> *input2
     return (*input1) + (*input2);
 }
 
+void functional::add(Tensor<float32> *input1, Tensor<float32> *input2, Tensor<float32> &output) {
+    /*
+     * add: 表达式直接写入output
+     */
+    auto expr = (*input1) + (*input2);
+    prepare_output(output, expr.shape());
+    std::move(output) = expr;
+}
+
 Tensor<float32> functional::concat(Tensor<float32> *input1, Tensor<float32> *input2, int dim) {
     /*
      * concat
@@ -497,9 +676,50 @@ Tensor<float32> functional::concat(Tensor<float32> *input1, Tensor<float32> *inp
     return input1->concat(*input2, dim);
 }
 
+void functional::concat(Tensor<float32> *input1, Tensor<float32> *input2, Tensor<float32> &output, int dim) {
+    /*
+     * concat
+     */
+    concat(std::vector<Tensor<float32>*>{input1, input2}, output, dim);
+}
+
+Tensor<float32> functional::concat(const std::vector<Tensor<float32>*> &inputs, int dim) {
+    /*
+     * 一次拼接多个输入。每个输入只复制一次，不产生两两拼接的中间结果
+     */
+    std::vector<Tensor<float32>> arrays;
+    arrays.reserve(inputs.size());
+    for(Tensor<float32> *input: inputs) {
+        arrays.push_back(*input);
+    }
+    return tensor_concat(arrays, dim);
+}
+
+void functional::concat(const std::vector<Tensor<float32>*> &inputs, Tensor<float32> &output, int dim) {
+    /*
+     * 一次拼接多个输入，写入output
+     */
+    std::vector<Tensor<float32>> arrays;
+    arrays.reserve(inputs.size());
+    for(Tensor<float32> *input: inputs) {
+        arrays.push_back(*input);
+    }
+    prepare_output(output, tensor_concat_shape(arrays, dim));
+    tensor_concat(output.data, std::move(arrays), dim);
+}
+
 Tensor<float32>
 functional::batch_norm2d(Tensor<float32> *input, Tensor<float32> *running_mean, Tensor<float32> *running_var,
                        Tensor<float32> *weight, Tensor<float32> *bias, float eps)
+{
+    Tensor<float32> result;
+    batch_norm2d(input, result, running_mean, running_var, weight, bias, eps);
+    return result;
+}
+
+void functional::batch_norm2d(Tensor<float32> *input, Tensor<float32> &output, Tensor<float32> *running_mean,
+                              Tensor<float32> *running_var, Tensor<float32> *weight, Tensor<float32> *bias,
+                              float eps)
 {
     /*
      * batch normalization 2d
@@ -524,27 +744,26 @@ functional::batch_norm2d(Tensor<float32> *input, Tensor<float32> *running_mean,
         fprintf(stderr, "File functional.cpp, line %d. Only 1 dimension bias is allowed in batch_norm2d\n", __LINE__);
         exit(-1);
     }
-    Tensor<float32> x = input->deep_copy();
-    Tensor<float32> E_x = running_mean->deep_copy();
-    Tensor<float32> Var_x = running_var->deep_copy();
-    int batch_size = x.size[0];
-    int channel = x.size[1];
-    for(int n = 0; n < batch_size; n++) {
-        for (int c = 0; c < channel; c++) {
-            x[n][c] -= E_x[c].to_num();
-        }
-    }
-    Var_x += eps;
-    Var_x = Var_x.elewise_sqrt();
-    Tensor<float32> y = 
-            (x / Var_x.reshape(std::vector<int>{1,-1,1,1}))
-            * (weight->reshape(std::vector<int>{1,-1,1,1}))
-            + (bias->reshape(std::vector<int>{1,-1,1,1}));
-    return y;
+    // 整个归一化(包括按通道计算标准差)在一个表达式中完成，直接写入output：不申请临时张量，不复制输入
+    Tensor_shape channel_shape{1, -1, 1, 1};
+    auto y =
+            (*input - running_mean->reshape(channel_shape))
+            / (running_var->reshape(channel_shape) + eps).elewise_sqrt()
+            * weight->reshape(channel_shape)
+            + bias->reshape(channel_shape);
+    prepare_output(output, y.shape());
+    std::move(output) = y;
 }
 
 Tensor<float32> functional::avgpool2d(Tensor<float32> *input, const std::vector<int> &kernel_size,
                                       std::vector<int> stride, const std::vector<int> &padding_size) {
+    Tensor<float32> result;
+    avgpool2d(input, result, kernel_size, std::move(stride), padding_size);
+    return result;
+}
+
+void functional::avgpool2d(Tensor<float32> *input, Tensor<float32> &output, const std::vector<int> &kernel_size,
+                           std::vector<int> stride, const std::vector<int> &padding_size) {
     /*
      * avgpool2d
      */
@@ -570,20 +789,15 @@ Tensor<float32> functional::avgpool2d(Tensor<float32> *input, const std::vector<
         stride[1] = kernel_size[1];
     }
     // padding
-    Tensor<float32> padded;
-    if(padding_size[0] == 0 && padding_size[1] == 0) {
-        padded = *input;
-    }
-    else {
-        padded = padding(input, padding_size);
-    }
+    int padded_height;
+    int padded_width;
+    const float32 * padded = padded_input(input, padding_size, (float32)0, 0, padded_height, padded_width);
     // 计算pool后尺寸
     int batch_size = input->size[0];
     int channel = input->size[1];
-    int height = (padded.size[2] - kernel_size[0]) / stride[0] + 1;
-    int width = (padded.size[3] - kernel_size[1]) / stride[1] + 1;
-    // 创建返回对象
-    Tensor<float32> result{std::vector<int>{batch_size, channel, height, width}};
+    int height = (padded_height - kernel_size[0]) / stride[0] + 1;
+    int width = (padded_width - kernel_size[1]) / stride[1] + 1;
+    prepare_output(output, Tensor_shape{batch_size, channel, height, width});
     // pool
     for(int n = 0; n<batch_size; n++) {
         for(int c = 0; c<channel; c++) {
@@ -600,16 +814,16 @@ Tensor<float32> functional::avgpool2d(Tensor<float32> *input, const std::vector<
                     for(int kh = 0; kh < kernel_size[0]; kh++, start_kh ++) {
                         start_kw = 0;
                         for(int kw = 0; kw < kernel_size[1]; kw++, start_kw ++) {
-                            sum += padded.data[
-                                        n * channel * padded.size[2] * padded.size[3] +
-                                        c * padded.size[2] * padded.size[3] +
-                                        (start_h + start_kh) * padded.size[3] +
+                            sum += padded[
+                                        (int64_t)n * channel * padded_height * padded_width +
+                                        c * padded_height * padded_width +
+                                        (start_h + start_kh) * padded_width +
                                         (start_w + start_kw)];
                         }
                     }
                     // result[n][c][h][w] = sum / (kernel_size[0] * kernel_size[1])
-                    result.data[
-                            n * channel * height * width +
+                    output.data[
+                            (int64_t)n * channel * height * width +
                             c * height * width +
                             h * width +
                             w] = sum / (float32)(kernel_size[0] * kernel_size[1]);
@@ -617,7 +831,6 @@ Tensor<float32> functional::avgpool2d(Tensor<float32> *input, const std::vector<
             }
         }
     }
-    return result;
 }
 
 Tensor<float32> 
@@ -631,6 +844,25 @@ functional::dropout(Tensor<float32> *input, const float p)
     return ret;
 }
 
+void functional::dropout(Tensor<float32> *input, Tensor<float32> &output, const float p)
+{
+    /*
+     * dropout: 表达式直接写入output
+     */
+    auto expr = (*input) * (1-p);
+    prepare_output(output, expr.shape());
+    std::move(output) = expr;
+}
+
+void functional::copy(Tensor<float32> *input, Tensor<float32> &output)
+{
+    /*
+     * 把input复制到output(output不是input的视图)
+     */
+    prepare_output(output, input->size);
+    std::move(output) = *input;
+}
+
 // Tensor<uint8>
 // functional::qconv2d(Tensor<uint8> *input, int zero_x, int zero_w, int zero_b, int zero_y,
 //                     Fixed_point coe, int rshift, int qmin, int qmax,
@@ -752,16 +984,18 @@ functional::dropout(Tensor<float32> *input, const float p)
 // }
 
 void qconv2d_thread(int n, int start_o, int end_o, int height, int width, 
-                    std::vector<int> stride, std::vector<int> dilation, 
+                    Tensor_shape stride, Tensor_shape dilation, 
                     int input_channel, int kernel_height, int kernel_width,
                     int zero_x, int zero_w, int zero_b, int zero_y,
-                    uint8 * padded_data, std::vector<int> padded_size, 
-                    int32 * result_data, std::vector<int> result_size,
-                    int8 * weight_data, std::vector<int> weight_size,
+                    uint8 * padded_data, Tensor_shape padded_size, 
+                    uint8 * result_data, Tensor_shape result_size,
+                    int8 * weight_data, Tensor_shape weight_size,
                     int32 * bias_data,  
-                    Fixed_point coe, int rshift
+                    Fixed_point coe, int rshift, int qmin, int qmax
                     )
 {
+    // padded是qconv2d所在线程的临时缓冲区，保证按TENSOR_ALIGN对齐
+    padded_data = (uint8*)__builtin_assume_aligned(padded_data, TENSOR_ALIGN);
     Fixed_point fp_temp{0};
     for(int o = start_o; o<end_o; o++) {
         int start_h = 0;
@@ -775,7 +1009,7 @@ void qconv2d_thread(int n, int start_o, int end_o, int height, int width,
                         for(int kw = 0; kw < kernel_width; kw++) {
     //                                temp += padded[n][i][h+kh*dilation[0]][w+kw*dilation[1]] * weight[o][i][kh][kw];
                             temp += padded_data[
-                                    n * padded_size[1] * padded_size[2] * padded_size[3] +
+                                    (int64_t)n * padded_size[1] * padded_size[2] * padded_size[3] +
                                     i * padded_size[2] * padded_size[3] +
                                     (start_h+kh*dilation[0]) * padded_size[3] +
                                     (start_w+kw*dilation[1])]
@@ -799,7 +1033,7 @@ void qconv2d_thread(int n, int start_o, int end_o, int height, int width,
                                     kh * weight_size[3] +
                                     kw];
                             temp -= zero_w * padded_data[
-                                    n * padded_size[1] * padded_size[2] * padded_size[3] +
+                                    (int64_t)n * padded_size[1] * padded_size[2] * padded_size[3] +
                                     i * padded_size[2] * padded_size[3] +
                                     (start_h+kh*dilation[0]) * padded_size[3] +
                                     (start_w+kw*dilation[1])];
@@ -811,10 +1045,10 @@ void qconv2d_thread(int n, int start_o, int end_o, int height, int width,
                 fp_temp *= coe;
                 int t = fp_temp.to_int();
                 result_data[
-                        n * result_size[1] * result_size[2] * result_size[3] +
+                        (int64_t)n * result_size[1] * result_size[2] * result_size[3] +
                         o * result_size[2] * result_size[3] +
                         h * result_size[3] +
-                        w] = (t >> rshift) + zero_y;
+                        w] = (uint8)clip((t >> rshift) + zero_y, qmin, qmax);     // clip后转为uint8
             }
         }
     }
@@ -824,9 +1058,20 @@ Tensor<uint8>
 functional::qconv2d(Tensor<uint8> *input, int zero_x, int zero_w, int zero_b, int zero_y,
                     Fixed_point coe, int rshift, int qmin, int qmax,
                     Tensor<int8> *weight, Tensor<int32> *bias, const std::vector<int> &stride,
-                    const std::vector<int> &padding_size, const std::vector<int> &dilation) {printf("%d\n", zero_w);
+                    const std::vector<int> &padding_size, const std::vector<int> &dilation) {
+    Tensor<uint8> result;
+    qconv2d(input, result, zero_x, zero_w, zero_b, zero_y, coe, rshift, qmin, qmax,
+            weight, bias, stride, padding_size, dilation);
+    return result;
+}
+
+void functional::qconv2d(Tensor<uint8> *input, Tensor<uint8> &output, int zero_x, int zero_w, int zero_b, int zero_y,
+                         Fixed_point coe, int rshift, int qmin, int qmax,
+                         Tensor<int8> *weight, Tensor<int32> *bias, const std::vector<int> &stride,
+                         const std::vector<int> &padding_size, const std::vector<int> &dilation) {printf("%d\n", zero_w);
     /*
      * qconv2d
+     * padding结果放在当前线程的临时缓冲区(slot 0)，各线程把clip后的结果直接写入output
      */
     // 对输入尺寸进行校验
     if(input->size.size() != 4) {
@@ -861,52 +1106,51 @@ functional::qconv2d(Tensor<uint8> *input, int zero_x, int zero_w, int zero_b, in
         exit(-1);
     }
     // padding
-    Tensor<uint8> padded = qpadding(input, padding_size, zero_x);
+    Tensor_shape padded_size{input->size[0], input->size[1],
+                             input->size[2] + padding_size[0] * 2, input->size[3] + padding_size[1] * 2};
+    uint8 * padded = workspace<uint8>(0, padded_size);
+    pad_data(padded, input->data, input->size, padding_size[0], padding_size[1], (uint8)zero_x);
     // qconv2d
     // 计算输出尺寸以及其他尺寸
     std::vector<int> kernel_size{weight->size[2], weight->size[3]};
-    int batch_size = padded.size[0];
+    int batch_size = padded_size[0];
     int output_channel = weight->size[0];
-    int height = (padded.size[2] - (dilation[0] * (kernel_size[0]-1) + 1)) / stride[0] + 1;
-    int width = (padded.size[3] - (dilation[1] * (kernel_size[1]-1) + 1)) / stride[1] + 1;
+    int height = (padded_size[2] - (dilation[0] * (kernel_size[0]-1) + 1)) / stride[0] + 1;
+    int width = (padded_size[3] - (dilation[1] * (kernel_size[1]-1) + 1)) / stride[1] + 1;
     int input_channel = input->size[1];
     int kernel_height = kernel_size[0];
     int kernel_width = kernel_size[1];
-    // 创建中间结果
-    Tensor<int32> result{std::vector<int>{batch_size, output_channel, height, width}};
-    // 计算
-    for(int n = 0; n<batch_size; n++) {
-        // 每次处理一张图片
-        int n_proc = sys_info->n_proc;
-        int channel_per_thread = output_channel / n_proc;   // 分给每个线程的通道数
-        int channel_left = output_channel % n_proc;         // 剩下的通道数，分给最后一个线程
-        std::thread t[n_proc];
-        for(int i = 0; i<n_proc; i++) {
-            int start_o = i * channel_per_thread;
-            int end_o = start_o + channel_per_thread;
-            if(i == n_proc-1) {
-                end_o += channel_left;
-            }
-            t[i] = std::thread(
-                qconv2d_thread, n, start_o, end_o, height, width, 
-                stride, dilation, input_channel, kernel_height, kernel_width, 
-                zero_x, zero_w, zero_b, zero_y, 
-                padded.data, padded.size, 
-                result.data, result.size,
-                weight->data, weight->size, 
-                bias->data, coe, rshift);
+    prepare_output(output, Tensor_shape{batch_size, output_channel, height, width});
+    // 尺寸按值传给每个线程(Tensor_shape存放在对象内，复制不申请内存)
+    Tensor_shape stride_2d = stride;
+    Tensor_shape dilation_2d = dilation;
+    // 计算：整个batch的(图片, 输出通道)一起分给线程池，每块一个输出通道
+    int64_t n_task = (int64_t)batch_size * output_channel;
+    parallel_for(0, n_task, 1, [&](int64_t from, int64_t to) {
+        for(int64_t task = from; task<to; ) {
+            int n = (int)(task / output_channel);
+            int start_o = (int)(task % output_channel);
+            int end_o = (int)std::min<int64_t>(output_channel, start_o + (to - task));
+            qconv2d_thread(n, start_o, end_o, height, width,
+                           stride_2d, dilation_2d, input_channel, kernel_height, kernel_width,
+                           zero_x, zero_w, zero_b, zero_y,
+                           padded, padded_size,
+                           output.data, output.size,
+                           weight->data, weight->size,
+                           bias->data, coe, rshift, qmin, qmax);
+            task += end_o - start_o;
         }
-        for(int i = 0; i<n_proc; i++) {
-            t[i].join();
-        }
-    }
-    // 将中间结果clip后转为uint8并返回
-    result.clip(qmin, qmax);
-    Tensor<uint8> ret = result.astype_uint8();
-    return ret;
+    });
 }
 
 Tensor<uint8> functional::qpadding(Tensor<uint8> *input, const std::vector<int> &padding_size, int zero)
+{
+    Tensor<uint8> padded;
+    qpadding(input, padded, padding_size, zero);
+    return padded;
+}
+
+void functional::qpadding(Tensor<uint8> *input, Tensor<uint8> &output, const std::vector<int> &padding_size, int zero)
 {
     /*
      * qpadding
@@ -914,42 +1158,10 @@ Tensor<uint8> functional::qpadding(Tensor<uint8> *input, const std::vector<int>
     int ph = padding_size[0];
     int pw = padding_size[1];
     // 计算padding后尺寸
-    int batch_size = input->size[0];
-    int channel = input->size[1];
-    int height = input->size[2];
-    int width = input->size[3];
-    int padded_height = height + ph * 2;
-    int padded_width = width + pw * 2;
-    // 创建padding后对象
-    Tensor<uint8> padded{std::vector<int>{batch_size, channel, padded_height, padded_width}};
+    prepare_output(output, Tensor_shape{input->size[0], input->size[1],
+                                        input->size[2] + ph * 2, input->size[3] + pw * 2});
     // padding
-    uint8 * y_ptr = padded.data;
-    uint8 * x_ptr = input->data;
-    for(int n = 0; n<batch_size; n++) {
-        for(int c = 0; c<channel; c++) {
-            // 对于前ph行，直接在y中memset zero
-            for(int h = 0; h<ph; h++) {
-                memset(y_ptr, zero, sizeof(uint8)*padded_width);
-                y_ptr += padded_width;
-            }
-            // 对于之后的xh行，先在y中memset长度为pw的0，然后memcpy x的一行，然后再mamset长度为pw的0
-            for(int h = 0; h<height; h++) {
-                memset(y_ptr, zero, sizeof(uint8)*pw);
-                y_ptr += pw;
-                memcpy(y_ptr, x_ptr, sizeof(uint8)*width);
-                y_ptr += width;
-                x_ptr += width;
-                memset(y_ptr, zero, sizeof(uint8)*pw);
-                y_ptr += pw;
-            }
-            // 对于最后的ph行，直接在y中memset zero
-            for(int h = 0; h<ph; h++) {
-                memset(y_ptr, zero, sizeof(uint8)*padded_width);
-                y_ptr += padded_width;
-            }
-        }
-    }
-    return padded;
+    pad_data(output.data, input->data, input->size, ph, pw, (uint8)zero);
 }
 //Tensor<uint8> functional::qpadding(Tensor<uint8> *input, const std::vector<int> &padding_size, int zero) {
 //    /*
@@ -1000,20 +1212,34 @@ Tensor<uint8> functional::qpadding(Tensor<uint8> *input, const std::vector<int>
 //}
 
 Tensor<uint8> functional::qrelu(Tensor<uint8> *input, int zero, int qmax) {
+    Tensor<uint8> res;
+    qrelu(input, res, zero, qmax);
+    return res;
+}
+
+void functional::qrelu(Tensor<uint8> *input, Tensor<uint8> &output, int zero, int qmax) {
     /*
      * qrelu
      */
-    Tensor<uint8> res{input->size};
-    int len = res.len();
-    for(int i = 0; i<len; i++) {
-        res.data[i] = clip(input->data[i], zero, qmax);
-    }
-    return res;
+    prepare_output(output, input->size);
+    // 输入是uint8，把zero和qmax限制到[0, 255]后结果不变
+    uint8 min = (uint8)clip(zero, 0, 255);
+    uint8 max = (uint8)clip(qmax, 0, 255);
+    kernel_clip(output.data, input->data, output.len(), min, max);
 }
 
 Tensor<uint8> functional::qmaxpool2d(Tensor<uint8> *input, int zero, const std::vector<int> &kernel_size,
                                      std::vector<int> stride, const std::vector<int> &padding_size,
                                      const std::vector<int> &dilation)
+{
+    Tensor<uint8> result;
+    qmaxpool2d(input, result, zero, kernel_size, std::move(stride), padding_size, dilation);
+    return result;
+}
+
+void functional::qmaxpool2d(Tensor<uint8> *input, Tensor<uint8> &output, int zero, const std::vector<int> &kernel_size,
+                            std::vector<int> stride, const std::vector<int> &padding_size,
+                            const std::vector<int> &dilation)
 {
     /*
      * qmaxpool2d
@@ -1044,20 +1270,15 @@ Tensor<uint8> functional::qmaxpool2d(Tensor<uint8> *input, int zero, const std::
         stride[1] = kernel_size[1];
     }
     // padding
-    Tensor<uint8> padded;
-    if(padding_size[0] == 0 && padding_size[1] == 0) {
-        padded = *input;
-    }
-    else {
-        padded = qpadding(input, padding_size, zero);
-    }
+    int padded_height;
+    int padded_width;
+    const uint8 * padded = padded_input(input, padding_size, (uint8)zero, 0, padded_height, padded_width);
     // 计算pool后尺寸
     int batch_size = input->size[0];
     int channel = input->size[1];
-    int height = (padded.size[2] - (dilation[0]*(kernel_size[0]-1)+1)) / stride[0] + 1;
-    int width = (padded.size[3] - (dilation[1]*(kernel_size[1]-1)+1)) / stride[1] + 1;
-    // 创建返回对象
-    Tensor<uint8> result{std::vector<int>{batch_size, channel, height, width}};
+    int height = (padded_height - (dilation[0]*(kernel_size[0]-1)+1)) / stride[0] + 1;
+    int width = (padded_width - (dilation[1]*(kernel_size[1]-1)+1)) / stride[1] + 1;
+    prepare_output(output, Tensor_shape{batch_size, channel, height, width});
     // pool
     for(int n = 0; n<batch_size; n++) {
         for(int c = 0; c<channel; c++) {
@@ -1070,30 +1291,30 @@ Tensor<uint8> functional::qmaxpool2d(Tensor<uint8> *input, int zero, const std::
                     int start_kh = 0;               // 相对于kernel的偏移
                     int start_kw = 0;
                     // max = padded[n][c][start_h+start_kh][start_w+start_kw]
-                    uint8 max = padded.data[
-                            n * channel * padded.size[2] * padded.size[3] +
-                            c * padded.size[2] * padded.size[3] +
-                            start_h * padded.size[3] +
+                    uint8 max = padded[
+                            (int64_t)n * channel * padded_height * padded_width +
+                            c * padded_height * padded_width +
+                            start_h * padded_width +
                             start_w];
                     for(int kh = 0; kh < kernel_size[0]; kh++, start_kh += dilation[0]) {
                         start_kw = 0;
                         for(int kw = 0; kw < kernel_size[1]; kw++, start_kw += dilation[1]) {
-                            if(padded.data[
-                                       n * channel * padded.size[2] * padded.size[3] +
-                                       c * padded.size[2] * padded.size[3] +
-                                       (start_h + start_kh) * padded.size[3] +
+                            if(padded[
+                                       (int64_t)n * channel * padded_height * padded_width +
+                                       c * padded_height * padded_width +
+                                       (start_h + start_kh) * padded_width +
                                        (start_w + start_kw)] > max) {
-                                max = padded.data[
-                                        n * channel * padded.size[2] * padded.size[3] +
-                                        c * padded.size[2] * padded.size[3] +
-                                        (start_h + start_kh) * padded.size[3] +
+                                max = padded[
+                                        (int64_t)n * channel * padded_height * padded_width +
+                                        c * padded_height * padded_width +
+                                        (start_h + start_kh) * padded_width +
                                         (start_w + start_kw)];
                             }
                         }
                     }
                     // result[n][c][h][w] = max
-                    result.data[
-                            n * channel * height * width +
+                    output.data[
+                            (int64_t)n * channel * height * width +
                             c * height * width +
                             h * width +
                             w] = max;
@@ -1101,7 +1322,6 @@ Tensor<uint8> functional::qmaxpool2d(Tensor<uint8> *input, int zero, const std::
             }
         }
     }
-    return result;
 }
 
 Tensor<uint8> functional::qflatten(Tensor<uint8> *input) {
@@ -1112,9 +1332,23 @@ Tensor<uint8> functional::qflatten(Tensor<uint8> *input) {
     return result;
 }
 
+void functional::qflatten(Tensor<uint8> *input, Tensor<uint8> &output) {
+    /*
+     * qflatten: output成为input的视图，不复制数据
+     */
+    output = input->reshape(Tensor_shape{input->size[0], -1});
+}
+
 Tensor<uint8>
 functional::qdense(Tensor<uint8> *input, int zero_x, int zero_w, int zero_b, int zero_y, Fixed_point coe, int rshift,
                    int qmin, int qmax, Tensor<int8> *weight, Tensor<int32> *bias) {
+    Tensor<uint8> result;
+    qdense(input, result, zero_x, zero_w, zero_b, zero_y, coe, rshift, qmin, qmax, weight, bias);
+    return result;
+}
+
+void functional::qdense(Tensor<uint8> *input, Tensor<uint8> &output, int zero_x, int zero_w, int zero_b, int zero_y,
+                        Fixed_point coe, int rshift, int qmin, int qmax, Tensor<int8> *weight, Tensor<int32> *bias) {
     /*
      * qdense
      */
@@ -1131,8 +1365,8 @@ functional::qdense(Tensor<uint8> *input, int zero_x, int zero_w, int zero_b, int
         fprintf(stderr, "File functional.cpp, line %d. Only 1 dimension bias is allowed in dense\n", __LINE__);
         exit(-1);
     }
-    // 矩阵乘法
-    Tensor<int> result{std::vector<int>{input->size[0], weight->size[1]}};
+    // 矩阵乘法，clip后直接写入output
+    prepare_output(output, Tensor_shape{input->size[0], weight->size[1]});
     int batch_size = input->size[0];
     int output_channel = weight->size[1];
     int input_channel = input->size[1];
@@ -1142,22 +1376,19 @@ functional::qdense(Tensor<uint8> *input, int zero_x, int zero_w, int zero_b, int
             int temp = 0;
             temp += input_channel * zero_x * zero_w;
             for(int i = 0; i<input_channel; i++) {
-                temp += input->data[n * input_channel + i] * weight->data[i * output_channel + o];
+                temp += input->data[(int64_t)n * input_channel + i] * weight->data[i * output_channel + o];
             }
             for(int i = 0; i<input_channel; i++) {
                 temp -= zero_x * weight->data[i * output_channel + o];
-                temp -= zero_w * input->data[n * input_channel + i];
+                temp -= zero_w * input->data[(int64_t)n * input_channel + i];
             }
             temp += bias->data[o] - zero_b;
             fp_temp.assign(temp);
             fp_temp *= coe;
             int t = fp_temp.to_int();
-            result.data[n * output_channel + o] = (t >> rshift) + zero_y;
+            output.data[(int64_t)n * output_channel + o] = (uint8)clip((t >> rshift) + zero_y, qmin, qmax);
         }
     }
-    result.clip(qmin, qmax);
-    Tensor<uint8> ret = result.astype_uint8();
-    return ret;
 }
 
 // Tensor<uint8>
@@ -1192,83 +1423,116 @@ functional::qdense(Tensor<uint8> *input, int zero_x, int zero_w, int zero_b, int
 //     return ret;
 // }
 
+static inline int requantize(int x, int zero_x, Fixed_point coe, int rshift)
+{
+    /*
+     * 把输入的量化值换算到输出的scale上(未加输出的zero)：((x - zero_x) * coe) >> rshift，rshift为负时左移
+     */
+    Fixed_point fp_temp{0};
+    fp_temp.assign(x - zero_x);
+    fp_temp *= coe;
+    int t = fp_temp.to_int();
+    if(rshift < 0) {
+        return t << (-rshift);
+    }
+    return t >> rshift;
+}
+
+static inline int requantize_concat(int x, int zero_x, Fixed_point coe, int rshift)
+{
+    /*
+     * qconcat的换算。与qadd不同，qconcat一直是不区分正负直接右移(t >> rshift)，
+     * rshift为负时x86的算术右移只取移位数的低5位，这里显式写出，保持原来的结果
+     */
+    Fixed_point fp_temp{0};
+    fp_temp.assign(x - zero_x);
+    fp_temp *= coe;
+    int t = fp_temp.to_int();
+    return t >> (rshift & 31);
+}
+
 Tensor<uint8>
 functional::qadd(Tensor<uint8> *input1, Tensor<uint8> *input2, int zero_x1, int zero_x2, int zero_y,
                  Fixed_point coe1, Fixed_point coe2, int rshift1, int rshift2, int qmin, int qmax) {
+    Tensor<uint8> result;
+    qadd(input1, input2, result, zero_x1, zero_x2, zero_y, coe1, coe2, rshift1, rshift2, qmin, qmax);
+    return result;
+}
+
+void functional::qadd(Tensor<uint8> *input1, Tensor<uint8> *input2, Tensor<uint8> &output, int zero_x1, int zero_x2,
+                      int zero_y, Fixed_point coe1, Fixed_point coe2, int rshift1, int rshift2, int qmin, int qmax) {
     /*
      * qadd
+     * 两个输入尺寸相同(QAdd保证)，逐元素换算、相加、clip后直接写入output，不产生int32的中间张量
      */
-    Tensor<int32> temp_x1 = input1->astype_int32();
-    Tensor<int32> temp_x2 = input2->astype_int32();
-    Fixed_point fp_temp1{0};
-    Fixed_point fp_temp2{0};
-    int len1 = input1->len();
-    for(int i = 0; i<len1; i++) {
-        int temp1 = temp_x1.data[i] - zero_x1;
-        fp_temp1.assign(temp1);
-        fp_temp1 *= coe1;
-        int t1 = fp_temp1.to_int();
-        if(rshift1 < 0) {
-            temp_x1.data[i] = t1 << (-rshift1);
-        }
-        else {
-            temp_x1.data[i] = t1 >> rshift1;
-        }
+    if(input1->size != input2->size) {
+        fprintf(stderr, "File: functional.cpp, line: %d. Shape of inputs of qadd should be the same\n", __LINE__);
+        exit(-1);
     }
-    int len2 = input2->len();
-    for(int i = 0; i<len2; i++) {
-        int temp2 = temp_x2.data[i] - zero_x2;
-        fp_temp2.assign(temp2);
-        fp_temp2 *= coe2;
-        int t2 = fp_temp2.to_int();
-        if(rshift2 < 0) {
-            temp_x2.data[i] = t2 << (-rshift2);
-        }
-        else {
-            temp_x2.data[i] = t2 >> rshift2;
-        }
+    Tensor<uint8> x1 = input1->contiguous();
+    Tensor<uint8> x2 = input2->contiguous();
+    prepare_output(output, x1.size);
+    int64_t len = x1.len();
+    for(int64_t i = 0; i<len; i++) {
+        int t1 = requantize(x1.data[i], zero_x1, coe1, rshift1);
+        int t2 = requantize(x2.data[i], zero_x2, coe2, rshift2);
+        output.data[i] = (uint8)clip(t1 + t2 + zero_y, qmin, qmax);
     }
-    Tensor<int32> result = temp_x1 + temp_x2 + zero_y;
-    result.clip(qmin, qmax);
-    Tensor<uint8> ret = result.astype_uint8();
-    return ret;
 }
 
 Tensor<uint8> functional::qconcat(Tensor<uint8> *input1, Tensor<uint8> *input2, int zero_x1, int zero_x2,
                                   int zero_y, Fixed_point coe1, Fixed_point coe2, int rshift1, int rshift2,
                                   int qmin, int qmax, int dim)
+{
+    Tensor<uint8> result;
+    qconcat(input1, input2, result, zero_x1, zero_x2, zero_y, coe1, coe2, rshift1, rshift2, qmin, qmax, dim);
+    return result;
+}
+
+void functional::qconcat(Tensor<uint8> *input1, Tensor<uint8> *input2, Tensor<uint8> &output, int zero_x1,
+                         int zero_x2, int zero_y, Fixed_point coe1, Fixed_point coe2, int rshift1, int rshift2,
+                         int qmin, int qmax, int dim)
 {
     /*
      * qconcat
+     * 与tensor_concat相同，把输入看作(outer, size[dim]*inner)的矩阵，结果的每一行依次由两个输入的对应行拼成。
+     * 每个元素换算、clip后直接写入output中的位置，不产生int32的中间张量
      */
-    Tensor<int32> temp_x1 = input1->astype_int32();
-    Tensor<int32> temp_x2 = input2->astype_int32();
-    Fixed_point fp_temp1{0};
-    Fixed_point fp_temp2{0};
-    int len1 = input1->len();
-    for(int i = 0; i<len1; i++) {
-        int temp1 = temp_x1.data[i] - zero_x1;
-        fp_temp1.assign(temp1);
-        fp_temp1 *= coe1;
-        int t1 = fp_temp1.to_int();
-        temp_x1.data[i] = (t1 >> rshift1) + zero_y;
-    }
-    int len2 = input2->len();
-    for(int i = 0; i<len2; i++) {
-        int temp2 = temp_x2.data[i] - zero_x2;
-        fp_temp2.assign(temp2);
-        fp_temp2 *= coe2;
-        int t2 = fp_temp2.to_int();
-        temp_x2.data[i] = (t2 >> rshift2) + zero_y;
-    }
-    Tensor<int32> result = temp_x1.concat(temp_x2, dim);
-    result.clip(qmin, qmax);
-    Tensor<uint8> ret = result.astype_uint8();
-    return ret;
+    std::vector<Tensor<uint8>> arrays{input1->contiguous(), input2->contiguous()};
+    Tensor_shape new_size = tensor_concat_shape(arrays, dim);
+    prepare_output(output, new_size);
+    int64_t outer = 1;
+    int64_t inner = 1;
+    for(int i = 0; i<dim; i++) {
+        outer *= new_size[i];
+    }
+    for(int i = dim+1; i<(int)new_size.size(); i++) {
+        inner *= new_size[i];
+    }
+    int64_t run1 = arrays[0].size[dim] * inner;
+    int64_t run2 = arrays[1].size[dim] * inner;
+    for(int64_t o = 0; o<outer; o++) {
+        const uint8 * x1 = arrays[0].data + o * run1;
+        const uint8 * x2 = arrays[1].data + o * run2;
+        uint8 * y = output.data + o * (run1 + run2);
+        for(int64_t i = 0; i<run1; i++) {
+            y[i] = (uint8)clip(requantize_concat(x1[i], zero_x1, coe1, rshift1) + zero_y, qmin, qmax);
+        }
+        for(int64_t i = 0; i<run2; i++) {
+            y[run1 + i] = (uint8)clip(requantize_concat(x2[i], zero_x2, coe2, rshift2) + zero_y, qmin, qmax);
+        }
+    }
 }
 
 Tensor<uint8> functional::qavgpool2d(Tensor<uint8> *input, int zero, const std::vector<int> &kernel_size,
                                      std::vector<int> stride, const std::vector<int> &padding_size) {
+    Tensor<uint8> result;
+    qavgpool2d(input, result, zero, kernel_size, std::move(stride), padding_size);
+    return result;
+}
+
+void functional::qavgpool2d(Tensor<uint8> *input, Tensor<uint8> &output, int zero, const std::vector<int> &kernel_size,
+                            std::vector<int> stride, const std::vector<int> &padding_size) {
     /*
      * qavgpool2d
      */
@@ -1294,20 +1558,15 @@ Tensor<uint8> functional::qavgpool2d(Tensor<uint8> *input, int zero, const std::
         stride[1] = kernel_size[1];
     }
     // padding
-    Tensor<uint8> padded;
-    if(padding_size[0] == 0 && padding_size[1] == 0) {
-        padded = *input;
-    }
-    else {
-        padded = qpadding(input, padding_size, zero);
-    }
+    int padded_height;
+    int padded_width;
+    const uint8 * padded = padded_input(input, padding_size, (uint8)zero, 0, padded_height, padded_width);
     // 计算pool后尺寸
     int batch_size = input->size[0];
     int channel = input->size[1];
-    int height = (padded.size[2] - kernel_size[0]) / stride[0] + 1;
-    int width = (padded.size[3] - kernel_size[1]) / stride[1] + 1;
-    // 创建返回对象
-    Tensor<uint8> result{std::vector<int>{batch_size, channel, height, width}};
+    int height = (padded_height - kernel_size[0]) / stride[0] + 1;
+    int width = (padded_width - kernel_size[1]) / stride[1] + 1;
+    prepare_output(output, Tensor_shape{batch_size, channel, height, width});
     // pool
     for(int n = 0; n<batch_size; n++) {
         for(int c = 0; c<channel; c++) {
@@ -1324,16 +1583,16 @@ Tensor<uint8> functional::qavgpool2d(Tensor<uint8> *input, int zero, const std::
                     for(int kh = 0; kh < kernel_size[0]; kh++, start_kh ++) {
                         start_kw = 0;
                         for(int kw = 0; kw < kernel_size[1]; kw++, start_kw ++) {
-                            sum += padded.data[
-                                        n * channel * padded.size[2] * padded.size[3] +
-                                        c * padded.size[2] * padded.size[3] +
-                                        (start_h + start_kh) * padded.size[3] +
+                            sum += padded[
+                                        (int64_t)n * channel * padded_height * padded_width +
+                                        c * padded_height * padded_width +
+                                        (start_h + start_kh) * padded_width +
                                         (start_w + start_kw)];
                         }
                     }
                     // result[n][c][h][w] = sum / (kernel_size[0] * kernel_size[1])
-                    result.data[
-                            n * channel * height * width +
+                    output.data[
+                            (int64_t)n * channel * height * width +
                             c * height * width +
                             h * width +
                             w] = (uint8)(sum / (kernel_size[0] * kernel_size[1]));
@@ -1341,5 +1600,13 @@ Tensor<uint8> functional::qavgpool2d(Tensor<uint8> *input, int zero, const std::
             }
         }
     }
-    return result;
+}
+
+void functional::qcopy(Tensor<uint8> *input, Tensor<uint8> &output)
+{
+    /*
+     * 把input复制到output(output不是input的视图)
+     */
+    prepare_output(output, input->size);
+    std::move(output) = *input;
 }
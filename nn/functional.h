@@ -15,12 +15,39 @@
 #include "quant_tools.h"
 
 
+#define DENSE_HALF_BLOCK_BYTES (1 << 18)     // 半精度weight的dense每次转换为float32的weight字节数
+#define FUNCTIONAL_WORKSPACE_SLOTS 3        // 每个线程为算子内部临时数据保留的缓冲区个数
+#define FUNCTIONAL_RELU_GRAIN (1 << 16)     // 多线程relu每块的元素数
+
+
+/*
+ * 每个算子有两种形式：
+ * 1. 返回结果：Tensor<float32> relu(Tensor<float32> *input)，每次调用申请一个新的结果张量
+ * 2. 写入输出：void relu(Tensor<float32> *input, Tensor<float32> &output)，output紧跟在数据输入之后
+ *      output已有连续存储且尺寸与结果相同时，直接写入它的数据空间(不申请内存)，否则按结果尺寸重新申请。
+ *      Node::forward把Execution_context构造时预先申请的中间结果(intermediate_results)传入，稳定运行后前向传播不再申请张量。
+ *      output的数据空间被原地覆盖，与它共享数据空间的视图也会看到新结果。除逐元素的算子外，output不能与输入共用数据空间
+ *      flatten/qflatten仍返回输入的视图(output指向输入的数据空间，不复制)
+ * 算子内部的临时数据(padding结果、im2col矩阵、转换后的半精度weight)放在每个线程保留的缓冲区中，
+ * 缓冲区只在不够大时重新申请，大小为各层所需的最大值
+ */
+
+
 namespace functional {
     // float32算子
     Tensor<float32> conv2d(Tensor<float32> *input, Tensor<float32> *weight, Tensor<float32> *bias= nullptr,
                            const std::vector<int>& stride=std::vector<int>{1,1},
                            const std::vector<int>& padding=std::vector<int>{0,0},
                            const std::vector<int>& dilation=std::vector<int>{1,1});
+    // 半精度weight(fp16/bf16)的conv2d和dense：计算仍使用float32，weight在使用时转换
+    Tensor<float32> conv2d(Tensor<float32> *input, Tensor<fp16> *weight, Tensor<float32> *bias= nullptr,
+                           const std::vector<int>& stride=std::vector<int>{1,1},
+                           const std::vector<int>& padding=std::vector<int>{0,0},
+                           const std::vector<int>& dilation=std::vector<int>{1,1});
+    Tensor<float32> conv2d(Tensor<float32> *input, Tensor<bf16> *weight, Tensor<float32> *bias= nullptr,
+                           const std::vector<int>& stride=std::vector<int>{1,1},
+                           const std::vector<int>& padding=std::vector<int>{0,0},
+                           const std::vector<int>& dilation=std::vector<int>{1,1});
     Tensor<float32> relu(Tensor<float32> *input);
     Tensor<float32> padding(Tensor<float32> *input, const std::vector<int>& padding_size);
     Tensor<float32> maxpool2d(Tensor<float32> *input, const std::vector<int>& kernel_size,
@@ -29,8 +56,11 @@ namespace functional {
                               const std::vector<int>& dilation=std::vector<int>{1,1});
     Tensor<float32> flatten(Tensor<float32> *input);
     Tensor<float32> dense(Tensor<float32> *input, Tensor<float32> *weight, Tensor<float32> *bias= nullptr);
+    Tensor<float32> dense(Tensor<float32> *input, Tensor<fp16> *weight, Tensor<float32> *bias= nullptr);
+    Tensor<float32> dense(Tensor<float32> *input, Tensor<bf16> *weight, Tensor<float32> *bias= nullptr);
     Tensor<float32> add(Tensor<float32> *input1, Tensor<float32> *input2);
     Tensor<float32> concat(Tensor<float32> *input1, Tensor<float32> *input2, int dim=0);
+    Tensor<float32> concat(const std::vector<Tensor<float32>*> &inputs, int dim=0);
     Tensor<float32> batch_norm2d(Tensor<float32> *input, Tensor<float32> *running_mean,
                                Tensor<float32> *running_var, Tensor<float32> *weight,
                                Tensor<float32> *bias, float eps);
@@ -38,9 +68,43 @@ namespace functional {
                               std::vector<int> stride=std::vector<int>{-1,-1},
                               const std::vector<int>& padding_size=std::vector<int>{0,0});
     Tensor<float32> dropout(Tensor<float32> *input, const float p);
+    // float32算子：写入output
+    void conv2d(Tensor<float32> *input, Tensor<float32> &output, Tensor<float32> *weight, Tensor<float32> *bias= nullptr,
+                const std::vector<int>& stride=std::vector<int>{1,1},
+                const std::vector<int>& padding=std::vector<int>{0,0},
+                const std::vector<int>& dilation=std::vector<int>{1,1});
+    void conv2d(Tensor<float32> *input, Tensor<float32> &output, Tensor<fp16> *weight, Tensor<float32> *bias= nullptr,
+                const std::vector<int>& stride=std::vector<int>{1,1},
+                const std::vector<int>& padding=std::vector<int>{0,0},
+                const std::vector<int>& dilation=std::vector<int>{1,1});
+    void conv2d(Tensor<float32> *input, Tensor<float32> &output, Tensor<bf16> *weight, Tensor<float32> *bias= nullptr,
+                const std::vector<int>& stride=std::vector<int>{1,1},
+                const std::vector<int>& padding=std::vector<int>{0,0},
+                const std::vector<int>& dilation=std::vector<int>{1,1});
+    void relu(Tensor<float32> *input, Tensor<float32> &output);
+    void padding(Tensor<float32> *input, Tensor<float32> &output, const std::vector<int>& padding_size);
+    void maxpool2d(Tensor<float32> *input, Tensor<float32> &output, const std::vector<int>& kernel_size,
+                   std::vector<int> stride=std::vector<int>{-1,-1},
+                   const std::vector<int>& padding_size=std::vector<int>{0,0},
+                   const std::vector<int>& dilation=std::vector<int>{1,1});
+    void flatten(Tensor<float32> *input, Tensor<float32> &output);
+    void dense(Tensor<float32> *input, Tensor<float32> &output, Tensor<float32> *weight, Tensor<float32> *bias= nullptr);
+    void dense(Tensor<float32> *input, Tensor<float32> &output, Tensor<fp16> *weight, Tensor<float32> *bias= nullptr);
+    void dense(Tensor<float32> *input, Tensor<float32> &output, Tensor<bf16> *weight, Tensor<float32> *bias= nullptr);
+    void add(Tensor<float32> *input1, Tensor<float32> *input2, Tensor<float32> &output);
+    void concat(Tensor<float32> *input1, Tensor<float32> *input2, Tensor<float32> &output, int dim=0);
+    void concat(const std::vector<Tensor<float32>*> &inputs, Tensor<float32> &output, int dim=0);
+    void batch_norm2d(Tensor<float32> *input, Tensor<float32> &output, Tensor<float32> *running_mean,
+                      Tensor<float32> *running_var, Tensor<float32> *weight,
+                      Tensor<float32> *bias, float eps);
+    void avgpool2d(Tensor<float32> *input, Tensor<float32> &output, const std::vector<int>& kernel_size,
+                   std::vector<int> stride=std::vector<int>{-1,-1},
+                   const std::vector<int>& padding_size=std::vector<int>{0,0});
+    void dropout(Tensor<float32> *input, Tensor<float32> &output, const float p);
+    void copy(Tensor<float32> *input, Tensor<float32> &output);
     void im2col(float32 * data_col, float32 * data_im, int height, int width, int channels_col, 
                 int height_col, int width_col, int kernel_h, int kernel_w, int stride_h, int stride_w, 
-                int pad_h, int pad_w, int dilation_h, int dilation_w);
+                int pad_h, int pad_w, int dilation_h, int dilation_w, int ld_col=0);
 
     // uint8算子
     Tensor<uint8> qconv2d(Tensor<uint8> *input,
@@ -69,9 +133,37 @@ namespace functional {
     Tensor<uint8> qavgpool2d(Tensor<uint8> *input, int zero, const std::vector<int>& kernel_size,
                              std::vector<int> stride=std::vector<int>{-1,-1},
                              const std::vector<int>& padding_size=std::vector<int>{0,0});
+    // uint8算子：写入output
+    void qconv2d(Tensor<uint8> *input, Tensor<uint8> &output,
+                 int zero_x, int zero_w, int zero_b, int zero_y,
+                 Fixed_point coe, int rshift, int qmin, int qmax,
+                 Tensor<int8> *weight, Tensor<int32> *bias= nullptr,
+                 const std::vector<int>& stride=std::vector<int>{1,1},
+                 const std::vector<int>& padding=std::vector<int>{0,0},
+                 const std::vector<int>& dilation=std::vector<int>{1,1});
+    void qrelu(Tensor<uint8> *input, Tensor<uint8> &output, int zero, int qmax);
+    void qpadding(Tensor<uint8> *input, Tensor<uint8> &output, const std::vector<int>& padding_size, int zero);
+    void qmaxpool2d(Tensor<uint8> *input, Tensor<uint8> &output, int zero, const std::vector<int>& kernel_size,
+                    std::vector<int> stride=std::vector<int>{-1,-1},
+                    const std::vector<int>& padding_size=std::vector<int>{0,0},
+                    const std::vector<int>& dilation=std::vector<int>{1,1});
+    void qflatten(Tensor<uint8> *input, Tensor<uint8> &output);
+    void qdense(Tensor<uint8> *input, Tensor<uint8> &output, int zero_x, int zero_w, int zero_b, int zero_y,
+                Fixed_point coe, int rshift, int qmin, int qmax,
+                Tensor<int8> *weight, Tensor<int32> *bias= nullptr);
+    void qadd(Tensor<uint8> *input1, Tensor<uint8> *input2, Tensor<uint8> &output, int zero_x1, int zero_x2,
+              int zero_y, Fixed_point coe1, Fixed_point coe2, int rshift1, int rshift2,
+              int qmin, int qmax);
+    void qconcat(Tensor<uint8> *input1, Tensor<uint8> *input2, Tensor<uint8> &output, int zero_x1, int zero_x2,
+                 int zero_y, Fixed_point coe1, Fixed_point coe2, int rshift1, int rshift2,
+                 int qmin, int qmax, int dim=0);
+    void qavgpool2d(Tensor<uint8> *input, Tensor<uint8> &output, int zero, const std::vector<int>& kernel_size,
+                    std::vector<int> stride=std::vector<int>{-1,-1},
+                    const std::vector<int>& padding_size=std::vector<int>{0,0});
+    void qcopy(Tensor<uint8> *input, Tensor<uint8> &output);
     void im2col(uint8 * data_col, uint8 * data_im, int height, int width, int channels_col, 
                 int height_col, int width_col, int kernel_h, int kernel_w, int stride_h, int stride_w, 
-                int pad_h, int pad_w, int dilation_h, int dilation_w, int zero);
+                int pad_h, int pad_w, int dilation_h, int dilation_w, int zero, int ld_col=0);
 }
 
 
@@ -16,6 +16,7 @@ Graph::Graph(const std::string& graph_content, const std::string& model_dir)
      * 读取path的文件，根据它创建计算图
      * 每读取一行，创建一个节点
      */
+    Tensor_trace_site trace_site("graph_load");
     this->graph_content = graph_content;        // 保存计算图文件内容
     this->model_dir = model_dir;
 
@@ -47,6 +48,26 @@ Graph::~Graph() {
     }
 }
 
+void Graph::set_weight_dtype(const std::string &dtype)
+{
+    /*
+     * 改变conv2d、dense权重的存储类型
+     */
+    if(dtype != "float32" && dtype != "float16" && dtype != "bfloat16") {
+        fprintf(stderr, "File graph.cpp, line %d. Unsupported weight dtype: %s\n", __LINE__, dtype.c_str());
+        exit(-1);
+    }
+    Tensor_trace_site trace_site("weight_dtype");
+    for(Node * node: node_list) {
+        if(node->name == OPN_NN_CONV2D) {
+            ((Conv2d*)node->op)->set_weight_dtype(dtype);
+        }
+        else if(node->name == OPN_NN_DENSE) {
+            ((Dense*)node->op)->set_weight_dtype(dtype);
+        }
+    }
+}
+
 void Graph::fuse_op()
 {
     /*
@@ -60,6 +81,7 @@ void Graph::fuse_op()
      * 3. 对bn进行算子融合
      */
     printf("Fusing operators...\n");
+    Tensor_trace_site trace_site("fuse_op");
     // 0. 检查是否包含bn
     int found = 0;
     for(Node *node: node_list) {
@@ -107,7 +129,7 @@ void Graph::fuse_op()
         Tensor<float32> running_mean = ((Batch_Norm2d*)this->node_list[layer]->op)->running_mean;
         Tensor<float32> running_var = ((Batch_Norm2d*)this->node_list[layer]->op)->running_var;
         // 提取weight和bias
-        Tensor<float32> conv_weight = ((Conv2d*)this->node_list[bn_input_node]->op)->weight.deep_copy();
+        Tensor<float32> conv_weight = ((Conv2d*)this->node_list[bn_input_node]->op)->get_weight().deep_copy();
         Tensor<float32> conv_bias = ((Conv2d*)this->node_list[bn_input_node]->op)->bias.deep_copy();
         Tensor<float32> bn_weight = ((Batch_Norm2d*)this->node_list[layer]->op)->weight.deep_copy();
         Tensor<float32> bn_bias = ((Batch_Norm2d*)this->node_list[layer]->op)->bias.deep_copy();
@@ -117,7 +139,7 @@ void Graph::fuse_op()
         conv_weight = gamma_dot.reshape(std::vector<int>{-1, 1, 1, 1}) * conv_weight;
         conv_bias = gamma_dot * (conv_bias - running_mean) + bn_bias;
         // 将融合后的权重存储进conv
-        ((Conv2d*)this->node_list[bn_input_node]->op)->weight = conv_weight;
+        ((Conv2d*)this->node_list[bn_input_node]->op)->set_weight(conv_weight);
         ((Conv2d*)this->node_list[bn_input_node]->op)->bias = conv_bias;
     }
     // 现在this的conv层的权重是融合后的权重，new_graph计算的中间结果已经没用了
@@ -247,74 +269,41 @@ void Graph::fuse_op()
     printf("Fuse operators finished\n");
 }
 
-std::vector<void*> Graph::forward(void *input) {
+std::vector<void*> Graph::forward(Execution_context &context, void *input) const {
     /*
      * 前向传播函数：
      * 输入和返回类型实际均为Tensor<>*
-     * 该函数应使用intermediate_results存储中间结果，且intermediate_results的实际类型为std::vector<Tensor<>*>
+     * 中间结果存储在context.intermediate_results中，其实际类型为std::vector<Tensor<>*>
      * 由于Graph不管理类型，所有Tensor<>*均设为void*。调用者必须负责管理类型
      *
      * 计算方式:
-     * 1. 不需要初始化intermediate_results。intermediate_results应由调用者管理
+     * 1. 不需要初始化intermediate_results。context由调用者用此graph创建
      * 2. 遍历graph中所有节点，传入input和output指针
      * 3. 如果某个节点是output节点，那么将它对应的中间结果Tensor数组指针加入一个vector，并最终返回这个vector
+     * 节点的执行顺序由context的scheduler决定(见scheduler.h)：按节点列表的顺序，或就绪的节点同时执行
      */
+    if(context.graph != this || context.intermediate_results.size() != node_list.size()) {
+        fprintf(stderr, "File: graph.cpp, line: %d. Execution context was not created for this graph "
+                        "(or the graph changed after it was created)\n", __LINE__);
+        exit(-1);
+    }
     // 使用各节点进行前向传播计算
+    context.scheduler.forward(node_list, context.intermediate_results, input);
 
-    
-    for(Node *node: node_list) {
-        node->forward(intermediate_results, input);
-    }
-    
     // 将output节点的输出push到ret里
     std::vector<void*> ret;
     for(Node *node: node_list) {
         if(node->name == OPN_OUTPUT) {
-            ret.push_back(intermediate_results[node->number]);
+            ret.push_back(context.intermediate_results[node->number]);
         }
         if(node->name == OPN_QOUTPUT) {
-            ret.push_back((intermediate_results[node->number]));
+            ret.push_back((context.intermediate_results[node->number]));
         }
     }
 
     return ret;
 }
 
-void Graph::alloc_intermediate_results() {
-    /*
-     * 为前向传播中间结果分配内存
-     */
-    for(const Node* node: node_list) {
-        if(node->dtype == "float32") {
-            Tensor<float32> *inter_res = new Tensor<float32>{node->output_shape};
-            inter_res->set_zero();
-            intermediate_results.push_back(inter_res);
-        }
-        else if(node->dtype == "uint8") {
-            Tensor<uint8> *inter_res = new Tensor<uint8>{node->output_shape};
-            inter_res->set_zero();
-            intermediate_results.push_back(inter_res);
-        }
-    }
-}
-
-void Graph::free_intermediate_results() {
-    /*
-     * 释放前向传播中间结果的内存
-     */
-    for(int i = 0; i<(int)node_list.size(); i++) {
-        if(node_list[i]->dtype == "float32") {
-            delete((Tensor<float32>*)intermediate_results[i]);
-        }
-        if(node_list[i]->dtype == "uint8") {
-            delete((Tensor<uint8>*)intermediate_results[i]);
-        }
-    }
-    while(!intermediate_results.empty()) {
-        intermediate_results.pop_back();
-    }
-}
-
 void Graph::print() {
     /*
      * 打印计算图结构
@@ -362,6 +351,7 @@ Graph *Graph::quantization(Tensor<float32>* processed_calib_set) {
      * 6. 对需要的层的weight和bias进行量化
      * 7. 返回量化计算图
      */
+    Tensor_trace_site trace_site("quantization");     // 前向传播中的申请记到各算子名下
     // 0. 根据当前计算图，创建量化计算图
     Graph * qgraph = new Graph();
     for(Node * node: node_list) {
@@ -383,15 +373,14 @@ Graph *Graph::quantization(Tensor<float32>* processed_calib_set) {
     // 2. 使用processed_calib_set进行前向传播计算
     printf("Calibrating...\n");
     int img_number = processed_calib_set->size[0];
-    this->alloc_intermediate_results();
+    Execution_context * context = new Execution_context(*this);
     for(int i = 0; i<img_number; i++) {
         // 2.0 前向传播计算
         Tensor<float32> img = (*processed_calib_set)[i].expand_dim(0);
-        this->forward(&img);
+        this->forward(*context, &img);
         for(int j = 0; j<node_number; j++) {
             // 2.1 计算各层的r, q
-            rmax[j] = ((Tensor<float32>*)intermediate_results[j])->max();
-            rmin[j] = ((Tensor<float32>*)intermediate_results[j])->min();
+            ((Tensor<float32>*)context->intermediate_results[j])->minmax(rmin[j], rmax[j]);
             // float temp_rmax = (fabs(rmax[j]) > fabs(rmin[j])) ? fabs(rmax[j]) : fabs(rmin[j]);
             // rmax[j] = temp_rmax;
             // rmin[j] = -temp_rmax;
@@ -406,7 +395,13 @@ Graph *Graph::quantization(Tensor<float32>* processed_calib_set) {
         fflush(stdout);
     }
     printf("\rCalibrate finished\n");
-    this->free_intermediate_results();
+    if(graph_scheduler() == GRAPH_SCHEDULER_DAG) {
+        context->print_schedule_report("calibration");
+    }
+    delete context;
+    if(tensor_trace_enabled()) {
+        print_tensor_trace("calibration");
+    }
     // 3. 求各层平均的s, z
     // 注意：部分层应直接使用其输入层的scale和zero
     for(int i = 0; i<node_number; i++) {
@@ -467,8 +462,7 @@ Graph *Graph::quantization(Tensor<float32>* processed_calib_set) {
     }
     for(int i = 0; i<node_number; i++) {
         if(node_list[i]->name == OPN_NN_CONV2D) {
-            rmax_weight[i] = ((Conv2d*)node_list[i]->op)->weight.max();
-            rmin_weight[i] = ((Conv2d*)node_list[i]->op)->weight.min();
+            ((Conv2d*)node_list[i]->op)->get_weight().minmax(rmin_weight[i], rmax_weight[i]);
             float temp_rmax = (fabs(rmax_weight[i]) > fabs(rmin_weight[i])) ? fabs(rmax_weight[i]) : fabs(rmin_weight[i]);
             rmax_weight[i] = temp_rmax;
             rmin_weight[i] = -temp_rmax;
@@ -484,8 +478,7 @@ Graph *Graph::quantization(Tensor<float32>* processed_calib_set) {
             zero_bias[i] = 0;
         }
         else if(node_list[i]->name == OPN_NN_DENSE) {
-            rmax_weight[i] = ((Dense*)node_list[i]->op)->weight.max();
-            rmin_weight[i] = ((Dense*)node_list[i]->op)->weight.min();
+            ((Dense*)node_list[i]->op)->get_weight().minmax(rmin_weight[i], rmax_weight[i]);
             float temp_rmax = (fabs(rmax_weight[i]) > fabs(rmin_weight[i])) ? fabs(rmax_weight[i]) : fabs(rmin_weight[i]);
             rmax_weight[i] = temp_rmax;
             rmin_weight[i] = -temp_rmax;
@@ -572,13 +565,15 @@ Graph *Graph::quantization(Tensor<float32>* processed_calib_set) {
     // 6. 对需要的层的weight和bias进行量化
     for(int i = 0; i<node_number; i++) {
         if(node_list[i]->name == OPN_NN_CONV2D) {
-            quant(((QConv2d*)qgraph->node_list[i]->op)->weight, ((Conv2d*)node_list[i]->op)->weight,
+            Tensor<float32> weight = ((Conv2d*)node_list[i]->op)->get_weight();
+            quant(((QConv2d*)qgraph->node_list[i]->op)->weight, weight,
                   scale_weight[i], zero_weight[i], qmin_weight[i], qmax_weight[i]);
             quant(((QConv2d*)qgraph->node_list[i]->op)->bias, ((Conv2d*)node_list[i]->op)->bias,
                   scale_bias[i], zero_bias[i], qmin_bias[i], qmax_bias[i]);
         }
         else if(node_list[i]->name == OPN_NN_DENSE) {
-            quant(((QDense*)qgraph->node_list[i]->op)->weight, ((Dense*)node_list[i]->op)->weight,
+            Tensor<float32> weight = ((Dense*)node_list[i]->op)->get_weight();
+            quant(((QDense*)qgraph->node_list[i]->op)->weight, weight,
                   scale_weight[i], zero_weight[i], qmin_weight[i], qmax_weight[i]);
             quant(((QDense*)qgraph->node_list[i]->op)->bias, ((Dense*)node_list[i]->op)->bias,
                   scale_bias[i], zero_bias[i], qmin_bias[i], qmax_bias[i]);
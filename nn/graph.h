@@ -25,6 +25,7 @@
 #include "preprocess.h"
 #include "fixed_point.h"
 #include "quant_tools.h"
+#include "execution_context.h"
 
 /*
  * 计算图：
@@ -36,7 +37,7 @@
  * 考虑到需要处理大量图片，如果每张图片计算过程中都需要重新申请中间结果存储空间，必然十分浪费时间
  * 所以我们需要在计算之前提前申请好存储空间，在每张图片计算过程中重复利用这些空间。那么就必须能够在Graph中就知道数据类型(flot32? uint8)
  * 和每个节点的output尺寸，那么我们最好在Node中保存这两个数据。这样在forward计算的时候可以按照以下步骤进行：
- * 1. 根据Node的dtype和output尺寸为每个Node的输出申请空间(Tensor类型)
+ * 1. 根据Node的dtype和output尺寸为每个Node的输出申请空间(Tensor类型)，这些空间保存在Execution_context中
  * 2. 遍历每一个Node，将输入(上一层的输出空间指针)和输出空间指针传入(Node内部自动根据算子类型进行计算)
  * 3. 得到最后结果后，将结果指针返回(void*)
  * 调用forward的函数自行根据上下文处理返回值类型
@@ -57,30 +58,17 @@ public:
      */
     std::vector<std::vector<int> > output_shape_list;
 
-    /*
-     * 这个vector用于存储forward过程中的中间结果，即各节点的输出
-     * vector里存储的实际类型是Tensor<>*，但由于graph不处理类型，所以将它设为void*。forward函数需要自己处理类型
-     */
-    std::vector<void*> intermediate_results;
-
     explicit Graph();
     Graph(const std::string& path, const std::string& model_dir);                // constructor
     ~Graph();
 
-    /*
-     * 由于forward()每次只能计算一个batch，如果在forward()里为中间结果分配空间，那么每次调用forward都要重新分配空间，会
-     * 浪费大量时间。所以提供此方法，可在调用forward的函数中分配空间
-     * 同时提供释放空间的方法
-     */
-    void alloc_intermediate_results();
-    void free_intermediate_results();
-
     /*
      * 前向传播函数。由于graph不限制数据类型(float32 uint8等)，这里只返回std::vector<void*>。实际返回类型为
-     * std::vector<Tensor<>*>。调用者需要根据上下文修改指针类型
+     * std::vector<Tensor<>*>，指向context中的中间结果。调用者需要根据上下文修改指针类型
      * 考虑到某些神经网络可能有超过1个输出节点，这里使用vector存储返回值
+     * forward不修改Graph，多个线程可以使用各自的context同时调用(见execution_context.h)
      */
-     std::vector<void*> forward(void * input);
+     std::vector<void*> forward(Execution_context &context, void * input) const;
 
     /*
      * 融合算子。将batch_norm2d融入conv2d
@@ -88,12 +76,18 @@ public:
      */
      void fuse_op();
 
+    /*
+     * 改变conv2d、dense权重的存储类型：float32, float16, bfloat16
+     * 半精度存储时权重只占一半内存，forward时读取权重的内存带宽减半，计算仍使用float32(中间结果也是float32)
+     * fuse_op和quantization使用转换回float32的权重
+     */
+     void set_weight_dtype(const std::string &dtype);
+
      Graph* quantization(Tensor<float32>* processed_calib_set);
 
      void print();              // 打印计算图结构
 
      void save(std::string path);               // 保存计算图
-
 };
 
 
@@ -163,13 +163,15 @@ Node::~Node() {
     }
 }
 
-void Node::forward(const std::vector<void *> &intermediate_results, void *input)
+void Node::forward(const std::vector<void *> &intermediate_results, void *input) const
 {
     /*
      * 前向传播函数
      * 传入存储所有中间结果指针的vector，和graph的input的指针
      * 根据算子名称分类处理：调用算子的forward，传入input和output指针
+     * 算子把结果写入output(Execution_context的intermediate_results中预先申请的中间结果)，尺寸不变时不申请新张量
      */
+    Tensor_trace_site trace_site(get_op_name(this->name));     // 分配统计记到算子名下
     // 普通算子
     if(this->name == OPN_NN_CONV2D) {
         ((Conv2d*)op)->forward(
@@ -293,6 +295,77 @@ void Node::forward(const std::vector<void *> &intermediate_results, void *input)
     }
 }
 
+std::vector<int> Node::get_input_nodes() const
+{
+    /*
+     * 输入节点的编号(即forward读取的intermediate_results的下标)。input/qinput读取计算图的输入，没有输入节点
+     */
+    if(this->name == OPN_NN_CONV2D) {
+        return std::vector<int>{((Conv2d*)op)->input_node};
+    }
+    else if(this->name == OPN_NN_RELU) {
+        return std::vector<int>{((Relu*)op)->input_node};
+    }
+    else if(this->name == OPN_NN_MAXPOOL2D) {
+        return std::vector<int>{((Maxpool2d*)op)->input_node};
+    }
+    else if(this->name == OPN_NN_AVGPOOL2D) {
+        return std::vector<int>{((Avgpool2d*)op)->input_node};
+    }
+    else if(this->name == OPN_NN_FLATTEN) {
+        return std::vector<int>{((Flatten*)op)->input_node};
+    }
+    else if(this->name == OPN_NN_DENSE) {
+        return std::vector<int>{((Dense*)op)->input_node};
+    }
+    else if(this->name == OPN_OUTPUT) {
+        return std::vector<int>{((Output*)op)->input_node};
+    }
+    else if(this->name == OPN_NN_BATCH_NORM2D) {
+        return std::vector<int>{((Batch_Norm2d*)op)->input_node};
+    }
+    else if(this->name == OPN_NN_DROPOUT) {
+        return std::vector<int>{((Dropout*)op)->input_node};
+    }
+    else if(this->name == OPN_NN_QCONV2D) {
+        return std::vector<int>{((QConv2d*)op)->input_node};
+    }
+    else if(this->name == OPN_NN_QMAXPOOL2D) {
+        return std::vector<int>{((QMaxpool2d*)op)->input_node};
+    }
+    else if(this->name == OPN_NN_QAVGPOOL2D) {
+        return std::vector<int>{((QAvgpool2d*)op)->input_node};
+    }
+    else if(this->name == OPN_NN_QRELU) {
+        return std::vector<int>{((QRelu*)op)->input_node};
+    }
+    else if(this->name == OPN_NN_QFLATTEN) {
+        return std::vector<int>{((QFlatten*)op)->input_node};
+    }
+    else if(this->name == OPN_NN_QDENSE) {
+        return std::vector<int>{((QDense*)op)->input_node};
+    }
+    else if(this->name == OPN_QOUTPUT) {
+        return std::vector<int>{((QOutput*)op)->input_node};
+    }
+    else if(this->name == OPN_NN_QDROPOUT) {
+        return std::vector<int>{((QDropout*)op)->input_node};
+    }
+    else if(this->name == OPN_ADD) {
+        return std::vector<int>{((Add*)op)->input_node1, ((Add*)op)->input_node2};
+    }
+    else if(this->name == OPN_CONCAT) {
+        return std::vector<int>{((Concat*)op)->input_node1, ((Concat*)op)->input_node2};
+    }
+    else if(this->name == OPN_QADD) {
+        return std::vector<int>{((QAdd*)op)->input_node1, ((QAdd*)op)->input_node2};
+    }
+    else if(this->name == OPN_QCONCAT) {
+        return std::vector<int>{((QConcat*)op)->input_node1, ((QConcat*)op)->input_node2};
+    }
+    return std::vector<int>();
+}
+
 void Node::print() {
     /*
      * 打印节点参数
@@ -585,6 +658,38 @@ int get_name(const std::string &graph_line) {
     return -1;
 }
 
+const char * get_op_name(int name) {
+    /*
+     * 节点名称对应的算子名称字符串
+     */
+    switch(name) {
+        case OPN_INPUT: return "input";
+        case OPN_NN_CONV2D: return "nn.conv2d";
+        case OPN_NN_MAXPOOL2D: return "nn.maxpool2d";
+        case OPN_NN_RELU: return "nn.relu";
+        case OPN_NN_FLATTEN: return "nn.flatten";
+        case OPN_NN_DENSE: return "nn.dense";
+        case OPN_ADD: return "add";
+        case OPN_CONCAT: return "concat";
+        case OPN_OUTPUT: return "output";
+        case OPN_NN_BATCH_NORM2D: return "nn.batch_norm2d";
+        case OPN_NN_AVGPOOL2D: return "nn.avgpool2d";
+        case OPN_NN_DROPOUT: return "nn.dropout";
+        case OPN_QINPUT: return "qinput";
+        case OPN_NN_QCONV2D: return "nn.qconv2d";
+        case OPN_NN_QMAXPOOL2D: return "nn.qmaxpool2d";
+        case OPN_NN_QRELU: return "nn.qrelu";
+        case OPN_NN_QFLATTEN: return "nn.qflatten";
+        case OPN_NN_QDENSE: return "nn.qdense";
+        case OPN_QADD: return "qadd";
+        case OPN_QCONCAT: return "qconcat";
+        case OPN_QOUTPUT: return "qoutput";
+        case OPN_NN_QAVGPOOL2D: return "nn.qavgpool2d";
+        case OPN_NN_QDROPOUT: return "nn.qdropout";
+        default: return "unknown";
+    }
+}
+
 std::vector<std::string> get_parameters(const std::string &graph_line) {
     /*
      * 提取参数(参数名和参数值 对)。每个参数对存为一个string，并存入vector
@@ -46,7 +46,9 @@ public:
      * 前向传播函数。Graph在调用node的forward时，将预分配的中间结果空间指针vector
      * 和整个计算图的输入数据指针传入，这些指针类型均为void*，需要forward内部根据算子名称进行处理
      */
-    void forward(const std::vector<void*> &intermediate_results, void* input);
+    void forward(const std::vector<void*> &intermediate_results, void* input) const;
+
+    std::vector<int> get_input_nodes() const;   // 输入节点的编号(用于建立节点间的依赖关系)
 
     Node* to_qnode();               // 创建量化节点
 
@@ -57,6 +59,7 @@ public:
 
 int get_number(const std::string &graph_line);
 int get_name(const std::string &graph_line);
+const char * get_op_name(int name);         // 节点名称对应的算子名称字符串(get_name的逆运算，包括量化算子)
 std::vector<std::string> get_parameters(const std::string &graph_line);
 
 #endif //QUANT_NODE_H
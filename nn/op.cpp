@@ -6,6 +6,65 @@
 #include <cstddef>
 #include <cstdlib>
 
+
+static void store_weight(Tensor<float32> src, const std::string &dtype, Tensor<float32> &weight,
+                         Tensor<fp16> &weight_f16, Tensor<bf16> &weight_bf16)
+{
+    /*
+     * 把float32的权重src按dtype存入对应的张量，另外两个释放
+     * dtype: float32(直接共享src), float16, bfloat16(转换为半精度，占一半空间)
+     */
+    if(dtype == "float32") {
+        weight = src;
+        weight_f16 = Tensor<fp16>();
+        weight_bf16 = Tensor<bf16>();
+    }
+    else if(dtype == "float16") {
+        weight_f16 = src.astype_float16();
+        weight = Tensor<float32>();
+        weight_bf16 = Tensor<bf16>();
+    }
+    else if(dtype == "bfloat16") {
+        weight_bf16 = src.astype_bfloat16();
+        weight = Tensor<float32>();
+        weight_f16 = Tensor<fp16>();
+    }
+    else {
+        fprintf(stderr, "File op.cpp, line %d. Unsupported weight dtype: %s\n", __LINE__, dtype.c_str());
+        exit(-1);
+    }
+}
+
+static Tensor<float32> load_weight(const std::string &dtype, Tensor<float32> &weight,
+                                   Tensor<fp16> &weight_f16, Tensor<bf16> &weight_bf16)
+{
+    /*
+     * 取出float32的权重。float32存储时直接返回(共享数据空间)，半精度存储时转换得到新张量
+     */
+    if(dtype == "float16") {
+        return weight_f16.astype_float32();
+    }
+    if(dtype == "bfloat16") {
+        return weight_bf16.astype_float32();
+    }
+    return weight;
+}
+
+static Tensor_shape weight_shape(const std::string &dtype, const Tensor<float32> &weight,
+                                 const Tensor<fp16> &weight_f16, const Tensor<bf16> &weight_bf16)
+{
+    /*
+     * 按dtype取出当前存储的权重的尺寸
+     */
+    if(dtype == "float16") {
+        return weight_f16.size;
+    }
+    if(dtype == "bfloat16") {
+        return weight_bf16.size;
+    }
+    return weight.size;
+}
+
 Input::Input(const std::vector <std::string>& parameters)
 {
     /*
@@ -113,7 +172,7 @@ void Relu::forward(Tensor<float32> *input, Tensor<float32> *output) {
     /*
      * Relu算子的forward
      */
-    *output = F::relu(input);
+    F::relu(input, *output);
 }
 
 void Relu::print() {
@@ -229,42 +288,17 @@ Conv2d::Conv2d(const std::vector<std::string> &parameters,
             }
         }
     }
-    // 读取 weight
-    int ret;
-    weight = Tensor<float32>(std::vector<int>{output_channel, input_channel, kernel_size[0], kernel_size[1]});
-    FILE * weight_file = fopen(weight_path.c_str(), "rb");
-    if(weight_file == nullptr) {
-        fprintf(stderr, "file op.cpp line %d: Open file %s failed\n", 
-                __LINE__, weight_path.c_str());
-        exit(-1);
-    }
-    ret = fread(weight.data, sizeof(float), output_channel*input_channel*kernel_size[0]*kernel_size[1], weight_file);
-    if(ret != output_channel*input_channel*kernel_size[0]*kernel_size[1]) {
-        fprintf(stderr, "file op.cpp line %d: Read length error when read file %s. Expected %d, Got %d\n", 
-                __LINE__, weight_path.c_str(), output_channel*input_channel*kernel_size[0]*kernel_size[1], ret);
-        exit(-1);
-    }
-    fclose(weight_file);
+    // 读取 weight(只读映射权重文件，见tensor_load_file)
+    weight = tensor_load_file<float32>(weight_path,
+                                       Tensor_shape{output_channel, input_channel, kernel_size[0], kernel_size[1]});
+    weight_dtype = "float32";
     // 读取 bias
     if(bias_path == "None") {
         bias = Tensor<float32>(std::vector<int>{output_channel});
         bias.set_zero();
     }
     else {
-        bias = Tensor<float32>(std::vector<int>{output_channel});
-        FILE * bias_file = fopen(bias_path.c_str(), "rb");
-        if(bias_file == nullptr) {
-            fprintf(stderr, "file op.cpp, line %d: Open file %s failed\n", 
-                    __LINE__, bias_path.c_str());
-            exit(-1);
-        }
-        ret = fread(bias.data, sizeof(float), output_channel, bias_file);
-        if(ret != output_channel) {
-            fprintf(stderr, "file op.cpp line %d: Read length error when read file %s. Expected %d, Got %d\n",
-                    __LINE__, bias_path.c_str(), output_channel, ret);
-            exit(-1);
-        }
-        fclose(bias_file);
+        bias = tensor_load_file<float32>(bias_path, Tensor_shape{output_channel});
     }
     // 设置output_shape
     /*
@@ -296,7 +330,42 @@ void Conv2d::forward(Tensor<float32> *input, Tensor<float32> *output) {
     /*
      * Conv2d算子的forward
      */
-    *output = F::conv2d(input, &weight, &bias, stride, padding, dilation);
+    if(weight_dtype == "float16") {
+        F::conv2d(input, *output, &weight_f16, &bias, stride, padding, dilation);
+    }
+    else if(weight_dtype == "bfloat16") {
+        F::conv2d(input, *output, &weight_bf16, &bias, stride, padding, dilation);
+    }
+    else {
+        F::conv2d(input, *output, &weight, &bias, stride, padding, dilation);
+    }
+}
+
+Tensor<float32> Conv2d::get_weight() {
+    /*
+     * float32的weight。半精度存储时转换得到新张量，修改它不影响算子，需要用set_weight写回
+     */
+    return load_weight(weight_dtype, weight, weight_f16, weight_bf16);
+}
+
+Tensor_shape Conv2d::get_weight_shape() {
+    return weight_shape(weight_dtype, weight, weight_f16, weight_bf16);
+}
+
+void Conv2d::set_weight(const Tensor<float32> &new_weight) {
+    /*
+     * 按weight_dtype存储new_weight
+     */
+    store_weight(new_weight, weight_dtype, weight, weight_f16, weight_bf16);
+}
+
+void Conv2d::set_weight_dtype(const std::string &dtype) {
+    /*
+     * 改变weight的存储类型(float32, float16, bfloat16)。由半精度改为其他类型时，使用的是已经舍入过的值
+     */
+    Tensor<float32> current = get_weight();
+    weight_dtype = dtype;
+    store_weight(current, weight_dtype, weight, weight_f16, weight_bf16);
 }
 
 Conv2d::~Conv2d() = default;
@@ -387,7 +456,7 @@ void Maxpool2d::forward(Tensor<float32> *input, Tensor<float32> *output) {
     /*
      * Maxpool2d算子的forward
      */
-    *output = F::maxpool2d(input, kernel_size, stride, padding, dilation);
+    F::maxpool2d(input, *output, kernel_size, stride, padding, dilation);
 }
 
 void Maxpool2d::print() {
@@ -453,7 +522,7 @@ void Flatten::forward(Tensor<float32> *input, Tensor<float32> *output) {
     /*
      * Flatten算子的forward
      */
-    *output = F::flatten(input);
+    F::flatten(input, *output);
 }
 
 void Flatten::print() {
@@ -519,22 +588,9 @@ Dense::Dense(const std::vector<std::string> &parameters,
             this->input_channel = (int)strtol(para_pair[1].c_str(), nullptr, 10);
         }
     }
-    // 读取 weight
-    int ret;
-    weight = Tensor<float32>(std::vector<int>{input_channel, output_channel});
-    FILE * weight_file = fopen(weight_path.c_str(), "rb");
-    if(weight_file == nullptr) {
-        fprintf(stderr, "file op.cpp line %d: Open file %s failed\n", 
-                __LINE__, weight_path.c_str());
-        exit(-1);
-    }
-    ret = fread(weight.data, sizeof(float), output_channel*input_channel, weight_file);
-    if(ret != output_channel * input_channel) {
-        fprintf(stderr, "file op.cpp line %d: Read length error when read file %s. Expected %d, Got %d\n",
-                __LINE__, weight_path.c_str(), output_channel*input_channel, ret);
-        exit(-1);
-    }
-    fclose(weight_file);
+    // 读取 weight(只读映射权重文件，见tensor_load_file)
+    weight = tensor_load_file<float32>(weight_path, Tensor_shape{input_channel, output_channel});
+    weight_dtype = "float32";
 //    weight = weight.transpose(std::vector<int>{1,0});
 //    print_size(weight.size);
     // 读取 bias
@@ -543,20 +599,7 @@ Dense::Dense(const std::vector<std::string> &parameters,
         bias.set_zero();
     }
     else {
-        bias = Tensor<float32>(std::vector<int>{output_channel});
-        FILE * bias_file = fopen(bias_path.c_str(), "rb");
-        if(bias_file == nullptr) {
-            fprintf(stderr, "file op.cpp line %d: Open file %s failed\n", 
-                    __LINE__, bias_path.c_str());
-            exit(-1);
-        }
-        ret = fread(bias.data, sizeof(float), output_channel, bias_file);
-        if(ret != output_channel) {
-            fprintf(stderr, "file op.cpp line %d: Read length error when read file %s. Expected %d, Got %d\n", 
-                    __LINE__, bias_path.c_str(), output_channel, ret);
-            exit(-1);
-        }
-        fclose(bias_file);
+        bias = tensor_load_file<float32>(bias_path, Tensor_shape{output_channel});
     }
     // 设置output_shape
     /*
@@ -571,7 +614,42 @@ void Dense::forward(Tensor<float32> *input, Tensor<float32> *output) {
     /*
      * Dense算子的forward
      */
-    *output = F::dense(input, &weight, &bias);
+    if(weight_dtype == "float16") {
+        F::dense(input, *output, &weight_f16, &bias);
+    }
+    else if(weight_dtype == "bfloat16") {
+        F::dense(input, *output, &weight_bf16, &bias);
+    }
+    else {
+        F::dense(input, *output, &weight, &bias);
+    }
+}
+
+Tensor<float32> Dense::get_weight() {
+    /*
+     * float32的weight。半精度存储时转换得到新张量，修改它不影响算子，需要用set_weight写回
+     */
+    return load_weight(weight_dtype, weight, weight_f16, weight_bf16);
+}
+
+Tensor_shape Dense::get_weight_shape() {
+    return weight_shape(weight_dtype, weight, weight_f16, weight_bf16);
+}
+
+void Dense::set_weight(const Tensor<float32> &new_weight) {
+    /*
+     * 按weight_dtype存储new_weight
+     */
+    store_weight(new_weight, weight_dtype, weight, weight_f16, weight_bf16);
+}
+
+void Dense::set_weight_dtype(const std::string &dtype) {
+    /*
+     * 改变weight的存储类型(float32, float16, bfloat16)。由半精度改为其他类型时，使用的是已经舍入过的值
+     */
+    Tensor<float32> current = get_weight();
+    weight_dtype = dtype;
+    store_weight(current, weight_dtype, weight, weight_f16, weight_bf16);
 }
 
 void Dense::print() {
@@ -606,8 +684,9 @@ void Dense::save(const std::string &path, int number) {
     // 存储weight bias
     sprintf(save_weight_path, "%sdense_%d_weight.bin", path.c_str(), number);
     sprintf(save_bias_path, "%sdense_%d_bias.bin", path.c_str(), number);
+    Tensor<float32> save_weight = get_weight();
     FILE * wf = fopen(save_weight_path, "wb");
-    fwrite(weight.data, sizeof(float32), weight.len(), wf);
+    fwrite(save_weight.data, sizeof(float32), save_weight.len(), wf);
     fclose(wf);
     FILE * bf = fopen(save_bias_path, "wb");
     fwrite(bias.data, sizeof(float32), bias.len(), bf);
@@ -639,7 +718,7 @@ void Output::forward(Tensor<float32> *input, Tensor<float32> *output) {
     /*
      * Output算子forward
      */
-    *output = (*input).deep_copy();
+    F::copy(input, *output);
 }
 
 void Output::print() {
@@ -711,7 +790,7 @@ void Add::forward(Tensor<float32> *input1, Tensor<float32> *input2, Tensor<float
     /*
      * Add算子forward
      */
-    *output = F::add(input1, input2);
+    F::add(input1, input2, *output);
 }
 
 void Add::print() {
@@ -797,7 +876,7 @@ void Concat::forward(Tensor<float32> *input1, Tensor<float32> *input2, Tensor<fl
     /*
      * concat算子forward
      */
-    *output = F::concat(input1, input2, dim);
+    F::concat(input1, input2, *output, dim);
 }
 
 void Concat::print() {
@@ -886,69 +965,20 @@ Batch_Norm2d::Batch_Norm2d(const std::vector<std::string> &parameters,
             this->running_var_path = model_dir + (std::string)para_pair[1];
         }
     }
-    // 读取weight
-    int ret;
-    weight = Tensor<float32>{std::vector<int>{num_features}};
-    FILE * weight_file = fopen(weight_path.c_str(), "rb");
-    if(weight_file == nullptr) {
-        fprintf(stderr, "file op.cpp line %d: Open file %s failed\n", __LINE__, weight_path.c_str());
-        exit(-1);
-    }
-    ret = fread(weight.data, sizeof(float), num_features, weight_file);
-    if(ret != num_features) {
-        fprintf(stderr, "file op.cpp line %d. Read length error when read %s. Expected %d, Got %d\n", 
-                __LINE__, weight_path.c_str(), num_features, ret);
-        exit(-1);
-    }
-    fclose(weight_file);
+    // 读取weight(只读映射权重文件，见tensor_load_file)
+    weight = tensor_load_file<float32>(weight_path, Tensor_shape{num_features});
     // 读取bias
     if(bias_path == "None") {
         bias = Tensor<float32>{std::vector<int>{num_features}};
         bias.set_zero();
     }
     else {
-        bias = Tensor<float32>{std::vector<int>{num_features}};
-        FILE * bias_file = fopen(bias_path.c_str(), "rb");
-        if(bias_file == nullptr) {
-            fprintf(stderr, "file op.cpp line %d: Open file %s failed\n", __LINE__, bias_path.c_str());
-            exit(-1);
-        }
-        ret = fread(bias.data, sizeof(float), num_features, bias_file);
-        if(ret != num_features) {
-            fprintf(stderr, "file op.cpp line %d. Read length error when read %s. Expected %d, Got %d\n", 
-                    __LINE__, bias_path.c_str(), num_features, ret);
-            exit(-1);
-        }
-        fclose(bias_file);
+        bias = tensor_load_file<float32>(bias_path, Tensor_shape{num_features});
     }
     // 读取running_mean
-    running_mean = Tensor<float32>{std::vector<int>{num_features}};
-    FILE * running_mean_file = fopen(running_mean_path.c_str(), "rb");
-    if(running_mean_file == nullptr) {
-        fprintf(stderr, "file op.cpp line %d: Open file %s failed\n", __LINE__, running_mean_path.c_str());
-        exit(-1);
-    }
-    ret = fread(running_mean.data, sizeof(float), num_features, running_mean_file);
-    if(ret != num_features) {
-        fprintf(stderr, "file op.cpp line %d. Read length error when read %s. Expected %d, Got %d\n", 
-                    __LINE__, running_mean_path.c_str(), num_features, ret);
-        exit(-1);
-    }
-    fclose(running_mean_file);
+    running_mean = tensor_load_file<float32>(running_mean_path, Tensor_shape{num_features});
     // 读取running_var
-    running_var = Tensor<float32>{std::vector<int>{num_features}};
-    FILE * running_var_file = fopen(running_var_path.c_str(), "rb");
-    if(running_var_file == nullptr) {
-        fprintf(stderr, "file op.cpp line %d: Open file %s failed\n", __LINE__, running_var_path.c_str());
-        exit(-1);
-    }
-    ret = fread(running_var.data, sizeof(float), num_features, running_var_file);
-    if(ret != num_features) {
-        fprintf(stderr, "file op.cpp line %d. Read length error when read %s. Expected %d, Got %d\n", 
-                    __LINE__, running_var_path.c_str(), num_features, ret);
-        exit(-1);
-    }
-    fclose(running_var_file);
+    running_var = tensor_load_file<float32>(running_var_path, Tensor_shape{num_features});
     // 设置output_shape
     this->output_shape = output_shape_list[input_node];
 }
@@ -958,7 +988,7 @@ void Batch_Norm2d::forward(Tensor<float32> *input, Tensor<float32> *output) {
      * TODO: bn2d forward
      */
     // 调用Functional
-    *output = F::batch_norm2d(input, &running_mean, &running_var, &weight, &bias, eps);
+    F::batch_norm2d(input, *output, &running_mean, &running_var, &weight, &bias, eps);
 }
 
 void Batch_Norm2d::print() {
@@ -1027,8 +1057,9 @@ void Conv2d::save(const std::string &path, int number) {
     // 存储weight bias
     sprintf(save_weight_path, "%sconv2d_%d_weight.bin", path.c_str(), number);
     sprintf(save_bias_path, "%sconv2d_%d_bias.bin", path.c_str(), number);
+    Tensor<float32> save_weight = get_weight();
     FILE * wf = fopen(save_weight_path, "wb");
-    fwrite(weight.data, sizeof(float32), weight.len(), wf);
+    fwrite(save_weight.data, sizeof(float32), save_weight.len(), wf);
     fclose(wf);
     FILE * bf = fopen(save_bias_path, "wb");
     fwrite(bias.data, sizeof(float32), bias.len(), bf);
@@ -1063,7 +1094,7 @@ void Dropout::forward(Tensor<float32> *input, Tensor<float32> *output)
     /*
      * Dropout的forward
      */
-    *output = F::dropout(input, p);
+    F::dropout(input, *output, p);
 }
 
 void Dropout::print()
@@ -1168,7 +1199,7 @@ void Avgpool2d::forward(Tensor<float32> *input, Tensor<float32> *output) {
     /*
      * Avgpool2d的forward
      */
-    *output = F::avgpool2d(input, kernel_size, stride, padding);
+    F::avgpool2d(input, *output, kernel_size, stride, padding);
 }
 
 void Avgpool2d::print() {
@@ -1208,7 +1239,7 @@ QConv2d::QConv2d(Conv2d *op) {
      * 因此使用conv2d算子进行构建。其他量化算子与此类似
      */
     input_node = op->input_node;
-    weight = Tensor<int8>{op->weight.size};
+    weight = Tensor<int8>{op->get_weight_shape()};
     bias = Tensor<int32>{op->bias.size};
     output_channel = op->output_channel;
     input_channel = op->input_channel;
@@ -1245,8 +1276,8 @@ void QConv2d::forward(Tensor<uint8> *input, Tensor<uint8> *output) {
     /*
      * QConv2d前向传播函数
      */
-    *output = F::qconv2d(input, zero_x, zero_w, zero_b, zero_y, coe, rshift, qmin, qmax,
-                         &weight, &bias, stride, padding, dilation);
+    F::qconv2d(input, *output, zero_x, zero_w, zero_b, zero_y, coe, rshift, qmin, qmax,
+               &weight, &bias, stride, padding, dilation);
 }
 
 void QConv2d::save(const std::string &path, int number) {
@@ -1378,7 +1409,7 @@ void QMaxpool2d::forward(Tensor<uint8> *input, Tensor<uint8> *output) {
     /*
      * QMaxpool2d前向传播韩函数
      */
-    *output = F::qmaxpool2d(input, zero, kernel_size, stride, padding, dilation);
+    F::qmaxpool2d(input, *output, zero, kernel_size, stride, padding, dilation);
 }
 
 void QMaxpool2d::save(const std::string &path, int number) {
@@ -1430,7 +1461,7 @@ void QRelu::forward(Tensor<uint8> *input, Tensor<uint8> *output) {
     /*
      * QRelu前向传播函数
      */
-    *output = F::qrelu(input, zero, qmax);
+    F::qrelu(input, *output, zero, qmax);
 }
 
 void QRelu::save(const std::string &path, int number) {
@@ -1477,7 +1508,7 @@ void QFlatten::forward(Tensor<uint8> *input, Tensor<uint8> *output) {
     /*
      * QFlatten前向传播函数
      */
-    *output = F::qflatten(input);
+    F::qflatten(input, *output);
 }
 
 void QFlatten::save(const std::string &path, int number) {
@@ -1500,7 +1531,7 @@ QDense::QDense(Dense *op) {
      * 创建QDense算子
      */
     input_node = op->input_node;
-    weight = Tensor<int8>{op->weight.size};
+    weight = Tensor<int8>{op->get_weight_shape()};
     bias = Tensor<int32>{op->bias.size};
     output_channel = op->output_channel;
     input_channel = op->input_channel;
@@ -1530,8 +1561,8 @@ void QDense::forward(Tensor<uint8> *input, Tensor<uint8> *output) {
     /*
      * QDense前向传播函数
      */
-    *output = F::qdense(input, zero_x, zero_w, zero_b, zero_y, coe, rshift, qmin, qmax,
-                        &weight, &bias);
+    F::qdense(input, *output, zero_x, zero_w, zero_b, zero_y, coe, rshift, qmin, qmax,
+              &weight, &bias);
 }
 
 void QDense::save(const std::string &path, int number) {
@@ -1655,7 +1686,7 @@ void QOutput::forward(Tensor<uint8> *input, Tensor<uint8> *output) {
     /*
      * QOutput前向传播函数
      */
-    *output = (*input).deep_copy();
+    F::qcopy(input, *output);
 }
 
 void QOutput::save(const std::string &path, int number) {
@@ -1717,7 +1748,7 @@ void QAdd::forward(Tensor<uint8> *input1, Tensor<uint8> *input2, Tensor<uint8> *
     /*
      * QAdd前向传播函数
      */
-    *output = F::qadd(input1, input2, zero_x1, zero_x2, zero_y, coe1, coe2, rshift1, rshift2, qmin, qmax);
+    F::qadd(input1, input2, *output, zero_x1, zero_x2, zero_y, coe1, coe2, rshift1, rshift2, qmin, qmax);
 }
 
 void QAdd::save(const std::string &path, int number) {
@@ -1785,7 +1816,7 @@ void QConcat::forward(Tensor<uint8> *input1, Tensor<uint8> *input2, Tensor<uint8
     /*
      * QConcat前向传播函数
      */
-    *output = F::qconcat(input1, input2, zero_x1, zero_x2, zero_y, coe1, coe2, rshift1, rshift2, qmin, qmax, dim);
+    F::qconcat(input1, input2, *output, zero_x1, zero_x2, zero_y, coe1, coe2, rshift1, rshift2, qmin, qmax, dim);
 }
 
 void QConcat::save(const std::string &path, int number) {
@@ -1843,7 +1874,7 @@ void QAvgpool2d::forward(Tensor<uint8> *input, Tensor<uint8> *output) {
     /*
      * QAvgpool2d前向传播韩函数
      */
-    *output = F::qavgpool2d(input, zero, kernel_size, stride, padding);
+    F::qavgpool2d(input, *output, zero, kernel_size, stride, padding);
 }
 
 void QAvgpool2d::save(const std::string &path, int number) {
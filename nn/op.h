@@ -52,6 +52,7 @@
  * 8. Graph::fuse_op()      2处
  * 9. Graph::forward()
  * 10. Graph::quantization()     5处
+ * 11. node.cpp  get_op_name()
  */
 
 #define OPN_INPUT                   1
@@ -120,7 +121,10 @@ class Conv2d {
 public:
     int input_node;                     // 输入节点编号
     std::string weight_path;            // weight file path
-    Tensor<float32> weight;            // weight
+    Tensor<float32> weight;            // weight(weight_dtype为float32时)
+    std::string weight_dtype;           // weight的存储类型：float32, float16, bfloat16
+    Tensor<fp16> weight_f16;            // weight(weight_dtype为float16时)
+    Tensor<bf16> weight_bf16;           // weight(weight_dtype为bfloat16时)
     std::string bias_path;              // bias file path
     Tensor<float32> bias;              // bias
     int output_channel;
@@ -135,6 +139,10 @@ public:
            const std::string& model_dir);       // constructor
     ~Conv2d();
     void forward(Tensor<float32> *input, Tensor<float32> *output);
+    Tensor<float32> get_weight();                       // float32的weight(半精度存储时转换得到)
+    Tensor_shape get_weight_shape();                    // weight的尺寸(不转换)
+    void set_weight(const Tensor<float32> &new_weight); // 按weight_dtype存储weight
+    void set_weight_dtype(const std::string &dtype);    // 改变weight的存储类型
     void print();
     void save(const std::string &path, int number);
 };
@@ -250,7 +258,10 @@ class Dense {
 public:
     int input_node;                     // 输入节点编号
     std::string weight_path;
-    Tensor<float32> weight;
+    Tensor<float32> weight;             // weight(weight_dtype为float32时)
+    std::string weight_dtype;           // weight的存储类型：float32, float16, bfloat16
+    Tensor<fp16> weight_f16;            // weight(weight_dtype为float16时)
+    Tensor<bf16> weight_bf16;           // weight(weight_dtype为bfloat16时)
     std::string bias_path;
     Tensor<float32> bias;
     int output_channel;
@@ -261,6 +272,10 @@ public:
           const std::string& model_dir);     // constructor
     ~Dense();
     void forward(Tensor<float32> *input, Tensor<float32> *output);
+    Tensor<float32> get_weight();                       // float32的weight(半精度存储时转换得到)
+    Tensor_shape get_weight_shape();                    // weight的尺寸(不转换)
+    void set_weight(const Tensor<float32> &new_weight); // 按weight_dtype存储weight
+    void set_weight_dtype(const std::string &dtype);    // 改变weight的存储类型
     void print();
     void save(const std::string &path, int number);
 };
@@ -78,8 +78,8 @@ void quant(Tensor<int8> &dst, Tensor<float32> &src, float scale, int zero, int q
         fprintf(stderr, "File quant_tools.cpp, line %d. Size of dst and src should be the same\n", __LINE__);
         exit(-1);
     }
-    int len = src.len();
-    for(int i = 0; i<len; i++) {
+    int64_t len = src.len();
+    for(int64_t i = 0; i<len; i++) {
         dst.data[i] = clip((int)std::round(src.data[i] / scale + (float)zero), qmin, qmax);
     }
 }
@@ -105,8 +105,8 @@ void quant(Tensor<int32> &dst, Tensor<float32> &src, float scale, int zero, int
         fprintf(stderr, "File quant_tools.cpp, line %d. Size of dst and src should be the same\n", __LINE__);
         exit(-1);
     }
-    int len = src.len();
-    for(int i = 0; i<len; i++) {
+    int64_t len = src.len();
+    for(int64_t i = 0; i<len; i++) {
         dst.data[i] = clip((int)std::round(src.data[i] / scale + (float)zero), qmin, qmax);
     }
 }
@@ -0,0 +1,189 @@
+#include "scheduler.h"
+
+#include <cstdio>
+#include <atomic>
+#include <map>
+#include <algorithm>
+
+#include "util.h"
+
+
+static std::atomic<int> scheduler_mode(GRAPH_SCHEDULER_SERIAL);
+
+
+void set_graph_scheduler(int scheduler)
+{
+    scheduler_mode.store(scheduler, std::memory_order_relaxed);
+}
+
+int graph_scheduler()
+{
+    return scheduler_mode.load(std::memory_order_relaxed);
+}
+
+
+Graph_scheduler::Graph_scheduler(): width(1), executors(nullptr), n_done(0), mode(GRAPH_SCHEDULER_SERIAL),
+    n_forward(0), wall_us(0), work_us(0), critical_us(0)
+{
+}
+
+Graph_scheduler::~Graph_scheduler()
+{
+    delete executors;
+}
+
+void Graph_scheduler::build(const std::vector<Node*> &node_list)
+{
+    /*
+     * 由各节点的输入节点编号建立依赖关系，并按深度分层计算图的宽度
+     */
+    nodes = node_list;
+    int n = (int)nodes.size();
+    std::map<int, int> index;                   // 节点编号 -> 在nodes中的下标
+    for(int i = 0; i<n; i++) {
+        index[nodes[i]->number] = i;
+    }
+    producers.assign(n, std::vector<int>());
+    consumers.assign(n, std::vector<int>());
+    std::vector<int> depth(n, 0);
+    for(int i = 0; i<n; i++) {
+        for(int number: nodes[i]->get_input_nodes()) {
+            auto it = index.find(number);
+            if(it == index.end() || it->second >= i) {
+                fprintf(stderr, "File: scheduler.cpp, line: %d. Node %%%d has invalid input node %%%d\n",
+                        __LINE__, nodes[i]->number, number);
+                exit(-1);
+            }
+            producers[i].push_back(it->second);
+            consumers[it->second].push_back(i);
+            depth[i] = std::max(depth[i], depth[it->second] + 1);
+        }
+    }
+    std::vector<int> level_size(n + 1, 0);
+    width = 1;
+    for(int i = 0; i<n; i++) {
+        width = std::max(width, ++level_size[depth[i]]);
+    }
+    width = std::min(width, get_thread_pool()->size());
+    delete executors;
+    executors = width > 1 ? new Thread_pool(width) : nullptr;
+    waiting.assign(n, 0);
+    cost.assign(n, 0);
+    finish.assign(n, 0);
+}
+
+void Graph_scheduler::run_node(int i, const std::vector<void*> &intermediate_results, void * input)
+{
+    unsigned long long start_time = get_micro_sec_time();
+    nodes[i]->forward(intermediate_results, input);
+    cost[i] = get_micro_sec_time() - start_time;
+}
+
+void Graph_scheduler::execute(const std::vector<void*> &intermediate_results, void * input)
+{
+    /*
+     * 一个执行线程：从就绪队列中取节点执行，直到所有节点都完成
+     * 就绪队列为空但还有节点未完成时，等待其他执行线程完成节点
+     */
+    int n = (int)nodes.size();
+    while(true) {
+        int i;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this, n] { return !ready.empty() || n_done == n; });
+            if(ready.empty()) {
+                return;
+            }
+            auto first = std::min_element(ready.begin(), ready.end());   // 按node_list中的顺序优先
+            i = *first;
+            ready.erase(first);
+        }
+        run_node(i, intermediate_results, input);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            n_done++;
+            for(int c: consumers[i]) {
+                if(--waiting[c] == 0) {
+                    ready.push_back(c);
+                }
+            }
+        }
+        wake.notify_all();
+    }
+}
+
+void Graph_scheduler::run_dag(const std::vector<void*> &intermediate_results, void * input)
+{
+    /*
+     * 就绪的节点由执行线程同时执行
+     */
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.clear();
+        for(int i = 0; i<(int)nodes.size(); i++) {
+            waiting[i] = (int)producers[i].size();
+            if(waiting[i] == 0) {
+                ready.push_back(i);
+            }
+        }
+        n_done = 0;
+    }
+    // 每个执行线程处理[0, width)中的一个下标，即运行一个execute循环
+    auto task = [&](int64_t from, int64_t to) {
+        for(int64_t k = from; k<to; k++) {
+            execute(intermediate_results, input);
+        }
+    };
+    executors->run(0, width, 1, parallel_for_task<decltype(task)>, (void*)&task);
+}
+
+void Graph_scheduler::forward(const std::vector<Node*> &node_list, const std::vector<void*> &intermediate_results,
+                              void * input)
+{
+    /*
+     * 按当前的调度方式执行所有节点，并统计耗时和关键路径
+     */
+    if(node_list != nodes) {
+        build(node_list);
+    }
+    mode = graph_scheduler();
+    unsigned long long start_time = get_micro_sec_time();
+    if(mode == GRAPH_SCHEDULER_DAG && executors != nullptr) {
+        run_dag(intermediate_results, input);
+    }
+    else {
+        for(int i = 0; i<(int)nodes.size(); i++) {
+            run_node(i, intermediate_results, input);
+        }
+    }
+    wall_us += get_micro_sec_time() - start_time;
+    // 关键路径：node_list的顺序是拓扑序，按顺序累加
+    unsigned long long critical = 0;
+    for(int i = 0; i<(int)nodes.size(); i++) {
+        unsigned long long start = 0;
+        for(int p: producers[i]) {
+            start = std::max(start, finish[p]);
+        }
+        finish[i] = start + cost[i];
+        critical = std::max(critical, finish[i]);
+        work_us += cost[i];
+    }
+    critical_us += critical;
+    n_forward++;
+}
+
+void Graph_scheduler::print_report(const char * name)
+{
+    /*
+     * 打印统计：forward次数、墙钟时间、节点耗时之和、关键路径耗时，以及节点耗时/关键路径(dag调度的加速上限)
+     */
+    printf("Scheduler [%s]: %s, width: %d, forwards: %llu, wall: %.2f ms, node time: %.2f ms, "
+           "critical path: %.2f ms, max speedup: %.2fx\n",
+           name, mode == GRAPH_SCHEDULER_DAG ? "dag" : "serial", width, n_forward,
+           (double)wall_us / 1e3, (double)work_us / 1e3, (double)critical_us / 1e3,
+           critical_us == 0 ? 1.0 : (double)work_us / (double)critical_us);
+    n_forward = 0;
+    wall_us = 0;
+    work_us = 0;
+    critical_us = 0;
+}
@@ -0,0 +1,79 @@
+#ifndef QUANT_SCHEDULER_H
+#define QUANT_SCHEDULER_H
+
+/*
+ * 计算图的节点调度
+ * 设计思路：
+ * Graph::forward原来严格按node_list的顺序逐个执行节点。有add/concat的计算图(残差网络的shortcut等)中，
+ * 不同分支的节点互不依赖，可以同时执行。
+ * 1. 由各节点的输入节点编号(Node::get_input_nodes)建立依赖关系图(DAG)。node_list中输入节点总在前面，
+ *    因此node_list的顺序就是一个拓扑序。节点列表改变(fuse_op等)后，下一次forward时重建
+ * 2. serial：按node_list的顺序执行(原来的方式)
+ *    dag：就绪(输入节点都已完成)的节点可以同时执行。由一组执行线程(单独的Thread_pool，线程数为图的宽度，
+ *    即按深度分层后最宽一层的节点数，不超过共享线程池的线程数)从就绪队列中取节点执行，
+ *    节点完成后把后继中输入都已完成的节点加入就绪队列。就绪的节点按node_list中的顺序优先执行。
+ *    节点内的内核照常使用共享线程池(parallel_for)，多个节点的内核任务在共享线程池中同时执行
+ *    图的宽度为1(链式结构，如mnist的卷积网络)时直接按顺序执行
+ * 3. 两种方式都记录每个节点的耗时，每次forward后沿DAG求关键路径(耗时最长的一条依赖链)。
+ *    print_report打印累计的墙钟时间、节点总耗时和关键路径耗时：节点总耗时/关键路径是dag调度可能达到的最大加速比
+ * 节点之间只通过intermediate_results中各自的输出张量交换数据，算子的临时缓冲区是每个线程独立的，
+ * 因此不同节点可以在不同线程中同时执行
+ */
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+#include "node.h"
+#include "tensor.h"
+
+
+#define GRAPH_SCHEDULER_SERIAL 0            // 按节点列表的顺序执行
+#define GRAPH_SCHEDULER_DAG 1               // 就绪的节点同时执行
+
+
+class Graph_scheduler {
+public:
+    Graph_scheduler();
+    ~Graph_scheduler();
+    Graph_scheduler(const Graph_scheduler &) = delete;
+    Graph_scheduler & operator=(const Graph_scheduler &) = delete;
+
+    // 执行一次前向传播，参数同Node::forward
+    void forward(const std::vector<Node*> &node_list, const std::vector<void*> &intermediate_results, void * input);
+    void print_report(const char * name);   // 打印上一次打印以来的统计，然后清零
+
+private:
+    std::vector<Node*> nodes;                       // 建立依赖关系时的节点列表
+    std::vector<std::vector<int> > producers;       // 各节点的输入节点(在nodes中的下标)
+    std::vector<std::vector<int> > consumers;       // 以各节点为输入的节点
+    int width;                                      // 执行线程数
+    Thread_pool * executors;                        // 执行线程，width大于1时创建
+
+    // 一次dag执行的状态，由mutex保护
+    std::mutex mutex;
+    std::condition_variable wake;                   // 有新的就绪节点或全部完成时通知
+    std::vector<int> waiting;                       // 各节点未完成的输入节点数
+    std::vector<int> ready;                         // 就绪的节点
+    int n_done;                                     // 已完成的节点数
+
+    std::vector<unsigned long long> cost;           // 本次forward各节点的耗时(us)
+    std::vector<unsigned long long> finish;         // 关键路径计算：从输入到各节点完成的最长耗时
+    int mode;                                       // 最近一次forward使用的调度方式
+    unsigned long long n_forward;                   // 统计：forward次数
+    unsigned long long wall_us;                     // 统计：forward的墙钟时间
+    unsigned long long work_us;                     // 统计：节点耗时之和
+    unsigned long long critical_us;                 // 统计：关键路径耗时之和
+
+    void build(const std::vector<Node*> &node_list);
+    void run_node(int i, const std::vector<void*> &intermediate_results, void * input);
+    void run_dag(const std::vector<void*> &intermediate_results, void * input);
+    void execute(const std::vector<void*> &intermediate_results, void * input);
+};
+
+
+void set_graph_scheduler(int scheduler);    // GRAPH_SCHEDULER_SERIAL或GRAPH_SCHEDULER_DAG，默认serial
+int graph_scheduler();
+
+
+#endif //QUANT_SCHEDULER_H
@@ -3,6 +3,8 @@
 #include <cstdio>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <atomic>
 #include <quant_tools.h>
 
 
@@ -11,9 +13,14 @@
 #include "tensor.h"
 #include "preprocess.h"
 #include "util.h"
+#include "benchmark.h"
+#include "thread_budget.h"
+#include "image_loader.h"
 
-void test_accuracy(const std::string &val_set_path, Graph *graph, std::vector<int> infer_shape);
-void test_quant_accuracy(const std::string &val_set_path, Graph *graph, std::vector<int> infer_shape);
+// n_workers: 同时测试的线程数，共享graph的权重
+void test_accuracy(const std::string &val_set_path, Graph *graph, std::vector<int> infer_shape, int n_workers);
+void test_quant_accuracy(const std::string &val_set_path, Graph *graph, std::vector<int> infer_shape, int n_workers);
+Graph * read_graph(std::string model_dir);
 
 System_info * sys_info;
 
@@ -25,12 +32,21 @@ int main(int argc, char *argv[]) {
     sys_info = new System_info();       // 读取一些系统信息
 
     Graph * graph = nullptr;                                        // 计算图
+    std::string model_dir = "";                                     // 模型路径(包含graph.txt和权重)
     std::string calib_set_path = "";                                // calibration set 路径
     std::string method = "per_tensor";                              // 量化方法
     Tensor<uint8>* calib_set = nullptr;                             // calibration set
     Tensor<uint8>* calc_running_img = nullptr;                      // 计算running数据集
     std::string output_dir = "quanted_output";                      // 输出路径
     std::string val_set_path = "";                                  // 测试数据集路径
+    std::string benchmark_name = "";                                // 性能测试名
+    bool tensor_pool = true;                                        // 是否使用张量内存池
+    bool mmap_weights = true;                                       // 是否mmap权重文件
+    bool trace_alloc = false;                                       // 是否统计张量内存分配
+    std::string weight_dtype = "float32";                           // float32计算图中权重的存储类型
+    int n_threads = sys_info->n_proc;                               // 计算线程数
+    bool pin_threads = false;                                       // 是否把计算线程绑定到cpu
+    int eval_workers = 1;                                           // 测试准确率的线程数
 
     for(int i = 1; i<argc; i++) {
         std::string option(argv[i]);    // 从argv读取选项
@@ -42,34 +58,8 @@ int main(int argc, char *argv[]) {
         std::string value(argv[i]);     // 选项值
 
         // 处理选项
-        if(option == "--model_dir") {           // 创建计算图
-            // 保证model_dir最后为'/'
-            if(value[value.size()-1] != '/') {
-                value += "/";
-            }
-            printf("Reading calculation graph...\n");
-            // 将计算图文件里的内容读取到字符串里
-            // 打开计算图文件
-            std::ifstream graph_file;
-            graph_file.open(value+"graph.txt", std::ios::in);
-            if(!graph_file.is_open()) {
-                std::cerr << "graph txt file not found\n";
-                exit(-1);
-            }
-            // 将有信息的行加入graph_content
-            std::string graph_content;
-            std::string graph_line;
-            while(std::getline(graph_file, graph_line)) {
-                graph_line = delete_annotation(graph_line, "#");
-                graph_line = replace(graph_line, " ", "");
-                if(graph_line.empty()) {
-                    continue;
-                }
-                graph_content += graph_line;
-                graph_content.push_back('\n');
-            }
-            graph = new Graph(graph_content, value);
-            printf("Read calculation graph finished\n");
+        if(option == "--model_dir") {           // 读取模型路径，计算图在选项全部读取后创建
+            model_dir = value;
         }
         else if(option == "--calib_set") {  // 读取包含calib set路径的txt文件路径
             calib_set_path = value;
@@ -83,14 +73,74 @@ int main(int argc, char *argv[]) {
         else if(option == "--val_set") {        // 读取测试数据集路径
             val_set_path = value;
         }
+        else if(option == "--benchmark") {      // 读取性能测试名
+            benchmark_name = value;
+        }
+        else if(option == "--tensor_pool") {    // 是否使用张量内存池
+            tensor_pool = string_to_bool(value);
+        }
+        else if(option == "--mmap_weights") {   // 是否mmap权重文件
+            mmap_weights = string_to_bool(value);
+        }
+        else if(option == "--weight_dtype") {   // 权重的存储类型: float32, float16, bfloat16
+            weight_dtype = value;
+        }
+        else if(option == "--threads") {        // OpenBLAS、OpenMP和线程池共用的线程数
+            n_threads = std::stoi(value);
+        }
+        else if(option == "--pin_threads") {    // 是否把计算线程绑定到cpu
+            pin_threads = string_to_bool(value);
+        }
+        else if(option == "--scheduler") {      // 计算图节点的调度方式: serial, dag
+            if(value == "serial") {
+                set_graph_scheduler(GRAPH_SCHEDULER_SERIAL);
+            }
+            else if(value == "dag") {
+                set_graph_scheduler(GRAPH_SCHEDULER_DAG);
+            }
+            else {
+                std::cerr << "Unknown scheduler " << value << ", should be serial or dag\n";
+                exit(-1);
+            }
+        }
+        else if(option == "--eval_workers") {   // 测试准确率时同时推理的线程数，每个线程有自己的中间结果
+            eval_workers = std::stoi(value);
+            if(eval_workers < 1) {
+                std::cerr << "--eval_workers should be at least 1\n";
+                exit(-1);
+            }
+        }
+        else if(option == "--prefetch") {       // 读取图片的流水线预读的图片数，0表示在推理线程中逐张读取
+            set_image_prefetch(std::stoi(value));
+        }
+        else if(option == "--trace_alloc") {    // 是否统计张量内存分配并按阶段打印
+            trace_alloc = string_to_bool(value);
+        }
         else {
             std::cerr << "option " << option << " not allowed\n";
         }
     }
-    if(graph == nullptr) {
+    // 以下选项影响计算图的创建，在选项全部读取后设置，与选项的顺序无关
+    set_tensor_pool_enabled(tensor_pool);
+    set_tensor_mmap_enabled(mmap_weights);
+    set_tensor_trace_enabled(trace_alloc);
+    // OpenBLAS、OpenMP和线程池的线程数(默认为可用cpu数)，选项全部读取后设置一次
+    // 同时推理的线程数：--eval_workers个线程，dag调度时每个线程中还会同时执行多个节点(按线程数计，见thread_budget.h)
+    int n_callers = graph_scheduler() == GRAPH_SCHEDULER_DAG ? 0 : eval_workers;
+    set_thread_budget(n_threads, pin_threads, n_callers);
+    if(benchmark_name != "") {      // 只运行性能测试
+        run_benchmark(benchmark_name);
+        return 0;
+    }
+    if(model_dir == "") {
         fprintf(stderr, "--graph is required\n");
         exit(-1);
     }
+    graph = read_graph(model_dir);
+    graph->set_weight_dtype(weight_dtype);
+    if(tensor_trace_enabled()) {
+        print_tensor_trace("graph load");
+    }
 
     calib_set = get_calib_set(calib_set_path, graph->input_shape);  // 读取 calibration set
     // 目前，计算图已经生成
@@ -98,42 +148,58 @@ int main(int argc, char *argv[]) {
 
     // 数据预处理
     Tensor<float32>* processed_calib_set = preprocess(calib_set);
+    if(tensor_trace_enabled()) {
+        print_tensor_trace("calib set");
+    }
 
     // test original accuracy
     if(val_set_path != "") {
         // unsigned long long start_time, end_time;
         // start_time = get_micro_sec_time();
-        // test_accuracy(val_set_path, graph, graph->input_shape);
+        // test_accuracy(val_set_path, graph, graph->input_shape, eval_workers);
         // end_time = get_micro_sec_time();
         // printf("Test original accuracy cost: %llu us.\n", end_time - start_time);
     }
 
     // fuse operator
     graph->fuse_op();   // 如果计算图中不包含bn，会自动跳过此步骤
+    if(tensor_trace_enabled()) {
+        print_tensor_trace("fuse_op");
+    }
 
     // test fused accuracy
     if(val_set_path != "") {
         // unsigned long long start_time, end_time;
         // start_time = get_micro_sec_time();
-        // test_accuracy(val_set_path, graph, graph->input_shape);    
+        // test_accuracy(val_set_path, graph, graph->input_shape, eval_workers);    
         // end_time = get_micro_sec_time();
         // printf("Test fused accuracy cost: %llu us.\n", end_time - start_time);
     }
 
     // quantization
-    Graph * q_graph = graph->quantization(processed_calib_set);
+    Graph * q_graph = graph->quantization(processed_calib_set);     // 其中校准阶段的统计在quantization中打印
+    if(tensor_trace_enabled()) {
+        print_tensor_trace("quantization");
+    }
     // test quantized accuracy
     if(val_set_path != "") {
         unsigned long long start_time, end_time;
         start_time = get_micro_sec_time();
-        test_quant_accuracy(val_set_path, q_graph, graph->input_shape);    
+        test_quant_accuracy(val_set_path, q_graph, graph->input_shape, eval_workers);    
         end_time = get_micro_sec_time();
         printf("Test quantized accuracy cost: %llu us.\n", end_time - start_time);
+        if(tensor_trace_enabled()) {
+            print_tensor_trace("eval");
+        }
     }
 
     // save quantized model
     q_graph->save(output_dir);
 
+    if(tensor_pool) {
+        print_tensor_pool_stats();
+    }
+
 
     delete(graph);
     delete(calib_set);
@@ -145,174 +211,161 @@ int main(int argc, char *argv[]) {
 }
 
 
-void test_accuracy(const std::string &val_set_path, Graph *graph, std::vector<int> infer_shape) {
-/*
-     * 测试计算图准确率
-     * 只用于分类任务
+Graph * read_graph(std::string model_dir) {
+    /*
+     * 读取model_dir下的graph.txt并创建计算图，权重从model_dir读取
+     */
+    // 保证model_dir最后为'/'
+    if(model_dir[model_dir.size()-1] != '/') {
+        model_dir += "/";
+    }
+    printf("Reading calculation graph...\n");
+    // 将计算图文件里的内容读取到字符串里
+    // 打开计算图文件
+    std::ifstream graph_file;
+    graph_file.open(model_dir+"graph.txt", std::ios::in);
+    if(!graph_file.is_open()) {
+        std::cerr << "graph txt file not found\n";
+        exit(-1);
+    }
+    // 将有信息的行加入graph_content
+    std::string graph_content;
+    std::string graph_line;
+    while(std::getline(graph_file, graph_line)) {
+        graph_line = delete_annotation(graph_line, "#");
+        graph_line = replace(graph_line, " ", "");
+        if(graph_line.empty()) {
+            continue;
+        }
+        graph_content += graph_line;
+        graph_content.push_back('\n');
+    }
+    Graph * graph = new Graph(graph_content, model_dir);
+    printf("Read calculation graph finished\n");
+    return graph;
+}
+
+
+struct Val_image {
+    std::string path;                   // 图片路径
+    int answer;                         // 分类标签
+};
+
+std::vector<Val_image> read_val_set(const std::string &val_set_path) {
+    /*
+     * 读取val set文件：每行为图片路径和分类标签
      */
-    printf("Test accuracy:\n");
-    // 打开val set数据集文件
     std::ifstream file;
     file.open(val_set_path, std::ios::in);
     if(!file.is_open()) {
         std::cerr << "val set txt file not found\n";
         exit(-1);
     }
-    // 遍历文件里的每一行
-    int top1_correct = 0;
-    int top5_correct = 0;
-    int total = 0;
+    std::vector<Val_image> val_set;
     std::string line;
-    graph->alloc_intermediate_results();    // 为中间结果分配内存
     while(std::getline(file, line)) {
         // 将行分为图片路径和分类标签
         std::vector<std::string> line_split = split(line, " ");
-        std::string img_path = line_split[0];
-        int answer = (int)strtol(line_split[1].c_str(), nullptr, 10);
-        // 将img读入Tensor
-        cv::Mat img;
-        cv::Mat dst;
-        if(infer_shape[1] == 1) {
-            img = cv::imread(img_path, cv::IMREAD_GRAYSCALE);
-        }
-        else if(infer_shape[1] == 3) {
-            img = cv::imread(img_path, cv::IMREAD_COLOR);
-        }
-        // Resize
-        cv::resize(img, dst, cv::Size(infer_shape[3], infer_shape[2]), 0, 0, cv::INTER_LINEAR);
-        // 存储resized图片到Tensor
-        Tensor<uint8> bgr_hwc_img(std::vector<int>{infer_shape[2], infer_shape[3], infer_shape[1]});
-        memcpy(bgr_hwc_img.data, dst.data, sizeof(unsigned char)*infer_shape[2]*infer_shape[3]*infer_shape[1]);
-        // hwc to chw
-        Tensor<uint8> bgr_chw_img = bgr_hwc_img.transpose(std::vector<int>{2, 0, 1});
-        // bgr to rgb
-        Tensor<uint8> rgb_chw_img(bgr_chw_img.shape());
-        if(infer_shape[1] == 3) {
-            rgb_chw_img[0] = bgr_chw_img[2];
-            rgb_chw_img[1] = bgr_chw_img[1];
-            rgb_chw_img[2] = bgr_chw_img[0];
-        }
-        else {
-            rgb_chw_img[0] = bgr_chw_img[0];
-        }
-        rgb_chw_img = rgb_chw_img.reshape(std::vector<int>{1, rgb_chw_img.size[0], rgb_chw_img.size[1], rgb_chw_img.size[2]});
-        // 根据graph类型进行数据预处理
-        void * processed_input = nullptr;
-        if(graph->node_list[0]->dtype == "uint8") {
-            processed_input = &rgb_chw_img;
-        }
-        else {
-            processed_input = preprocess(&rgb_chw_img);
-        }
-        // 调用graph->forward
-        // 不需要释放result_vector中的结果, 应为它们是指向graph中intermediate_results里空间的指针，在forward返回时不会分配新空间
-        std::vector<void*> result_vector = graph->forward(processed_input);
-        // 释放processed_input
-        if(graph->node_list[0]->dtype == "uint8") {
-            delete((Tensor<uint8>*)processed_input);
-        }
-        else {
-            delete((Tensor<float32>*)processed_input);
+        val_set.push_back(Val_image{line_split[0], (int)strtol(line_split[1].c_str(), nullptr, 10)});
+    }
+    return val_set;
+}
+
+template<typename T>
+void evaluate(const std::vector<Val_image> &val_set, Graph *graph, const std::vector<int> &infer_shape,
+            int n_workers) {
+    /*
+     * 测试计算图准确率，T为输出节点的类型
+     * n_workers个线程共享graph(权重只有一份)，每个线程使用自己的Execution_context(中间结果)。
+     * 图片的读取和resize由Image_loader的流水线完成(每级n_workers个线程，见image_loader.h)，
+     * 线程从loader依次取出下一张图片，预处理后直接写入自己上下文中Input节点的中间结果，进行forward，
+     * 结果累加到原子计数器上(不加锁)
+     * 每个线程的forward中的内核仍使用共享线程池(见thread_pool.h)，总线程数由--threads决定
+     * n_workers为1时推理在调用线程中执行
+     */
+    std::vector<Execution_context*> contexts;
+    for(int k = 0; k<n_workers; k++) {
+        contexts.push_back(new Execution_context(*graph));     // 为中间结果分配内存
+    }
+    std::vector<std::string> img_paths;
+    for(const Val_image &val_image: val_set) {
+        img_paths.push_back(val_image.path);
+    }
+    // 根据graph类型进行数据预处理
+    bool quant_input = graph->node_list[0]->dtype == "uint8";
+    unsigned long long start_time = get_micro_sec_time();
+    Image_loader loader(img_paths, infer_shape, quant_input ? IMAGE_LOADER_QPREPROCESS : IMAGE_LOADER_PREPROCESS,
+                        n_workers);
+    std::atomic<int> top1_correct(0);
+    std::atomic<int> top5_correct(0);
+    std::atomic<int> total(0);
+    auto worker = [&](int k) {
+        // 图片直接写入Input节点预先申请的中间结果，再把它作为forward的输入
+        void * input = contexts[k]->input_result();
+        void * input_data = quant_input ? (void*)((Tensor<uint8>*)input)->data : (void*)((Tensor<float32>*)input)->data;
+        int i;
+        while(loader.next(i, input_data)) {
+            // 调用graph->forward
+            // 不需要释放result_vector中的结果, 应为它们是指向context中intermediate_results里空间的指针，在forward返回时不会分配新空间
+            std::vector<void*> result_vector = graph->forward(*contexts[k], input);
+            int result = ((Tensor<T>*)(result_vector[0]))->argmax();
+            if(result == val_set[i].answer) {
+                top1_correct.fetch_add(1, std::memory_order_relaxed);
+            }
+            Tensor<int> top5 = ((Tensor<T>*)(result_vector[0]))->topK(5);
+            if(top5.has(val_set[i].answer)) {
+                top5_correct.fetch_add(1, std::memory_order_relaxed);
+            }
+            int done = total.fetch_add(1, std::memory_order_relaxed) + 1;
+            int top1 = top1_correct.load(std::memory_order_relaxed);
+            int top5_count = top5_correct.load(std::memory_order_relaxed);
+            printf("\rImg: %d. Top1: %d, Top5: %d, Top1 acc: %0.4f, Top5 acc: %0.4f",
+                    done, top1, top5_count, (float)top1/(float)done, (float)top5_count/(float)done);
+            fflush(stdout);
         }
-        int result = ((Tensor<float32>*)(result_vector[0]))->argmax();
-        if(result == answer) {
-            top1_correct ++;
+    };
+    if(n_workers == 1) {
+        worker(0);
+    }
+    else {
+        std::vector<std::thread> threads;
+        for(int k = 0; k<n_workers; k++) {
+            threads.push_back(std::thread(worker, k));
         }
-        Tensor<int> top5 = ((Tensor<float32>*)(result_vector[0]))->topK(5);
-        if(top5.has(answer)) {
-            top5_correct ++;
+        for(std::thread &t: threads) {
+            t.join();
         }
-        total ++;
-        printf("\rImg: %d. Top1: %d, Top5: %d, Top1 acc: %0.4f, Top5 acc: %0.4f",
-                total, top1_correct, top5_correct, (float)top1_correct/(float)total, (float)top5_correct/(float)total);
-        fflush(stdout);
     }
+    unsigned long long end_time = get_micro_sec_time();
     printf("\n");
     printf("Top1: %d, Top5: %d, Total: %d, Top1 acc: %f, Top5 acc: %f\n", 
-        top1_correct, top5_correct, total, (float)top1_correct/(float)total, (float)top5_correct/(float)total);
-    graph->free_intermediate_results();
+        top1_correct.load(), top5_correct.load(), total.load(),
+        (float)top1_correct.load()/(float)total.load(), (float)top5_correct.load()/(float)total.load());
+    printf("Eval workers: %d, images: %d, throughput: %.2f img/s\n", n_workers, total.load(),
+           end_time == start_time ? 0.0 : (double)total.load() * 1e6 / (double)(end_time - start_time));
+    for(int k = 0; k<n_workers; k++) {
+        if(graph_scheduler() == GRAPH_SCHEDULER_DAG) {
+            std::string phase = n_workers == 1 ? "eval" : "eval worker " + std::to_string(k);
+            contexts[k]->print_schedule_report(phase.c_str());
+        }
+        delete contexts[k];
+    }
 }
 
-void test_quant_accuracy(const std::string &val_set_path, Graph *graph, std::vector<int> infer_shape) {
+void test_accuracy(const std::string &val_set_path, Graph *graph, std::vector<int> infer_shape, int n_workers) {
 /*
      * 测试计算图准确率
      * 只用于分类任务
      */
     printf("Test accuracy:\n");
-    // 打开val set数据集文件
-    std::ifstream file;
-    file.open(val_set_path, std::ios::in);
-    if(!file.is_open()) {
-        std::cerr << "calib set txt file not found\n";
-        exit(-1);
-    }
-    // 遍历文件里的每一行
-    int top1_correct = 0;
-    int top5_correct = 0;
-    int total = 0;
-    std::string line;
-    graph->alloc_intermediate_results();    // 为中间结果分配内存
-    while(std::getline(file, line)) {
-        // 将行分为图片路径和分类标签
-        std::vector<std::string> line_split = split(line, " ");
-        std::string img_path = line_split[0];
-        int answer = (int)strtol(line_split[1].c_str(), nullptr, 10);
-        // 将img读入Tensor
-        cv::Mat img;
-        cv::Mat dst;
-        if(infer_shape[1] == 1) {
-            img = cv::imread(img_path, cv::IMREAD_GRAYSCALE);;
-        }
-        else if(infer_shape[1] == 3) {
-            img = cv::imread(img_path, cv::IMREAD_COLOR);;
-        }
-        // Resize
-        cv::resize(img, dst, cv::Size(infer_shape[3], infer_shape[2]), 0, 0, cv::INTER_LINEAR);
-        // 存储resized图片到Tensor
-        Tensor<uint8> bgr_hwc_img(std::vector<int>{infer_shape[2], infer_shape[3], infer_shape[1]});
-        memcpy(bgr_hwc_img.data, dst.data, sizeof(unsigned char)*infer_shape[2]*infer_shape[3]*infer_shape[1]);
-        // hwc to chw
-        Tensor<uint8> bgr_chw_img = bgr_hwc_img.transpose(std::vector<int>{2, 0, 1});
-        // bgr to rgb
-        Tensor<uint8> rgb_chw_img(bgr_chw_img.shape());
-        if(infer_shape[1] == 3) {
-            rgb_chw_img[0] = bgr_chw_img[2];
-            rgb_chw_img[1] = bgr_chw_img[1];
-            rgb_chw_img[2] = bgr_chw_img[0];
-        }
-        else {
-            rgb_chw_img[0] = bgr_chw_img[0];
-        }
-        rgb_chw_img = rgb_chw_img.reshape(std::vector<int>{1, rgb_chw_img.size[0], rgb_chw_img.size[1], rgb_chw_img.size[2]});
-        // 根据graph类型进行数据预处理
-        void * processed_input = nullptr;
-        if(graph->node_list[0]->dtype == "uint8") {
-            // processed_input = &rgb_chw_img;
-            processed_input = qpreprocess(&rgb_chw_img);
-        }
-        else {
-            processed_input = preprocess(&rgb_chw_img);
-        }
-        // 调用graph->forward
-        // 不需要释放result_vector中的结果, 应为它们是指向graph中intermediate_results里空间的指针，在forward返回时不会分配新空间
-//        memcpy(((Tensor<uint8>*)processed_input)->data, image, sizeof(uint8)*784);
-        std::vector<void*> result_vector = graph->forward(processed_input);
-        int result = ((Tensor<uint8>*)(result_vector[0]))->argmax();
-        if(result == answer) {
-            top1_correct ++;
-        }
-        Tensor<int> top5 = ((Tensor<uint8>*)(result_vector[0]))->topK(5);
-        if(top5.has(answer)) {
-            top5_correct ++;
-        }
-        total ++;
-        printf("\rImg: %d. Top1: %d, Top5: %d, Top1 acc: %0.4f, Top5 acc: %0.4f",
-                total, top1_correct, top5_correct, (float)top1_correct/(float)total, (float)top5_correct/(float)total);
-        fflush(stdout);
-    }
-    printf("\n");
-    printf("Top1: %d, Top5: %d, Total: %d, Top1 acc: %f, Top5 acc: %f\n", 
-        top1_correct, top5_correct, total, (float)top1_correct/(float)total, (float)top5_correct/(float)total);
-    graph->free_intermediate_results();
+    evaluate<float32>(read_val_set(val_set_path), graph, infer_shape, n_workers);
 }
 
+void test_quant_accuracy(const std::string &val_set_path, Graph *graph, std::vector<int> infer_shape, int n_workers) {
+/*
+     * 测试计算图准确率
+     * 只用于分类任务
+     */
+    printf("Test accuracy:\n");
+    evaluate<uint8>(read_val_set(val_set_path), graph, infer_shape, n_workers);
+}
@@ -4,7 +4,109 @@
 
 #include "tensor.h"
 
-void array_add_1(int array[], const std::vector<int> &size)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+Tensor_storage * tensor_storage_alloc(size_t bytes)
+{
+    /*
+     * 申请控制块和数据空间
+     * 控制块和数据放在同一块内存中(由当前分配器申请)，控制块在前，数据从TENSOR_STORAGE_HEADER偏移处开始
+     * 新控制块引用计数为1
+     */
+    Tensor_allocator * allocator = get_tensor_allocator();
+    char * mem = (char*)allocator->allocate(TENSOR_STORAGE_HEADER + bytes);
+    if(mem == nullptr) {
+        fprintf(stderr, "File: tensor.cpp, line: %d. Failed to malloc %lu bytes for tensor storage\n",
+                __LINE__, (unsigned long)bytes);
+        exit(-1);
+    }
+    Tensor_storage * storage = new(mem) Tensor_storage;
+    storage->ref_count.store(1, std::memory_order_relaxed);
+    storage->mem_addr = mem + TENSOR_STORAGE_HEADER;
+    storage->bytes = bytes;
+    storage->allocator = allocator;
+    storage->trace_site = tensor_trace_alloc(bytes);
+    return storage;
+}
+
+Tensor_storage * tensor_storage_map(const char * path, size_t bytes)
+{
+    /*
+     * 以只读方式把文件path映射为数据空间(文件至少要有bytes字节，只使用前bytes字节)
+     * MAP_PRIVATE+PROT_READ：数据直接来自页缓存，多个进程映射同一文件时共享物理内存
+     * 映射区是只读的，放不下控制块，因此控制块单独申请，allocator设为nullptr表示释放时munmap
+     * 文件打不开、长度不足或无法映射时返回nullptr，由调用者改用fread(并报告错误)
+     */
+    if(bytes == 0) {
+        return nullptr;
+    }
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < bytes) {
+        close(fd);
+        return nullptr;
+    }
+    void * addr = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);      // 映射建立后不再需要文件描述符
+    if(addr == MAP_FAILED) {
+        return nullptr;
+    }
+    Tensor_storage * storage = new Tensor_storage;
+    storage->ref_count.store(1, std::memory_order_relaxed);
+    storage->mem_addr = addr;
+    storage->bytes = bytes;
+    storage->allocator = nullptr;
+    storage->trace_site = -1;       // 不占用堆内存，不统计
+    return storage;
+}
+
+void tensor_storage_retain(Tensor_storage * storage)
+{
+    /*
+     * 增加引用计数
+     * 调用者已持有一个引用，因此只需保证自增本身是原子的
+     */
+    storage->ref_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void tensor_storage_release(Tensor_storage * storage)
+{
+    /*
+     * 减引用计数，最后一个引用释放时销毁控制块并把整块内存还给分配器
+     * acq_rel保证其他线程在释放前对数据的写入对执行free的线程可见
+     */
+    if(storage->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        Tensor_allocator * allocator = storage->allocator;
+        size_t bytes = storage->bytes;
+        tensor_trace_free(storage->trace_site, bytes);
+        if(allocator == nullptr) {      // 文件映射
+            munmap(storage->mem_addr, bytes);
+            delete storage;
+            return;
+        }
+        storage->~Tensor_storage();
+        allocator->deallocate(storage, TENSOR_STORAGE_HEADER + bytes);
+    }
+}
+
+static std::atomic<bool> mmap_enabled(true);
+
+void set_tensor_mmap_enabled(bool enabled)
+{
+    mmap_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool tensor_mmap_enabled()
+{
+    return mmap_enabled.load(std::memory_order_relaxed);
+}
+
+void array_add_1(int array[], const Tensor_shape &size)
 {
     /*
      * 给出一个数组array，和数组每一位的进制size。让数组自增一
@@ -28,7 +130,7 @@ void array_add_1(int array[], const std::vector<int> &size)
     }
 }
 
-void print_size(const std::vector<int> &size)
+void print_size(const Tensor_shape &size)
 {
     /*
      * 打印一个Tensor的size
@@ -39,10 +141,36 @@ void print_size(const std::vector<int> &size)
     printf("\n");
 }
 
-void mt_dot(float * C, float * A, float * B, int mt_M, int mt_K, int mt_N)
+Tensor_stride contiguous_stride(const Tensor_shape &size)
 {
     /*
-     * 多线程矩阵乘法的一个子线程
+     * 连续存储时各维度的步长：最后一维为1，其他维为其后各维度长度的乘积
+     */
+    Tensor_stride stride;
+    stride.resize(size.size());
+    int64_t weight = 1;
+    for(int i = (int)size.size()-1; i>=0; i--) {
+        stride[i] = weight;
+        weight *= size[i];
+    }
+    return stride;
+}
+
+int padded_row_len(int row_len, int elem_size)
+{
+    /*
+     * 把行长度(元素个数)补齐，使每行的字节数是TENSOR_ALIGN的整数倍
+     * 按补齐后的行长度申请的矩阵，每一行的起始地址都按TENSOR_ALIGN对齐
+     */
+    int align_elems = TENSOR_ALIGN / elem_size;
+    return (row_len + align_elems - 1) / align_elems * align_elems;
+}
+
+static inline __attribute__((always_inline))
+void mt_dot_kernel(float * C, const float * A, const float * B, int mt_M, int mt_K, int mt_N)
+{
+    /*
+     * 矩阵乘法计算核心，由mt_dot按对齐/不对齐两种情况展开
      */
     int new_M = mt_M / 4 * 4;
     for (int i = 0; i < new_M; i+=4) {
@@ -127,4 +255,147 @@ void mt_dot(float * C, float * A, float * B, int mt_M, int mt_K, int mt_N)
             C[i * mt_N + j] = temp;
         }
     }
-}
\ No newline at end of file
+}
+
+void mt_dot(float * C, float * A, float * B, int mt_M, int mt_K, int mt_N)
+{
+    /*
+     * 多线程矩阵乘法的一个子线程
+     * Tensor::dot会尽量让每个线程的分块起始地址对齐。三个矩阵都对齐时，告知编译器按TENSOR_ALIGN对齐访问
+     */
+    if((((uintptr_t)C) | ((uintptr_t)A) | ((uintptr_t)B)) % TENSOR_ALIGN == 0) {
+        mt_dot_kernel((float*)__builtin_assume_aligned(C, TENSOR_ALIGN),
+                      (const float*)__builtin_assume_aligned(A, TENSOR_ALIGN),
+                      (const float*)__builtin_assume_aligned(B, TENSOR_ALIGN), mt_M, mt_K, mt_N);
+    }
+    else {
+        mt_dot_kernel(C, A, B, mt_M, mt_K, mt_N);
+    }
+}
+
+void tensor_dot(float * C, float * A, float * B, int M, int K, int N)
+{
+    /*
+     * 矩阵乘法C = A * B，A、B、C都是连续存储的。C由调用者提供(不申请内存)
+     * 按行分块，由线程池的线程分别调用mt_dot
+     */
+    // 分块数n_proc(另加一块剩余的行)。每150000计算量增加一块，最大不超过线程池的线程数
+    int n_proc = get_thread_pool()->size();
+    int64_t max_calc_amount = (int64_t)150000 * n_proc;
+    n_proc = n_proc - (int)std::max<int64_t>(0, (max_calc_amount - (int64_t)M*K*N) / 150000);
+
+    int M_per_proc = M / n_proc;
+    // 分块行数取row_align的整数倍，使每个分块在A和C中的起始地址都按TENSOR_ALIGN对齐
+    // (A、C本身对齐时)。分块较小时不调整，避免剩余行过多都落到主线程
+    int align_elems = TENSOR_ALIGN / (int)sizeof(float);
+    int row_align = std::max(align_elems / std::__gcd(N, align_elems), align_elems / std::__gcd(K, align_elems));
+    if(M_per_proc >= 8 * row_align) {
+        M_per_proc = M_per_proc / row_align * row_align;
+    }
+    // 第0到n_proc-1块各M_per_proc行，剩余的行(如果有)是最后一块。每块交给线程池的一次调用
+    int n_block = M > n_proc * M_per_proc ? n_proc + 1 : n_proc;
+    parallel_for(0, n_block, 1, [&](int64_t from, int64_t to) {
+        for(int64_t i = from; i<to; i++) {
+            int rows = i < n_proc ? M_per_proc : M - n_proc * M_per_proc;
+            mt_dot(&C[i*M_per_proc*N], &A[i*M_per_proc*K], B, rows, K, N);
+        }
+    });
+}
+
+template<typename T>
+static void tensor_lookup_hwc_to_chw(T * dst, const uint8 * src, int height, int width, int channel,
+                                     bool reverse_channel, const T (*table)[256])
+{
+    /*
+     * (H, W, C) -> (C, H, W)，同时查表：dst[c] = table[c][src[c']]
+     * 一次顺序读取输入，写C个连续的输出平面。按行多线程
+     */
+    int64_t plane = (int64_t)height * width;
+    parallel_for(0, height, tensor_parallel_grain(height, (int64_t)width * channel), [&](int64_t from, int64_t to) {
+        for(int h = (int)from; h<(int)to; h++) {
+            const uint8 * s = src + (int64_t)h * width * channel;
+            if(channel == 3) {
+                T * d0 = dst + (int64_t)h * width;
+                T * d1 = dst + (int64_t)h * width + plane;
+                T * d2 = dst + (int64_t)h * width + 2 * plane;
+                const T * t0 = table[0];
+                const T * t1 = table[1];
+                const T * t2 = table[2];
+                int c0 = reverse_channel ? 2 : 0;
+                int c2 = reverse_channel ? 0 : 2;
+                for(int w = 0; w<width; w++) {
+                    d0[w] = t0[s[w*3+c0]];
+                    d1[w] = t1[s[w*3+1]];
+                    d2[w] = t2[s[w*3+c2]];
+                }
+            }
+            else {
+                for(int c = 0; c<channel; c++) {
+                    T * d = dst + (int64_t)c * plane + (int64_t)h * width;
+                    const T * t = table[c];
+                    int sc = reverse_channel ? channel-1-c : c;
+                    for(int w = 0; w<width; w++) {
+                        d[w] = t[s[w*channel + sc]];
+                    }
+                }
+            }
+        }
+    });
+}
+
+static void tensor_ingest_table(float32 (*table)[256], uint8 (*qtable)[256], int channel,
+                                const float32 * mean, const float32 * std, float32 scale, float32 zero)
+{
+    /*
+     * 输入只有256种取值，所以先对0~255逐个通道算出结果，之后每个像素查表即可，不必逐像素做除法。
+     * 表用向量化内核(tensor_kernel.h)计算，运算顺序与张量表达式
+     * (x.astype_float32() - mean) / std(/ scale + zero，clip，astype_uint8)相同，因此结果逐位相同
+     */
+    if(channel > TENSOR_INGEST_MAX_CHANNEL) {
+        fprintf(stderr, "File: tensor.cpp, line: %d. Image channel should be at most %d, got %d\n",
+                __LINE__, TENSOR_INGEST_MAX_CHANNEL, channel);
+        exit(-1);
+    }
+    uint8 values[256];
+    for(int i = 0; i<256; i++) {
+        values[i] = (uint8)i;
+    }
+    for(int c = 0; c<channel; c++) {
+        float32 * v = table[c];
+        kernel_cast(v, (const uint8*)values, 256);
+        kernel_sub(v, (const float32*)v, mean[c], 256);
+        kernel_div(v, (const float32*)v, std[c], 256);
+        if(qtable != nullptr) {
+            kernel_div(v, (const float32*)v, scale, 256);
+            kernel_add(v, (const float32*)v, zero, 256);
+            kernel_clip(v, (const float32*)v, 256, 0.0f, 255.0f);
+            kernel_cast(qtable[c], (const float32*)v, 256);
+        }
+    }
+}
+
+void tensor_normalize_hwc_to_chw(float32 * dst, const uint8 * src, int height, int width, int channel,
+                                 bool reverse_channel, const float32 * mean, const float32 * std)
+{
+    /*
+     * (H, W, C)的uint8图片 -> (C, H, W)的float32，dst[c] = ((float32)src[c'] - mean[c]) / std[c]
+     * reverse_channel为true时c' = C-1-c(BGR->RGB)，否则c' = c。mean、std按输出的通道给出
+     * 先算出每个通道0~255的结果表，再一次遍历输入查表写入dst，不申请中间张量
+     */
+    float32 table[TENSOR_INGEST_MAX_CHANNEL][256];
+    tensor_ingest_table(table, nullptr, channel, mean, std, 1.0f, 0.0f);
+    tensor_lookup_hwc_to_chw(dst, src, height, width, channel, reverse_channel, (const float32 (*)[256])table);
+}
+
+void tensor_quantize_hwc_to_chw(uint8 * dst, const uint8 * src, int height, int width, int channel,
+                                bool reverse_channel, const float32 * mean, const float32 * std,
+                                float32 scale, float32 zero)
+{
+    /*
+     * 同tensor_normalize_hwc_to_chw，再量化：dst[c] = (uint8)clip(归一化结果 / scale + zero, 0, 255)
+     */
+    float32 table[TENSOR_INGEST_MAX_CHANNEL][256];
+    uint8 qtable[TENSOR_INGEST_MAX_CHANNEL][256];
+    tensor_ingest_table(table, qtable, channel, mean, std, scale, zero);
+    tensor_lookup_hwc_to_chw(dst, src, height, width, channel, reverse_channel, (const uint8 (*)[256])qtable);
+}
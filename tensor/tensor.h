@@ -20,37 +20,61 @@
  * 具体设计：
  * 一. 对属性的解释：
  * 1. data: 数据指针，指向张量中存储数据的地方。
- * 2. mem_addr: 内存地址，指向张量内存的起始地址(后面解释mem_addr和data的区别)
- * 3. size: 张量拥有可变的维度和尺寸。使用一个vector存储尺寸
- * 4. cut: 标记当前张量是否是其他张量的截取(即在程序中，是否以t[i]的形式出现)
- * 5. is_num: 标记当前张量是否是数值(对于n维张量，通过n次[下标]的方式取出数值)
- * 6. counter: 引用计数器
+ * 2. mem_addr: 内存地址，指向张量内存的起始地址，记录在storage控制块中(后面解释mem_addr和data的区别)
+ * 3. size: 张量拥有可变的维度和尺寸。使用Tensor_shape存储尺寸(最多TENSOR_MAX_DIM维，存放在对象内，见tensor_shape.h)
+ *    每一维的长度是int，元素个数、偏移和步长用int64_t计算，整个校准集/验证集可以放在一个张量中(超过2^31个元素)
+ * 4. is_num: 标记当前张量是否是数值(对于n维张量，通过n次[下标]的方式取出数值)
+ * 5. storage: 数据空间控制块，其中记录内存地址mem_addr和引用计数
+ * 6. stride: 各维度的步长(沿该维度移动一个下标时，data上移动的元素个数，Tensor_stride)。为空表示连续存储(行优先，最后一维步长为1)
+ * 视图：
+ *      transpose、broadcast_to以及对视图的expand_dim、[]只修改size和stride，返回与原张量共享数据空间的视图，不复制数据。
+ *      transpose交换各维度的步长；broadcast_to把被广播的维度步长设为0。
+ *      视图的数据不是连续的，需要连续数据时调用contiguous()：已经连续则直接返回(不复制)，否则复制为连续存储的新张量。
+ *      Tensor的成员函数会在需要时自动调用contiguous()；在Tensor之外直接访问data的代码，需要自己保证张量是连续的。
+ *      对视图进行原地修改(set_zero、clip、+=等)会写回原数据空间
  * 引用计数：
  *      由于为了减少内存空间占用和提高性能，所以在对张量进行简单的操作，如对象复制，数据截取，变形等不会改变数据的值的操作时，
  *      我们仅将创建的新张量的data指向旧张量的data，而不为新张量分配新的数据空间。即让新张量和旧张量共享数据空间，但它们可能
  *      拥有不同的尺寸，维度，数据长度等属性。
  *      但这会带来一个问题：由于新旧张量共享数据空间，我们必须保证旧张量析构时，其数据空间不被释放，因为新张量仍在使用它。
- *      考虑到'[]'的存在，即便两个张量共享数据空间，其实际使用的数据空间起始地址(即data)仍可能不同，所以我们必须为每个张量新建一个
- *      mem_addr属性，记录此张量的数据空间的真正起始地址，用于管理内存的释放。与此同时，我们需要引入引用计数方法，根据mem_addr
- *      进行引用计数。对于某一块内存，只有当所有张量都不使用它时(所有现存张量的mem_addr的值都不为它)，才将它释放。
- *      引用计数的计算方式：使用map记录所有出现的mem_addr，和每个mem_addr的出现次数。创建新的张量时，会对mem_addr次数加一(或
- *      加入map中)。析构张量时，会对mem_addr减一(或从map中删除)
+ *      考虑到'[]'的存在，即便两个张量共享数据空间，其实际使用的数据空间起始地址(即data)仍可能不同，所以我们必须为每个张量记录
+ *      数据空间的真正起始地址mem_addr，用于管理内存的释放。与此同时，我们需要引入引用计数方法，对于某一块内存，只有当所有张量
+ *      都不使用它时，才将它释放。
+ *      引用计数的计算方式：每次申请数据空间时，同时申请一个控制块(Tensor_storage)，控制块与数据空间放在同一块内存中，控制块
+ *      在前，数据在后。控制块中记录mem_addr和原子类型的引用计数。共享数据空间的张量指向同一个控制块。创建新的张量时，对控制块
+ *      的引用计数加一；析构张量时减一，减到0时释放整块内存。
+ *      这样复制和截取张量只需要一次原子加减(O(1))，不需要查找全局map，并且可以在多个线程间共享张量(例如同时进行多个forward)
  *      注意：共享数据空间会带来一个问题：如果两个张量共享数据空间，那么对其中一个的数据进行修改时，另一个的数据也会改变
+ *      注意：引用计数是线程安全的，但数据本身不是。多个线程同时写同一个张量的数据仍需由调用者保证不冲突
  *
  * 二. 构造与析构Tensor:
  * 1. 不给定尺寸：仅创建对象，数据均设为0或null
- * 2. 给定尺寸：申请空间data，同时记录空间首地址mem_addr。size设为输入的size。对mem_addr引用计数
- * 3. 拷贝构造：函数返回对象时会自动调用拷贝构造。共享数据空间
- * 4. 析构：mem_addr查找引用计数，释放空间
+ * 2. 给定尺寸：申请控制块和数据空间data。size设为输入的size。引用计数为1(内存默认从池分配器申请，见tensor_allocator.h)
+ * 3. 拷贝构造：共享数据空间，引用计数加一
+ *    移动构造：接管临时对象的数据空间，不改变引用计数，临时对象变为未分配空间的对象。
+ *    函数按值返回张量时，编译器通常直接省略复制(RVO)，不能省略时使用移动构造
+ * 4. 析构：引用计数减一，减到0时释放空间(归还给分配器)
+ * 5. 对齐：给定尺寸构造的张量，data按TENSOR_ALIGN(64字节)对齐。截取得到的张量(t[i])不一定对齐，可用is_aligned()判断。
+ *    需要每行都对齐的矩阵(如im2col的输出)，可用padded_row_len()计算补齐后的行长度，按补齐后的尺寸申请，使用时以补齐长度为行距
+ * 6. 文件映射：tensor_load_file()读取模型权重等二进制文件时，以只读方式mmap整个文件作为数据空间(tensor_storage_map)，
+ *    不复制数据，多个进程加载同一模型时共享页缓存中的同一份数据。控制块单独申请，最后一个引用释放时munmap。
+ *    映射得到的张量是只读的(写入会导致段错误)，需要修改时先deep_copy()。无法映射时(或set_tensor_mmap_enabled(false))改用fread
+ * 7. 多线程：张量和算子的多线程循环都通过parallel_for(见thread_pool.h)交给进程内共享的线程池，不再各自创建线程。
+ *    分块大小由tensor_parallel_grain()按每个任务的元素数计算，元素较少时不分发
  *
  * 三. 数组处理:
  * 1. print(): 打印所有数据
- * 2. len(): 获取张量的元素个数
+ * 2. len(): 获取张量的元素个数(int64_t)
  * 3. shape(): 获取张量的形状
  * 4. reshape(): 创建新张量，使其形状为变形后的形状。共享数据空间
- * 5. transpose(): 创建新张量，使其形状和数据顺序为transpose后的样子
- * 6. broadcast_to(): 创建新张量，使其形状为广播后的样子
- * 7. deep_copy(): 创建新张量，复制原张量数据空间内的数据
+ * 5. transpose(): 创建视图，使其形状和数据顺序为transpose后的样子。共享数据空间
+ * 6. broadcast_to(): 创建视图，使其形状为广播后的样子。共享数据空间
+ * 7. deep_copy(): 创建新张量，复制原张量数据空间内的数据(结果总是连续的)
+ * 8. contiguous(): 返回连续存储的张量。转置视图按块复制，元素较多时多线程
+ * 9. hwc_to_chw(reverse_channel)/chw_to_hwc(reverse_channel): 创建新张量，HWC与CHW(或NHWC与NCHW)互相转换，
+ *    reverse_channel为true时在同一次遍历中反转通道顺序(BGR<->RGB)
+ * 10. concat(array, dim)/tensor_concat(arrays, dim): 创建新张量，沿dim拼接。
+ *    dim之前的维度看作outer，每个outer下各输入的数据都是连续的一段，直接memcpy
  *
  * 四. 数据处理:
  * 1. to_num(): n维张量使用[]进行n次截取后，变为数值(is_num->true)。此时可使用to_num()取出这个数值
@@ -61,8 +85,12 @@
  * 6. astype_uint8(): 创建新张量，使其值为原张量转为uint8后的值
  * 7. astype_int32(): 创建新张量，使其值为原张量转为int32后的值
  * 8. astype_float32(): 创建新张量，使其值为原张量转为float32后的值
+ *    astype_float16()/astype_bfloat16(): 创建新张量，转为半精度(见tensor_half.h)，与float32之间的转换使用向量化内核
  * 9. clip(min, max): 不创建新张量，使数据截断到[min, max]之间
- * 10. sort(direction): 不创建新张量，对数据排序
+ * 10. sort(direction): 不创建新张量，对数据排序。整数类型使用基数排序，其他类型使用std::sort
+ * 11. max()/min()/minmax(min, max): 最大值/最小值。元素较多时分块多线程计算，minmax在一次遍历中同时求两者
+ * 12. topK(k)/topK(k, axis): 创建新张量，最大的k个值的下标(按值从大到小，值相同时下标小的在前)。
+ *     用大小为k的堆筛选，O(n log k)。topK(k, axis)对其他维度的每个位置分别沿axis计算，结果axis维的尺寸为k
  *
  * 五. 数学运算:
  * 1. add(): 创建新张量。计算加法
@@ -70,31 +98,33 @@
  * 3. true_divide(): 创建新张量。计算除法
  * 4. floor_divide(): 创建新张量。计算向下取整除法
  * 5. dot(): 创建新张量。矩阵乘法
+ * 6. + - * /: 返回延迟计算的表达式(见tensor_expr.h)，赋值给张量时才在一次遍历中计算整个表达式，不产生中间张量。
+ *    add()、sub()、mult()、true_divide()等函数直接返回计算后的张量
+ * 7. mean()/var(): 单遍计算均值/方差(分块求和再按Chan公式合并，累积量为double)。
+ *    mean(axis)/var(axis)把张量看作(outer, reduce, inner)：inner为1时逐行归约，否则逐行累加到各列(Welford)，
+ *    axis不连续时先转置使其连续。都在同一次遍历中得到均值和方差
  *
  * 六. 运算符重载：
  * 1. =
- *      1.1 当左值为对象(cut==0)时：将左值data指向右值data。共享数据空间
- *      1.2 当左值为对象截取(cut==1)时：将右值data指向的数据复制到左值data指向的地址(真复制)。
+ *      1.1 当左值为具名对象(左值表达式，如b = a)时：将左值data指向右值data。共享数据空间。右值是临时对象时直接接管其数据空间
+ *      1.2 当左值为临时对象(右值表达式，如b[i] = a)时：将右值data指向的数据复制到左值data指向的地址(真复制)。
  *      1.3 我们希望截取到is_num时，能直接对其赋值。所以当左值is_num时，右值可以为数值。
+ *      两种情况用成员函数的引用限定符(&和&&)区分，不依赖拷贝构造的调用次数，因此编译器可以正常省略复制
  * 2. []
  * -- 使用[int]取数组的一部分，称之为截取
- * -- gcc 使用-fno-elide-constructors参数时，函数返回对象时会自动调用一次拷贝构造
- *        使用该返回值创建对象(ClassA a = func())时会再调用一次拷贝构造
- * 使用[]截取：创建一个对象，使其data指向截取后的位置，但mem_addr仍指向原位置，并引用计数。将其cut设为2。返回这个对象
+ * 使用[]截取：创建一个对象，使其data指向截取后的位置，但storage仍指向原控制块，并引用计数。返回这个对象
  *      当截取到只剩一个数字时(如array(2,3,4)，使用array[0][0][0]截取)，我们希望能直接返回一个数字，但由于C++的限制，
  *      无法做到像python那样灵活，所以我们仍只能返回一个对象，但此时我们会将这个对象标记为is_num，并可使用to_num()提取这个数
- *      -- mem_addr指向原位置的理由：如果a是b的截取，a的数据首地址与b不同，a的mem_addr不指向b的首地址
- *         那么当b释放时，由于a的引用计数没有与b计在同一地址，当b的引用计数减少时，无法发现a仍在使用b申请的内存
- *         会直接将b申请的内存释放掉。但此时a仍在使用。将a的计数地址与b计同一地址可解决此问题
- *      -- cut设为2的理由：在使用=时，我们希望对于对象左值和对象截取左值采用不同的操作，所以需要对对象和对象截取进行区分
- *         设计为：对象的cut为0，对象截取的cut为1。即[]返回的对象的cut为1，其余为0
- *         在[]中创建临时对象时，将其cut设为2。返回时自动调用拷贝构造，检测到2，发现是[]返回的对象，将cut减1。
- *         这样返回到外层函数的对象截取的cut就为1。
- *         当使用此对象截取创建对象时，仍会调用拷贝构造，再将cut减1，这样新对象就是普通对象
- *         当使用此对象作为右值时，会调用operator=
- * 3. +: 创建新张量。+
- * 4. +=: 在原张量的基础上+
- * 5. /: 创建新张量。+
+ *      -- storage指向原控制块的理由：如果a是b的截取，a的数据首地址与b不同，如果a不与b共用控制块
+ *         那么当b释放时，由于a的引用计数没有与b计在同一处，当b的引用计数减少时，无法发现a仍在使用b申请的内存
+ *         会直接将b申请的内存释放掉。但此时a仍在使用。将a与b计在同一控制块可解决此问题
+ *      -- []返回的是临时对象，所以b[i] = a是对临时对象赋值，复制数据(1.2)；
+ *         用截取创建具名对象(Tensor c = b[i])后，c是普通对象，c = a只改变c的指向(1.1)
+ * 3. + - * /: 不立即计算，返回记录运算的表达式(Tensor_expr，见tensor_expr.h)，操作数可以是Tensor、数值或其他表达式。
+ *      表达式在赋值给Tensor(构造、operator=、对截取的赋值)时才一次遍历算出结果，只为最终结果申请空间，不创建中间张量。
+ *      表达式持有操作数张量的浅拷贝：计算前修改了操作数的数据，结果也会改变
+ * 4. += -= *= /=: 立即计算，结果写回原张量的数据空间
+ * 5. /: 同3，整数类型按C++的整数除法截断
  */
 
 
@@ -102,12 +132,23 @@
 #include <cstdlib>
 #include <cstring>
 #include <vector>
-#include <map>
+#include <string>
+#include <atomic>
+#include <new>
 #include <type_traits>
 #include <thread>
 #include <unistd.h>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <cinttypes>
+#include <algorithm>
+
+#include "tensor_allocator.h"
+#include "tensor_trace.h"
+#include "tensor_shape.h"
+#include "tensor_half.h"
+#include "thread_pool.h"
 
 typedef char int8;
 typedef unsigned char uint8;
@@ -117,27 +158,93 @@ typedef float float32;
 typedef double float64;
 
 
+/*
+ * 张量数据空间的控制块
+ * 与数据空间通过同一次分配申请(见tensor_allocator.h)：控制块在前(占TENSOR_STORAGE_HEADER字节)，数据在后
+ * 分配器返回的地址和TENSOR_STORAGE_HEADER都是TENSOR_ALIGN的整数倍，因此mem_addr按TENSOR_ALIGN对齐
+ * 共享同一数据空间的所有张量指向同一个控制块
+ */
+struct Tensor_storage {
+    std::atomic<int> ref_count;         // 引用计数
+    void * mem_addr;                    // 数据空间起始地址
+    size_t bytes;                       // 数据空间字节数
+    Tensor_allocator * allocator;       // 申请这块内存的分配器，释放时归还给它。为nullptr时数据空间是文件映射
+    int trace_site;                     // 分配统计的位置编号(见tensor_trace.h)，未统计时为-1
+};
+#define TENSOR_STORAGE_HEADER ((sizeof(Tensor_storage) + TENSOR_ALIGN - 1) / TENSOR_ALIGN * TENSOR_ALIGN)
+
+#define TENSOR_TRANSPOSE_BLOCK 32               // 分块转置的块边长
+#define TENSOR_PARALLEL_MIN_LEN (1 << 18)       // 元素数不少于此值时多线程复制/归约
+#define TENSOR_REDUCE_CHUNK (1 << 16)           // 多线程归约时每块的元素数(分块与线程数无关，结果是确定的)
+#define TENSOR_REDUCE_BLOCK 1024                // 均值/方差按块计算时的块长，按列归约时每次处理的列数
+#define TENSOR_PARALLEL_GRAIN_LEN (1 << 14)     // 多线程时每块至少处理的元素数
+#define TENSOR_INGEST_MAX_CHANNEL 4             // 图片输入预处理支持的最大通道数
+
+inline int64_t tensor_parallel_grain(int64_t n, int64_t item_len)
+{
+    /*
+     * n个任务、每个任务处理item_len个元素时parallel_for的grain：
+     * 总元素数少于TENSOR_PARALLEL_MIN_LEN时不分发(grain为n)，否则每块至少TENSOR_PARALLEL_GRAIN_LEN个元素
+     */
+    if(n * item_len < TENSOR_PARALLEL_MIN_LEN) {
+        return n;
+    }
+    return std::max<int64_t>(1, TENSOR_PARALLEL_GRAIN_LEN / std::max<int64_t>(1, item_len));
+}
+
+/*
+ * 均值/方差的累积量：元素个数、均值、与均值之差的平方和
+ * 两组累积量可以合并(Chan的并行公式)，因此可以分块、多线程计算后再按顺序合并
+ */
+struct Tensor_moment {
+    int64_t n;
+    double mean;
+    double m2;
+};
+
+Tensor_storage * tensor_storage_alloc(size_t bytes);           // 申请控制块和数据空间，引用计数为1
+Tensor_storage * tensor_storage_map(const char * path, size_t bytes);  // 只读映射文件作为数据空间，失败返回nullptr
+void tensor_storage_retain(Tensor_storage * storage);          // 引用计数加一
+void tensor_storage_release(Tensor_storage * storage);         // 引用计数减一，减到0时释放
+void set_tensor_mmap_enabled(bool enabled);                     // 开关tensor_load_file的文件映射(关闭时总是fread)
+bool tensor_mmap_enabled();
+
+
+template<typename E> class Tensor_expr;
+
+
 template <typename T>
 class Tensor {
 public:
+    typedef T value_type;
+
     // 属性
     T * data;                   // 数据空间
-    std::vector<int> size;      // 数据尺寸
-    int cut;                    // 是否是截取
+    Tensor_shape size;          // 数据尺寸
+    Tensor_stride stride;       // 各维度步长(元素个数)。为空表示连续存储
 
     // 构造与析构
     Tensor();                                               // constructor
-    explicit Tensor(const std::vector<int>& size);          // constructor with input shape
+    explicit Tensor(const Tensor_shape& size);              // constructor with input shape
+    Tensor(const Tensor_shape& size, Tensor_storage * storage);  // 使用已有的数据空间(接管storage的一个引用)
     Tensor(const Tensor<T> &src);                           // 拷贝构造函数
+    Tensor(Tensor<T> &&src) noexcept;                       // 移动构造函数
+    template<typename E>
+    Tensor(const Tensor_expr<E> &expr);                     // 从表达式构造(计算表达式)
     ~Tensor();                                              // 析构函数
 
     // 数组处理
     void print();                                           // print
-    int len();                                              // 返回数据空间元素数量
-    std::vector<int> shape();                               // shape
-    Tensor<T> reshape(const std::vector<int>& new_size);    // reshape
+    int64_t len();                                          // 返回数据空间元素数量
+    bool is_aligned();                                      // data是否按TENSOR_ALIGN对齐
+    bool is_contiguous();                                   // 是否连续存储
+    Tensor<T> contiguous();                                 // 返回连续存储的张量(视图会复制数据)
+    Tensor_shape shape();                                   // shape
+    Tensor<T> reshape(const Tensor_shape& new_size);        // reshape
     Tensor<T> transpose(const std::vector<int>& new_order); // transpose
-    Tensor<T> broadcast_to(const std::vector<int> &size);   // broadcast_to
+    Tensor<T> hwc_to_chw(bool reverse_channel = false);     // (N)HWC -> (N)CHW，可同时反转通道顺序
+    Tensor<T> chw_to_hwc(bool reverse_channel = false);     // (N)CHW -> (N)HWC，可同时反转通道顺序
+    Tensor<T> broadcast_to(const Tensor_shape &size);       // broadcast_to
     Tensor<T> deep_copy();                                  // deep copy
     Tensor<T> concat(Tensor<T> array, int dim = 0);         // concat
     Tensor<T> expand_dim(int axis);                         // expand_dim
@@ -146,16 +253,20 @@ public:
     T to_num();                                             // 返回数值
     void set_zero();                                        // data置0
     void set_rand();                                        // data置随机值
-    int argmax();                                           // argmax
+    int64_t argmax();                                       // argmax
     Tensor<int> argmax(int axis);                           // argmax
     Tensor<uint8> astype_uint8();                           // astype("uint8");
     Tensor<int32> astype_int32();                           // astype("int32")
     Tensor<float32> astype_float32();                       // astype("float32")
+    Tensor<fp16> astype_float16();                          // astype("float16")
+    Tensor<bf16> astype_bfloat16();                         // astype("bfloat16")
     T max();                                                // max
     T min();                                                // min
+    void minmax(T &min, T &max);                            // 一次遍历求min和max
     void clip(T min, T max);                                // clip
     void sort(int direction);                               // sort
     Tensor<int> topK(int k);                                // topK
+    Tensor<int> topK(int k, int axis);                      // 沿axis的topK
     int has(T value);                                       // value is in this
 
     // 数学运算
@@ -180,36 +291,84 @@ public:
 
     // 运算符重载
     Tensor<T> operator[](int index);                        // overload []  : Tensor[]
-    Tensor<T>& operator=(Tensor<T> array);                  // overload =   : Tensor = Tensor
+    Tensor<T>& operator=(const Tensor<T> &array) &;         // overload =   : Tensor = Tensor(共享数据空间)
+    Tensor<T>& operator=(Tensor<T> &&array) &;              // overload =   : Tensor = 临时Tensor(接管数据空间)
+    Tensor<T>& operator=(const Tensor<T> &array) &&;        // overload =   : Tensor[i] = Tensor(复制数据)
     Tensor<T>& operator=(T value);                          // overload =   : is_num_Tensor = value
-    Tensor<T> operator+(T adder);                           // overload +   : Tensor + value
-    Tensor<T> operator+(Tensor<T> adder);                   // overload +   : Tensor + Tensor
+    template<typename E>
+    Tensor<T>& operator=(const Tensor_expr<E> &expr) &;     // overload =   : Tensor = 表达式
+    template<typename E>
+    Tensor<T>& operator=(const Tensor_expr<E> &expr) &&;    // overload =   : Tensor[i] = 表达式(写入原数据空间)
     Tensor<T>& operator+=(T adder);                         // overload +=  : Tensor += value
-    Tensor<T> operator-(T subtractend);                     // overload -   : Tensor - value
-    Tensor<T> operator-(Tensor<T> subtractend);             // overload -   : Tensor - Tensor
     Tensor<T>& operator-=(T subtractend);                   // overload -=  : Tensor -= value
-    Tensor<T> operator*(T multiplier);                      // overload *   : Tensor * value
-    Tensor<T> operator*(Tensor<T> multiplier);              // overload *   : Tensor * Tensor
-    Tensor<T>& operator*=(Tensor<T> multiplier);            // overload *=  : Tensor *= value
-    Tensor<T> operator/(T divisor);                         // overload /   : Tensor / value
-    Tensor<T> operator/(Tensor<T> divisor);                 // overload /   : Tensor / Tensor
-    Tensor<T>& operator/=(Tensor<T> divisor);               // overload /=  : Tensor /= value
+    Tensor<T>& operator*=(Tensor<T> multiplier);            // overload *=  : Tensor *= Tensor
+    Tensor<T>& operator/=(Tensor<T> divisor);               // overload /=  : Tensor /= Tensor
+    // + - * / 见tensor_expr.h，返回延迟计算的表达式
 
 private:
-    T * mem_addr;               // 记录内存地址
+    Tensor_storage * storage;   // 数据空间控制块(记录内存地址和引用计数)
     bool is_num;                // 是否是数值
 
-    static std::map<T*, int> counter;   // reference counter
+    void normalize_stride();    // stride与连续存储相同时清空
 };
-template <typename T>
-std::map<T*, int> Tensor<T>::counter;   // reference counter
 
 
-void array_add_1(int array[], const std::vector<int> &size);    // 数组自增
-void print_size(const std::vector<int> &size);                  // 打印Tensor的size
+void array_add_1(int array[], const Tensor_shape &size);        // 数组自增
+void print_size(const Tensor_shape &size);                      // 打印Tensor的size
+Tensor_stride contiguous_stride(const Tensor_shape &size);      // 连续存储时各维度的步长
+template<typename T>
+void tensor_strided_copy(T * dst, const Tensor_stride &dst_stride, const T * src,
+                         const Tensor_stride &src_stride, const Tensor_shape &size);  // 按步长复制
+template<typename T>
+void tensor_transpose_2d(T * dst, int64_t dst_ld, const T * src, int64_t src_ld, int rows, int cols);  // 分块转置
+template<typename T>
+void tensor_transpose_copy(T * dst, const Tensor_stride &ds, const T * src, const Tensor_stride &ss,
+                           const Tensor_shape &size, int p);  // 按块复制转置视图
+template<typename T>
+Tensor<T> tensor_reduce_prepare(Tensor<T> src, const std::vector<int> &axis, Tensor_shape &new_size,
+                                int64_t &outer, int64_t &reduce, int64_t &inner);  // 归约前整理维度
+template<typename T>
+Tensor_moment tensor_moment(const T * a, int64_t n);         // n个元素的均值/方差累积量
+template<typename T>
+void tensor_reduce_moment(T * mean, T * var, const T * src, int64_t outer, int64_t reduce, int64_t inner);
+template<typename T>
+T tensor_max(const T * a, int64_t n);                        // 多线程max
+template<typename T>
+T tensor_min(const T * a, int64_t n);                        // 多线程min
+template<typename T>
+void tensor_minmax(const T * a, int64_t n, T * min, T * max);   // 多线程min+max
+template<typename T>
+void tensor_topk(int * index, int64_t index_stride, const T * src, int64_t src_stride, int n, int k);  // topK
+template<typename T>
+void tensor_sort(T * data, int64_t n, int direction);     // 排序
+template<typename T>
+void tensor_radix_sort(T * data, int64_t n);              // 整数升序基数排序
+template<typename T>
+Tensor<T> tensor_concat(std::vector<Tensor<T>> arrays, int dim);  // 沿dim拼接多个张量
+template<typename T>
+Tensor_shape tensor_concat_shape(const std::vector<Tensor<T>> &arrays, int dim);  // 拼接结果的尺寸(检查各输入尺寸)
+template<typename T>
+void tensor_concat(T * dst, std::vector<Tensor<T>> arrays, int dim);  // 沿dim拼接，写入连续的dst
+template<typename T>
+Tensor<T> tensor_load_file(const std::string &path, const Tensor_shape &size);  // 从二进制文件读取张量(优先mmap)
+template<typename T>
+void tensor_hwc_to_chw(T * dst, const T * src, int height, int width, int channel, bool reverse_channel);
+template<typename T>
+void tensor_chw_to_hwc(T * dst, const T * src, int height, int width, int channel, bool reverse_channel);
+// 图片输入：(H, W, C)的uint8 -> (C, H, W)，dst[c] = (src[c] - mean[c]) / std[c]，查表一次遍历，写入调用者提供的dst
+void tensor_normalize_hwc_to_chw(float32 * dst, const uint8 * src, int height, int width, int channel,
+                                 bool reverse_channel, const float32 * mean, const float32 * std);
+// 同上，再量化为uint8：dst[c] = clip((src[c] - mean[c]) / std[c] / scale + zero, 0, 255)
+void tensor_quantize_hwc_to_chw(uint8 * dst, const uint8 * src, int height, int width, int channel,
+                                bool reverse_channel, const float32 * mean, const float32 * std,
+                                float32 scale, float32 zero);
 void mt_dot(float * C, float * A, float * B, int mt_M, int mt_K, int mt_N);
+void tensor_dot(float * C, float * A, float * B, int M, int K, int N);     // 多线程矩阵乘法，结果写入C
+int padded_row_len(int row_len, int elem_size);                 // 行长度补齐到TENSOR_ALIGN字节的整数倍
 
 
+#include "tensor_kernel.h"
+#include "tensor_expr.h"
 #include "tensor_impl.h"
 
 #endif //QUANT_TENSOR_H
@@ -0,0 +1,323 @@
+#include "tensor_allocator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+
+#define TENSOR_POOL_N_CLASSES (1 + (32 - 6) * 4)        // 64字节一档，(2^6, 2^32]每个2的幂区间4档
+
+
+static size_t class_block_bytes(int index)
+{
+    /*
+     * 尺寸等级index对应的块大小(Pool_allocator::size_class的逆运算)
+     */
+    if(index == 0) {
+        return TENSOR_POOL_MIN_BLOCK_BYTES;
+    }
+    int k = 6 + (index - 1) / 4;
+    size_t j = (size_t)((index - 1) % 4 + 1);
+    return ((size_t)1 << k) + j * ((size_t)1 << (k - 2));
+}
+
+
+void * aligned_malloc(size_t bytes)
+{
+    void * ptr = nullptr;
+    if(posix_memalign(&ptr, TENSOR_ALIGN, bytes) != 0) {
+        return nullptr;
+    }
+    return ptr;
+}
+
+void * Malloc_allocator::allocate(size_t bytes)
+{
+    return aligned_malloc(bytes);
+}
+
+void Malloc_allocator::deallocate(void * ptr, size_t bytes)
+{
+    (void)bytes;
+    free(ptr);
+}
+
+
+struct Pool_allocator::Impl {
+    std::mutex mutex;                                   // 保护全局池
+    std::vector<std::vector<void*>> free_list;          // 每个尺寸等级的空闲内存块
+    unsigned long long cached_bytes = 0;                // 全局池中缓存的字节数
+
+    Impl(): free_list(TENSOR_POOL_N_CLASSES) {}
+};
+
+
+/*
+ * 线程缓存
+ * 只为全局池分配器(get_pool_allocator())服务。线程退出时把缓存的内存块还给全局池
+ * 线程局部变量按构造的逆序析构：在线程缓存之前构造的线程局部张量(如functional.cpp的workspace)在线程缓存析构之后才释放，
+ * 此时不能再使用线程缓存。thread_cache_state是平凡析构的，析构后仍可读取，用它判断线程缓存是否可用
+ */
+#define THREAD_CACHE_UNUSED 0               // 当前线程还没有使用过线程缓存
+#define THREAD_CACHE_ALIVE 1
+#define THREAD_CACHE_DESTROYED 2            // 已析构，之后的申请和释放直接使用全局池
+
+static thread_local int thread_cache_state = THREAD_CACHE_UNUSED;
+
+struct Tensor_pool_thread_cache {
+    std::vector<void*> free_list[TENSOR_POOL_N_CLASSES];
+
+    Tensor_pool_thread_cache()
+    {
+        thread_cache_state = THREAD_CACHE_ALIVE;
+    }
+
+    ~Tensor_pool_thread_cache()
+    {
+        thread_cache_state = THREAD_CACHE_DESTROYED;
+        Pool_allocator * pool = get_pool_allocator();
+        for(int i = 0; i < TENSOR_POOL_N_CLASSES; i++) {
+            for(void * ptr: free_list[i]) {
+                if(!pool->global_push(ptr, i, class_block_bytes(i))) {
+                    free(ptr);
+                }
+            }
+        }
+    }
+};
+
+static thread_local Tensor_pool_thread_cache thread_cache;
+
+static Tensor_pool_thread_cache * local_thread_cache()
+{
+    /*
+     * 当前线程的线程缓存(第一次使用时构造)，已析构时返回nullptr
+     */
+    if(thread_cache_state == THREAD_CACHE_DESTROYED) {
+        return nullptr;
+    }
+    return &thread_cache;
+}
+
+
+Pool_allocator::Pool_allocator(unsigned long long limit_bytes)
+{
+    impl = new Impl();
+    this->limit_bytes = limit_bytes;
+    hits = 0;
+    misses = 0;
+    bypass = 0;
+}
+
+Pool_allocator::~Pool_allocator()
+{
+    trim();
+    delete(impl);
+}
+
+size_t Pool_allocator::size_class(size_t bytes, int * index)
+{
+    /*
+     * 计算尺寸等级
+     * bytes <= 64: 等级0，块大小64
+     * 2^k < bytes <= 2^(k+1): 区间平均分为4档，每档step=2^(k-2)，取能容纳bytes的最小一档
+     * 超过TENSOR_POOL_MAX_BLOCK_BYTES: 等级-1，块大小即bytes
+     */
+    if(bytes <= TENSOR_POOL_MIN_BLOCK_BYTES) {
+        *index = 0;
+        return TENSOR_POOL_MIN_BLOCK_BYTES;
+    }
+    if(bytes > TENSOR_POOL_MAX_BLOCK_BYTES) {
+        *index = -1;
+        return bytes;
+    }
+    int k = 63 - __builtin_clzll((unsigned long long)bytes - 1);
+    size_t base = (size_t)1 << k;
+    size_t step = (size_t)1 << (k - 2);
+    size_t j = (bytes - base + step - 1) / step;       // 1~4
+    *index = 1 + (k - 6) * 4 + (int)(j - 1);
+    return base + j * step;
+}
+
+void * Pool_allocator::global_pop(int index)
+{
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    std::vector<void*> &list = impl->free_list[index];
+    if(list.empty()) {
+        return nullptr;
+    }
+    void * ptr = list.back();
+    list.pop_back();
+    impl->cached_bytes -= class_block_bytes(index);
+    return ptr;
+}
+
+bool Pool_allocator::global_push(void * ptr, int index, size_t block_bytes)
+{
+    /*
+     * 把内存块放入全局池。超过缓存上限时返回false，由调用者free
+     */
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    if(impl->cached_bytes + block_bytes > limit_bytes) {
+        return false;
+    }
+    impl->free_list[index].push_back(ptr);
+    impl->cached_bytes += block_bytes;
+    return true;
+}
+
+void Pool_allocator::count_hit()
+{
+    hits.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Pool_allocator::count_miss()
+{
+    misses.fetch_add(1, std::memory_order_relaxed);
+}
+
+void * Pool_allocator::allocate(size_t bytes)
+{
+    /*
+     * 申请内存块：线程缓存 -> 全局池 -> aligned_malloc
+     */
+    int index;
+    size_t block_bytes = size_class(bytes, &index);
+    if(index < 0) {
+        bypass.fetch_add(1, std::memory_order_relaxed);
+        return aligned_malloc(bytes);
+    }
+    Tensor_pool_thread_cache * cache = nullptr;
+    if(block_bytes <= TENSOR_POOL_THREAD_CACHE_MAX_BYTES && this == get_pool_allocator()) {
+        cache = local_thread_cache();
+    }
+    if(cache != nullptr) {
+        std::vector<void*> &list = cache->free_list[index];
+        if(!list.empty()) {
+            void * ptr = list.back();
+            list.pop_back();
+            count_hit();
+            return ptr;
+        }
+    }
+    void * ptr = global_pop(index);
+    if(ptr != nullptr) {
+        count_hit();
+        return ptr;
+    }
+    count_miss();
+    return aligned_malloc(block_bytes);
+}
+
+void Pool_allocator::deallocate(void * ptr, size_t bytes)
+{
+    /*
+     * 释放内存块：线程缓存 -> 全局池 -> free
+     */
+    int index;
+    size_t block_bytes = size_class(bytes, &index);
+    if(index < 0) {
+        free(ptr);
+        return;
+    }
+    Tensor_pool_thread_cache * cache = nullptr;
+    if(block_bytes <= TENSOR_POOL_THREAD_CACHE_MAX_BYTES && this == get_pool_allocator()) {
+        cache = local_thread_cache();
+    }
+    if(cache != nullptr) {
+        std::vector<void*> &list = cache->free_list[index];
+        if(list.size() < TENSOR_POOL_THREAD_CACHE_BLOCKS) {
+            list.push_back(ptr);
+            return;
+        }
+    }
+    if(!global_push(ptr, index, block_bytes)) {
+        free(ptr);
+    }
+}
+
+void Pool_allocator::trim()
+{
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    for(auto &list: impl->free_list) {
+        for(void * ptr: list) {
+            free(ptr);
+        }
+        list.clear();
+    }
+    impl->cached_bytes = 0;
+}
+
+Tensor_pool_stats Pool_allocator::stats() const
+{
+    Tensor_pool_stats s;
+    s.hits = hits.load(std::memory_order_relaxed);
+    s.misses = misses.load(std::memory_order_relaxed);
+    s.bypass = bypass.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        s.cached_bytes = impl->cached_bytes;
+    }
+    return s;
+}
+
+void Pool_allocator::reset_stats()
+{
+    hits = 0;
+    misses = 0;
+    bypass = 0;
+}
+
+
+static std::atomic<Tensor_allocator*> current_allocator(nullptr);
+
+Malloc_allocator * get_malloc_allocator()
+{
+    static Malloc_allocator * allocator = new Malloc_allocator();     // 不析构，保证退出时仍可释放张量
+    return allocator;
+}
+
+Pool_allocator * get_pool_allocator()
+{
+    static Pool_allocator * allocator = new Pool_allocator();         // 不析构，保证退出时仍可释放张量
+    return allocator;
+}
+
+Tensor_allocator * get_tensor_allocator()
+{
+    Tensor_allocator * allocator = current_allocator.load(std::memory_order_acquire);
+    if(allocator == nullptr) {
+        return get_pool_allocator();
+    }
+    return allocator;
+}
+
+void set_tensor_allocator(Tensor_allocator * allocator)
+{
+    current_allocator.store(allocator, std::memory_order_release);
+}
+
+void set_tensor_pool_enabled(bool enabled)
+{
+    if(enabled) {
+        set_tensor_allocator(get_pool_allocator());
+    }
+    else {
+        set_tensor_allocator(get_malloc_allocator());
+    }
+}
+
+bool tensor_pool_enabled()
+{
+    return get_tensor_allocator() == get_pool_allocator();
+}
+
+void print_tensor_pool_stats()
+{
+    Tensor_pool_stats s = get_pool_allocator()->stats();
+    unsigned long long total = s.hits + s.misses;
+    printf("Tensor pool: hits: %llu, misses: %llu, bypass: %llu, hit rate: %.2f%%, cached: %.2f MB\n",
+           s.hits, s.misses, s.bypass, total == 0 ? 0.0 : 100.0 * (double)s.hits / (double)total,
+           (double)s.cached_bytes / 1024 / 1024);
+}
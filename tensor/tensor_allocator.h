@@ -0,0 +1,96 @@
+#ifndef QUANT_TENSOR_ALLOCATOR_H
+#define QUANT_TENSOR_ALLOCATOR_H
+
+/*
+ * 张量数据空间分配器
+ * Tensor_storage的内存(控制块+数据)都通过当前分配器申请和释放。
+ * 分配器可替换：继承Tensor_allocator并通过set_tensor_allocator()设置即可。
+ * 对齐约定：allocate()返回的地址必须按TENSOR_ALIGN(64字节，即一个cache line，也是AVX-512一个向量的宽度)对齐。
+ * 每个控制块记录申请它的分配器，因此运行中切换分配器不影响已经存在的张量。
+ *
+ * 提供两种分配器：
+ * 1. Malloc_allocator: 直接posix_memalign/free
+ * 2. Pool_allocator(默认): 按尺寸等级回收复用内存块
+ *      尺寸等级：每个2的幂区间(2^k, 2^(k+1)]再平均分为4档，浪费不超过25%。最小64字节
+ *      线程缓存：不超过TENSOR_POOL_THREAD_CACHE_MAX_BYTES的内存块优先放入当前线程的缓存，存取不加锁
+ *      全局池：较大的内存块以及线程缓存放不下的内存块放入全局池，用互斥锁保护
+ *      全局池缓存的总字节数超过上限时，多出的内存块直接free
+ *      超过TENSOR_POOL_MAX_BLOCK_BYTES的内存块不进入池，直接malloc/free
+ *      统计申请时命中(hit)和未命中(miss)的次数
+ */
+
+#include <atomic>
+#include <cstddef>
+
+
+#define TENSOR_ALIGN 64                                         // 数据空间对齐字节数
+#define TENSOR_POOL_MIN_BLOCK_BYTES 64                          // 最小内存块
+#define TENSOR_POOL_MAX_BLOCK_BYTES (1ULL << 32)                // 进入池的最大内存块
+#define TENSOR_POOL_THREAD_CACHE_MAX_BYTES (1ULL << 20)         // 进入线程缓存的最大内存块
+#define TENSOR_POOL_THREAD_CACHE_BLOCKS 8                       // 线程缓存每个尺寸等级最多缓存的内存块数
+#define TENSOR_POOL_DEFAULT_LIMIT_BYTES (2ULL << 30)            // 全局池默认最多缓存的字节数
+
+
+class Tensor_allocator {
+public:
+    virtual void * allocate(size_t bytes) = 0;                  // 申请bytes字节，返回TENSOR_ALIGN对齐的地址
+    virtual void deallocate(void * ptr, size_t bytes) = 0;      // 释放，bytes必须与申请时相同
+    virtual ~Tensor_allocator() = default;
+};
+
+
+class Malloc_allocator: public Tensor_allocator {
+public:
+    void * allocate(size_t bytes) override;
+    void deallocate(void * ptr, size_t bytes) override;
+};
+
+
+struct Tensor_pool_stats {
+    unsigned long long hits;                // 从池中取到内存块的次数
+    unsigned long long misses;              // 池中没有可用内存块，调用malloc的次数
+    unsigned long long bypass;              // 内存块过大，不经过池的次数
+    unsigned long long cached_bytes;        // 全局池中当前缓存的字节数(不含线程缓存)
+};
+
+
+class Pool_allocator: public Tensor_allocator {
+public:
+    explicit Pool_allocator(unsigned long long limit_bytes=TENSOR_POOL_DEFAULT_LIMIT_BYTES);
+    void * allocate(size_t bytes) override;
+    void deallocate(void * ptr, size_t bytes) override;
+    ~Pool_allocator() override;
+
+    void trim();                            // 释放全局池中缓存的所有内存块
+    Tensor_pool_stats stats() const;
+    void reset_stats();
+
+    static size_t size_class(size_t bytes, int * index);   // 计算bytes所属的尺寸等级，返回该等级的块大小
+
+    // 以下成员供线程缓存使用
+    void * global_pop(int index);
+    bool global_push(void * ptr, int index, size_t block_bytes);
+    void count_hit();
+    void count_miss();
+
+private:
+    struct Impl;
+    Impl * impl;
+    unsigned long long limit_bytes;
+    std::atomic<unsigned long long> hits;
+    std::atomic<unsigned long long> misses;
+    std::atomic<unsigned long long> bypass;
+};
+
+
+void * aligned_malloc(size_t bytes);                            // 申请TENSOR_ALIGN对齐的内存，失败返回nullptr，用free释放
+Tensor_allocator * get_tensor_allocator();                      // 获取当前分配器
+void set_tensor_allocator(Tensor_allocator * allocator);        // 设置当前分配器(不转移所有权)
+Malloc_allocator * get_malloc_allocator();                      // 全局malloc分配器
+Pool_allocator * get_pool_allocator();                          // 全局池分配器
+void set_tensor_pool_enabled(bool enabled);                     // 开关池分配器(关闭时使用malloc分配器)
+bool tensor_pool_enabled();
+void print_tensor_pool_stats();                                 // 打印池分配器命中统计
+
+
+#endif //QUANT_TENSOR_ALLOCATOR_H
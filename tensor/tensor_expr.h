@@ -0,0 +1,592 @@
+#ifndef QUANT_TENSOR_EXPR_H
+#define QUANT_TENSOR_EXPR_H
+
+/*
+ * 张量表达式模板
+ * 设计思路：
+ * Tensor之间(以及Tensor与数值之间)的 + - * / 不再立即计算，而是返回一个记录了运算结构的表达式对象。
+ * 表达式被赋值给Tensor(构造、operator=、对截取的赋值)时，才在一次遍历中算出所有结果，不为中间结果申请张量。
+ * 例如：
+ *      Tensor<float32> y = (x - mean) / std * weight + bias;
+ * 只申请y一块空间，对每个元素依次计算 (x-mean)/std*weight+bias。
+ *
+ * 表达式节点：
+ * 1. Tensor_leaf: 叶子，持有一个Tensor(增加引用计数，保证计算时数据有效)
+ * 2. Tensor_scalar: 数值
+ * 3. Tensor_binary: 二元运算(+ - * /)，构造时按广播规则计算结果尺寸
+ * 4. Tensor_unary: 一元运算(elewise_sqrt, clip)
+ * 5. Tensor_cast: 类型转换(astype_float32等)
+ * 每一步运算的结果都转换为节点的value_type，与逐个算子计算时的舍入/截断完全一致。
+ *
+ * 计算过程(tensor_expr_eval)：
+ * 1. bind: 每个叶子根据结果尺寸计算自己的步长(被广播的维度步长为0，视图使用自己的步长)
+ * 2. 去掉长度为1的维度，并合并所有叶子和结果都能合并的相邻维度(如按通道广播的(1,C,1,1)与(N,C,H,W)计算时，H和W合并为一维)
+ *    尺寸相同的连续张量合并为一维，整个计算只有一行
+ * 3. 按行遍历：每行开始时seek定位各叶子的行首；行内每次处理TENSOR_EXPR_BLOCK个元素，
+ *    叶子把这一段准备为连续数据(步长为1直接使用原数据，步长为0或其他时填充/收集到叶子内部的缓冲区)，
+ *    运算节点对这一段调用向量化内核(见tensor_kernel.h)，结果放在缓冲区中(不超过一级缓存)，再交给上一层节点。
+ *    被广播的操作数不会被复制为完整尺寸的张量：数值直接参与计算，步长为0的维度只填充一段缓冲区，且值不变时不重复填充
+ *
+ * 注意：表达式中的叶子持有的是Tensor的浅拷贝，表达式计算前修改原张量的数据，计算结果也会改变。
+ * 注意：原地计算(*=, /=)时，右值中的张量如果以广播的方式引用了左值自身，结果是未定义的
+ */
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
+
+#include "tensor.h"
+
+
+#define TENSOR_EXPR_BLOCK 256       // 每次计算的元素个数
+
+
+// 运算：对一段连续数据调用tensor_kernel.h中的内核(float32使用向量化内核)
+#define TENSOR_EXPR_OP(Name, kernel)                                                    \
+struct Name {                                                                           \
+    template<typename T, typename A, typename B>                                        \
+    static void block(T * out, A a, B b, int n) { kernel(out, a, b, n); }               \
+};
+
+TENSOR_EXPR_OP(Expr_add, kernel_add)
+TENSOR_EXPR_OP(Expr_sub, kernel_sub)
+TENSOR_EXPR_OP(Expr_mult, kernel_mult)
+TENSOR_EXPR_OP(Expr_div, kernel_div)
+TENSOR_EXPR_OP(Expr_floor_div, kernel_floor_div)
+
+#undef TENSOR_EXPR_OP
+
+template<typename T>
+struct Expr_sqrt {
+    void block(T * out, const T * a, int n) const { kernel_sqrt(out, a, n); }
+};
+template<typename T>
+struct Expr_clip {
+    T min;
+    T max;
+    void block(T * out, const T * a, int n) const { kernel_clip(out, a, n, min, max); }
+};
+
+template<typename Op, typename L, typename R> class Tensor_binary;
+template<typename Op, typename E> class Tensor_unary;
+template<typename U, typename E> class Tensor_cast;
+
+
+template<typename E>
+class Tensor_expr {
+    /*
+     * 所有表达式节点的基类(CRTP)
+     */
+public:
+    static const bool is_scalar = false;    // 是否是数值(Tensor_scalar中为true)
+
+    const E & self() const { return static_cast<const E&>(*this); }
+
+    template<typename V = E>    // 推迟到调用时才取value_type(基类实例化时E还不完整)
+    Tensor_unary<Expr_sqrt<typename V::value_type>, V> elewise_sqrt() const;   // 开平方
+    Tensor_cast<float32, E> astype_float32() const;                             // 转为float32
+    Tensor_cast<int32, E> astype_int32() const;                                 // 转为int32
+    Tensor_cast<uint8, E> astype_uint8() const;                                 // 转为uint8
+    Tensor_cast<fp16, E> astype_float16() const;                                // 转为fp16
+    Tensor_cast<bf16, E> astype_bfloat16() const;                               // 转为bf16
+};
+
+
+template<typename T>
+class Tensor_leaf: public Tensor_expr<Tensor_leaf<T>> {
+    /*
+     * 叶子：一个张量
+     */
+public:
+    typedef T value_type;
+
+    explicit Tensor_leaf(const Tensor<T> &t): tensor(t) {}
+    // 复制节点时不复制缓冲区和遍历状态(计算前由bind/seek重新设置)
+    Tensor_leaf(const Tensor_leaf &other): Tensor_expr<Tensor_leaf<T>>(), tensor(other.tensor), stride(other.stride) {}
+
+    Tensor_shape shape() const { return tensor.size; }
+
+    void bind(const Tensor_shape &out_shape)
+    {
+        // 计算相对于结果尺寸的步长：尺寸右对齐，左侧补齐的维度和被广播的维度步长为0
+        int out_dim = (int)out_shape.size();
+        int dim = (int)tensor.size.size();
+        Tensor_stride self_stride = tensor.stride.empty() ? contiguous_stride(tensor.size) : tensor.stride;
+        stride.assign(out_dim, 0);
+        for(int k = out_dim-dim; k<out_dim; k++) {
+            int j = k - (out_dim-dim);
+            if(tensor.size[j] != 1 || out_shape[k] == 1) {
+                stride[k] = self_stride[j];
+            }
+        }
+    }
+    bool can_merge(const Tensor_shape &shape, int d) const
+    {
+        return (int64_t)stride[d] == (int64_t)stride[d+1] * shape[d+1];
+    }
+    void erase(int d) { stride.erase(stride.begin()+d); }
+    void seek(const Tensor_shape &index)
+    {
+        int dim = (int)stride.size();
+        int64_t offset = 0;
+        for(int k = 0; k<dim-1; k++) {
+            offset += (int64_t)index[k] * stride[k];
+        }
+        row = tensor.data + offset;
+        inner = stride[dim-1];
+    }
+    const T * eval(int start, int n, T *)
+    {
+        // 这一段的连续数据：步长为1直接返回原数据，否则填充/收集到缓冲区
+        if(inner == 1) {
+            block = row + start;
+        }
+        else if(inner == 0) {
+            // 被广播的维度：缓冲区中已经是同一个值时不再重复填充(按通道广播时每行只填充一次)
+            T value = row[0];
+            if(block != buf || filled < n || !(buf[0] == value)) {
+                for(int i = 0; i<n; i++) {
+                    buf[i] = value;
+                }
+                filled = n;
+            }
+            block = buf;
+        }
+        else {
+            const T * src = row + (int64_t)start * inner;
+            for(int i = 0; i<n; i++) {
+                buf[i] = src[(int64_t)i * inner];
+            }
+            filled = 0;
+            block = buf;
+        }
+        return block;
+    }
+
+private:
+    Tensor<T> tensor;
+    Tensor_stride stride;       // 相对于结果尺寸的步长
+    const T * row = nullptr;        // 当前行首
+    int64_t inner = 1;              // 最内层维度的步长
+    const T * block = nullptr;      // 当前段的连续数据
+    int filled = 0;                 // 缓冲区中填充的相同值的个数
+    T buf[TENSOR_EXPR_BLOCK];       // 步长不为1时的缓冲区
+};
+
+
+template<typename T>
+class Tensor_scalar: public Tensor_expr<Tensor_scalar<T>> {
+    /*
+     * 叶子：一个数值。可广播到任意尺寸
+     */
+public:
+    typedef T value_type;
+    static const bool is_scalar = true;
+
+    explicit Tensor_scalar(T value): v(value) {}
+
+    Tensor_shape shape() const { return Tensor_shape(); }
+    void bind(const Tensor_shape &) {}
+    bool can_merge(const Tensor_shape &, int) const { return true; }
+    void erase(int) {}
+    void seek(const Tensor_shape &) {}
+    const T * eval(int, int n, T * out)
+    {
+        for(int i = 0; i<n; i++) {
+            out[i] = v;
+        }
+        return out;
+    }
+    T value() const { return v; }
+
+private:
+    T v;
+};
+
+
+template<typename Op, typename L, typename R>
+class Tensor_binary: public Tensor_expr<Tensor_binary<Op, L, R>> {
+    /*
+     * 二元运算。构造时按广播规则计算结果尺寸，不能广播时报错
+     */
+public:
+    typedef typename L::value_type value_type;
+    static_assert(std::is_same<typename L::value_type, typename R::value_type>::value,
+                  "operands of a tensor expression should have the same type");
+
+    Tensor_binary(const Tensor_binary &other):
+            Tensor_expr<Tensor_binary<Op, L, R>>(), l(other.l), r(other.r), out_shape(other.out_shape) {}  // 不复制缓冲区
+    Tensor_binary(const L &l, const R &r): l(l), r(r)
+    {
+        Tensor_shape l_shape = l.shape();
+        Tensor_shape r_shape = r.shape();
+        int dim = (int)std::max(l_shape.size(), r_shape.size());
+        out_shape.assign(dim, 1);
+        for(int k = 0; k<dim; k++) {
+            int lk = k - (dim - (int)l_shape.size());
+            int rk = k - (dim - (int)r_shape.size());
+            int ls = lk >= 0 ? l_shape[lk] : 1;
+            int rs = rk >= 0 ? r_shape[rk] : 1;
+            if(ls == rs || rs == 1) {
+                out_shape[k] = ls;
+            }
+            else if(ls == 1) {
+                out_shape[k] = rs;
+            }
+            else {
+                fprintf(stderr, "File: tensor_expr.h, line: %d. operands could not be broadcast together "
+                                "with shapes (", __LINE__);
+                for(const int &s: l_shape) {
+                    fprintf(stderr, "%d, ", s);
+                }
+                fprintf(stderr, ") (");
+                for(const int &s: r_shape) {
+                    fprintf(stderr, "%d, ", s);
+                }
+                fprintf(stderr, ")\n");
+                exit(-1);
+            }
+        }
+    }
+
+    Tensor_shape shape() const { return out_shape; }
+    void bind(const Tensor_shape &shape) { l.bind(shape); r.bind(shape); }
+    bool can_merge(const Tensor_shape &shape, int d) const { return l.can_merge(shape, d) && r.can_merge(shape, d); }
+    void erase(int d) { l.erase(d); r.erase(d); }
+    void seek(const Tensor_shape &index) { l.seek(index); r.seek(index); }
+    const value_type * eval(int start, int n, value_type * out)
+    {
+        // 左操作数可以把结果放在out中(逐元素运算可以原地进行)，右操作数使用自己的缓冲区；数值直接传给内核
+        eval(start, n, out, std::integral_constant<bool, L::is_scalar>(), std::integral_constant<bool, R::is_scalar>());
+        return out;
+    }
+
+private:
+    void eval(int start, int n, value_type * out, std::false_type, std::false_type)
+    {
+        const value_type * a = l.eval(start, n, out);
+        const value_type * b = r.eval(start, n, buf);
+        Op::block(out, a, b, n);
+    }
+    void eval(int start, int n, value_type * out, std::false_type, std::true_type)
+    {
+        const value_type * a = l.eval(start, n, out);
+        Op::block(out, a, r.value(), n);
+    }
+    void eval(int start, int n, value_type * out, std::true_type, std::false_type)
+    {
+        const value_type * b = r.eval(start, n, out);
+        Op::block(out, l.value(), b, n);
+    }
+
+    L l;
+    R r;
+    Tensor_shape out_shape;
+    value_type buf[TENSOR_EXPR_BLOCK];      // 右操作数的计算结果
+};
+
+
+template<typename Op, typename E>
+class Tensor_unary: public Tensor_expr<Tensor_unary<Op, E>> {
+    /*
+     * 一元运算
+     */
+public:
+    typedef typename E::value_type value_type;
+
+    Tensor_unary(const E &e, const Op &op): e(e), op(op) {}
+
+    Tensor_shape shape() const { return e.shape(); }
+    void bind(const Tensor_shape &shape) { e.bind(shape); }
+    bool can_merge(const Tensor_shape &shape, int d) const { return e.can_merge(shape, d); }
+    void erase(int d) { e.erase(d); }
+    void seek(const Tensor_shape &index) { e.seek(index); }
+    const value_type * eval(int start, int n, value_type * out)
+    {
+        op.block(out, e.eval(start, n, out), n);
+        return out;
+    }
+
+private:
+    E e;
+    Op op;
+};
+
+
+template<typename U, typename E>
+class Tensor_cast: public Tensor_expr<Tensor_cast<U, E>> {
+    /*
+     * 类型转换
+     */
+public:
+    typedef U value_type;
+
+    explicit Tensor_cast(const E &e): e(e) {}
+    Tensor_cast(const Tensor_cast &other): Tensor_expr<Tensor_cast<U, E>>(), e(other.e) {}    // 不复制缓冲区
+
+    Tensor_shape shape() const { return e.shape(); }
+    void bind(const Tensor_shape &shape) { e.bind(shape); }
+    bool can_merge(const Tensor_shape &shape, int d) const { return e.can_merge(shape, d); }
+    void erase(int d) { e.erase(d); }
+    void seek(const Tensor_shape &index) { e.seek(index); }
+    const U * eval(int start, int n, U * out)
+    {
+        kernel_cast(out, e.eval(start, n, buf), n);
+        return out;
+    }
+
+private:
+    E e;
+    typename E::value_type buf[TENSOR_EXPR_BLOCK];     // 转换前的数据
+};
+
+
+template<typename E>
+template<typename V>
+Tensor_unary<Expr_sqrt<typename V::value_type>, V> Tensor_expr<E>::elewise_sqrt() const
+{
+    return Tensor_unary<Expr_sqrt<typename V::value_type>, V>(self(), Expr_sqrt<typename V::value_type>());
+}
+
+template<typename E>
+Tensor_cast<float32, E> Tensor_expr<E>::astype_float32() const
+{
+    return Tensor_cast<float32, E>(self());
+}
+
+template<typename E>
+Tensor_cast<int32, E> Tensor_expr<E>::astype_int32() const
+{
+    return Tensor_cast<int32, E>(self());
+}
+
+template<typename E>
+Tensor_cast<uint8, E> Tensor_expr<E>::astype_uint8() const
+{
+    return Tensor_cast<uint8, E>(self());
+}
+
+template<typename E>
+Tensor_cast<fp16, E> Tensor_expr<E>::astype_float16() const
+{
+    return Tensor_cast<fp16, E>(self());
+}
+
+template<typename E>
+Tensor_cast<bf16, E> Tensor_expr<E>::astype_bfloat16() const
+{
+    return Tensor_cast<bf16, E>(self());
+}
+
+
+template<typename T>
+Tensor_leaf<T> as_expr(const Tensor<T> &t)
+{
+    /*
+     * 把张量包装为表达式，以便使用表达式的elewise_sqrt、astype等延迟计算的成员
+     */
+    return Tensor_leaf<T>(t);
+}
+
+
+template<typename E>
+Tensor_unary<Expr_clip<typename E::value_type>, E>
+clip(const Tensor_expr<E> &e, typename E::value_type min, typename E::value_type max)
+{
+    /*
+     * 延迟计算的clip，返回表达式。与Tensor::clip(原地修改)不同
+     */
+    return Tensor_unary<Expr_clip<typename E::value_type>, E>(e.self(), Expr_clip<typename E::value_type>{min, max});
+}
+
+template<typename T>
+Tensor_unary<Expr_clip<T>, Tensor_leaf<T>>
+clip(const Tensor<T> &t, typename Tensor<T>::value_type min, typename Tensor<T>::value_type max)
+{
+    return Tensor_unary<Expr_clip<T>, Tensor_leaf<T>>(Tensor_leaf<T>(t), Expr_clip<T>{min, max});
+}
+
+
+/*
+ * 运算符重载：张量/表达式/数值两两组合，返回表达式
+ */
+#define TENSOR_EXPR_OPERATOR(op, Op)                                                                    \
+template<typename T>                                                                                    \
+Tensor_binary<Op, Tensor_leaf<T>, Tensor_leaf<T>> operator op(const Tensor<T> &a, const Tensor<T> &b)   \
+{                                                                                                       \
+    return Tensor_binary<Op, Tensor_leaf<T>, Tensor_leaf<T>>(Tensor_leaf<T>(a), Tensor_leaf<T>(b));     \
+}                                                                                                       \
+template<typename T, typename E>                                                                        \
+Tensor_binary<Op, Tensor_leaf<T>, E> operator op(const Tensor<T> &a, const Tensor_expr<E> &b)           \
+{                                                                                                       \
+    return Tensor_binary<Op, Tensor_leaf<T>, E>(Tensor_leaf<T>(a), b.self());                           \
+}                                                                                                       \
+template<typename E, typename T>                                                                        \
+Tensor_binary<Op, E, Tensor_leaf<T>> operator op(const Tensor_expr<E> &a, const Tensor<T> &b)           \
+{                                                                                                       \
+    return Tensor_binary<Op, E, Tensor_leaf<T>>(a.self(), Tensor_leaf<T>(b));                           \
+}                                                                                                       \
+template<typename E1, typename E2>                                                                      \
+Tensor_binary<Op, E1, E2> operator op(const Tensor_expr<E1> &a, const Tensor_expr<E2> &b)               \
+{                                                                                                       \
+    return Tensor_binary<Op, E1, E2>(a.self(), b.self());                                               \
+}                                                                                                       \
+template<typename T>                                                                                    \
+Tensor_binary<Op, Tensor_leaf<T>, Tensor_scalar<T>>                                                     \
+operator op(const Tensor<T> &a, typename Tensor<T>::value_type b)                                       \
+{                                                                                                       \
+    return Tensor_binary<Op, Tensor_leaf<T>, Tensor_scalar<T>>(Tensor_leaf<T>(a), Tensor_scalar<T>(b)); \
+}                                                                                                       \
+template<typename T>                                                                                    \
+Tensor_binary<Op, Tensor_scalar<T>, Tensor_leaf<T>>                                                     \
+operator op(typename Tensor<T>::value_type a, const Tensor<T> &b)                                       \
+{                                                                                                       \
+    return Tensor_binary<Op, Tensor_scalar<T>, Tensor_leaf<T>>(Tensor_scalar<T>(a), Tensor_leaf<T>(b)); \
+}                                                                                                       \
+template<typename E>                                                                                    \
+Tensor_binary<Op, E, Tensor_scalar<typename E::value_type>>                                             \
+operator op(const Tensor_expr<E> &a, typename E::value_type b)                                          \
+{                                                                                                       \
+    return Tensor_binary<Op, E, Tensor_scalar<typename E::value_type>>(                                 \
+            a.self(), Tensor_scalar<typename E::value_type>(b));                                        \
+}                                                                                                       \
+template<typename E>                                                                                    \
+Tensor_binary<Op, Tensor_scalar<typename E::value_type>, E>                                             \
+operator op(typename E::value_type a, const Tensor_expr<E> &b)                                          \
+{                                                                                                       \
+    return Tensor_binary<Op, Tensor_scalar<typename E::value_type>, E>(                                 \
+            Tensor_scalar<typename E::value_type>(a), b.self());                                        \
+}
+
+TENSOR_EXPR_OPERATOR(+, Expr_add)
+TENSOR_EXPR_OPERATOR(-, Expr_sub)
+TENSOR_EXPR_OPERATOR(*, Expr_mult)
+TENSOR_EXPR_OPERATOR(/, Expr_div)
+
+#undef TENSOR_EXPR_OPERATOR
+
+
+template<typename T, typename E>
+void tensor_expr_eval(T * out, Tensor_stride out_stride, Tensor_shape shape, E expr, bool may_alias = true)
+{
+    /*
+     * 计算表达式expr，结果写入out(尺寸shape，步长out_stride，为空表示连续)
+     * expr按值传入：计算过程会修改节点内部的步长和缓冲区
+     * may_alias: 表达式中的张量是否可能与out共享数据。共享时先算到缓冲区再写入out，
+     *            避免左子树提前写入out后，右子树读到已经被修改的数据
+     */
+    static_assert(std::is_same<typename E::value_type, T>::value,
+                  "type of tensor expression should be the same as the tensor assigned to");
+    if(shape.empty()) {
+        shape.push_back(1);
+    }
+    if(out_stride.empty()) {
+        out_stride = contiguous_stride(shape);
+    }
+    expr.bind(shape);
+    // 去掉长度为1的维度(至少保留一维)
+    for(int d = (int)shape.size()-1; d>=0 && shape.size()>1; d--) {
+        if(shape[d] == 1) {
+            shape.erase(shape.begin()+d);
+            out_stride.erase(out_stride.begin()+d);
+            expr.erase(d);
+        }
+    }
+    // 合并相邻维度：合并后的维度长度为两者之积，步长为内侧维度的步长
+    for(int d = (int)shape.size()-2; d>=0; d--) {
+        if((int64_t)out_stride[d] == (int64_t)out_stride[d+1] * shape[d+1] && expr.can_merge(shape, d)) {
+            shape[d+1] *= shape[d];
+            shape.erase(shape.begin()+d);
+            out_stride.erase(out_stride.begin()+d);
+            expr.erase(d);
+        }
+    }
+    // 按行计算
+    int dim = (int)shape.size();
+    int row = shape[dim-1];
+    int64_t out_inner = out_stride[dim-1];
+    int64_t rows = 1;
+    for(int k = 0; k<dim-1; k++) {
+        rows *= shape[k];
+    }
+    Tensor_shape index(dim, 0);
+    int64_t out_offset = 0;
+    T block[TENSOR_EXPR_BLOCK];
+    for(int64_t r = 0; r<rows; r++) {
+        expr.seek(index);
+        T * o = out + out_offset;
+        for(int start = 0; start<row; start += TENSOR_EXPR_BLOCK) {
+            int n = std::min(TENSOR_EXPR_BLOCK, row-start);
+            if(out_inner == 1 && !may_alias) {
+                T * dst = o + start;
+                const T * result = expr.eval(start, n, dst);
+                if(result != dst) {
+                    std::copy(result, result+n, dst);
+                }
+            }
+            else {
+                const T * result = expr.eval(start, n, block);
+                for(int i = 0; i<n; i++) {
+                    o[(int64_t)(start+i) * out_inner] = result[i];
+                }
+            }
+        }
+        // 外层下标加一
+        for(int p = dim-2; p>=0; p--) {
+            index[p]++;
+            out_offset += out_stride[p];
+            if(index[p] < shape[p]) {
+                break;
+            }
+            out_offset -= (int64_t)out_stride[p] * shape[p];
+            index[p] = 0;
+        }
+    }
+}
+
+
+template<typename T>
+template<typename E>
+Tensor<T>::Tensor(const Tensor_expr<E> &expr): Tensor(expr.self().shape()) {
+    /*
+     * 从表达式构造：按表达式的尺寸申请空间，计算表达式
+     */
+    tensor_expr_eval(data, Tensor_stride(), size, expr.self(), false);     // 新申请的空间不会被表达式引用
+}
+
+template<typename T>
+template<typename E>
+Tensor<T> &Tensor<T>::operator=(const Tensor_expr<E> &expr) & {
+    /*
+     * 表达式赋值，左值是具名对象：按表达式计算出新张量，左值指向新张量
+     */
+    *this = Tensor<T>(expr);
+    return *this;
+}
+
+template<typename T>
+template<typename E>
+Tensor<T> &Tensor<T>::operator=(const Tensor_expr<E> &expr) && {
+    /*
+     * 表达式赋值，左值是临时对象(截取)：尺寸必须与表达式相同，直接把结果写入左值的数据空间
+     */
+    Tensor_shape expr_size = expr.self().shape();
+    if(this->size != expr_size) {
+        fprintf(stderr, "File: tensor_expr.h, line: %d. Could not broadcast input array "
+                        "from shape (", __LINE__);
+        for(const int &s: expr_size) {
+            fprintf(stderr, "%d, ", s);
+        }
+        fprintf(stderr, ") into shape (");
+        for(const int &s: this->size) {
+            fprintf(stderr, "%d, ", s);
+        }
+        fprintf(stderr, ")\n");
+        exit(-1);
+    }
+    tensor_expr_eval(this->data, this->stride, this->size, expr.self());
+    return *this;
+}
+
+#endif //QUANT_TENSOR_EXPR_H
@@ -0,0 +1,130 @@
+#ifndef QUANT_TENSOR_HALF_H
+#define QUANT_TENSOR_HALF_H
+
+/*
+ * 半精度浮点类型：fp16(IEEE 754 binary16，即float16)和bf16(bfloat16)
+ * 类型名不用bfloat16：OpenBLAS的头文件(cblas.h)已经定义了全局的typedef uint16_t bfloat16
+ * 设计思路：
+ * 两者都只用于存储(权重等)，占float32一半的空间，读取时的内存带宽减半。计算时转为float32：
+ * 类型本身只保存16位的位模式，可以与float32互相隐式转换，因此 + - * / 和比较都先转为float32计算，结果再转回半精度。
+ * 大量数据的转换使用tensor_kernel.h中的向量化内核(astype_float16/astype_bfloat16/astype_float32)，
+ * 这里的标量转换函数是所有内核的参考实现，各指令集的结果与其逐位相同。
+ *
+ * 1. fp16: 1位符号、5位指数、10位尾数。范围±65504，有非规格化数
+ *      float32 -> fp16: 就近舍入(ties to even)，超出范围得到inf，过小得到非规格化数或0。与F16C的vcvtps2ph相同
+ *      fp16 -> float32: 精确
+ * 2. bf16: float32的高16位(1位符号、8位指数、7位尾数)。范围与float32相同，精度较低
+ *      float32 -> bf16: 就近舍入(ties to even)
+ *      bf16 -> float32: 精确(低16位补0)
+ * NaN转换后仍为NaN(quiet NaN，保留尾数高位)
+ */
+
+#include <cstdint>
+#include <cstring>
+
+
+inline uint32_t float32_bits(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    return x;
+}
+
+inline float float32_from_bits(uint32_t x)
+{
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+inline uint16_t float32_to_float16_bits(float f)
+{
+    /*
+     * float32 -> fp16，就近舍入
+     */
+    uint32_t x = float32_bits(f);
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t abs = x & 0x7fffffff;
+    if(abs > 0x7f800000) {              // NaN：置quiet位，保留尾数高10位
+        return (uint16_t)(sign | 0x7e00 | ((abs >> 13) & 0x3ff));
+    }
+    if(abs >= 0x47800000) {             // 不小于65536(含inf)：inf
+        return (uint16_t)(sign | 0x7c00);
+    }
+    if(abs >= 0x38800000) {             // fp16的规格化数：指数偏移由127改为15，尾数舍去低13位(就近舍入)
+        // 舍入进位可能进到指数，[65520, 65536)进位后正好得到inf
+        return (uint16_t)(sign | ((abs - 0x38000000 + 0xfff + ((abs >> 13) & 1)) >> 13));
+    }
+    // 非规格化数或0：加上0.5后，float32尾数的低位正好是fp16非规格化数的尾数(加法按就近舍入)
+    float denorm = float32_from_bits(abs) + 0.5f;
+    return (uint16_t)(sign | (float32_bits(denorm) - 0x3f000000));
+}
+
+inline float float16_bits_to_float32(uint16_t h)
+{
+    /*
+     * fp16 -> float32，精确
+     */
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = h & 0x7c00;
+    uint32_t mant = h & 0x3ff;
+    if(exp == 0x7c00) {                 // inf或NaN(NaN置quiet位)
+        return float32_from_bits(sign | 0x7f800000 | (mant << 13) | (mant != 0 ? 0x400000 : 0));
+    }
+    if(exp == 0) {                      // 非规格化数或0：mant * 2^-24
+        float value = (float)mant * float32_from_bits(0x33800000);
+        return float32_from_bits(sign | float32_bits(value));
+    }
+    return float32_from_bits(sign | (((exp >> 10) + 112) << 23) | (mant << 13));
+}
+
+inline uint16_t float32_to_bfloat16_bits(float f)
+{
+    /*
+     * float32 -> bf16，就近舍入
+     */
+    uint32_t x = float32_bits(f);
+    if((x & 0x7fffffff) > 0x7f800000) {     // NaN：置quiet位
+        return (uint16_t)((x >> 16) | 0x40);
+    }
+    return (uint16_t)((x + 0x7fff + ((x >> 16) & 1)) >> 16);
+}
+
+inline float bfloat16_bits_to_float32(uint16_t h)
+{
+    return float32_from_bits((uint32_t)h << 16);
+}
+
+
+struct fp16 {
+    uint16_t bits;
+
+    fp16() = default;
+    fp16(float f): bits(float32_to_float16_bits(f)) {}      // 允许隐式转换
+    operator float() const { return float16_bits_to_float32(bits); }
+
+    static fp16 from_bits(uint16_t bits)
+    {
+        fp16 h;
+        h.bits = bits;
+        return h;
+    }
+};
+
+struct bf16 {
+    uint16_t bits;
+
+    bf16() = default;
+    bf16(float f): bits(float32_to_bfloat16_bits(f)) {}    // 允许隐式转换
+    operator float() const { return bfloat16_bits_to_float32(bits); }
+
+    static bf16 from_bits(uint16_t bits)
+    {
+        bf16 h;
+        h.bits = bits;
+        return h;
+    }
+};
+
+
+#endif //QUANT_TENSOR_HALF_H
@@ -23,18 +23,19 @@ Tensor<T>::Tensor() {
        !std::is_same<T, float>::value &&
        !std::is_same<T, double>::value &&
        !std::is_same<T, char>::value &&
-       !std::is_same<T, unsigned char>::value) {
+       !std::is_same<T, unsigned char>::value &&
+       !std::is_same<T, fp16>::value &&
+       !std::is_same<T, bf16>::value) {
         fprintf(stderr, "File: tensor_inpl.h, line: %d. Only digital type allowed in Tensor\n", __LINE__);
         exit(-1);
     }
     data = nullptr;
-    mem_addr = nullptr;
+    storage = nullptr;
     is_num = false;
-    cut = 0;
 }
 
 template<typename T>
-Tensor<T>::Tensor(const std::vector<int>& size) {
+Tensor<T>::Tensor(const Tensor_shape& size) {
     /*
      * Tensor 构造函数：
      * 根据输入size分配空间，设置size
@@ -48,82 +49,109 @@ Tensor<T>::Tensor(const std::vector<int>& size) {
        !std::is_same<T, float>::value &&
        !std::is_same<T, double>::value &&
        !std::is_same<T, char>::value &&
-       !std::is_same<T, unsigned char>::value) {
+       !std::is_same<T, unsigned char>::value &&
+       !std::is_same<T, fp16>::value &&
+       !std::is_same<T, bf16>::value) {
         fprintf(stderr, "File: tensor_impl.h, line: %d. Only digital type allowed in Tensor\n", __LINE__);
         exit(-1);
     }
     this->size = size;
-    unsigned long space = 1;
-    for(const int &i: size) {
-        space *= i;
+    // 申请控制块和数据空间，引用计数为1
+    storage = tensor_storage_alloc(sizeof(T)*(size_t)size.len());
+    data = (T*)storage->mem_addr;
+    is_num = false;
+}
+
+template<typename T>
+Tensor<T>::Tensor(const Tensor_shape& size, Tensor_storage * storage) {
+    /*
+     * 使用已有的数据空间(如tensor_storage_map映射的文件)，接管调用者持有的一个引用
+     * 数据空间不能小于size对应的字节数
+     */
+    if(storage == nullptr || storage->bytes < sizeof(T)*(size_t)size.len()) {
+        fprintf(stderr, "File: tensor_impl.h, line: %d. Storage is too small for tensor\n", __LINE__);
+        exit(-1);
     }
-    data = (T*)malloc(sizeof(T)*space);
-    mem_addr = data;
+    this->size = size;
+    this->storage = storage;
+    data = (T*)storage->mem_addr;
     is_num = false;
-    cut = 0;
+}
 
-    // 对刚分配的空间引用计数(如果没有bug，应该找不到)
-    if(counter.find(mem_addr) != counter.end()) {   // if found
-        fprintf(stderr, "File: tensor_impl.h, line: %d. Found just malloced \'data\' in counter "
-                        "when constructing\n", __LINE__);
+template<typename T>
+Tensor<T> tensor_load_file(const std::string &path, const Tensor_shape &size) {
+    /*
+     * 从二进制文件读取张量：文件开头是按行优先存放的size.len()个T
+     * 优先只读映射整个文件(tensor_storage_map)，不复制数据，多个进程共享页缓存。得到的张量是只读的
+     * 无法映射(或已关闭映射)时申请内存并fread
+     */
+    size_t count = (size_t)size.len();
+    Tensor_storage * storage = tensor_mmap_enabled() ? tensor_storage_map(path.c_str(), sizeof(T)*count) : nullptr;
+    if(storage != nullptr) {
+        return Tensor<T>(size, storage);
+    }
+    Tensor<T> result(size);
+    FILE * file = fopen(path.c_str(), "rb");
+    if(file == nullptr) {
+        fprintf(stderr, "File: tensor_impl.h, line: %d. Open file %s failed\n", __LINE__, path.c_str());
         exit(-1);
     }
-    else {
-        counter.insert(std::pair<T*, int>(mem_addr, 1));
+    size_t ret = fread(result.data, sizeof(T), count, file);
+    fclose(file);
+    if(ret != count) {
+        fprintf(stderr, "File: tensor_impl.h, line: %d. Read length error when read file %s. Expected %lu, Got %lu\n",
+                __LINE__, path.c_str(), (unsigned long)count, (unsigned long)ret);
+        exit(-1);
     }
+    return result;
 }
 
 template<typename T>
 Tensor<T>::Tensor(const Tensor<T> &src) {
     /*
-     * 拷贝构造函数
+     * 拷贝构造函数：共享数据空间，引用计数加一
      */
     data = src.data;
-    mem_addr = src.mem_addr;
+    storage = src.storage;
     is_num = src.is_num;
     size = src.size;
-    if(src.cut > 0) {
-        cut = src.cut - 1;
-    }
-    else {
-        cut = 0;
-    }
-    if(counter.find(mem_addr) != counter.end()) {
-        counter[mem_addr]++;
-    }
-    else {
-        fprintf(stderr, "File: tensor_impl.h, line: %d. Not found src \'data\' when copy "
-                        "constructing\n", __LINE__);
-        exit(-1);
+    stride = src.stride;
+    // 增加引用计数(未分配空间的对象没有控制块)
+    if(storage != nullptr) {
+        tensor_storage_retain(storage);
     }
 }
 
+template<typename T>
+Tensor<T>::Tensor(Tensor<T> &&src) noexcept {
+    /*
+     * 移动构造函数：接管src的数据空间，不改变引用计数。src变为未分配空间的对象
+     */
+    data = src.data;
+    storage = src.storage;
+    is_num = src.is_num;
+    size = std::move(src.size);
+    stride = std::move(src.stride);
+    src.data = nullptr;
+    src.storage = nullptr;
+    src.is_num = false;
+}
+
 template<typename T>
 Tensor<T>::~Tensor() {
     /*
      * Tensor destructor：
      * 释放内存
      */
-    // 查找引用计数
-    if(data == nullptr || mem_addr == nullptr) {
-        // 如果对象只创建但没分配内存，那么data和mem_addr应该都是null
-        if(data != nullptr || mem_addr != nullptr) {
-            std::cerr << "Found data and mem_addr only 1 equal to nullptr\n";
+    if(data == nullptr || storage == nullptr) {
+        // 如果对象只创建但没分配内存，那么data和storage应该都是null
+        if(data != nullptr || storage != nullptr) {
+            std::cerr << "Found data and storage only 1 equal to nullptr\n";
         }
         return;
     }
-    if(counter.find(mem_addr) != counter.end()) {
-        counter[mem_addr]--;
-        if(counter[mem_addr] == 0) {
-            free(mem_addr);
-            counter.erase(mem_addr);
-        }
-    }
-    else {
-        fprintf(stderr, "File: tensor_impl.h, line: %d. Not found \'data\' in counter when "
-                        "destructing\n", __LINE__);
-        exit(-1);
-    }
+    // 减引用计数，减到0时释放
+    tensor_storage_release(storage);
 }
 
 template<typename T>
@@ -132,7 +160,7 @@ Tensor<T> Tensor<T>::operator[](int index)
     /*
      * 重载[]
      * 注：[]不复制内存
-     * 创建对象，使data指向截取后地址。mem_addr仍指向旧地址，以保持对整块内存的引用计数
+     * 创建对象，使data指向截取后地址。storage仍指向原控制块，以保持对整块内存的引用计数
      * 修改size
      */
     Tensor<T> temp;
@@ -150,13 +178,15 @@ Tensor<T> Tensor<T>::operator[](int index)
         fprintf(stderr, "File: tensor_impl.h, line: %d. Index out of range\n", __LINE__);
         exit(-1);
     }
-    int other_dim_len = 1;      // 除第一维度外，其他维度长度的乘积，用于计算截取后长度
+    int64_t other_dim_len = 1;  // 除第一维度外，其他维度长度的乘积，用于计算截取后长度(可能超过int)
     for(int i = 1; i<(int)size.size(); i++) {
         other_dim_len *= size[i];
     }
+    if(!stride.empty()) {       // 视图：第一维的步长不一定是其他维度长度的乘积
+        other_dim_len = stride[0];
+    }
     temp.data = data + index*other_dim_len;
-    temp.mem_addr = mem_addr;
-    temp.cut = 2;
+    temp.storage = storage;
     if(size.size() == 1) {      // 如果原数组只有1个维度，截取后变为数值
         temp.is_num = true;
         temp.size.push_back(1);
@@ -165,82 +195,92 @@ Tensor<T> Tensor<T>::operator[](int index)
         for (int i = 1; i < (int)size.size(); i++) {
             temp.size.push_back(size[i]);
         }
+        if(!stride.empty()) {
+            temp.stride.assign(stride.begin()+1, stride.end());
+            temp.normalize_stride();
+        }
     }
     // 增加引用计数
-    if(counter.find(mem_addr) != counter.end()) {
-        counter[mem_addr]++;
-    }
-    else {
+    if(storage == nullptr) {
         fprintf(stderr, "File: tensor_impl.h, line: %d. Not found \'data\' in []\n", __LINE__);
         exit(-1);
     }
+    tensor_storage_retain(storage);
     return temp;
 }
 
 template<typename T>
-Tensor<T>& Tensor<T>::operator=(Tensor<T> array)
+Tensor<T>& Tensor<T>::operator=(const Tensor<T> &array) &
 {
     /*
-     * 重载=
-     * 两种情况：
-     * 1. 左值是截取：B[i] = A：需要检查左值和右值尺寸一致，并复制数据（deep copy）
-     * 2. 左值不是截取：只改变指针。对原地址减引用计数，复制属性，对新地址增引用计数
-     */
-    if(this->cut > 0) {         // 如果左值是截取
-        if(this->size != array.size) {
-            fprintf(stderr, "File: tensor_impl.h, line: %d. Could not broadcast input array "
-                            "from shape (", __LINE__);
-            for(int i = 0; i<(int)array.size.size(); i++) {
-                std::cerr << array.size[i] << ", ";
-            }
-            std::cerr << ") into shape (";
-            for(int i = 0; i<(int)this->size.size(); i++) {
-                std::cerr << this->size[i] << ", ";
-            } 
-            std::cerr << ")\n";
-            exit(-1);
-        }
-        int space = 1;
-        for(int i = 0; i<(int)array.size.size(); i++) {
-            space *= array.size[i];
-        }
-        memcpy(this->data, array.data, sizeof(T)*space);
-    }
-    else {                      // 如果左值不是截取
-        // 减引用计数
-        if(this->mem_addr != nullptr) {
-            // 有时只声明对象但没有分配空间，此时不需要减引用计数
-            if (counter.find(this->mem_addr) != counter.end()) {
-                counter[mem_addr]--;
-                if (counter[mem_addr] == 0) {
-                    free(mem_addr);
-                    counter.erase(mem_addr);
-                }
-            } else {
-                fprintf(stderr, "File: tensor_impl.h, line: %d. Not found old \'data\' in counter "
-                                "when operator=\n", __LINE__);
-                exit(-1);
-            }
-        }
+     * 重载=，左值是具名对象：只改变指针。对新控制块增引用计数，对原控制块减引用计数，复制属性
+     */
+    // 先对新控制块增加引用计数，再对原控制块减引用计数(保证自赋值时不会提前释放)
+    if(array.storage != nullptr) {
+        tensor_storage_retain(array.storage);
+    }
+    if(this->storage != nullptr) {
+        // 有时只声明对象但没有分配空间，此时不需要减引用计数
+        tensor_storage_release(this->storage);
+    }
+
+    // 复制属性
+    this->data = array.data;
+    this->storage = array.storage;
+    this->size = array.size;
+    this->stride = array.stride;
+    this->is_num = array.is_num;
+    return *this;
+}
 
-        // 复制属性
-        this->data = array.data;
-        this->mem_addr = array.mem_addr;
-        this->size = array.size;
-        this->is_num = array.is_num;
-        this->cut = 0;
+template<typename T>
+Tensor<T>& Tensor<T>::operator=(Tensor<T> &&array) &
+{
+    /*
+     * 重载=，左值是具名对象，右值是临时对象：接管右值的数据空间，不改变右值控制块的引用计数
+     */
+    if(this == &array) {
+        return *this;
+    }
+    if(this->storage != nullptr) {
+        tensor_storage_release(this->storage);
+    }
+    this->data = array.data;
+    this->storage = array.storage;
+    this->size = std::move(array.size);
+    this->stride = std::move(array.stride);
+    this->is_num = array.is_num;
+    array.data = nullptr;
+    array.storage = nullptr;
+    array.is_num = false;
+    return *this;
+}
 
-        // 引用计数
-        if(counter.find(this->mem_addr) != counter.end()) {
-            counter[mem_addr]++;
+template<typename T>
+Tensor<T>& Tensor<T>::operator=(const Tensor<T> &array) &&
+{
+    /*
+     * 重载=，左值是临时对象(截取，如B[i] = A)：检查左值和右值尺寸一致，并复制数据(deep copy)
+     */
+    if(this->size != array.size) {
+        fprintf(stderr, "File: tensor_impl.h, line: %d. Could not broadcast input array "
+                        "from shape (", __LINE__);
+        for(int i = 0; i<(int)array.size.size(); i++) {
+            std::cerr << array.size[i] << ", ";
         }
-        else {
-            fprintf(stderr, "File: tensor_impl.h, line: %d. Not found new \'data\' in "
-                            "counter when operator=\n", __LINE__);
-            exit(-1);
+        std::cerr << ") into shape (";
+        for(int i = 0; i<(int)this->size.size(); i++) {
+            std::cerr << this->size[i] << ", ";
         }
+        std::cerr << ")\n";
+        exit(-1);
+    }
+    if(this->stride.empty() && array.stride.empty()) {
+        memcpy(this->data, array.data, sizeof(T)*(size_t)array.size.len());
+    }
+    else {                  // 左值或右值是视图，按步长复制
+        tensor_strided_copy(this->data, this->stride, array.data, array.stride, this->size);
     }
-
     return *this;
 }
 
@@ -275,15 +315,17 @@ void Tensor<T>::set_zero() {
     /*
      * data中所有值设为0
      */
+    if(!is_contiguous()) {      // 非连续的视图：在连续副本上计算，再写回视图
+        Tensor<T> temp = contiguous();
+        temp.set_zero();
+        tensor_strided_copy(data, stride, temp.data, Tensor_stride(), size);
+        return;
+    }
     if(data == nullptr) {
         fprintf(stderr, "File: tensor_impl.h, line: %d. You cannot set zero to an array not malloced\n", __LINE__);
         exit(-1);
     }
-    int space = 1;
-    for(const int &i: size) {
-        space *= i;
-    }
-    memset(data, 0, sizeof(T)*space);
+    memset(data, 0, sizeof(T)*(size_t)len());
 }
 
 template<typename T>
@@ -291,21 +333,24 @@ void Tensor<T>::set_rand() {
     /*
      * data中所有值设为随机值
      */
+    if(!is_contiguous()) {      // 非连续的视图：在连续副本上计算，再写回视图
+        Tensor<T> temp = contiguous();
+        temp.set_rand();
+        tensor_strided_copy(data, stride, temp.data, Tensor_stride(), size);
+        return;
+    }
     if(data == nullptr) {
         fprintf(stderr, "File: tensor_impl.h, line: %d. You cannot set rand to an array not malloced\n", __LINE__);
         exit(-1);
     }
-    int space = 1;
-    for(const int &i: size) {
-        space *= i;
-    }
-    for(int i = 0; i<space; i++) {
+    int64_t space = len();
+    for(int64_t i = 0; i<space; i++) {
         data[i] = ((T)rand()/RAND_MAX) * 2 - 1;
     }
 }
 
 template<typename T>
-Tensor<T> Tensor<T>::reshape(const std::vector<int> &new_size) {
+Tensor<T> Tensor<T>::reshape(const Tensor_shape &new_size) {
     /*
      * reshape
      * 检查旧size和新size
@@ -314,20 +359,20 @@ Tensor<T> Tensor<T>::reshape(const std::vector<int> &new_size) {
     if(is_num) {
         std::cerr << "You cannot reshape a num\n";
     }
-    // 检查new_size：负值不能超过1个。不能有0。如果没有负值，则新size对应的内存大小应与原来的相同
-    int old_space = 1;
-    for(const int &i: size) {
-        old_space *= i;
+    if(!is_contiguous()) {      // 非连续的视图无法只修改尺寸，先转为连续存储
+        return contiguous().reshape(new_size);
     }
+    // 检查new_size：负值不能超过1个。不能有0。如果没有负值，则新size对应的内存大小应与原来的相同
+    int64_t old_space = len();
     int negative_count = 0;    // new_size中负值数量
-    int new_space = 1;
+    int64_t new_space = 1;
     for(const int &i: new_size) {
         if(i < 0) {
             negative_count++;
         }
         else if(i == 0) {
             fprintf(stderr, "File: tensor_impl.h, line: %d. Cannot reshape array of "
-                            "size %d into shape(", __LINE__, old_space);
+                            "size %" PRId64 " into shape(", __LINE__, old_space);
             for(const int &j: new_size) {
                 fprintf(stderr, "%d, ", j);
             }
@@ -345,7 +390,7 @@ Tensor<T> Tensor<T>::reshape(const std::vector<int> &new_size) {
     if(negative_count == 0) {
         if(old_space != new_space) {
             fprintf(stderr, "File: tensor_impl.h, line: %d. Cannot reshape array of "
-                            "size %d into shape(", __LINE__, old_space);
+                            "size %" PRId64 " into shape(", __LINE__, old_space);
             for(const int &j: new_size) {
                 fprintf(stderr, "%d, ", j);
             }
@@ -356,23 +401,25 @@ Tensor<T> Tensor<T>::reshape(const std::vector<int> &new_size) {
     // 如果size检查通过，对负值进行推断
     Tensor<T> temp;
     temp.data = this->data;
-    temp.mem_addr = this->mem_addr;
+    temp.storage = this->storage;
     temp.size = new_size;
     for(int i = 0; i<(int)new_size.size(); i++) {
         if(temp.size[i] < 0) {
-            temp.size[i] = old_space / new_space;
+            if(old_space / new_space > INT32_MAX) {     // 每一维的长度是int
+                fprintf(stderr, "File: tensor_impl.h, line: %d. Inferred dimension %" PRId64 " is too large\n",
+                        __LINE__, old_space / new_space);
+                exit(-1);
+            }
+            temp.size[i] = (int)(old_space / new_space);
         }
     }
-    temp.cut = 0;
     temp.is_num = this->is_num;
     // 引用计数
-    if(counter.find(mem_addr) != counter.end()) {
-        counter[mem_addr]++;
-    }
-    else {
+    if(storage == nullptr) {
         fprintf(stderr, "File: tensor_impl.h, line: %d. Not found \'data\' when reshape\n", __LINE__);
         exit(-1);
     }
+    tensor_storage_retain(storage);
     return temp;
 }
 
@@ -387,36 +434,40 @@ void Tensor<T>::print() {
         } printf("\n");
     }
     else {
+        int64_t step = stride.empty() ? 1 : stride[0];
         for(int i = 0; i<size[0]; i++) {
             if(std::is_same<T, int32>::value) {
-                printf("%d ", data[i]);
+                printf("%d ", data[i*step]);
             }
             else if(std::is_same<T, uint32>::value) {
-                printf("%u ", data[i]);
+                printf("%u ", data[i*step]);
             }
             else if(std::is_same<T, long int>::value) {
-                printf("%ld ", data[i]);
+                printf("%ld ", data[i*step]);
             }
             else if(std::is_same<T, unsigned long>::value) {
-                printf("%lu ", data[i]);
+                printf("%lu ", data[i*step]);
             }
             else if(std::is_same<T, long long int>::value) {
-                printf("%lld ", data[i]);
+                printf("%lld ", data[i*step]);
             }
             else if(std::is_same<T, unsigned long long>::value) {
-                printf("%llu ", data[i]);
+                printf("%llu ", data[i*step]);
             }
             else if(std::is_same<T, float32>::value) {
-                printf("%.6f ", data[i]);
+                printf("%.6f ", data[i*step]);
             }
             else if(std::is_same<T, float64>::value) {
-                printf("%.8g ", data[i]);
+                printf("%.8g ", data[i*step]);
             }
             else if(std::is_same<T, int8>::value) {
-                printf("%d ", data[i]);
+                printf("%d ", data[i*step]);
             }
             else if(std::is_same<T, uint8>::value) {
-                printf("%4d", data[i]);
+                printf("%4d", data[i*step]);
+            }
+            else if(std::is_same<T, fp16>::value || std::is_same<T, bf16>::value) {
+                printf("%.6f ", (float32)data[i*step]);
             }
         } printf("\n");
     }
@@ -427,6 +478,7 @@ Tensor<T> Tensor<T>::transpose(const std::vector<int> &new_order) {
     /*
      * transpose:
      * transpose(2,0,1) => dst[k][i][j] = src[i][j][k]
+     * 返回与原张量共享数据空间的视图(只交换size和stride)，需要连续数据时调用contiguous()
      */
     // new_order的长度应与旧size相同
     if(this->size.size() != new_order.size()) {
@@ -457,44 +509,21 @@ Tensor<T> Tensor<T>::transpose(const std::vector<int> &new_order) {
             // 而重复的在上面已经处理过了
         }
     }
-    // 创建新数组，使其size为transpose之后的size
-    std::vector<int> new_size;
+    // 创建视图，使其size和stride为transpose之后的size和stride。不复制数据
+    Tensor_stride old_stride = this->stride.empty() ? contiguous_stride(this->size) : this->stride;
+    Tensor<T> temp = *this;
+    temp.size.clear();
+    temp.stride.clear();
     for(const int& i: new_order) {
-        new_size.push_back(this->size[i]);
-    }
-    Tensor<T> temp(new_size);
-    // 遍历旧数组中的元素(根据data进行遍历)，计算其下标，并转换到新下标
-    int dim = this->size.size();    // 维度
-    int old_index[dim];             // 旧下标
-    int new_index[dim];             // 新下标
-    int array_len = 1;              // 数组中元素个数
-    for(const int& i: this->size) {
-        array_len *= i;
-    }
-    for(int i = 0; i<dim; i++) {
-        old_index[i] = 0;
-    }
-    for(int index = 0; index<array_len; index++) {  // 遍历旧数组
-        // 旧下标映射到新下标
-        for(int i = 0; i<dim; i++) {
-            new_index[i] = old_index[new_order[i]];
-        }
-        // 计算该元素在新数组的位置（位置：相对于data的偏移）
-        int offset = 0;
-        int weight = 1;
-        for(int p = dim-1; p>=0; p--) {
-            offset += new_index[p] * weight;
-            weight *= new_size[p];
-        }
-        temp.data[offset] = this->data[index];
-        // old_index加一
-        array_add_1(old_index, this->size);
+        temp.size.push_back(this->size[i]);
+        temp.stride.push_back(old_stride[i]);
     }
+    temp.normalize_stride();
     return temp;
 }
 
 template<typename T>
-std::vector<int> Tensor<T>::shape() {
+Tensor_shape Tensor<T>::shape() {
     /*
      * 返回size
      */
@@ -502,14 +531,17 @@ std::vector<int> Tensor<T>::shape() {
 }
 
 template<typename T>
-int Tensor<T>::argmax() {
+int64_t Tensor<T>::argmax() {
     /*
      * argmax
      */
-    int len = this->len();
+    if(!is_contiguous()) {      // 非连续的视图先转为连续存储
+        return contiguous().argmax();
+    }
+    int64_t len = this->len();
     T max = data[0];
-    int index = 0;
-    for(int i = 0; i<len; i++) {
+    int64_t index = 0;
+    for(int64_t i = 0; i<len; i++) {
         if(data[i] > max) {
             max = data[i];
             index = i;
@@ -524,7 +556,6 @@ Tensor<int> Tensor<T>::argmax(int axis) {
      * 在给定axis上argmax
      * 创建新数组，其维度应比旧数组少1
      * 新数组各维度长度应与旧数组除axis指定维度外其他维度一一对应
-     * 遍历新数组的每个元素，并在旧数组中axis指定维度上计算argmax
      * 例如：
      * A.size = (2,3,4,5,6)
      * O = A.argmax(2)
@@ -534,8 +565,12 @@ Tensor<int> Tensor<T>::argmax(int axis) {
      *      for j in range(3):
      *          for k in range(5):
      *              for l in range(6):
-     *                  O[i][j][k][l] = max(A[i][j][:][k][l])
+     *                  O[i][j][k][l] = argmax(A[i][j][:][k][l])
+     * 把原数组看作(outer, size[axis], inner)：inner为1时逐行扫描，否则逐行与各列当前最大值比较，都是顺序访问
      */
+    if(!is_contiguous()) {      // 非连续的视图先转为连续存储
+        return contiguous().argmax(axis);
+    }
     // 检查axis: axis不应超过维度，不应小于0
     if(axis >= (int)size.size() || axis < 0) {
         fprintf(stderr, "File: tensor_impl.h, line: %d. axis %d is out of bounds "
@@ -546,80 +581,73 @@ Tensor<int> Tensor<T>::argmax(int axis) {
      * 如果原维度为1，那么返回值应为数值。但此函数无法返回数值，所以返回is_num数组
      */
     if(size.size() == 1) {
-        Tensor<int> result(std::vector<int>{1});
-        result.data[0] = this->argmax();
+        Tensor<int> result(Tensor_shape{1});
+        result.data[0] = (int)this->argmax();       // 一维时下标不超过size[0]
         return result;
     }
 
     // 如果原数组维度大于1
     // 计算结果数组的size
-    std::vector<int> new_size;
+    Tensor_shape new_size;
+    int64_t outer = 1;
+    int64_t inner = 1;
     for(int i = 0; i<(int)size.size(); i++) {
-        if(i == axis) {
-            continue;
+        if(i < axis) {
+            outer *= size[i];
         }
-        else {
+        else if(i > axis) {
+            inner *= size[i];
+        }
+        if(i != axis) {
             new_size.push_back(size[i]);
         }
     }
+    int reduce = size[axis];
     // 使用new_size创建结果数组
     Tensor<int> result{new_size};
-    // 遍历结果数组的每个元素，计算其argmax
-    int new_dim = (int)new_size.size();
-    int old_dim = new_dim+1;
-    int new_index[new_dim];     // result中正在访问元素的下标
-    int old_index[old_dim];     // 原数组中要访问的元素的下标
-    for(int i = 0; i<new_dim; i++) {        // 初始化 new_index 和 old_index
-        new_index[i] = 0;
-        old_index[i] = 0;
-    }
-    old_index[old_dim-1] = 0;
-    int new_len = 1;                    // result数据空间长度
-    for(const int &i: new_size) {
-        new_len *= i;
-    }
-    for(int i = 0; i<new_len; i++) {    // 遍历result
-        // 映射new_index 到 old_index
-        for(int j = 0; j<old_dim; j++) {
-            if(j < axis) {
-                old_index[j] = new_index[j];
-            }
-            else if(j > axis) {
-                old_index[j] = new_index[j-1];
+    if(inner == 1) {
+        parallel_for(0, outer, tensor_parallel_grain(outer, reduce), [&](int64_t from, int64_t to) {
+            for(int64_t o = from; o<to; o++) {
+                const T * row = data + o * reduce;
+                T max = row[0];
+                int index = 0;
+                for(int k = 0; k<reduce; k++) {
+                    if(row[k] > max) {
+                        max = row[k];
+                        index = k;
+                    }
+                }
+                result.data[o] = index;
             }
-        }
-        // 设置遍历旧数组axis维的起始下标
-        old_index[axis] = 0;
-        // 计算元素在旧数组的位置（位置：相对data的offset）
-        int offset = 0;
-        int weight = 1;
-        for(int p = old_dim-1; p>=0; p--) {
-            offset += old_index[p] * weight;
-            weight *= this->size[p];
-        }
-        // 初始化 max 和 index
-        T max = this->data[offset];
-        int index = 0;
-        for(int j = 0; j<this->size[axis]; j++) {   // 遍历旧数组axis维元素
-            old_index[axis] = j;
-            // 计算元素在旧数组的位置（位置：相对data的offset）
-            offset = 0;
-            weight = 1;
-            for(int p = old_dim-1; p>=0; p--) {
-                offset += old_index[p] * weight;
-                weight *= this->size[p];
+        });
+        return result;
+    }
+    // 每次处理一个outer下的TENSOR_REDUCE_BLOCK列
+    int64_t n_block = (inner + TENSOR_REDUCE_BLOCK - 1) / TENSOR_REDUCE_BLOCK;
+    int64_t grain = tensor_parallel_grain(outer * n_block, reduce * std::min<int64_t>(inner, TENSOR_REDUCE_BLOCK));
+    parallel_for(0, outer * n_block, grain, [&](int64_t from, int64_t to) {
+        for(int64_t task = from; task<to; task++) {
+            int64_t o = task / n_block;
+            int64_t j0 = task % n_block * TENSOR_REDUCE_BLOCK;
+            int cols = (int)std::min<int64_t>(TENSOR_REDUCE_BLOCK, inner - j0);
+            const T * src = data + o * reduce * inner + j0;
+            int * index = result.data + o * inner + j0;
+            T max[TENSOR_REDUCE_BLOCK];
+            for(int j = 0; j<cols; j++) {
+                max[j] = src[j];
+                index[j] = 0;
             }
-            // 比较max，修改index
-            if(this->data[offset] > max) {
-                max = this->data[offset];
-                index = j;
+            for(int k = 1; k<reduce; k++) {
+                const T * row = src + k * inner;
+                for(int j = 0; j<cols; j++) {
+                    if(row[j] > max[j]) {
+                        max[j] = row[j];
+                        index[j] = k;
+                    }
+                }
             }
         }
-        // 存储index到result
-        result.data[i] = index;
-        // new_index加一
-        array_add_1(new_index, new_size);
-    }
+    });
     return result;
 }
 
@@ -638,12 +666,7 @@ Tensor<T> Tensor<T>::true_divide(T divisor) {
      * 除法
      * 创建新的数组并分配新的空间。将原数组每个值除以divisor并赋值给新数组
      */
-    Tensor<T> result{this->size};
-    int len = this->len();
-    for(int i = 0; i<len; i++) {
-        result.data[i] = this->data[i] / divisor;
-    }
-    return result;
+    return *this / divisor;
 }
 
 template<typename T>
@@ -652,36 +675,329 @@ Tensor<T> Tensor<T>::floor_divide(T divisor) {
      * 向下取整除法
      * 创建新的数组并分配新的空间。将原数组每个值除以divisor并赋值给新数组
      */
-    Tensor<T> result{this->size};
-    int len = this->len();
-    for(int i = 0; i<len; i++) {
-        result.data[i] = (int)(this->data[i] / divisor);
+    return Tensor_binary<Expr_floor_div, Tensor_leaf<T>, Tensor_scalar<T>>(Tensor_leaf<T>(*this), Tensor_scalar<T>(divisor));
+}
+
+template<typename T>
+int64_t Tensor<T>::len() {
+    /*
+     * 获取当前Tensor数据空间元素数量
+     * 用int64_t计算：各维度都不超过int，但乘积(如整个校准集)可能超过int
+     */
+    return size.len();
+}
+
+template<typename T>
+bool Tensor<T>::is_aligned() {
+    /*
+     * data是否按TENSOR_ALIGN对齐
+     * 给定尺寸构造的张量总是对齐的，截取得到的张量取决于截取位置
+     */
+    return ((uintptr_t)data) % TENSOR_ALIGN == 0;
+}
+
+template<typename T>
+bool Tensor<T>::is_contiguous() {
+    /*
+     * 是否是连续存储。stride为空时一定是连续的
+     */
+    return stride.empty() || stride == contiguous_stride(size);
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::contiguous() {
+    /*
+     * 返回连续存储的张量
+     * 已经是连续的：返回共享数据空间的张量，不复制
+     * 是视图：申请新的数据空间，按步长复制数据
+     */
+    if(is_contiguous()) {
+        Tensor<T> temp = *this;
+        temp.stride.clear();
+        return temp;
+    }
+    Tensor<T> result{size};
+    tensor_strided_copy(result.data, Tensor_stride(), data, stride, size);
+    result.is_num = is_num;
+    return result;
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::hwc_to_chw(bool reverse_channel) {
+    /*
+     * (H, W, C) -> (C, H, W) 或 (N, H, W, C) -> (N, C, H, W)，创建新张量
+     * 与transpose({2, 0, 1})/transpose({0, 3, 1, 2})后contiguous()结果相同，但一次遍历完成。
+     * reverse_channel为true时同时反转通道顺序(如BGR->RGB)
+     */
+    if(size.size() != 3 && size.size() != 4) {
+        fprintf(stderr, "File: tensor_impl.h, line: %d. hwc_to_chw only supports 3 or 4 dimension array\n", __LINE__);
+        exit(-1);
+    }
+    if(!is_contiguous()) {      // 非连续的视图先转为连续存储
+        return contiguous().hwc_to_chw(reverse_channel);
+    }
+    int batch = size.size() == 4 ? size[0] : 1;
+    int height = size[size.size()-3];
+    int width = size[size.size()-2];
+    int channel = size[size.size()-1];
+    Tensor_shape new_size{channel, height, width};
+    if(size.size() == 4) {
+        new_size.insert(new_size.begin(), batch);
+    }
+    Tensor<T> result{new_size};
+    int64_t image = (int64_t)height * width * channel;
+    for(int n = 0; n<batch; n++) {
+        tensor_hwc_to_chw(result.data + n * image, data + n * image, height, width, channel, reverse_channel);
     }
     return result;
 }
 
 template<typename T>
-int Tensor<T>::len() {
+Tensor<T> Tensor<T>::chw_to_hwc(bool reverse_channel) {
     /*
-     * 获取当前Tensor数据空间元素数量
+     * (C, H, W) -> (H, W, C) 或 (N, C, H, W) -> (N, H, W, C)，创建新张量
+     * reverse_channel为true时同时反转通道顺序(如RGB->BGR)
+     */
+    if(size.size() != 3 && size.size() != 4) {
+        fprintf(stderr, "File: tensor_impl.h, line: %d. chw_to_hwc only supports 3 or 4 dimension array\n", __LINE__);
+        exit(-1);
+    }
+    if(!is_contiguous()) {      // 非连续的视图先转为连续存储
+        return contiguous().chw_to_hwc(reverse_channel);
+    }
+    int batch = size.size() == 4 ? size[0] : 1;
+    int channel = size[size.size()-3];
+    int height = size[size.size()-2];
+    int width = size[size.size()-1];
+    Tensor_shape new_size{height, width, channel};
+    if(size.size() == 4) {
+        new_size.insert(new_size.begin(), batch);
+    }
+    Tensor<T> result{new_size};
+    int64_t image = (int64_t)height * width * channel;
+    for(int n = 0; n<batch; n++) {
+        tensor_chw_to_hwc(result.data + n * image, data + n * image, height, width, channel, reverse_channel);
+    }
+    return result;
+}
+
+template<typename T>
+void Tensor<T>::normalize_stride() {
+    /*
+     * 如果stride与连续存储的步长相同，清空stride
      */
-    int len = 1;
-    for(const int &i: size) {
-        len *= i;
+    if(!stride.empty() && stride == contiguous_stride(size)) {
+        stride.clear();
     }
-    return len;
 }
 
 template<typename T>
-Tensor<T> Tensor<T>::operator/(T divisor) {
+void tensor_transpose_2d(T * dst, int64_t dst_ld, const T * src, int64_t src_ld, int rows, int cols)
+{
     /*
-     * 重载 /
+     * 分块转置：dst[i*dst_ld + j] = src[j*src_ld + i]，i<rows，j<cols
+     * 每次处理TENSOR_TRANSPOSE_BLOCK*TENSOR_TRANSPOSE_BLOCK的块，读写两边的块都能放在一级缓存中
      */
-    return this->true_divide(divisor);
+    for(int ib = 0; ib<rows; ib += TENSOR_TRANSPOSE_BLOCK) {
+        int ie = std::min(ib + TENSOR_TRANSPOSE_BLOCK, rows);
+        for(int jb = 0; jb<cols; jb += TENSOR_TRANSPOSE_BLOCK) {
+            int je = std::min(jb + TENSOR_TRANSPOSE_BLOCK, cols);
+            for(int i = ib; i<ie; i++) {
+                T * d = dst + i * dst_ld;
+                const T * s = src + i;
+                for(int j = jb; j<je; j++) {
+                    d[j] = s[j * src_ld];
+                }
+            }
+        }
+    }
+}
+
+template<typename T>
+void tensor_transpose_copy(T * dst, const Tensor_stride &ds, const T * src, const Tensor_stride &ss,
+                           const Tensor_shape &size, int p)
+{
+    /*
+     * tensor_strided_copy的转置情况：最内层维度q在一边连续，维度p在另一边连续
+     * 对其余维度的每个下标，(p, q)两维是一个二维转置，调用tensor_transpose_2d
+     * 元素较多时按其余维度多线程
+     */
+    int dim = (int)size.size();
+    int q = dim-1;
+    Tensor_shape outer_size;
+    Tensor_stride outer_ds;
+    Tensor_stride outer_ss;
+    int64_t outer = 1;
+    for(int k = 0; k<dim-1; k++) {
+        if(k != p) {
+            outer_size.push_back(size[k]);
+            outer_ds.push_back(ds[k]);
+            outer_ss.push_back(ss[k]);
+            outer *= size[k];
+        }
+    }
+    int n_outer = (int)outer_size.size();
+    parallel_for(0, outer, tensor_parallel_grain(outer, (int64_t)size[p] * size[q]), [&](int64_t from, int64_t to) {
+        for(int64_t o = from; o<to; o++) {
+            // 由线性下标计算其余维度的偏移
+            int64_t dst_offset = 0;
+            int64_t src_offset = 0;
+            int64_t rest = o;
+            for(int k = n_outer-1; k>=0; k--) {
+                int64_t index = rest % outer_size[k];
+                rest /= outer_size[k];
+                dst_offset += index * outer_ds[k];
+                src_offset += index * outer_ss[k];
+            }
+            if(ds[q] == 1) {
+                tensor_transpose_2d(dst + dst_offset, ds[p], src + src_offset, ss[q], size[p], size[q]);
+            }
+            else {
+                tensor_transpose_2d(dst + dst_offset, ds[q], src + src_offset, ss[p], size[q], size[p]);
+            }
+        }
+    });
+}
+
+template<typename T>
+void tensor_hwc_to_chw(T * dst, const T * src, int height, int width, int channel, bool reverse_channel)
+{
+    /*
+     * (H, W, C) -> (C, H, W)，reverse_channel为true时同时反转通道顺序(BGR->RGB)
+     * 一次顺序读取输入，写C个连续的输出平面。按行多线程
+     */
+    int64_t plane = (int64_t)height * width;
+    parallel_for(0, height, tensor_parallel_grain(height, (int64_t)width * channel), [&](int64_t from, int64_t to) {
+        for(int h = (int)from; h<(int)to; h++) {
+            const T * s = src + (int64_t)h * width * channel;
+            if(channel == 3) {
+                T * d0 = dst + (int64_t)h * width + (reverse_channel ? 2 : 0) * plane;
+                T * d1 = dst + (int64_t)h * width + plane;
+                T * d2 = dst + (int64_t)h * width + (reverse_channel ? 0 : 2) * plane;
+                for(int w = 0; w<width; w++) {
+                    d0[w] = s[w*3];
+                    d1[w] = s[w*3+1];
+                    d2[w] = s[w*3+2];
+                }
+            }
+            else {
+                for(int c = 0; c<channel; c++) {
+                    T * d = dst + (int64_t)(reverse_channel ? channel-1-c : c) * plane + (int64_t)h * width;
+                    for(int w = 0; w<width; w++) {
+                        d[w] = s[w*channel + c];
+                    }
+                }
+            }
+        }
+    });
+}
+
+template<typename T>
+void tensor_chw_to_hwc(T * dst, const T * src, int height, int width, int channel, bool reverse_channel)
+{
+    /*
+     * (C, H, W) -> (H, W, C)，reverse_channel为true时同时反转通道顺序(RGB->BGR)
+     * 顺序写输出，从C个输入平面读取。按行多线程
+     */
+    int64_t plane = (int64_t)height * width;
+    parallel_for(0, height, tensor_parallel_grain(height, (int64_t)width * channel), [&](int64_t from, int64_t to) {
+        for(int h = (int)from; h<(int)to; h++) {
+            T * d = dst + (int64_t)h * width * channel;
+            if(channel == 3) {
+                const T * s0 = src + (int64_t)h * width + (reverse_channel ? 2 : 0) * plane;
+                const T * s1 = src + (int64_t)h * width + plane;
+                const T * s2 = src + (int64_t)h * width + (reverse_channel ? 0 : 2) * plane;
+                for(int w = 0; w<width; w++) {
+                    d[w*3] = s0[w];
+                    d[w*3+1] = s1[w];
+                    d[w*3+2] = s2[w];
+                }
+            }
+            else {
+                for(int c = 0; c<channel; c++) {
+                    const T * s = src + (int64_t)(reverse_channel ? channel-1-c : c) * plane + (int64_t)h * width;
+                    for(int w = 0; w<width; w++) {
+                        d[w*channel + c] = s[w];
+                    }
+                }
+            }
+        }
+    });
+}
+
+template<typename T>
+void tensor_strided_copy(T * dst, const Tensor_stride &dst_stride, const T * src,
+                         const Tensor_stride &src_stride, const Tensor_shape &size)
+{
+    /*
+     * 按步长把src复制到dst。步长为空表示连续存储
+     * 一边最内层连续而另一边在外层某一维连续时(转置视图)，按块转置复制(tensor_transpose_copy)
+     * 否则外层维度用下标逐个进位，最内层维度一次处理一整行：两边都连续时用memcpy，源步长为0时填充
+     */
+    int dim = (int)size.size();
+    if(dim == 0) {
+        dst[0] = src[0];
+        return;
+    }
+    Tensor_stride ds = dst_stride.empty() ? contiguous_stride(size) : dst_stride;
+    Tensor_stride ss = src_stride.empty() ? contiguous_stride(size) : src_stride;
+    if(dim >= 2 && ds[dim-1] != ss[dim-1] && (ds[dim-1] == 1 || ss[dim-1] == 1) && ss[dim-1] != 0) {
+        // 一边最内层连续、另一边的连续维度在外层：转置，按块复制
+        int p = -1;
+        for(int k = dim-2; k>=0; k--) {
+            if(size[k] > 1 && (ds[dim-1] == 1 ? ss[k] : ds[k]) == 1) {
+                p = k;
+                break;
+            }
+        }
+        if(p >= 0) {
+            tensor_transpose_copy(dst, ds, src, ss, size, p);
+            return;
+        }
+    }
+    int row = size[dim-1];
+    int64_t ds_row = ds[dim-1];
+    int64_t ss_row = ss[dim-1];
+    int64_t rows = 1;
+    for(int i = 0; i<dim-1; i++) {
+        rows *= size[i];
+    }
+    Tensor_shape index(dim, 0);
+    int64_t dst_offset = 0;
+    int64_t src_offset = 0;
+    for(int64_t r = 0; r<rows; r++) {
+        T * d = dst + dst_offset;
+        const T * s = src + src_offset;
+        if(ds_row == 1 && ss_row == 1) {
+            memcpy(d, s, sizeof(T)*row);
+        }
+        else if(ss_row == 0) {
+            for(int i = 0; i<row; i++) {
+                d[i*ds_row] = s[0];
+            }
+        }
+        else {
+            for(int i = 0; i<row; i++) {
+                d[i*ds_row] = s[i*ss_row];
+            }
+        }
+        // 外层下标加一(进位时撤销该维度的偏移)
+        for(int p = dim-2; p>=0; p--) {
+            index[p]++;
+            dst_offset += ds[p];
+            src_offset += ss[p];
+            if(index[p] < size[p]) {
+                break;
+            }
+            dst_offset -= (int64_t)ds[p] * size[p];
+            src_offset -= (int64_t)ss[p] * size[p];
+            index[p] = 0;
+        }
+    }
 }
 
 template<typename T>
-Tensor<T> Tensor<T>::broadcast_to(const std::vector<int> &target_size) {
+Tensor<T> Tensor<T>::broadcast_to(const Tensor_shape &target_size) {
     /*
      * broadcast_to: 将原数组广播为size
      * 1. 让size向target_size看齐，不足的部分在前面加1补齐，得到new_this(即若target=(2,3,4), size=(4), 则new_size=(1,1,4))
@@ -693,9 +1009,7 @@ Tensor<T> Tensor<T>::broadcast_to(const std::vector<int> &target_size) {
      * 以上为理论算法，实际算法如下：
      * 1. 只新建new_this的new_size，不新建new_this。
      * 2. 按照上面第3条规则检查new_size和target_size
-     * 3. 使用new_size新建result
-     * 4. 遍历result，按照上面第4条规则从new_this取数据(虽然没有创建new_this，但事实上this扩展为new_this后，data中数据
-     *      偏移是不变的，所以可以用new_this的offset从this中取数据)
+     * 3. 返回共享数据空间的视图，size为target_size。第4条规则通过把对应维度的步长设为0实现(沿此轴移动时地址不变)
      */
     // 检查target_size中不能有负值
     for(const int &i: target_size) {
@@ -711,7 +1025,7 @@ Tensor<T> Tensor<T>::broadcast_to(const std::vector<int> &target_size) {
         exit(-1);
     }
     // 新建new_size
-    std::vector<int> new_size;
+    Tensor_shape new_size;
     int target_dim = (int)target_size.size();
     int this_dim = this->size.size();
     for(int i = 0; i<target_dim-this_dim; i++) {
@@ -741,36 +1055,18 @@ Tensor<T> Tensor<T>::broadcast_to(const std::vector<int> &target_size) {
             exit(-1);
         }
     }
-    // 使用new_size新建result
-    Tensor<T> result{target_size};
-    // 遍历result，按照上面第4条规则从new_this取数据
-    int res_index[target_dim];              // 遍历result时，当前访问元素的index
-    int this_index[target_dim];             // result中元素对应的new_this中元素的下标
-    memset(res_index, 0, sizeof(T)*target_dim);
-    memset(this_index, 0, sizeof(T)*target_dim);
-    int target_len = result.len();
-    for(int i = 0; i<target_len; i++) { // 遍历result
-        // 将res_index映射到this_index
-        for(int j = 0; j<target_dim; j++) {
-            if(new_size[j] == 1) {
-                this_index[j] = 0;
-            }
-            else {
-                this_index[j] = res_index[j];
-            }
+    // 创建视图：补齐的维度和被广播的维度步长为0，其他维度沿用原步长。不复制数据
+    Tensor_stride old_stride = this->stride.empty() ? contiguous_stride(this->size) : this->stride;
+    Tensor<T> result = *this;
+    result.size = target_size;
+    result.stride.assign(target_dim, 0);
+    for(int i = target_dim-this_dim; i<target_dim; i++) {
+        if(new_size[i] != 1 || target_size[i] == 1) {
+            result.stride[i] = old_stride[i-(target_dim-this_dim)];
         }
-        // 计算this_index相对于data的偏移
-        int offset = 0;
-        int weight = 1;
-        for(int p = target_dim-1; p>=0; p--) {
-            offset += weight * this_index[p];
-            weight *= new_size[p];
-        }
-        // 赋值
-        result.data[i] = this->data[offset];
-        // res_index加一
-        array_add_1(res_index, target_size);
     }
+    result.is_num = false;
+    result.normalize_stride();
     return result;
 }
 
@@ -787,89 +1083,15 @@ Tensor<T> Tensor<T>::true_divide(Tensor<T> divisor) {
     /*
      * 除法。将this广播到divisor，或将divisor广播到this，然后进行elementwise除法
      */
-    Tensor<T> broadcasted_this;
-    Tensor<T> broadcasted_divisor;
-    if(this->size.size() < divisor.size.size()) {
-        broadcasted_this = this->broadcast_to(divisor.size);
-        broadcasted_divisor = divisor;
-    }
-    else if(this->size.size() > divisor.size.size()){
-        broadcasted_this = *this;
-        broadcasted_divisor = divisor.broadcast_to(this->size);
-    }
-    else {
-        // 如果两者维度相同，则比较两者各维度的尺寸，将小的广播到大的
-        int this_size_lager = 0;
-        for(int i = 0; i<(int)this->size.size(); i++) {
-            if(this->size[i] > divisor.size[i]) {
-                this_size_lager = 1;
-                break;
-            }
-        }
-        if(this_size_lager) {
-            broadcasted_this = *this;
-            broadcasted_divisor = divisor.broadcast_to(this->size);
-        }
-        else {
-            broadcasted_this = this->broadcast_to(divisor.size);
-            broadcasted_divisor = divisor;
-        }
-    }
-    Tensor<T> result{broadcasted_this.size};
-    int len = result.len();
-    for(int i = 0; i<len; i++) {
-        result.data[i] = broadcasted_this.data[i] / broadcasted_divisor.data[i];
-    }
-    return result;
+    return *this / divisor;
 }
 
 template<typename T>
 Tensor<T> Tensor<T>::floor_divide(Tensor<T> divisor) {
     /*
-     * 向下取整除法。将this广播到divisor，或将divisor广播到this，然后进行elementwise除法
-     */
-    Tensor<T> broadcasted_this;
-    Tensor<T> broadcasted_divisor;
-    if(this->size.size() < divisor.size.size()) {
-        broadcasted_this = this->broadcast_to(divisor.size);
-        broadcasted_divisor = divisor;
-    }
-    else if(this->size.size() > divisor.size.size()){
-        broadcasted_this = *this;
-        broadcasted_divisor = divisor.broadcast_to(this->size);
-    }
-    else {
-        // 如果两者维度相同，则比较两者各维度的尺寸，将小的广播到大的
-        int this_size_lager = 0;
-        for(int i = 0; i<(int)this->size.size(); i++) {
-            if(this->size[i] > divisor.size[i]) {
-                this_size_lager = 1;
-                break;
-            }
-        }
-        if(this_size_lager) {
-            broadcasted_this = *this;
-            broadcasted_divisor = divisor.broadcast_to(this->size);
-        }
-        else {
-            broadcasted_this = this->broadcast_to(divisor.size);
-            broadcasted_divisor = divisor;
-        }
-    }
-    Tensor<T> result{broadcasted_this.size};
-    int len = result.len();
-    for(int i = 0; i<len; i++) {
-        result.data[i] = (int)(broadcasted_this.data[i] / broadcasted_divisor.data[i]);
-    }
-    return result;
-}
-
-template<typename T>
-Tensor<T> Tensor<T>::operator/(Tensor<T> divisor) {
-    /*
-     * overload /
+     * 向下取整除法。按广播规则逐元素计算，不复制被广播的操作数
      */
-    return this->true_divide(divisor);
+    return Tensor_binary<Expr_floor_div, Tensor_leaf<T>, Tensor_leaf<T>>(Tensor_leaf<T>(*this), Tensor_leaf<T>(divisor));
 }
 
 template<typename T>
@@ -877,12 +1099,7 @@ Tensor<float32> Tensor<T>::astype_float32() {
     /*
      * 创建一个新数组，使其值与this相同，但类型为float32
      */
-    Tensor<float32> result{this->size};
-    int len = result.len();
-    for(int i = 0; i<len; i++) {
-        result.data[i] = (float32)(this->data[i]);
-    }
-    return result;
+    return as_expr(*this).astype_float32();
 }
 
 template<typename T>
@@ -890,12 +1107,7 @@ Tensor<int32> Tensor<T>::astype_int32() {
     /*
      * 创建一个新数组，使其值与this相同，但类型为int32
      */
-    Tensor<int32> result{this->size};
-    int len = result.len();
-    for(int i = 0; i<len; i++) {
-        result.data[i] = (int32)(this->data[i]);
-    }
-    return result;
+    return as_expr(*this).astype_int32();
 }
 
 template<typename T>
@@ -903,22 +1115,38 @@ Tensor<uint8> Tensor<T>::astype_uint8() {
     /*
      * 创建一个新数组，使其值与this相同，但类型为uint8
      */
-    Tensor<uint8> result{this->size};
-    int len = result.len();
-    for(int i = 0; i<len; i++) {
-        result.data[i] = (uint8) (this->data[i]);
-    }
-    return result;
+    return as_expr(*this).astype_uint8();
 }
 
 template<typename T>
-Tensor<T> Tensor<T>::deep_copy() {
+Tensor<fp16> Tensor<T>::astype_float16() {
+    /*
+     * 创建一个新数组，使其值与this相同，但类型为fp16
+     */
+    return as_expr(*this).astype_float16();
+}
+
+template<typename T>
+Tensor<bf16> Tensor<T>::astype_bfloat16() {
+    /*
+     * 创建一个新数组，使其值与this相同，但类型为bf16
+     */
+    return as_expr(*this).astype_bfloat16();
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::deep_copy() {
     /*
      * 创建一个新的数组，使其与this完全相同(但拥有不同的内存空间)，然后返回它
      */
     Tensor<T> ret{this->size};
-    int len = ret.len();
-    memcpy(ret.data, this->data, sizeof(T)*len);
+    if(is_contiguous()) {
+        memcpy(ret.data, this->data, sizeof(T)*(size_t)ret.len());
+    }
+    else {
+        tensor_strided_copy(ret.data, Tensor_stride(), this->data, this->stride, this->size);
+    }
+    ret.is_num = this->is_num;
     return ret;
 }
 
@@ -929,7 +1157,7 @@ Tensor<T> Tensor<T>::deep_copy() {
 //     * 矩阵乘法。原始算法
 //     */
 //    Tensor<T> A_tensor = *this;
-//    Tensor<T> C_tensor{std::vector<int>{A_tensor.size[0], B_tensor.size[1]}};
+//    Tensor<T> C_tensor{Tensor_shape{A_tensor.size[0], B_tensor.size[1]}};
 //    T * A = A_tensor.data;
 //    T * B = B_tensor.data;
 //    T * C = C_tensor.data;
@@ -957,7 +1185,7 @@ Tensor<T> Tensor<T>::deep_copy() {
 //     * 即在计算时，一次计算C的横向相连的4个数据，使用A的1行和B的4列
 //     */
 //    Tensor<T> A_tensor = *this;
-//    Tensor<T> C_tensor{std::vector<int>{A_tensor.size[0], B_tensor.size[1]}};
+//    Tensor<T> C_tensor{Tensor_shape{A_tensor.size[0], B_tensor.size[1]}};
 //    T * A = A_tensor.data;
 //    T * B = B_tensor.data;
 //    T * C = C_tensor.data;
@@ -1003,7 +1231,7 @@ Tensor<T> Tensor<T>::deep_copy() {
 //     * 即在计算时，一次计算C的横向纵向相连的16个数据，使用A的4行和B的4列
 //     */
 //    Tensor<T> A_tensor = *this;
-//    Tensor<T> C_tensor{std::vector<int>{A_tensor.size[0], B_tensor.size[1]}};
+//    Tensor<T> C_tensor{Tensor_shape{A_tensor.size[0], B_tensor.size[1]}};
 //    T * A = A_tensor.data;
 //    T * B = B_tensor.data;
 //    T * C = C_tensor.data;
@@ -1102,32 +1330,12 @@ Tensor<T> Tensor<T>::deep_copy() {
 template<typename T>
 Tensor<T> Tensor<T>::dot(Tensor<T> B_tensor) {
     /*
-     * 矩阵乘法。多线程
+     * 矩阵乘法。多线程，见tensor_dot
      */
-    Tensor<T> A_tensor = *this;
-    Tensor<T> C_tensor{std::vector<int>{A_tensor.size[0], B_tensor.size[1]}};
-    T * A = A_tensor.data;
-    T * B = B_tensor.data;
-    T * C = C_tensor.data;
-    int M = A_tensor.size[0];
-    int K = A_tensor.size[1];
-    int N = B_tensor.size[1];
-
-    // 最大线程数n_proc。每150000计算量增加一个线程，最大不超过n_proc
-    int n_proc = (int)sysconf(_SC_NPROCESSORS_ONLN);
-    int max_calc_amount = 150000 * n_proc;
-    n_proc = n_proc - (max_calc_amount - M*K*N) / 150000;
-
-    int M_per_proc = M / n_proc;
-    std::thread t[n_proc];
-    for(int i = 0; i<n_proc; i++) {
-        t[i] = std::thread(mt_dot, &C[i*M_per_proc*N], &A[i*M_per_proc*K], B, M_per_proc, K, N);
-    }
-    mt_dot(&C[n_proc*M_per_proc*N], &A[n_proc*M_per_proc*K], B, M-n_proc*M_per_proc, K, N);
-    for(int i = 0; i<n_proc; i++) {
-        t[i].join();
-    }
-
+    Tensor<T> A_tensor = this->contiguous();
+    B_tensor = B_tensor.contiguous();
+    Tensor<T> C_tensor{Tensor_shape{A_tensor.size[0], B_tensor.size[1]}};
+    tensor_dot(C_tensor.data, A_tensor.data, B_tensor.data, A_tensor.size[0], A_tensor.size[1], B_tensor.size[1]);
     return C_tensor;
 }
 
@@ -1136,20 +1344,7 @@ Tensor<T> Tensor<T>::add(T adder) {
     /*
      * add
      */
-    Tensor<T> result{this->size};
-    int len = result.len();
-    for(int i = 0; i<len; i++) {
-        result.data[i] = this->data[i] + adder;
-    }
-    return result;
-}
-
-template<typename T>
-Tensor<T> Tensor<T>::operator+(T adder) {
-    /*
-     * overload +
-     */
-    return this->add(adder);
+    return *this + adder;
 }
 
 template<typename T>
@@ -1157,10 +1352,13 @@ Tensor<T> &Tensor<T>::operator+=(T adder) {
     /*
      * overload +=
      */
-    int len = this->len();
-    for(int i = 0; i<len; i++) {
-        this->data[i] += adder;
+    if(!is_contiguous()) {      // 非连续的视图：在连续副本上计算，再写回视图
+        Tensor<T> temp = contiguous();
+        temp.operator+=(adder);
+        tensor_strided_copy(data, stride, temp.data, Tensor_stride(), size);
+        return *this;
     }
+    kernel_add(this->data, this->data, adder, this->len());
     return *this;
 }
 
@@ -1169,152 +1367,107 @@ Tensor<T> Tensor<T>::add(Tensor<T> adder) {
     /*
      * 加法。将this广播到adder，或将adder广播到this，然后进行elementwise加法
      */
-    Tensor<T> broadcasted_this;
-    Tensor<T> broadcasted_adder;
-    if(this->size.size() < adder.size.size()) {
-        broadcasted_this = this->broadcast_to(adder.size);
-        broadcasted_adder = adder;
-    }
-    else if(this->size.size() > adder.size.size()){
-        broadcasted_this = *this;
-        broadcasted_adder = adder.broadcast_to(this->size);
-    }
-    else {
-        // 如果两者维度相同，则比较两者各维度的尺寸，将小的广播到大的
-        int this_size_lager = 0;
-        for(int i = 0; i<(int)this->size.size(); i++) {
-            if(this->size[i] > adder.size[i]) {
-                this_size_lager = 1;
-                break;
-            }
-        }
-        if(this_size_lager) {
-            broadcasted_this = *this;
-            broadcasted_adder = adder.broadcast_to(this->size);
-        }
-        else {
-            broadcasted_this = this->broadcast_to(adder.size);
-            broadcasted_adder = adder;
-        }
-    }
-    Tensor<T> result{broadcasted_this.size};
-    int len = result.len();
-    for(int i = 0; i<len; i++) {
-        result.data[i] = broadcasted_this.data[i] + broadcasted_adder.data[i];
-    }
-    return result;
+    return *this + adder;
 }
 
 template<typename T>
-Tensor<T> Tensor<T>::operator+(Tensor<T> adder) {
+Tensor<T> Tensor<T>::concat(Tensor<T> array, int dim) {
     /*
-     * overload +
+     * concat: 拼接this和array，见tensor_concat
      */
-    return this->add(adder);
+    return tensor_concat(std::vector<Tensor<T>>{*this, array}, dim);
 }
 
 template<typename T>
-Tensor<T> Tensor<T>::concat(Tensor<T> array, int dim) {
+Tensor<T> tensor_concat(std::vector<Tensor<T>> arrays, int dim) {
+    /*
+     * 沿dim拼接多个张量，创建新张量
+     */
+    Tensor<T> result{tensor_concat_shape(arrays, dim)};
+    tensor_concat(result.data, std::move(arrays), dim);
+    return result;
+}
+
+template<typename T>
+Tensor_shape tensor_concat_shape(const std::vector<Tensor<T>> &arrays, int dim) {
     /*
-     * concat: 创建新张量使其尺寸为拼接后的尺寸。遍历新张量的元素，根据其偏移计算下标，根据下标
-     * 计算应从哪个输入张量中提取元素，并计算其下标，根据此下标计算该元素在输入张量中的偏移，并使用
-     * 此元素填充新张量
+     * 拼接结果的尺寸。检查：拼接各方维度相同，dim外其他维度尺寸相同
      */
-    // 计算新尺寸(检查：拼接双方维度相同，dim外其他维度尺寸相同)
-    std::vector<int> new_size;
-    if(this->size.size() != array.size.size()) {
-        fprintf(stderr, "the dimension of the tensors to concat should be same\n");
+    if(arrays.empty()) {
+        fprintf(stderr, "File: tensor_impl.h, line: %d. No tensor to concat\n", __LINE__);
         exit(-1);
     }
-    for(int i = 0; i<(int)this->size.size(); i++) {
-        if(i != dim) {
-            if(this->size[i] != array.size[i]) {
-                fprintf(stderr, "the dimensions to concat should exactly match. Cannot match"
-                                "%d to %d\n", this->size[i], array.size[i]);
-                exit(-1);
-            }
-            new_size.push_back(this->size[i]);
-        }
-        else {
-            new_size.push_back(this->size[i] + array.size[i]);
-        }
+    int n_dim = (int)arrays[0].size.size();
+    if(dim < 0 || dim >= n_dim) {
+        fprintf(stderr, "File: tensor_impl.h, line: %d. Cannot concat %d dimension tensors on dim %d\n",
+                __LINE__, n_dim, dim);
+        exit(-1);
     }
-    // 创建返回对象
-    Tensor<T> result{new_size};
-    // concat
-    int new_dim = (int)new_size.size();
-    int new_index[new_dim];
-    int old_index[new_dim];
-    memset(new_index, 0, sizeof(int)*new_dim);
-    memset(old_index, 0, sizeof(int)*new_dim);
-    int len = result.len();
-    for(int i = 0; i<len; i++) {    // 遍历新张量中的每个元素
-        // new_index即为当前访问元素在result中的下标，判断此下标应从哪个输入张量中取数
-        int get_from_this = 0;
-        if(new_index[dim] <= this->size[dim]-1) {
-            get_from_this = 1;
-        }
-        // 计算要取的数在输入张量中的下标
-        for(int j = 0; j<new_dim; j++) {
-            if(j == dim) {
-                if(get_from_this) {
-                    old_index[j] = new_index[j];
-                }
-                else {
-                    old_index[j] = new_index[j] - this->size[j];
-                }
-            }
-            else {
-                old_index[j] = new_index[j];
-            }
-        }
-        // 根据下标计算此数在输入张量中的偏移
-        int offset = 0;
-        int weight = 1;
-        if(get_from_this) {
-            for(int j = this->size.size()-1; j >= 0; j--) {
-                offset += weight * old_index[j];
-                weight *= this->size[j];
-            }
+    Tensor_shape new_size = arrays[0].size;
+    new_size[dim] = 0;
+    for(const Tensor<T> &array: arrays) {
+        if((int)array.size.size() != n_dim) {
+            fprintf(stderr, "the dimension of the tensors to concat should be same\n");
+            exit(-1);
         }
-        else {
-            for(int j = array.size.size()-1; j >= 0; j--) {
-                offset += weight * old_index[j];
-                weight *= array.size[j];
+        for(int i = 0; i<n_dim; i++) {
+            if(i != dim && array.size[i] != new_size[i]) {
+                fprintf(stderr, "the dimensions to concat should exactly match. Cannot match"
+                                "%d to %d\n", new_size[i], array.size[i]);
+                exit(-1);
             }
         }
-        // 从输入张量中取数置于result中
-        if(get_from_this) {
-            result.data[i] = this->data[offset];
-        }
-        else {
-            result.data[i] = array.data[offset];
-        }
-        // 将新张量下标加一
-        array_add_1(new_index, result.size);
+        new_size[dim] += array.size[dim];
     }
-    return result;
+    return new_size;
 }
 
 template<typename T>
-Tensor<T> Tensor<T>::sub(T subtractend) {
+void tensor_concat(T * dst, std::vector<Tensor<T>> arrays, int dim) {
     /*
-     * 减法
+     * 沿dim拼接多个张量，结果写入dst(连续存储，长度为tensor_concat_shape之积)
+     * 把每个张量看作(outer, size[dim]*inner)的矩阵，outer为dim之前各维度之积，inner为dim之后各维度之积。
+     * 结果的每一行依次由各输入的对应行拼成，每段都是连续的，直接memcpy。
+     * 例如NCHW在通道上拼接时，每个输入每个batch只需一次memcpy
      */
-    Tensor<T> result{this->size};
-    int len = this->len();
-    for(int i = 0; i<len; i++) {
-        result.data[i] = this->data[i] - subtractend;
+    Tensor_shape new_size = tensor_concat_shape(arrays, dim);
+    int n_dim = (int)new_size.size();
+    for(Tensor<T> &array: arrays) {
+        array = array.contiguous();     // 非连续的视图先转为连续存储
     }
-    return result;
+    int64_t outer = 1;
+    int64_t inner = 1;
+    for(int i = 0; i<dim; i++) {
+        outer *= new_size[i];
+    }
+    for(int i = dim+1; i<n_dim; i++) {
+        inner *= new_size[i];
+    }
+    // 各输入每行的长度，以及在结果行中的起始位置
+    int n_array = (int)arrays.size();
+    std::vector<int64_t> run(n_array);
+    std::vector<int64_t> start(n_array);
+    int64_t row = 0;
+    for(int k = 0; k<n_array; k++) {
+        run[k] = arrays[k].size[dim] * inner;
+        start[k] = row;
+        row += run[k];
+    }
+    parallel_for(0, outer, tensor_parallel_grain(outer, row), [&](int64_t from, int64_t to) {
+        for(int64_t o = from; o<to; o++) {
+            for(int k = 0; k<n_array; k++) {
+                memcpy(dst + o * row + start[k], arrays[k].data + o * run[k], sizeof(T) * run[k]);
+            }
+        }
+    });
 }
 
 template<typename T>
-Tensor<T> Tensor<T>::operator-(T subtractend) {
+Tensor<T> Tensor<T>::sub(T subtractend) {
     /*
-     * overload -
+     * 减法
      */
-    return this->sub(subtractend);
+    return *this - subtractend;
 }
 
 template<typename T>
@@ -1322,48 +1475,7 @@ Tensor<T> Tensor<T>::sub(Tensor<T> subtractend) {
     /*
      * 减法。将this广播到adder，或将adder广播到this，然后进行elementwise减法
      */
-    Tensor<T> broadcasted_this;
-    Tensor<T> broadcasted_subtractend;
-    if(this->size.size() < subtractend.size.size()) {
-        broadcasted_this = this->broadcast_to(subtractend.size);
-        broadcasted_subtractend = subtractend;
-    }
-    else if(this->size.size() > subtractend.size.size()){
-        broadcasted_this = *this;
-        broadcasted_subtractend = subtractend.broadcast_to(this->size);
-    }
-    else {
-        // 如果两者维度相同，则比较两者各维度的尺寸，将小的广播到大的
-        int this_size_lager = 0;
-        for(int i = 0; i<(int)this->size.size(); i++) {
-            if(this->size[i] > subtractend.size[i]) {
-                this_size_lager = 1;
-                break;
-            }
-        }
-        if(this_size_lager) {
-            broadcasted_this = *this;
-            broadcasted_subtractend = subtractend.broadcast_to(this->size);
-        }
-        else {
-            broadcasted_this = this->broadcast_to(subtractend.size);
-            broadcasted_subtractend = subtractend;
-        }
-    }
-    Tensor<T> result{broadcasted_this.size};
-    int len = result.len();
-    for(int i = 0; i<len; i++) {
-        result.data[i] = broadcasted_this.data[i] - broadcasted_subtractend.data[i];
-    }
-    return result;
-}
-
-template<typename T>
-Tensor<T> Tensor<T>::operator-(Tensor<T> subtractend) {
-    /*
-     * overload -
-     */
-    return this->sub(subtractend);
+    return *this - subtractend;
 }
 
 template<typename T>
@@ -1371,10 +1483,13 @@ Tensor<T> &Tensor<T>::operator-=(T subtractend) {
     /*
      * overload -=
      */
-    int len = this->len();
-    for(int i = 0; i<len; i++) {
-        this->data[i] -= subtractend;
+    if(!is_contiguous()) {      // 非连续的视图：在连续副本上计算，再写回视图
+        Tensor<T> temp = contiguous();
+        temp.operator-=(subtractend);
+        tensor_strided_copy(data, stride, temp.data, Tensor_stride(), size);
+        return *this;
     }
+    kernel_sub(this->data, this->data, subtractend, this->len());
     return *this;
 }
 
@@ -1383,12 +1498,7 @@ Tensor<T> Tensor<T>::elewise_sqrt() {
     /*
      * sqrt
      */
-    Tensor<T> result{this->size};
-    int len = result.len();
-    for(int i = 0; i<len; i++) {
-        result.data[i] = sqrt(this->data[i]);
-    }
-    return result;
+    return as_expr(*this).elewise_sqrt();
 }
 
 template<typename T>
@@ -1396,12 +1506,7 @@ Tensor<T> Tensor<T>::mult(T multiplier) {
     /*
      * 乘法
      */
-    Tensor<T> result{this->size};
-    int len = result.len();
-    for(int i = 0; i<len; i++) {
-        result.data[i] = this->data[i] * multiplier;
-    }
-    return result;
+    return *this * multiplier;
 }
 
 template<typename T>
@@ -1409,67 +1514,20 @@ Tensor<T> Tensor<T>::mult(Tensor<T> multiplier) {
     /*
      * 乘法。将this广播到multiplier，或将multiplier广播到this，然后进行elementwise加法
      */
-    Tensor<T> broadcasted_this;
-    Tensor<T> broadcasted_multiplier;
-    if(this->size.size() < multiplier.size.size()) {
-        broadcasted_this = this->broadcast_to(multiplier.size);
-        broadcasted_multiplier = multiplier;
-    }
-    else if(this->size.size() > multiplier.size.size()){
-        broadcasted_this = *this;
-        broadcasted_multiplier = multiplier.broadcast_to(this->size);
-    }
-    else {
-        // 如果两者维度相同，则比较两者各维度的尺寸，将小的广播到大的
-        int this_size_lager = 0;
-        for(int i = 0; i<(int)this->size.size(); i++) {
-            if(this->size[i] > multiplier.size[i]) {
-                this_size_lager = 1;
-                break;
-            }
-        }
-        if(this_size_lager) {
-            broadcasted_this = *this;
-            broadcasted_multiplier = multiplier.broadcast_to(this->size);
-        }
-        else {
-            broadcasted_this = this->broadcast_to(multiplier.size);
-            broadcasted_multiplier = multiplier;
-        }
-    }
-    Tensor<T> result{broadcasted_this.size};
-    int len = result.len();
-    for(int i = 0; i<len; i++) {
-        result.data[i] = broadcasted_this.data[i] * broadcasted_multiplier.data[i];
-    }
-    return result;
-}
-
-template<typename T>
-Tensor<T> Tensor<T>::operator*(T multiplier) {
-    /*
-     * overload *
-     */
-    return this->mult(multiplier);
-}
-
-template<typename T>
-Tensor<T> Tensor<T>::operator*(Tensor<T> multiplier) {
-    /*
-     * overload *
-     */
-    return this->mult(multiplier);
+    return *this * multiplier;
 }
 
 template<typename T>
 Tensor<T> &Tensor<T>::operator*=(Tensor<T> multiplier) {
     /*
      * overload *=
+     * 原地计算，multiplier广播到this的尺寸
      */
-    int len = this->len();
-    for(int i = 0; i<len; i++) {
-        this->data[i] *= multiplier;
+    if(this->size != (*this * multiplier).shape()) {
+        fprintf(stderr, "File: tensor_impl.h, line: %d. non-broadcastable output operand in *=\n", __LINE__);
+        exit(-1);
     }
+    tensor_expr_eval(this->data, this->stride, this->size, *this * multiplier, false);  // 只有一个运算节点，读取后才写入
     return *this;
 }
 
@@ -1477,109 +1535,244 @@ template<typename T>
 Tensor<T> &Tensor<T>::operator/=(Tensor<T> divisor) {
     /*
      * overload /=
+     * 原地计算，divisor广播到this的尺寸
      */
-    int len = this->len();
-    for(int i = 0; i<len; i++) {
-        this->data[i] /= divisor;
+    if(this->size != (*this / divisor).shape()) {
+        fprintf(stderr, "File: tensor_impl.h, line: %d. non-broadcastable output operand in /=\n", __LINE__);
+        exit(-1);
     }
+    tensor_expr_eval(this->data, this->stride, this->size, *this / divisor, false);  // 只有一个运算节点，读取后才写入
     return *this;
 }
 
 template<typename T>
-Tensor<T> Tensor<T>::mean(std::vector<int> axis) {
+Tensor<T> tensor_reduce_prepare(Tensor<T> src, const std::vector<int> &axis, Tensor_shape &new_size,
+                                int64_t &outer, int64_t &reduce, int64_t &inner) {
     /*
-     * mean。对axis指定的轴求平均值
-     * 使用不在axis中包含的维度的尺寸创建新数组。遍历新数组，计算其在旧数组中对应的下标，并使用对应的轴
+     * 归约前整理维度：检查axis，计算结果尺寸new_size(去掉axis中的轴)，
+     * 返回连续存储的张量，使其可以看作(outer, reduce, inner)，在reduce维上归约
+     * axis中的轴相邻时直接使用原数据，否则转置为(不归约的轴, 归约的轴)，此时inner为1
      */
     // 检查输入的axis。不能有重复，不能有负数，轴编号必须比维度数小
-    int appear[this->size.size()];
-    memset(appear, 0, sizeof(int)*this->size.size());
-    for(int &i: axis) {
+    int n_dim = (int)src.size.size();
+    std::vector<int> appear(n_dim, 0);
+    for(const int &i: axis) {
         if(i < 0) {
             fprintf(stderr, "Negative value not allowed in axis\n");
             exit(-1);
         }
-        else if(i >= (int)this->size.size()) {
-            fprintf(stderr, "Axis %d is out of bounds for array of dimension of %d\n", i, (int)this->size.size());
+        else if(i >= n_dim) {
+            fprintf(stderr, "Axis %d is out of bounds for array of dimension of %d\n", i, n_dim);
             exit(-1);
         }
         else {
             appear[i]++;
         }
     }
-    for(int i = 0; i<(int)this->size.size(); i++) {
+    for(int i = 0; i<n_dim; i++) {
         if(appear[i] > 1) {
             fprintf(stderr, "duplicate value in axis\n");
             exit(-1);
         }
     }
-    if(axis.size() == this->size.size()) {
-        Tensor<T> result{std::vector<int>{1}};
-        result.data[0] = this->mean();
-        result.is_num = 1;
-        return result;
+    // 考虑到axis中的轴编号可能不按顺序，使用appear计算
+    new_size.clear();
+    std::vector<int> order;     // 不归约的轴在前，归约的轴在后
+    int first = n_dim;          // 第一个/最后一个归约的轴
+    int last = -1;
+    for(int i = 0; i<n_dim; i++) {
+        if(appear[i]) {
+            first = std::min(first, i);
+            last = i;
+        }
+        else {
+            new_size.push_back(src.size[i]);
+            order.push_back(i);
+        }
+    }
+    outer = 1;
+    reduce = 1;
+    inner = 1;
+    if(axis.empty() || last - first + 1 == (int)axis.size()) {      // 归约的轴相邻(或axis为空)
+        for(int i = 0; i<n_dim; i++) {
+            if(i < first) {
+                outer *= src.size[i];
+            }
+            else if(i > last) {
+                inner *= src.size[i];
+            }
+            else {
+                reduce *= src.size[i];
+            }
+        }
+        return src.contiguous();
     }
-    // 计算axis指定轴的尺寸和结果tensor的尺寸   // 考虑到axis中的轴编号可能不按顺序，我们使用之前统计的appear计算
-    std::vector<int> new_size;
-    std::vector<int> axis_size;
-    // 分别使用axis中出现和未出现的轴，按序排放创建vector，用于在遍历新数组时，将新数组坐标映射到旧数组坐标
-    std::vector<int> did_appear;
-    std::vector<int> never_appear;
-    for(int i = 0; i<(int)this->size.size(); i++) {
+    for(int i = 0; i<n_dim; i++) {
         if(appear[i]) {
-            axis_size.push_back(this->size[i]);
-            did_appear.push_back(i);
+            order.push_back(i);
+            reduce *= src.size[i];
         }
         else {
-            new_size.push_back(this->size[i]);
-            never_appear.push_back(i);
+            outer *= src.size[i];
         }
     }
-    // 创建新tensor
-    Tensor<T> result{new_size};
-    // 遍历新数组，对于每一个元素，计算axis中指定轴上的平均值
-    int len = result.len();
-    int new_dim = result.size.size();
-    int old_dim = this->size.size();
-    int new_index[new_dim];
-    int old_index[old_dim];
-    memset(new_index, 0, sizeof(int)*new_dim);
-    memset(old_index, 0, sizeof(int)*old_dim);
-    int axis_dim = (int)axis.size();                    // 指定的轴的个数
-    int axis_index[axis_dim];                           // 遍历axis指定轴时，指定轴之间的下标
-    int axis_len = this->len() / result.len();          // axis指定轴的元素个数
-    for(int i = 0; i<len; i++) {
-        // 将新数组下标映射到旧数组下标
-        for(int j = 0; j<new_dim; j++) {
-            old_index[never_appear[j]] = new_index[j];
+    return src.transpose(order).contiguous();
+}
+
+inline void tensor_moment_merge(Tensor_moment &a, const Tensor_moment &b) {
+    /*
+     * 把b合并到a(Chan的并行公式)
+     */
+    if(b.n == 0) {
+        return;
+    }
+    if(a.n == 0) {
+        a = b;
+        return;
+    }
+    int64_t n = a.n + b.n;
+    double delta = b.mean - a.mean;
+    a.mean += delta * b.n / n;
+    a.m2 += b.m2 + delta * delta * a.n / n * b.n;
+    a.n = n;
+}
+
+template<typename T>
+Tensor_moment tensor_moment_block(const T * a, int64_t n) {
+    /*
+     * 单线程计算n个元素的累积量
+     * 每TENSOR_REDUCE_BLOCK个元素一块，块内先求和再求偏差平方和(第二遍读的是缓存中的数据)，块间合并
+     * 对内存只读一遍，块内的两个循环可以向量化
+     */
+    Tensor_moment result{0, 0, 0};
+    for(int64_t start = 0; start<n; start += TENSOR_REDUCE_BLOCK) {
+        int len = (int)std::min<int64_t>(TENSOR_REDUCE_BLOCK, n - start);
+        const T * p = a + start;
+        double sum = 0;
+        #pragma omp simd reduction(+:sum)
+        for(int i = 0; i<len; i++) {
+            sum += (double)p[i];
+        }
+        double mean = sum / len;
+        double m2 = 0;
+        #pragma omp simd reduction(+:m2)
+        for(int i = 0; i<len; i++) {
+            double d = (double)p[i] - mean;
+            m2 += d * d;
+        }
+        tensor_moment_merge(result, Tensor_moment{len, mean, m2});
+    }
+    return result;
+}
+
+template<typename T>
+Tensor_moment tensor_moment(const T * a, int64_t n) {
+    /*
+     * n个元素的累积量。元素较多时按TENSOR_REDUCE_CHUNK分块多线程计算，再按顺序合并
+     */
+    if(n < TENSOR_PARALLEL_MIN_LEN) {
+        return tensor_moment_block(a, n);
+    }
+    int64_t n_chunk = (n + TENSOR_REDUCE_CHUNK - 1) / TENSOR_REDUCE_CHUNK;
+    std::vector<Tensor_moment> part(n_chunk);
+    parallel_for(0, n_chunk, tensor_parallel_grain(n_chunk, TENSOR_REDUCE_CHUNK), [&](int64_t from, int64_t to) {
+        for(int64_t c = from; c<to; c++) {
+            part[c] = tensor_moment_block(a + c * TENSOR_REDUCE_CHUNK,
+                                          std::min<int64_t>(TENSOR_REDUCE_CHUNK, n - c * TENSOR_REDUCE_CHUNK));
+        }
+    });
+    Tensor_moment result{0, 0, 0};
+    for(int64_t c = 0; c<n_chunk; c++) {
+        tensor_moment_merge(result, part[c]);
+    }
+    return result;
+}
+
+template<typename T>
+void tensor_reduce_moment(T * mean, T * var, const T * src, int64_t outer, int64_t reduce, int64_t inner) {
+    /*
+     * 把src看作(outer, reduce, inner)，在reduce维上求均值和方差，结果为(outer, inner)。mean或var为nullptr时不输出
+     * inner为1：每行连续，逐行计算累积量
+     * inner大于1：逐行读取，用Welford公式累加到各列(一次处理TENSOR_REDUCE_BLOCK列，列方向可以向量化)
+     */
+    if(inner == 1) {
+        if(outer == 1) {
+            Tensor_moment m = tensor_moment(src, reduce);
+            if(mean) {
+                mean[0] = (T)m.mean;
+            }
+            if(var) {
+                var[0] = (T)(m.m2 / m.n);
+            }
+            return;
         }
-        // 对于axis指定的轴，将其提取出来，建立一个下标axis_index
-        memset(axis_index, 0, sizeof(int)*axis_dim);
-        // 遍历axis_index并求平均值
-        T sum = 0;
-        for(int j = 0; j<axis_len; j++) {
-            // 将axis_index映射到old_index
-            for(int k = 0; k<axis_dim; k++) {
-                old_index[did_appear[k]] = axis_index[k];
+        parallel_for(0, outer, tensor_parallel_grain(outer, reduce), [&](int64_t from, int64_t to) {
+            for(int64_t o = from; o<to; o++) {
+                Tensor_moment m = tensor_moment_block(src + o * reduce, reduce);
+                if(mean) {
+                    mean[o] = (T)m.mean;
+                }
+                if(var) {
+                    var[o] = (T)(m.m2 / m.n);
+                }
             }
-            // 根据old_index求该值在this中的偏移
-            int offset = 0;
-            int weight = 1;
-            for(int p = old_dim-1; p >= 0; p--) {
-                offset += weight * old_index[p];
-                weight *= this->size[p];
+        });
+        return;
+    }
+    int64_t n_block = (inner + TENSOR_REDUCE_BLOCK - 1) / TENSOR_REDUCE_BLOCK;
+    int64_t grain = tensor_parallel_grain(outer * n_block, reduce * std::min<int64_t>(inner, TENSOR_REDUCE_BLOCK));
+    parallel_for(0, outer * n_block, grain, [&](int64_t from, int64_t to) {
+        for(int64_t task = from; task<to; task++) {
+            int64_t o = task / n_block;
+            int64_t j0 = task % n_block * TENSOR_REDUCE_BLOCK;
+            int cols = (int)std::min<int64_t>(TENSOR_REDUCE_BLOCK, inner - j0);
+            const T * block = src + o * reduce * inner + j0;
+            double mu[TENSOR_REDUCE_BLOCK];
+            double m2[TENSOR_REDUCE_BLOCK];
+            for(int j = 0; j<cols; j++) {
+                mu[j] = 0;
+                m2[j] = 0;
+            }
+            for(int64_t k = 0; k<reduce; k++) {
+                const T * row = block + k * inner;
+                double inv = 1.0 / (double)(k + 1);
+                #pragma omp simd
+                for(int j = 0; j<cols; j++) {
+                    double x = (double)row[j];
+                    double d = x - mu[j];
+                    mu[j] += d * inv;
+                    m2[j] += d * (x - mu[j]);
+                }
+            }
+            for(int j = 0; j<cols; j++) {
+                if(mean) {
+                    mean[o * inner + j0 + j] = (T)mu[j];
+                }
+                if(var) {
+                    var[o * inner + j0 + j] = (T)(m2[j] / reduce);
+                }
             }
-            // 对数值进行累加
-            sum += this->data[offset];
-            // axis_index加一
-            array_add_1(axis_index, axis_size);
         }
-        sum /= axis_len;
-        // 将平均值存入结果数组
-        result.data[i] = sum;
-        // 新数组下标加一
-        array_add_1(new_index, new_size);
+    });
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::mean(std::vector<int> axis) {
+    /*
+     * mean。对axis指定的轴求平均值，见tensor_reduce_moment
+     */
+    Tensor_shape new_size;
+    int64_t outer, reduce, inner;
+    Tensor<T> src = tensor_reduce_prepare(*this, axis, new_size, outer, reduce, inner);
+    if(new_size.empty()) {
+        Tensor<T> result{Tensor_shape{1}};
+        result.data[0] = src.mean();
+        result.is_num = 1;
+        return result;
     }
+    // 创建新tensor
+    Tensor<T> result{new_size};
+    tensor_reduce_moment(result.data, (T*)nullptr, src.data, outer, reduce, inner);
     return result;
 }
 
@@ -1588,112 +1781,42 @@ T Tensor<T>::mean() {
     /*
      * mean
      */
-    T sum = 0;
-    int len = this->len();
-    for(int i = 0; i<len; i++) {
-        sum += this->data[i];
+    if(!is_contiguous()) {      // 非连续的视图先转为连续存储
+        return contiguous().mean();
     }
-    sum /= len;
-    return sum;
+    return (T)tensor_moment(this->data, this->len()).mean;
 }
 
 template<typename T>
 T Tensor<T>::var() {
     /*
-     * var
+     * var。与均值在同一次遍历中计算
      */
-    T mean = this->mean();
-    T sum = 0;
-    int len = this->len();
-    for(int i = 0; i<len; i++) {
-        sum += (this->data[i] - mean) * (this->data[i] - mean);
+    if(!is_contiguous()) {      // 非连续的视图先转为连续存储
+        return contiguous().var();
     }
-    sum /= len;
-    return sum;
+    Tensor_moment m = tensor_moment(this->data, this->len());
+    return (T)(m.m2 / m.n);
 }
 
 template<typename T>
 Tensor<T> Tensor<T>::var(std::vector<int> axis) {
     /*
-     * var
+     * var。对axis指定的轴求方差，见tensor_reduce_moment
      */
-    // 首先计算mean
-    Tensor<T> mean = this->mean(axis);
-    // 检查输入的axis。不能有重复，不能有负数，轴编号必须比维度数小
-    // 由于mean中已经检查过axis了，所以这里不再检查
-    int appear[this->size.size()];
-    memset(appear, 0, sizeof(int)*this->size.size());
-    for(int &i: axis) {
-        appear[i]++;
-    }
+    Tensor_shape new_size;
+    int64_t outer, reduce, inner;
+    Tensor<T> src = tensor_reduce_prepare(*this, axis, new_size, outer, reduce, inner);
     // 如果对所有轴求var，则直接调用var()
-    if(axis.size() == this->size.size()) {
-        Tensor<T> result{std::vector<int>{1}};
-        result.data[0] = this->var();
+    if(new_size.empty()) {
+        Tensor<T> result{Tensor_shape{1}};
+        result.data[0] = src.var();
         result.is_num = 1;
         return result;
     }
-    // 计算axis指定轴的尺寸和结果tensor的尺寸   // 考虑到axis中的轴编号可能不按顺序，我们使用之前统计的appear计算
-    std::vector<int> new_size;
-    std::vector<int> axis_size;
-    // 分别使用axis中出现和未出现的轴，按序排放创建vector，用于在遍历新数组时，将新数组坐标映射到旧数组坐标
-    std::vector<int> did_appear;
-    std::vector<int> never_appear;
-    for(int i = 0; i<(int)this->size.size(); i++) {
-        if(appear[i]) {
-            axis_size.push_back(this->size[i]);
-            did_appear.push_back(i);
-        }
-        else {
-            new_size.push_back(this->size[i]);
-            never_appear.push_back(i);
-        }
-    }
     // 创建新tensor
     Tensor<T> result{new_size};
-    // 遍历新数组，对于每一个元素，计算axis中指定轴上的平均值
-    int len = result.len();
-    int new_dim = result.size.size();
-    int old_dim = this->size.size();
-    int new_index[new_dim];
-    int old_index[old_dim];
-    memset(new_index, 0, sizeof(int)*new_dim);
-    memset(old_index, 0, sizeof(int)*old_dim);
-    int axis_dim = (int)axis.size();                    // 指定的轴的个数
-    int axis_index[axis_dim];                           // 遍历axis指定轴时，指定轴之间的下标
-    int axis_len = this->len() / result.len();          // axis指定轴的元素个数
-    for(int i = 0; i<len; i++) {
-        // 将新数组下标映射到旧数组下标
-        for(int j = 0; j<new_dim; j++) {
-            old_index[never_appear[j]] = new_index[j];
-        }
-        // 对于axis指定的轴，将其提取出来，建立一个下标axis_index
-        memset(axis_index, 0, sizeof(int)*axis_dim);
-        // 遍历axis_index并求平均值
-        T sum = 0;
-        for(int j = 0; j<axis_len; j++) {
-            // 将axis_index映射到old_index
-            for(int k = 0; k<axis_dim; k++) {
-                old_index[did_appear[k]] = axis_index[k];
-            }
-            // 根据old_index求该值在this中的偏移
-            int offset = 0;
-            int weight = 1;
-            for(int p = old_dim-1; p >= 0; p--) {
-                offset += weight * old_index[p];
-                weight *= this->size[p];
-            }
-            // 对数值进行累加
-            sum += (this->data[offset] - mean.data[i]) * (this->data[offset] - mean.data[i]);
-            // axis_index加一
-            array_add_1(axis_index, axis_size);
-        }
-        sum /= axis_len;
-        // 将平均值存入结果数组
-        result.data[i] = sum;
-        // 新数组下标加一
-        array_add_1(new_index, new_size);
-    }
+    tensor_reduce_moment((T*)nullptr, result.data, src.data, outer, reduce, inner);
     return result;
 }
 
@@ -1712,7 +1835,7 @@ Tensor<T> Tensor<T>::expand_dim(int axis) {
     if(axis < 0) {
         axis = this->size.size() + 1 + axis;
     }
-    std::vector<int> new_shape;
+    Tensor_shape new_shape;
     for(int i = 0; i<axis; i++) {
         new_shape.push_back(this->size[i]);
     }
@@ -1720,7 +1843,75 @@ Tensor<T> Tensor<T>::expand_dim(int axis) {
     for(int i = axis; i<(int)this->size.size(); i++) {
         new_shape.push_back(this->size[i]);
     }
-    return this->reshape(new_shape);
+    if(is_contiguous()) {
+        return this->reshape(new_shape);
+    }
+    // 视图：新增的长度为1的维度步长任意，取0。不复制数据
+    Tensor<T> temp = *this;
+    temp.size = new_shape;
+    temp.stride.insert(temp.stride.begin()+axis, 0);
+    return temp;
+}
+
+template<typename T>
+T tensor_max(const T * a, int64_t n) {
+    /*
+     * n个元素的最大值。元素较多时按TENSOR_REDUCE_CHUNK分块多线程计算，各块结果按顺序合并
+     */
+    if(n < TENSOR_PARALLEL_MIN_LEN) {
+        return kernel_max(a, (int)n);
+    }
+    int64_t n_chunk = (n + TENSOR_REDUCE_CHUNK - 1) / TENSOR_REDUCE_CHUNK;
+    std::vector<T> part(n_chunk);
+    parallel_for(0, n_chunk, tensor_parallel_grain(n_chunk, TENSOR_REDUCE_CHUNK), [&](int64_t from, int64_t to) {
+        for(int64_t c = from; c<to; c++) {
+            part[c] = kernel_max(a + c * TENSOR_REDUCE_CHUNK,
+                                 (int)std::min<int64_t>(TENSOR_REDUCE_CHUNK, n - c * TENSOR_REDUCE_CHUNK));
+        }
+    });
+    return kernel_max(part.data(), (int)n_chunk);
+}
+
+template<typename T>
+T tensor_min(const T * a, int64_t n) {
+    /*
+     * n个元素的最小值，同tensor_max
+     */
+    if(n < TENSOR_PARALLEL_MIN_LEN) {
+        return kernel_min(a, (int)n);
+    }
+    int64_t n_chunk = (n + TENSOR_REDUCE_CHUNK - 1) / TENSOR_REDUCE_CHUNK;
+    std::vector<T> part(n_chunk);
+    parallel_for(0, n_chunk, tensor_parallel_grain(n_chunk, TENSOR_REDUCE_CHUNK), [&](int64_t from, int64_t to) {
+        for(int64_t c = from; c<to; c++) {
+            part[c] = kernel_min(a + c * TENSOR_REDUCE_CHUNK,
+                                 (int)std::min<int64_t>(TENSOR_REDUCE_CHUNK, n - c * TENSOR_REDUCE_CHUNK));
+        }
+    });
+    return kernel_min(part.data(), (int)n_chunk);
+}
+
+template<typename T>
+void tensor_minmax(const T * a, int64_t n, T * min, T * max) {
+    /*
+     * n个元素的最小值和最大值，只读一遍数据，同tensor_max
+     */
+    if(n < TENSOR_PARALLEL_MIN_LEN) {
+        kernel_minmax(a, (int)n, min, max);
+        return;
+    }
+    int64_t n_chunk = (n + TENSOR_REDUCE_CHUNK - 1) / TENSOR_REDUCE_CHUNK;
+    std::vector<T> part_min(n_chunk);
+    std::vector<T> part_max(n_chunk);
+    parallel_for(0, n_chunk, tensor_parallel_grain(n_chunk, TENSOR_REDUCE_CHUNK), [&](int64_t from, int64_t to) {
+        for(int64_t c = from; c<to; c++) {
+            kernel_minmax(a + c * TENSOR_REDUCE_CHUNK,
+                          (int)std::min<int64_t>(TENSOR_REDUCE_CHUNK, n - c * TENSOR_REDUCE_CHUNK),
+                          &part_min[c], &part_max[c]);
+        }
+    });
+    *min = kernel_min(part_min.data(), (int)n_chunk);
+    *max = kernel_max(part_max.data(), (int)n_chunk);
 }
 
 template<typename T>
@@ -1728,14 +1919,10 @@ T Tensor<T>::max() {
     /*
      * max
      */
-    int len = this->len();
-    T tmax = this->data[0];
-    for(int i = 0; i<len; i++) {
-        if(this->data[i] > tmax) {
-            tmax = this->data[i];
-        }
+    if(!is_contiguous()) {      // 非连续的视图先转为连续存储
+        return contiguous().max();
     }
-    return tmax;
+    return tensor_max(this->data, this->len());
 }
 
 template<typename T>
@@ -1743,14 +1930,22 @@ T Tensor<T>::min() {
     /*
      * min
      */
-    int len = this->len();
-    T tmin = this->data[0];
-    for(int i = 0; i<len; i++) {
-        if(this->data[i] < tmin) {
-            tmin = this->data[i];
-        }
+    if(!is_contiguous()) {      // 非连续的视图先转为连续存储
+        return contiguous().min();
+    }
+    return tensor_min(this->data, this->len());
+}
+
+template<typename T>
+void Tensor<T>::minmax(T &min, T &max) {
+    /*
+     * 一次遍历同时求min和max(如校准时统计每层输出的范围)
+     */
+    if(!is_contiguous()) {      // 非连续的视图先转为连续存储
+        contiguous().minmax(min, max);
+        return;
     }
-    return tmin;
+    tensor_minmax(this->data, this->len(), &min, &max);
 }
 
 template<typename T>
@@ -1758,14 +1953,70 @@ void Tensor<T>::clip(T min, T max) {
     /*
      * clip
      */
-    int len = this->len();
-    for(int i = 0; i < len; i++) {
-        if(this->data[i] < min) {
-            this->data[i] = min;
+    if(!is_contiguous()) {      // 非连续的视图：在连续副本上计算，再写回视图
+        Tensor<T> temp = contiguous();
+        temp.clip(min, max);
+        tensor_strided_copy(data, stride, temp.data, Tensor_stride(), size);
+        return;
+    }
+    kernel_clip(this->data, this->data, this->len(), min, max);
+}
+
+template<typename T>
+void tensor_radix_sort(T * data, int64_t n) {
+    /*
+     * 整数升序基数排序(LSD)，每趟8位，共sizeof(T)趟
+     * 有符号数把符号位取反后按无符号数比较，顺序不变。所有元素某8位都相同时跳过这一趟
+     */
+    typedef typename std::make_unsigned<T>::type U;
+    const U sign = std::is_signed<T>::value ? (U)((U)1 << (sizeof(T) * 8 - 1)) : (U)0;
+    std::vector<T> buffer(n);
+    T * src = data;
+    T * dst = buffer.data();
+    for(int pass = 0; pass<(int)sizeof(T); pass++) {
+        int shift = pass * 8;
+        int64_t count[257] = {0};
+        for(int64_t i = 0; i<n; i++) {
+            count[(((U)src[i] ^ sign) >> shift & 0xff) + 1]++;
+        }
+        if(count[(((U)src[0] ^ sign) >> shift & 0xff) + 1] == n) {
+            continue;
+        }
+        for(int b = 0; b<256; b++) {
+            count[b+1] += count[b];
         }
-        else if(this->data[i] > max) {
-            this->data[i] = max;
+        for(int64_t i = 0; i<n; i++) {
+            dst[count[((U)src[i] ^ sign) >> shift & 0xff]++] = src[i];
         }
+        std::swap(src, dst);
+    }
+    if(src != data) {
+        memcpy(data, src, sizeof(T) * n);
+    }
+}
+
+template<typename T>
+void tensor_sort(T * data, int64_t n, std::true_type) {
+    tensor_radix_sort(data, n);
+}
+
+template<typename T>
+void tensor_sort(T * data, int64_t n, std::false_type) {
+    std::sort(data, data + n);
+}
+
+template<typename T>
+void tensor_sort(T * data, int64_t n, int direction) {
+    /*
+     * 排序。direction=0为升序，1为降序
+     * 整数类型基数排序，O(n)；其他类型std::sort，O(n log n)。降序时把升序结果反转(相等的值不可区分，反转不影响结果)
+     */
+    if(n <= 1) {
+        return;
+    }
+    tensor_sort(data, n, std::integral_constant<bool, std::is_integral<T>::value>());
+    if(direction != 0) {
+        std::reverse(data, data + n);
     }
 }
 
@@ -1773,41 +2024,44 @@ template<typename T>
 void Tensor<T>::sort(int direction) {
     /*
      * sort. direction=0为升序，1为降序
-     * 选择排序
      */
-    int len = this->len();
-    T temp;
-    T extre;
-    int index;
-    if(direction == 0) {
-        for(int i = 0; i<len; i++) {
-            extre = this->data[i];
-            index = i;
-            for(int j = i+1; j<len; j++) {
-                if(this->data[j] < extre) {
-                    extre = this->data[j];
-                    index = j;
-                }
-            }
-            temp = this->data[index];
-            this->data[index] = this->data[i];
-            this->data[i] = temp;
-        }
+    if(!is_contiguous()) {      // 非连续的视图：在连续副本上计算，再写回视图
+        Tensor<T> temp = contiguous();
+        temp.sort(direction);
+        tensor_strided_copy(data, stride, temp.data, Tensor_stride(), size);
+        return;
     }
-    else {
-        for(int i = 0; i<len; i++) {
-            extre = this->data[i];
-            index = i;
-            for(int j = i+1; j<len; j++) {
-                if(this->data[j] > extre) {
-                    extre = this->data[j];
-                    index = j;
-                }
-            }
-            temp = this->data[index];
-            this->data[index] = this->data[i];
-            this->data[i] = temp;
-        }
+    tensor_sort(this->data, this->len(), direction);
+}
+
+template<typename T>
+void tensor_topk(int * index, int64_t index_stride, const T * src, int64_t src_stride, int n, int k) {
+    /*
+     * 在src[0], src[src_stride], ...共n个元素中选出最大的k个，下标按值从大到小写入index[0], index[index_stride], ...
+     * 值相同时下标小的在前
+     * 维护一个大小为k的堆，堆顶是已选出的k个中最差的一个。新元素比堆顶好时替换堆顶。O(n log k)
+     */
+    std::vector<std::pair<T, int>> heap;
+    heap.reserve(k);
+    // better(a, b): a应排在b之前。以它为比较函数时，std堆的堆顶是最差的元素，sort_heap的结果从好到差
+    auto better = [](const std::pair<T, int> &a, const std::pair<T, int> &b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    };
+    for(int i = 0; i<n; i++) {
+        std::pair<T, int> item(src[i * src_stride], i);
+        if((int)heap.size() < k) {
+            heap.push_back(item);
+            std::push_heap(heap.begin(), heap.end(), better);
+        }
+        else if(better(item, heap.front())) {
+            std::pop_heap(heap.begin(), heap.end(), better);
+            heap.back() = item;
+            std::push_heap(heap.begin(), heap.end(), better);
+        }
+    }
+    std::sort_heap(heap.begin(), heap.end(), better);
+    for(int i = 0; i<k; i++) {
+        index[i * index_stride] = heap[i].second;
     }
 }
 
@@ -1815,47 +2069,68 @@ template<typename T>
 Tensor<int> Tensor<T>::topK(int k)
 {
     /*
-     * topK。选出最大的5个值的下标
-     */
-    Tensor<T> temp_tensor = this->deep_copy();
-    int len = temp_tensor.len();
-    Tensor<int> temp_tensor_index{std::vector<int>{len}};
-    for(int i = 0; i<len; i++) {
-        temp_tensor_index.data[i] = i;
-    }
-    
-    T extre;
-    int index;
-    T temp;
-    int index_temp;
-    for(int i = 0; i<len; i++) {
-        extre = temp_tensor.data[i];
-        index = i;
-        for(int j = i+1; j<len; j++) {
-            if(temp_tensor.data[j] > extre) {
-                extre = temp_tensor.data[j];
-                index = j;
-            }
-        }
-        temp = temp_tensor.data[index];
-        temp_tensor.data[index] = temp_tensor.data[i];
-        temp_tensor.data[i] = temp;
-        index_temp = temp_tensor_index.data[index];
-        temp_tensor_index.data[index] = temp_tensor_index.data[i];
-        temp_tensor_index.data[i] = index_temp;
-    }
-    Tensor<int> ret{std::vector<int>{k}};
-    for(int i = 0; i<k; i++) {
-        ret.data[i] = temp_tensor_index.data[i];
+     * topK。选出所有数据中最大的k个值的下标(相对于data的偏移)
+     */
+    if(!is_contiguous()) {      // 非连续的视图先转为连续存储
+        return contiguous().topK(k);
     }
-    return ret;
+    if(this->len() > INT32_MAX) {   // 结果的下标是int
+        fprintf(stderr, "File: tensor_impl.h, line: %d. topK(k) supports at most %d elements, "
+                        "use topK(k, axis) instead\n", __LINE__, INT32_MAX);
+        exit(-1);
+    }
+    return this->reshape(Tensor_shape{(int)this->len()}).topK(k, 0);
+}
+
+template<typename T>
+Tensor<int> Tensor<T>::topK(int k, int axis)
+{
+    /*
+     * 沿axis的topK。结果的尺寸与原张量相同，只是axis维为k
+     * 把原张量看作(outer, size[axis], inner)，对每个(outer, inner)位置分别计算
+     */
+    if(!is_contiguous()) {      // 非连续的视图先转为连续存储
+        return contiguous().topK(k, axis);
+    }
+    if(axis >= (int)size.size() || axis < 0) {
+        fprintf(stderr, "File: tensor_impl.h, line: %d. axis %d is out of bounds "
+                        "for array of dimension %d\n", __LINE__, axis, (int)size.size());
+        exit(-1);
+    }
+    if(k <= 0 || k > size[axis]) {
+        fprintf(stderr, "File: tensor_impl.h, line: %d. k=%d is out of range [1, %d]\n", __LINE__, k, size[axis]);
+        exit(-1);
+    }
+    int64_t outer = 1;
+    int64_t inner = 1;
+    for(int i = 0; i<axis; i++) {
+        outer *= size[i];
+    }
+    for(int i = axis+1; i<(int)size.size(); i++) {
+        inner *= size[i];
+    }
+    int n = size[axis];
+    Tensor_shape new_size = size;
+    new_size[axis] = k;
+    Tensor<int> result{new_size};
+    parallel_for(0, outer * inner, tensor_parallel_grain(outer * inner, n), [&](int64_t from, int64_t to) {
+        for(int64_t p = from; p<to; p++) {
+            int64_t o = p / inner;
+            int64_t j = p % inner;
+            tensor_topk(result.data + o * k * inner + j, inner, data + o * n * inner + j, inner, n, k);
+        }
+    });
+    return result;
 }
 
 template<typename T>
 int Tensor<T>::has(T value)
 {
-    int len = this->len();
-    for(int i = 0; i<len; i++) {
+    if(!is_contiguous()) {      // 非连续的视图先转为连续存储
+        return contiguous().has(value);
+    }
+    int64_t len = this->len();
+    for(int64_t i = 0; i<len; i++) {
         if(this->data[i] == value) {
             return 1;
         }
@@ -0,0 +1,104 @@
+#include "tensor.h"
+
+
+/*
+ * 标量实现：直接使用tensor_kernel.h中的模板循环(显式指定模板参数，避免重载到float32的分发函数)
+ */
+static void scalar_add(float32 * out, const float32 * a, const float32 * b, int64_t n) { kernel_add<float32>(out, a, b, n); }
+static void scalar_sub(float32 * out, const float32 * a, const float32 * b, int64_t n) { kernel_sub<float32>(out, a, b, n); }
+static void scalar_mult(float32 * out, const float32 * a, const float32 * b, int64_t n) { kernel_mult<float32>(out, a, b, n); }
+static void scalar_div(float32 * out, const float32 * a, const float32 * b, int64_t n) { kernel_div<float32>(out, a, b, n); }
+static void scalar_add_scalar(float32 * out, const float32 * a, float32 b, int64_t n) { kernel_add<float32>(out, a, b, n); }
+static void scalar_sub_scalar(float32 * out, const float32 * a, float32 b, int64_t n) { kernel_sub<float32>(out, a, b, n); }
+static void scalar_mult_scalar(float32 * out, const float32 * a, float32 b, int64_t n) { kernel_mult<float32>(out, a, b, n); }
+static void scalar_div_scalar(float32 * out, const float32 * a, float32 b, int64_t n) { kernel_div<float32>(out, a, b, n); }
+static void scalar_scalar_sub(float32 * out, float32 a, const float32 * b, int64_t n) { kernel_sub<float32>(out, a, b, n); }
+static void scalar_scalar_div(float32 * out, float32 a, const float32 * b, int64_t n) { kernel_div<float32>(out, a, b, n); }
+static void scalar_sqrt(float32 * out, const float32 * a, int64_t n) { kernel_sqrt<float32>(out, a, n); }
+static void scalar_clip(float32 * out, const float32 * a, int64_t n, float32 min, float32 max) { kernel_clip<float32>(out, a, n, min, max); }
+static void scalar_clip_u8(uint8 * out, const uint8 * a, int64_t n, uint8 min, uint8 max) { kernel_clip<uint8>(out, a, n, min, max); }
+static float32 scalar_max(const float32 * a, int64_t n) { return kernel_max<float32>(a, n); }
+static float32 scalar_min(const float32 * a, int64_t n) { return kernel_min<float32>(a, n); }
+static void scalar_minmax(const float32 * a, int64_t n, float32 * min, float32 * max) { kernel_minmax<float32>(a, n, min, max); }
+static void scalar_f32_to_i32(int32 * out, const float32 * a, int64_t n) { kernel_cast<int32, float32>(out, a, n); }
+static void scalar_f32_to_u8(uint8 * out, const float32 * a, int64_t n) { kernel_cast<uint8, float32>(out, a, n); }
+static void scalar_i32_to_f32(float32 * out, const int32 * a, int64_t n) { kernel_cast<float32, int32>(out, a, n); }
+static void scalar_u8_to_f32(float32 * out, const uint8 * a, int64_t n) { kernel_cast<float32, uint8>(out, a, n); }
+static void scalar_f32_to_f16(fp16 * out, const float32 * a, int64_t n) { kernel_cast<fp16, float32>(out, a, n); }
+static void scalar_f16_to_f32(float32 * out, const fp16 * a, int64_t n) { kernel_cast<float32, fp16>(out, a, n); }
+static void scalar_f32_to_bf16(bf16 * out, const float32 * a, int64_t n) { kernel_cast<bf16, float32>(out, a, n); }
+static void scalar_bf16_to_f32(float32 * out, const bf16 * a, int64_t n) { kernel_cast<float32, bf16>(out, a, n); }
+
+static void scalar_relu(float32 * out, const float32 * a, int64_t n)
+{
+    for(int64_t i = 0; i<n; i++) {
+        out[i] = (a[i] > 0) ? a[i] : 0;
+    }
+}
+
+
+const Tensor_kernels * tensor_kernels_scalar()
+{
+    static const Tensor_kernels kernels = {
+            "scalar",
+            scalar_add, scalar_sub, scalar_mult, scalar_div,
+            scalar_add_scalar, scalar_sub_scalar, scalar_mult_scalar, scalar_div_scalar,
+            scalar_scalar_sub, scalar_scalar_div,
+            scalar_sqrt, scalar_clip, scalar_relu, scalar_clip_u8,
+            scalar_max, scalar_min, scalar_minmax,
+            scalar_f32_to_i32, scalar_f32_to_u8, scalar_i32_to_f32, scalar_u8_to_f32,
+            scalar_f32_to_f16, scalar_f16_to_f32, scalar_f32_to_bf16, scalar_bf16_to_f32
+    };
+    return &kernels;
+}
+
+
+Tensor_isa detect_tensor_isa()
+{
+    /*
+     * 检测CPU支持的最高指令集
+     * __builtin_cpu_supports同时检查了操作系统是否保存对应的寄存器状态(XGETBV)
+     */
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl")) {
+        return TENSOR_ISA_AVX512;
+    }
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) {    // 支持AVX2的CPU都支持F16C
+        return TENSOR_ISA_AVX2;
+    }
+    if(__builtin_cpu_supports("sse4.1")) {
+        return TENSOR_ISA_SSE4;
+    }
+    return TENSOR_ISA_SCALAR;
+}
+
+const Tensor_kernels * get_tensor_kernels(Tensor_isa isa)
+{
+    /*
+     * 指定指令集的内核，CPU不支持时返回nullptr
+     */
+    if(isa > detect_tensor_isa()) {
+        return nullptr;
+    }
+    switch(isa) {
+        case TENSOR_ISA_AVX512:
+            return tensor_kernels_avx512();
+        case TENSOR_ISA_AVX2:
+            return tensor_kernels_avx2();
+        case TENSOR_ISA_SSE4:
+            return tensor_kernels_sse4();
+        case TENSOR_ISA_SCALAR:
+            return tensor_kernels_scalar();
+        default:
+            return nullptr;
+    }
+}
+
+const Tensor_kernels * get_tensor_kernels()
+{
+    /*
+     * 当前使用的内核。第一次调用时检测指令集，之后直接返回(局部静态变量的初始化是线程安全的)
+     */
+    static const Tensor_kernels * kernels = get_tensor_kernels(detect_tensor_isa());
+    return kernels;
+}
@@ -0,0 +1,226 @@
+#ifndef QUANT_TENSOR_KERNEL_H
+#define QUANT_TENSOR_KERNEL_H
+
+/*
+ * 逐元素计算的向量化内核
+ * 设计思路：
+ * 编译时不使用-march(生成的程序要能在不同的机器上运行)，编译器自动向量化最多只能用到SSE2。
+ * 因此把常用的float32逐元素计算写成内核，每种指令集一份实现，放在各自的源文件中，用#pragma GCC target单独开启指令集：
+ *      tensor_kernel.cpp          标量实现(所有CPU)，以及指令集检测
+ *      tensor_kernel_sse4.cpp     SSE4.1，每次4个float
+ *      tensor_kernel_avx2.cpp     AVX2(和F16C)，每次8个float
+ *      tensor_kernel_avx512.cpp   AVX-512F/BW/VL，每次16个float
+ * 第一次调用get_tensor_kernels()时检测CPU支持的指令集(只检测一次)，之后都使用最快的一组实现。
+ *
+ * 约定：
+ * 1. 所有内核处理n个连续元素(n为int64_t，整个大张量可以一次传入)，对地址没有对齐要求。out可以与输入是同一块内存(逐元素原地计算)
+ * 2. 计算结果与标量代码逐位相同：加减乘除和sqrt都是IEEE精确舍入；clip、relu用与标量代码相同的比较得到掩码再选择，NaN和±0的结果相同；
+ *    max、min各通道分别按标量代码的方式比较，再按同样的方式合并，结果相同(只有+0和-0并列最大/最小时符号可能不同)；
+ *    float转整数截断取整(超出范围时与标量代码一样是未定义的)；float与fp16/bf16之间的转换与tensor_half.h中的标量函数逐位相同
+ * 3. max、min、minmax要求n>=1
+ *
+ * 张量表达式(tensor_expr.h)、Tensor::max/min/clip以及relu/qrelu通过下面的kernel_xxx函数调用内核：
+ * float32(或float32与整数之间转换)使用当前指令集的内核，其他类型使用通用的模板循环。
+ */
+
+
+enum Tensor_isa {
+    TENSOR_ISA_SCALAR = 0,
+    TENSOR_ISA_SSE4,
+    TENSOR_ISA_AVX2,
+    TENSOR_ISA_AVX512,
+    TENSOR_ISA_NUM
+};
+
+
+struct Tensor_kernels {
+    const char * name;
+    // out = a op b
+    void (*add)(float32 * out, const float32 * a, const float32 * b, int64_t n);
+    void (*sub)(float32 * out, const float32 * a, const float32 * b, int64_t n);
+    void (*mult)(float32 * out, const float32 * a, const float32 * b, int64_t n);
+    void (*div)(float32 * out, const float32 * a, const float32 * b, int64_t n);
+    // out = a op b，b是数值
+    void (*add_scalar)(float32 * out, const float32 * a, float32 b, int64_t n);
+    void (*sub_scalar)(float32 * out, const float32 * a, float32 b, int64_t n);
+    void (*mult_scalar)(float32 * out, const float32 * a, float32 b, int64_t n);
+    void (*div_scalar)(float32 * out, const float32 * a, float32 b, int64_t n);
+    // out = a op b，a是数值
+    void (*scalar_sub)(float32 * out, float32 a, const float32 * b, int64_t n);
+    void (*scalar_div)(float32 * out, float32 a, const float32 * b, int64_t n);
+    // 一元运算
+    void (*sqrt)(float32 * out, const float32 * a, int64_t n);
+    void (*clip)(float32 * out, const float32 * a, int64_t n, float32 min, float32 max);
+    void (*relu)(float32 * out, const float32 * a, int64_t n);
+    void (*clip_u8)(uint8 * out, const uint8 * a, int64_t n, uint8 min, uint8 max);
+    // 归约
+    float32 (*max)(const float32 * a, int64_t n);
+    float32 (*min)(const float32 * a, int64_t n);
+    void (*minmax)(const float32 * a, int64_t n, float32 * min, float32 * max);     // 一次遍历同时求min和max
+    // 类型转换
+    void (*f32_to_i32)(int32 * out, const float32 * a, int64_t n);
+    void (*f32_to_u8)(uint8 * out, const float32 * a, int64_t n);
+    void (*i32_to_f32)(float32 * out, const int32 * a, int64_t n);
+    void (*u8_to_f32)(float32 * out, const uint8 * a, int64_t n);
+    // 半精度转换(舍入方式见tensor_half.h)
+    void (*f32_to_f16)(fp16 * out, const float32 * a, int64_t n);
+    void (*f16_to_f32)(float32 * out, const fp16 * a, int64_t n);
+    void (*f32_to_bf16)(bf16 * out, const float32 * a, int64_t n);
+    void (*bf16_to_f32)(float32 * out, const bf16 * a, int64_t n);
+};
+
+
+Tensor_isa detect_tensor_isa();                             // CPU支持的最高指令集
+const Tensor_kernels * get_tensor_kernels();                // 当前使用的内核(第一次调用时检测指令集)
+const Tensor_kernels * get_tensor_kernels(Tensor_isa isa);  // 指定指令集的内核，CPU不支持时返回nullptr
+
+// 各指令集的实现(tensor_kernel_xxx.cpp)
+const Tensor_kernels * tensor_kernels_scalar();
+const Tensor_kernels * tensor_kernels_sse4();
+const Tensor_kernels * tensor_kernels_avx2();
+const Tensor_kernels * tensor_kernels_avx512();
+
+
+/*
+ * 通用实现：模板循环
+ */
+#define TENSOR_KERNEL_BINARY(name, op)                                                  \
+template<typename T>                                                                    \
+inline void kernel_##name(T * out, const T * a, const T * b, int64_t n)                 \
+{                                                                                       \
+    for(int64_t i = 0; i<n; i++) {                                                      \
+        out[i] = op(a[i], b[i]);                                                        \
+    }                                                                                   \
+}                                                                                       \
+template<typename T>                                                                    \
+inline void kernel_##name(T * out, const T * a, T b, int64_t n)                         \
+{                                                                                       \
+    for(int64_t i = 0; i<n; i++) {                                                      \
+        out[i] = op(a[i], b);                                                           \
+    }                                                                                   \
+}                                                                                       \
+template<typename T>                                                                    \
+inline void kernel_##name(T * out, T a, const T * b, int64_t n)                         \
+{                                                                                       \
+    for(int64_t i = 0; i<n; i++) {                                                      \
+        out[i] = op(a, b[i]);                                                           \
+    }                                                                                   \
+}
+
+#define TENSOR_KERNEL_ADD(x, y) (x + y)
+#define TENSOR_KERNEL_SUB(x, y) (x - y)
+#define TENSOR_KERNEL_MULT(x, y) (x * y)
+#define TENSOR_KERNEL_DIV(x, y) (x / y)
+#define TENSOR_KERNEL_FLOOR_DIV(x, y) ((T)(int)(x / y))
+
+TENSOR_KERNEL_BINARY(add, TENSOR_KERNEL_ADD)
+TENSOR_KERNEL_BINARY(sub, TENSOR_KERNEL_SUB)
+TENSOR_KERNEL_BINARY(mult, TENSOR_KERNEL_MULT)
+TENSOR_KERNEL_BINARY(div, TENSOR_KERNEL_DIV)
+TENSOR_KERNEL_BINARY(floor_div, TENSOR_KERNEL_FLOOR_DIV)
+
+#undef TENSOR_KERNEL_BINARY
+#undef TENSOR_KERNEL_ADD
+#undef TENSOR_KERNEL_SUB
+#undef TENSOR_KERNEL_MULT
+#undef TENSOR_KERNEL_DIV
+#undef TENSOR_KERNEL_FLOOR_DIV
+
+template<typename T>
+inline void kernel_sqrt(T * out, const T * a, int64_t n)
+{
+    for(int64_t i = 0; i<n; i++) {
+        out[i] = (T)std::sqrt(a[i]);
+    }
+}
+
+template<typename T>
+inline void kernel_clip(T * out, const T * a, int64_t n, T min, T max)
+{
+    for(int64_t i = 0; i<n; i++) {
+        out[i] = a[i] < min ? min : (a[i] > max ? max : a[i]);
+    }
+}
+
+template<typename T>
+inline T kernel_max(const T * a, int64_t n)
+{
+    T tmax = a[0];
+    for(int64_t i = 0; i<n; i++) {
+        if(a[i] > tmax) {
+            tmax = a[i];
+        }
+    }
+    return tmax;
+}
+
+template<typename T>
+inline T kernel_min(const T * a, int64_t n)
+{
+    T tmin = a[0];
+    for(int64_t i = 0; i<n; i++) {
+        if(a[i] < tmin) {
+            tmin = a[i];
+        }
+    }
+    return tmin;
+}
+
+template<typename T>
+inline void kernel_minmax(const T * a, int64_t n, T * min, T * max)
+{
+    T tmin = a[0];
+    T tmax = a[0];
+    for(int64_t i = 0; i<n; i++) {
+        if(a[i] < tmin) {
+            tmin = a[i];
+        }
+        if(a[i] > tmax) {
+            tmax = a[i];
+        }
+    }
+    *min = tmin;
+    *max = tmax;
+}
+
+template<typename U, typename T>
+inline void kernel_cast(U * out, const T * a, int64_t n)
+{
+    for(int64_t i = 0; i<n; i++) {
+        out[i] = (U)a[i];
+    }
+}
+
+
+/*
+ * float32：使用当前指令集的内核(非模板函数，重载决议时优先于上面的模板)
+ */
+inline void kernel_add(float32 * out, const float32 * a, const float32 * b, int64_t n) { get_tensor_kernels()->add(out, a, b, n); }
+inline void kernel_sub(float32 * out, const float32 * a, const float32 * b, int64_t n) { get_tensor_kernels()->sub(out, a, b, n); }
+inline void kernel_mult(float32 * out, const float32 * a, const float32 * b, int64_t n) { get_tensor_kernels()->mult(out, a, b, n); }
+inline void kernel_div(float32 * out, const float32 * a, const float32 * b, int64_t n) { get_tensor_kernels()->div(out, a, b, n); }
+inline void kernel_add(float32 * out, const float32 * a, float32 b, int64_t n) { get_tensor_kernels()->add_scalar(out, a, b, n); }
+inline void kernel_sub(float32 * out, const float32 * a, float32 b, int64_t n) { get_tensor_kernels()->sub_scalar(out, a, b, n); }
+inline void kernel_mult(float32 * out, const float32 * a, float32 b, int64_t n) { get_tensor_kernels()->mult_scalar(out, a, b, n); }
+inline void kernel_div(float32 * out, const float32 * a, float32 b, int64_t n) { get_tensor_kernels()->div_scalar(out, a, b, n); }
+inline void kernel_add(float32 * out, float32 a, const float32 * b, int64_t n) { get_tensor_kernels()->add_scalar(out, b, a, n); }
+inline void kernel_sub(float32 * out, float32 a, const float32 * b, int64_t n) { get_tensor_kernels()->scalar_sub(out, a, b, n); }
+inline void kernel_mult(float32 * out, float32 a, const float32 * b, int64_t n) { get_tensor_kernels()->mult_scalar(out, b, a, n); }
+inline void kernel_div(float32 * out, float32 a, const float32 * b, int64_t n) { get_tensor_kernels()->scalar_div(out, a, b, n); }
+inline void kernel_sqrt(float32 * out, const float32 * a, int64_t n) { get_tensor_kernels()->sqrt(out, a, n); }
+inline void kernel_clip(float32 * out, const float32 * a, int64_t n, float32 min, float32 max) { get_tensor_kernels()->clip(out, a, n, min, max); }
+inline void kernel_clip(uint8 * out, const uint8 * a, int64_t n, uint8 min, uint8 max) { get_tensor_kernels()->clip_u8(out, a, n, min, max); }
+inline float32 kernel_max(const float32 * a, int64_t n) { return get_tensor_kernels()->max(a, n); }
+inline float32 kernel_min(const float32 * a, int64_t n) { return get_tensor_kernels()->min(a, n); }
+inline void kernel_minmax(const float32 * a, int64_t n, float32 * min, float32 * max) { get_tensor_kernels()->minmax(a, n, min, max); }
+inline void kernel_cast(int32 * out, const float32 * a, int64_t n) { get_tensor_kernels()->f32_to_i32(out, a, n); }
+inline void kernel_cast(uint8 * out, const float32 * a, int64_t n) { get_tensor_kernels()->f32_to_u8(out, a, n); }
+inline void kernel_cast(float32 * out, const int32 * a, int64_t n) { get_tensor_kernels()->i32_to_f32(out, a, n); }
+inline void kernel_cast(float32 * out, const uint8 * a, int64_t n) { get_tensor_kernels()->u8_to_f32(out, a, n); }
+inline void kernel_cast(fp16 * out, const float32 * a, int64_t n) { get_tensor_kernels()->f32_to_f16(out, a, n); }
+inline void kernel_cast(float32 * out, const fp16 * a, int64_t n) { get_tensor_kernels()->f16_to_f32(out, a, n); }
+inline void kernel_cast(bf16 * out, const float32 * a, int64_t n) { get_tensor_kernels()->f32_to_bf16(out, a, n); }
+inline void kernel_cast(float32 * out, const bf16 * a, int64_t n) { get_tensor_kernels()->bf16_to_f32(out, a, n); }
+
+
+#endif //QUANT_TENSOR_KERNEL_H
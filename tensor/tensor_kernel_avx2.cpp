@@ -0,0 +1,352 @@
+#include <immintrin.h>
+
+#include "tensor.h"
+
+/*
+ * AVX2实现，每次处理8个float。fp16转换使用F16C(vcvtps2ph/vcvtph2ps)
+ * 只在本文件的函数上开启AVX2和F16C(放在所有#include之后，头文件中的内联函数仍按默认指令集编译)
+ */
+#pragma GCC push_options
+#pragma GCC target("avx2,f16c")
+
+
+#define AVX2_BINARY(name, vop, sop)                                                     \
+static void avx2_##name(float32 * out, const float32 * a, const float32 * b, int64_t n) \
+{                                                                                       \
+    int64_t i = 0;                                                                      \
+    for(; i+8<=n; i+=8) {                                                               \
+        _mm256_storeu_ps(out+i, vop(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i)));                \
+    }                                                                                   \
+    for(; i<n; i++) {                                                                   \
+        out[i] = a[i] sop b[i];                                                         \
+    }                                                                                   \
+}                                                                                       \
+static void avx2_##name##_scalar(float32 * out, const float32 * a, float32 b, int64_t n)    \
+{                                                                                       \
+    __m256 vb = _mm256_set1_ps(b);                                                         \
+    int64_t i = 0;                                                                      \
+    for(; i+8<=n; i+=8) {                                                               \
+        _mm256_storeu_ps(out+i, vop(_mm256_loadu_ps(a+i), vb));                               \
+    }                                                                                   \
+    for(; i<n; i++) {                                                                   \
+        out[i] = a[i] sop b;                                                            \
+    }                                                                                   \
+}
+
+#define AVX2_SCALAR_BINARY(name, vop, sop)                                              \
+static void avx2_scalar_##name(float32 * out, float32 a, const float32 * b, int64_t n)  \
+{                                                                                       \
+    __m256 va = _mm256_set1_ps(a);                                                         \
+    int64_t i = 0;                                                                      \
+    for(; i+8<=n; i+=8) {                                                               \
+        _mm256_storeu_ps(out+i, vop(va, _mm256_loadu_ps(b+i)));                               \
+    }                                                                                   \
+    for(; i<n; i++) {                                                                   \
+        out[i] = a sop b[i];                                                            \
+    }                                                                                   \
+}
+
+AVX2_BINARY(add, _mm256_add_ps, +)
+AVX2_BINARY(sub, _mm256_sub_ps, -)
+AVX2_BINARY(mult, _mm256_mul_ps, *)
+AVX2_BINARY(div, _mm256_div_ps, /)
+AVX2_SCALAR_BINARY(sub, _mm256_sub_ps, -)
+AVX2_SCALAR_BINARY(div, _mm256_div_ps, /)
+
+#undef AVX2_BINARY
+#undef AVX2_SCALAR_BINARY
+
+
+static void avx2_sqrt(float32 * out, const float32 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+8<=n; i+=8) {
+        _mm256_storeu_ps(out+i, _mm256_sqrt_ps(_mm256_loadu_ps(a+i)));
+    }
+    for(; i<n; i++) {
+        out[i] = std::sqrt(a[i]);
+    }
+}
+
+static void avx2_clip(float32 * out, const float32 * a, int64_t n, float32 min, float32 max)
+{
+    /*
+     * 与标量代码相同：a<min取min，否则a>max取max，否则取a
+     */
+    __m256 vmin = _mm256_set1_ps(min);
+    __m256 vmax = _mm256_set1_ps(max);
+    int64_t i = 0;
+    for(; i+8<=n; i+=8) {
+        __m256 x = _mm256_loadu_ps(a+i);
+        __m256 r = _mm256_blendv_ps(x, vmax, _mm256_cmp_ps(x, vmax, _CMP_GT_OQ));
+        r = _mm256_blendv_ps(r, vmin, _mm256_cmp_ps(x, vmin, _CMP_LT_OQ));
+        _mm256_storeu_ps(out+i, r);
+    }
+    for(; i<n; i++) {
+        out[i] = a[i] < min ? min : (a[i] > max ? max : a[i]);
+    }
+}
+
+static void avx2_relu(float32 * out, const float32 * a, int64_t n)
+{
+    /*
+     * a>0取a，否则取0(NaN也取0)
+     */
+    __m256 zero = _mm256_setzero_ps();
+    int64_t i = 0;
+    for(; i+8<=n; i+=8) {
+        __m256 x = _mm256_loadu_ps(a+i);
+        _mm256_storeu_ps(out+i, _mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GT_OQ), x));
+    }
+    for(; i<n; i++) {
+        out[i] = (a[i] > 0) ? a[i] : 0;
+    }
+}
+
+static void avx2_clip_u8(uint8 * out, const uint8 * a, int64_t n, uint8 min, uint8 max)
+{
+    if(min > max) {     // max(min(...))与标量代码的比较顺序只在min<=max时一致
+        kernel_clip<uint8>(out, a, n, min, max);
+        return;
+    }
+    __m256i vmin = _mm256_set1_epi8((char)min);
+    __m256i vmax = _mm256_set1_epi8((char)max);
+    int64_t i = 0;
+    for(; i+32<=n; i+=32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a+i));
+        _mm256_storeu_si256((__m256i*)(out+i), _mm256_min_epu8(_mm256_max_epu8(x, vmin), vmax));
+    }
+    for(; i<n; i++) {
+        out[i] = a[i] < min ? min : (a[i] > max ? max : a[i]);
+    }
+}
+
+static float32 avx2_max(const float32 * a, int64_t n)
+{
+    /*
+     * 每个通道按标量代码的方式比较(大于时替换)，最后按同样的方式合并各通道
+     */
+    __m256 acc = _mm256_set1_ps(a[0]);
+    int64_t i = 0;
+    for(; i+8<=n; i+=8) {
+        __m256 x = _mm256_loadu_ps(a+i);
+        acc = _mm256_blendv_ps(acc, x, _mm256_cmp_ps(x, acc, _CMP_GT_OQ));
+    }
+    float32 lane[8];
+    _mm256_storeu_ps(lane, acc);
+    float32 tmax = a[0];
+    for(int k = 0; k<8; k++) {
+        if(lane[k] > tmax) {
+            tmax = lane[k];
+        }
+    }
+    for(; i<n; i++) {
+        if(a[i] > tmax) {
+            tmax = a[i];
+        }
+    }
+    return tmax;
+}
+
+static float32 avx2_min(const float32 * a, int64_t n)
+{
+    __m256 acc = _mm256_set1_ps(a[0]);
+    int64_t i = 0;
+    for(; i+8<=n; i+=8) {
+        __m256 x = _mm256_loadu_ps(a+i);
+        acc = _mm256_blendv_ps(acc, x, _mm256_cmp_ps(x, acc, _CMP_LT_OQ));
+    }
+    float32 lane[8];
+    _mm256_storeu_ps(lane, acc);
+    float32 tmin = a[0];
+    for(int k = 0; k<8; k++) {
+        if(lane[k] < tmin) {
+            tmin = lane[k];
+        }
+    }
+    for(; i<n; i++) {
+        if(a[i] < tmin) {
+            tmin = a[i];
+        }
+    }
+    return tmin;
+}
+
+static void avx2_minmax(const float32 * a, int64_t n, float32 * min, float32 * max)
+{
+    /*
+     * 与avx2_min、avx2_max相同，在同一次遍历中维护两组累加器
+     */
+    __m256 acc_min = _mm256_set1_ps(a[0]);
+    __m256 acc_max = acc_min;
+    int64_t i = 0;
+    for(; i+8<=n; i+=8) {
+        __m256 x = _mm256_loadu_ps(a+i);
+        acc_min = _mm256_blendv_ps(acc_min, x, _mm256_cmp_ps(x, acc_min, _CMP_LT_OQ));
+        acc_max = _mm256_blendv_ps(acc_max, x, _mm256_cmp_ps(x, acc_max, _CMP_GT_OQ));
+    }
+    float32 lane_min[8];
+    float32 lane_max[8];
+    _mm256_storeu_ps(lane_min, acc_min);
+    _mm256_storeu_ps(lane_max, acc_max);
+    float32 tmin = a[0];
+    float32 tmax = a[0];
+    for(int k = 0; k<8; k++) {
+        if(lane_min[k] < tmin) {
+            tmin = lane_min[k];
+        }
+        if(lane_max[k] > tmax) {
+            tmax = lane_max[k];
+        }
+    }
+    for(; i<n; i++) {
+        if(a[i] < tmin) {
+            tmin = a[i];
+        }
+        if(a[i] > tmax) {
+            tmax = a[i];
+        }
+    }
+    *min = tmin;
+    *max = tmax;
+}
+
+static void avx2_f32_to_i32(int32 * out, const float32 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+8<=n; i+=8) {
+        _mm256_storeu_si256((__m256i*)(out+i), _mm256_cvttps_epi32(_mm256_loadu_ps(a+i)));
+    }
+    for(; i<n; i++) {
+        out[i] = (int32)a[i];
+    }
+}
+
+static void avx2_f32_to_u8(uint8 * out, const float32 * a, int64_t n)
+{
+    /*
+     * 与标量代码相同：截断为int32后取低8位。先与0xff再做饱和压缩，饱和不会生效
+     * AVX2的pack在每个128位通道内进行，最后按32位重排恢复顺序
+     */
+    __m256i mask = _mm256_set1_epi32(0xff);
+    __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int64_t i = 0;
+    for(; i+32<=n; i+=32) {
+        __m256i i0 = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_loadu_ps(a+i)), mask);
+        __m256i i1 = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_loadu_ps(a+i+8)), mask);
+        __m256i i2 = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_loadu_ps(a+i+16)), mask);
+        __m256i i3 = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_loadu_ps(a+i+24)), mask);
+        __m256i p = _mm256_packus_epi16(_mm256_packus_epi32(i0, i1), _mm256_packus_epi32(i2, i3));
+        _mm256_storeu_si256((__m256i*)(out+i), _mm256_permutevar8x32_epi32(p, order));
+    }
+    for(; i<n; i++) {
+        out[i] = (uint8)a[i];
+    }
+}
+
+static void avx2_i32_to_f32(float32 * out, const int32 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+8<=n; i+=8) {
+        _mm256_storeu_ps(out+i, _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(a+i))));
+    }
+    for(; i<n; i++) {
+        out[i] = (float32)a[i];
+    }
+}
+
+static void avx2_u8_to_f32(float32 * out, const uint8 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a+i));
+        _mm256_storeu_ps(out+i, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(x)));
+        _mm256_storeu_ps(out+i+8, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(x, 8))));
+    }
+    for(; i<n; i++) {
+        out[i] = (float32)a[i];
+    }
+}
+
+static void avx2_f32_to_f16(fp16 * out, const float32 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+8<=n; i+=8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(a+i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm_storeu_si128((__m128i*)(out+i), h);
+    }
+    for(; i<n; i++) {
+        out[i] = fp16(a[i]);
+    }
+}
+
+static void avx2_f16_to_f32(float32 * out, const fp16 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+8<=n; i+=8) {
+        _mm256_storeu_ps(out+i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(a+i))));
+    }
+    for(; i<n; i++) {
+        out[i] = (float32)a[i];
+    }
+}
+
+static inline __m256i avx2_bf16_round(__m256i x)
+{
+    /*
+     * 8个float32的位模式就近舍入为bfloat16(结果在每个32位的低16位)，NaN置quiet位。与float32_to_bfloat16_bits相同
+     */
+    __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(1));
+    __m256i rounded = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(x, _mm256_set1_epi32(0x7fff)), lsb), 16);
+    __m256i quiet = _mm256_or_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(0x40));
+    __m256i nan = _mm256_cmpgt_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x7fffffff)), _mm256_set1_epi32(0x7f800000));
+    return _mm256_blendv_epi8(rounded, quiet, nan);
+}
+
+static void avx2_f32_to_bf16(bf16 * out, const float32 * a, int64_t n)
+{
+    /*
+     * pack在每个128位通道内进行，最后按64位重排恢复顺序
+     */
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        __m256i r0 = avx2_bf16_round(_mm256_castps_si256(_mm256_loadu_ps(a+i)));
+        __m256i r1 = avx2_bf16_round(_mm256_castps_si256(_mm256_loadu_ps(a+i+8)));
+        __m256i p = _mm256_packus_epi32(r0, r1);    // 都不超过0xffff，饱和不会生效
+        _mm256_storeu_si256((__m256i*)(out+i), _mm256_permute4x64_epi64(p, 0xd8));
+    }
+    for(; i<n; i++) {
+        out[i] = bf16(a[i]);
+    }
+}
+
+static void avx2_bf16_to_f32(float32 * out, const bf16 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+8<=n; i+=8) {
+        __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(a+i)));
+        _mm256_storeu_si256((__m256i*)(out+i), _mm256_slli_epi32(x, 16));
+    }
+    for(; i<n; i++) {
+        out[i] = (float32)a[i];
+    }
+}
+
+
+#pragma GCC pop_options
+
+
+const Tensor_kernels * tensor_kernels_avx2()
+{
+    static const Tensor_kernels kernels = {
+            "avx2",
+            avx2_add, avx2_sub, avx2_mult, avx2_div,
+            avx2_add_scalar, avx2_sub_scalar, avx2_mult_scalar, avx2_div_scalar,
+            avx2_scalar_sub, avx2_scalar_div,
+            avx2_sqrt, avx2_clip, avx2_relu, avx2_clip_u8,
+            avx2_max, avx2_min, avx2_minmax,
+            avx2_f32_to_i32, avx2_f32_to_u8, avx2_i32_to_f32, avx2_u8_to_f32,
+            avx2_f32_to_f16, avx2_f16_to_f32, avx2_f32_to_bf16, avx2_bf16_to_f32
+    };
+    return &kernels;
+}
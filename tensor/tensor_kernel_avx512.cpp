@@ -0,0 +1,381 @@
+#include <immintrin.h>
+
+#include "tensor.h"
+
+/*
+ * AVX-512实现，每次处理16个float
+ * 只在本文件的函数上开启AVX-512F/BW/VL(放在所有#include之后，头文件中的内联函数仍按默认指令集编译)
+ * 不足16个的尾部用掩码读写，被屏蔽的元素不会被访问
+ */
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw,avx512vl")
+
+
+static inline __mmask16 tail_mask(int rest)
+{
+    return (__mmask16)((1u << rest) - 1);
+}
+
+/*
+ * gcc 12中不带掩码的_mm512_sqrt_ps、_mm512_cvt*、_mm512_s*li_epi32
+ * 以_mm512_undefined_*()作为被屏蔽元素的来源，内联后引起-Wmaybe-uninitialized误报。
+ * 本文件改用全1掩码的maskz版本，生成的指令与不带掩码的版本相同
+ */
+#define ALL_LANES ((__mmask16)0xFFFF)
+
+
+#define AVX512_BINARY(name, vop)                                                        \
+static void avx512_##name(float32 * out, const float32 * a, const float32 * b, int64_t n)   \
+{                                                                                       \
+    int64_t i = 0;                                                                      \
+    for(; i+16<=n; i+=16) {                                                             \
+        _mm512_storeu_ps(out+i, vop(_mm512_loadu_ps(a+i), _mm512_loadu_ps(b+i)));       \
+    }                                                                                   \
+    if(i < n) {                                                                         \
+        __mmask16 m = tail_mask(n-i);                                                   \
+        __m512 r = vop(_mm512_maskz_loadu_ps(m, a+i), _mm512_maskz_loadu_ps(m, b+i));   \
+        _mm512_mask_storeu_ps(out+i, m, r);                                             \
+    }                                                                                   \
+}                                                                                       \
+static void avx512_##name##_scalar(float32 * out, const float32 * a, float32 b, int64_t n)  \
+{                                                                                       \
+    __m512 vb = _mm512_set1_ps(b);                                                      \
+    int64_t i = 0;                                                                      \
+    for(; i+16<=n; i+=16) {                                                             \
+        _mm512_storeu_ps(out+i, vop(_mm512_loadu_ps(a+i), vb));                         \
+    }                                                                                   \
+    if(i < n) {                                                                         \
+        __mmask16 m = tail_mask(n-i);                                                   \
+        _mm512_mask_storeu_ps(out+i, m, vop(_mm512_maskz_loadu_ps(m, a+i), vb));        \
+    }                                                                                   \
+}
+
+#define AVX512_SCALAR_BINARY(name, vop)                                                 \
+static void avx512_scalar_##name(float32 * out, float32 a, const float32 * b, int64_t n)    \
+{                                                                                       \
+    __m512 va = _mm512_set1_ps(a);                                                      \
+    int64_t i = 0;                                                                      \
+    for(; i+16<=n; i+=16) {                                                             \
+        _mm512_storeu_ps(out+i, vop(va, _mm512_loadu_ps(b+i)));                         \
+    }                                                                                   \
+    if(i < n) {                                                                         \
+        __mmask16 m = tail_mask(n-i);                                                   \
+        _mm512_mask_storeu_ps(out+i, m, vop(va, _mm512_maskz_loadu_ps(m, b+i)));        \
+    }                                                                                   \
+}
+
+AVX512_BINARY(add, _mm512_add_ps)
+AVX512_BINARY(sub, _mm512_sub_ps)
+AVX512_BINARY(mult, _mm512_mul_ps)
+AVX512_BINARY(div, _mm512_div_ps)
+AVX512_SCALAR_BINARY(sub, _mm512_sub_ps)
+AVX512_SCALAR_BINARY(div, _mm512_div_ps)
+
+#undef AVX512_BINARY
+#undef AVX512_SCALAR_BINARY
+
+
+static void avx512_sqrt(float32 * out, const float32 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        _mm512_storeu_ps(out+i, _mm512_maskz_sqrt_ps(ALL_LANES, _mm512_loadu_ps(a+i)));
+    }
+    if(i < n) {
+        __mmask16 m = tail_mask(n-i);
+        _mm512_mask_storeu_ps(out+i, m, _mm512_maskz_sqrt_ps(ALL_LANES, _mm512_maskz_loadu_ps(m, a+i)));
+    }
+}
+
+static inline __m512 clip_ps(__m512 x, __m512 vmin, __m512 vmax)
+{
+    /*
+     * 与标量代码相同：x<min取min，否则x>max取max，否则取x
+     */
+    __m512 r = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, vmax, _CMP_GT_OQ), x, vmax);
+    return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, vmin, _CMP_LT_OQ), r, vmin);
+}
+
+static void avx512_clip(float32 * out, const float32 * a, int64_t n, float32 min, float32 max)
+{
+    __m512 vmin = _mm512_set1_ps(min);
+    __m512 vmax = _mm512_set1_ps(max);
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        _mm512_storeu_ps(out+i, clip_ps(_mm512_loadu_ps(a+i), vmin, vmax));
+    }
+    if(i < n) {
+        __mmask16 m = tail_mask(n-i);
+        _mm512_mask_storeu_ps(out+i, m, clip_ps(_mm512_maskz_loadu_ps(m, a+i), vmin, vmax));
+    }
+}
+
+static void avx512_relu(float32 * out, const float32 * a, int64_t n)
+{
+    /*
+     * a>0取a，否则取0(NaN也取0)
+     */
+    __m512 zero = _mm512_setzero_ps();
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        __m512 x = _mm512_loadu_ps(a+i);
+        _mm512_storeu_ps(out+i, _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(x, zero, _CMP_GT_OQ), x));
+    }
+    if(i < n) {
+        __mmask16 m = tail_mask(n-i);
+        __m512 x = _mm512_maskz_loadu_ps(m, a+i);
+        _mm512_mask_storeu_ps(out+i, m, _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(x, zero, _CMP_GT_OQ), x));
+    }
+}
+
+static void avx512_clip_u8(uint8 * out, const uint8 * a, int64_t n, uint8 min, uint8 max)
+{
+    if(min > max) {     // max(min(...))与标量代码的比较顺序只在min<=max时一致
+        kernel_clip<uint8>(out, a, n, min, max);
+        return;
+    }
+    __m512i vmin = _mm512_set1_epi8((char)min);
+    __m512i vmax = _mm512_set1_epi8((char)max);
+    int64_t i = 0;
+    for(; i+64<=n; i+=64) {
+        __m512i x = _mm512_loadu_si512((const void*)(a+i));
+        _mm512_storeu_si512((void*)(out+i), _mm512_min_epu8(_mm512_max_epu8(x, vmin), vmax));
+    }
+    if(i < n) {
+        __mmask64 m = ((__mmask64)1 << (n-i)) - 1;
+        __m512i x = _mm512_maskz_loadu_epi8(m, a+i);
+        _mm512_mask_storeu_epi8(out+i, m, _mm512_min_epu8(_mm512_max_epu8(x, vmin), vmax));
+    }
+}
+
+static float32 avx512_max(const float32 * a, int64_t n)
+{
+    /*
+     * 每个通道按标量代码的方式比较(大于时替换)，最后按同样的方式合并各通道
+     */
+    __m512 acc = _mm512_set1_ps(a[0]);
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        __m512 x = _mm512_loadu_ps(a+i);
+        acc = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, acc, _CMP_GT_OQ), acc, x);
+    }
+    if(i < n) {
+        __mmask16 m = tail_mask(n-i);
+        __m512 x = _mm512_maskz_loadu_ps(m, a+i);
+        acc = _mm512_mask_blend_ps(_mm512_mask_cmp_ps_mask(m, x, acc, _CMP_GT_OQ), acc, x);
+    }
+    float32 lane[16];
+    _mm512_storeu_ps(lane, acc);
+    float32 tmax = a[0];
+    for(int k = 0; k<16; k++) {
+        if(lane[k] > tmax) {
+            tmax = lane[k];
+        }
+    }
+    return tmax;
+}
+
+static float32 avx512_min(const float32 * a, int64_t n)
+{
+    __m512 acc = _mm512_set1_ps(a[0]);
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        __m512 x = _mm512_loadu_ps(a+i);
+        acc = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, acc, _CMP_LT_OQ), acc, x);
+    }
+    if(i < n) {
+        __mmask16 m = tail_mask(n-i);
+        __m512 x = _mm512_maskz_loadu_ps(m, a+i);
+        acc = _mm512_mask_blend_ps(_mm512_mask_cmp_ps_mask(m, x, acc, _CMP_LT_OQ), acc, x);
+    }
+    float32 lane[16];
+    _mm512_storeu_ps(lane, acc);
+    float32 tmin = a[0];
+    for(int k = 0; k<16; k++) {
+        if(lane[k] < tmin) {
+            tmin = lane[k];
+        }
+    }
+    return tmin;
+}
+
+static void avx512_minmax(const float32 * a, int64_t n, float32 * min, float32 * max)
+{
+    /*
+     * 与avx512_min、avx512_max相同，在同一次遍历中维护两组累加器
+     */
+    __m512 acc_min = _mm512_set1_ps(a[0]);
+    __m512 acc_max = acc_min;
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        __m512 x = _mm512_loadu_ps(a+i);
+        acc_min = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, acc_min, _CMP_LT_OQ), acc_min, x);
+        acc_max = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, acc_max, _CMP_GT_OQ), acc_max, x);
+    }
+    if(i < n) {
+        __mmask16 m = tail_mask(n-i);
+        __m512 x = _mm512_maskz_loadu_ps(m, a+i);
+        acc_min = _mm512_mask_blend_ps(_mm512_mask_cmp_ps_mask(m, x, acc_min, _CMP_LT_OQ), acc_min, x);
+        acc_max = _mm512_mask_blend_ps(_mm512_mask_cmp_ps_mask(m, x, acc_max, _CMP_GT_OQ), acc_max, x);
+    }
+    float32 lane_min[16];
+    float32 lane_max[16];
+    _mm512_storeu_ps(lane_min, acc_min);
+    _mm512_storeu_ps(lane_max, acc_max);
+    float32 tmin = a[0];
+    float32 tmax = a[0];
+    for(int k = 0; k<16; k++) {
+        if(lane_min[k] < tmin) {
+            tmin = lane_min[k];
+        }
+        if(lane_max[k] > tmax) {
+            tmax = lane_max[k];
+        }
+    }
+    *min = tmin;
+    *max = tmax;
+}
+
+static void avx512_f32_to_i32(int32 * out, const float32 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        _mm512_storeu_si512((void*)(out+i), _mm512_maskz_cvttps_epi32(ALL_LANES, _mm512_loadu_ps(a+i)));
+    }
+    if(i < n) {
+        __mmask16 m = tail_mask(n-i);
+        _mm512_mask_storeu_epi32(out+i, m, _mm512_maskz_cvttps_epi32(ALL_LANES, _mm512_maskz_loadu_ps(m, a+i)));
+    }
+}
+
+static void avx512_f32_to_u8(uint8 * out, const float32 * a, int64_t n)
+{
+    /*
+     * 与标量代码相同：截断为int32后取低8位(vpmovdb是截断而不是饱和)
+     */
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        __m512i x = _mm512_maskz_cvttps_epi32(ALL_LANES, _mm512_loadu_ps(a+i));
+        __m128i r = _mm512_maskz_cvtepi32_epi8(ALL_LANES, x);
+        _mm_storeu_si128((__m128i*)(out+i), r);
+    }
+    if(i < n) {
+        __mmask16 m = tail_mask(n-i);
+        _mm512_mask_cvtepi32_storeu_epi8(out+i, m, _mm512_maskz_cvttps_epi32(ALL_LANES, _mm512_maskz_loadu_ps(m, a+i)));
+    }
+}
+
+static void avx512_i32_to_f32(float32 * out, const int32 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        _mm512_storeu_ps(out+i, _mm512_maskz_cvtepi32_ps(ALL_LANES, _mm512_loadu_si512((const void*)(a+i))));
+    }
+    if(i < n) {
+        __mmask16 m = tail_mask(n-i);
+        _mm512_mask_storeu_ps(out+i, m, _mm512_maskz_cvtepi32_ps(ALL_LANES, _mm512_maskz_loadu_epi32(m, a+i)));
+    }
+}
+
+static void avx512_u8_to_f32(float32 * out, const uint8 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a+i));
+        _mm512_storeu_ps(out+i, _mm512_maskz_cvtepi32_ps(ALL_LANES, _mm512_maskz_cvtepu8_epi32(ALL_LANES, x)));
+    }
+    if(i < n) {
+        __mmask16 m = tail_mask(n-i);
+        __m128i x = _mm_maskz_loadu_epi8(m, a+i);
+        _mm512_mask_storeu_ps(out+i, m, _mm512_maskz_cvtepi32_ps(ALL_LANES, _mm512_maskz_cvtepu8_epi32(ALL_LANES, x)));
+    }
+}
+
+static void avx512_f32_to_f16(fp16 * out, const float32 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        __m256i h = _mm512_maskz_cvtps_ph(ALL_LANES, _mm512_loadu_ps(a+i),
+                                          _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm256_storeu_si256((__m256i*)(out+i), h);
+    }
+    if(i < n) {
+        __mmask16 m = tail_mask(n-i);
+        __m256i h = _mm512_maskz_cvtps_ph(ALL_LANES, _mm512_maskz_loadu_ps(m, a+i),
+                                          _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm256_mask_storeu_epi16(out+i, m, h);
+    }
+}
+
+static void avx512_f16_to_f32(float32 * out, const fp16 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        _mm512_storeu_ps(out+i, _mm512_maskz_cvtph_ps(ALL_LANES, _mm256_loadu_si256((const __m256i*)(a+i))));
+    }
+    if(i < n) {
+        __mmask16 m = tail_mask(n-i);
+        _mm512_mask_storeu_ps(out+i, m, _mm512_maskz_cvtph_ps(ALL_LANES, _mm256_maskz_loadu_epi16(m, a+i)));
+    }
+}
+
+static inline __m256i avx512_bf16_round(__m512i x)
+{
+    /*
+     * 16个float32的位模式就近舍入为bf16，NaN置quiet位。与float32_to_bfloat16_bits相同
+     */
+    __m512i lsb = _mm512_and_si512(_mm512_maskz_srli_epi32(ALL_LANES, x, 16), _mm512_set1_epi32(1));
+    __m512i biased = _mm512_add_epi32(_mm512_add_epi32(x, _mm512_set1_epi32(0x7fff)), lsb);
+    __m512i rounded = _mm512_maskz_srli_epi32(ALL_LANES, biased, 16);
+    __m512i quiet = _mm512_or_si512(_mm512_maskz_srli_epi32(ALL_LANES, x, 16), _mm512_set1_epi32(0x40));
+    __mmask16 nan = _mm512_cmpgt_epi32_mask(_mm512_and_si512(x, _mm512_set1_epi32(0x7fffffff)),
+                                            _mm512_set1_epi32(0x7f800000));
+    return _mm512_maskz_cvtepi32_epi16(ALL_LANES, _mm512_mask_blend_epi32(nan, rounded, quiet));
+}
+
+static void avx512_f32_to_bf16(bf16 * out, const float32 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        _mm256_storeu_si256((__m256i*)(out+i), avx512_bf16_round(_mm512_castps_si512(_mm512_loadu_ps(a+i))));
+    }
+    if(i < n) {
+        __mmask16 m = tail_mask(n-i);
+        _mm256_mask_storeu_epi16(out+i, m, avx512_bf16_round(_mm512_castps_si512(_mm512_maskz_loadu_ps(m, a+i))));
+    }
+}
+
+static void avx512_bf16_to_f32(float32 * out, const bf16 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        __m512i x = _mm512_maskz_cvtepu16_epi32(ALL_LANES, _mm256_loadu_si256((const __m256i*)(a+i)));
+        _mm512_storeu_si512((void*)(out+i), _mm512_maskz_slli_epi32(ALL_LANES, x, 16));
+    }
+    if(i < n) {
+        __mmask16 m = tail_mask(n-i);
+        __m512i x = _mm512_maskz_cvtepu16_epi32(ALL_LANES, _mm256_maskz_loadu_epi16(m, a+i));
+        _mm512_mask_storeu_epi32(out+i, m, _mm512_maskz_slli_epi32(ALL_LANES, x, 16));
+    }
+}
+
+
+#undef ALL_LANES
+
+#pragma GCC pop_options
+
+
+const Tensor_kernels * tensor_kernels_avx512()
+{
+    static const Tensor_kernels kernels = {
+            "avx512",
+            avx512_add, avx512_sub, avx512_mult, avx512_div,
+            avx512_add_scalar, avx512_sub_scalar, avx512_mult_scalar, avx512_div_scalar,
+            avx512_scalar_sub, avx512_scalar_div,
+            avx512_sqrt, avx512_clip, avx512_relu, avx512_clip_u8,
+            avx512_max, avx512_min, avx512_minmax,
+            avx512_f32_to_i32, avx512_f32_to_u8, avx512_i32_to_f32, avx512_u8_to_f32,
+            avx512_f32_to_f16, avx512_f16_to_f32, avx512_f32_to_bf16, avx512_bf16_to_f32
+    };
+    return &kernels;
+}
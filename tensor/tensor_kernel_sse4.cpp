@@ -0,0 +1,315 @@
+#include <immintrin.h>
+
+#include "tensor.h"
+
+/*
+ * SSE4.1实现，每次处理4个float
+ * 只在本文件的函数上开启SSE4.1(放在所有#include之后，头文件中的内联函数仍按默认指令集编译)
+ */
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+
+
+#define SSE4_BINARY(name, vop, sop)                                                     \
+static void sse4_##name(float32 * out, const float32 * a, const float32 * b, int64_t n) \
+{                                                                                       \
+    int64_t i = 0;                                                                      \
+    for(; i+4<=n; i+=4) {                                                               \
+        _mm_storeu_ps(out+i, vop(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));                \
+    }                                                                                   \
+    for(; i<n; i++) {                                                                   \
+        out[i] = a[i] sop b[i];                                                         \
+    }                                                                                   \
+}
+
+#define SSE4_BINARY_SCALAR(name, vop, sop)                                              \
+static void sse4_##name##_scalar(float32 * out, const float32 * a, float32 b, int64_t n)    \
+{                                                                                       \
+    __m128 vb = _mm_set1_ps(b);                                                         \
+    int64_t i = 0;                                                                      \
+    for(; i+4<=n; i+=4) {                                                               \
+        _mm_storeu_ps(out+i, vop(_mm_loadu_ps(a+i), vb));                               \
+    }                                                                                   \
+    for(; i<n; i++) {                                                                   \
+        out[i] = a[i] sop b;                                                            \
+    }                                                                                   \
+}
+
+#define SSE4_SCALAR_BINARY(name, vop, sop)                                              \
+static void sse4_scalar_##name(float32 * out, float32 a, const float32 * b, int64_t n)  \
+{                                                                                       \
+    __m128 va = _mm_set1_ps(a);                                                         \
+    int64_t i = 0;                                                                      \
+    for(; i+4<=n; i+=4) {                                                               \
+        _mm_storeu_ps(out+i, vop(va, _mm_loadu_ps(b+i)));                               \
+    }                                                                                   \
+    for(; i<n; i++) {                                                                   \
+        out[i] = a sop b[i];                                                            \
+    }                                                                                   \
+}
+
+SSE4_BINARY(add, _mm_add_ps, +)
+SSE4_BINARY(sub, _mm_sub_ps, -)
+SSE4_BINARY(mult, _mm_mul_ps, *)
+SSE4_BINARY_SCALAR(add, _mm_add_ps, +)
+SSE4_BINARY_SCALAR(sub, _mm_sub_ps, -)
+SSE4_BINARY_SCALAR(div, _mm_div_ps, /)
+SSE4_SCALAR_BINARY(sub, _mm_sub_ps, -)
+SSE4_SCALAR_BINARY(div, _mm_div_ps, /)
+
+#undef SSE4_BINARY
+#undef SSE4_BINARY_SCALAR
+#undef SSE4_SCALAR_BINARY
+
+/*
+ * 下面几个运算手写的4路循环不比编译器对标量循环的自动向量化快(div受除法吞吐量限制，
+ * u8_to_f32的逐段移位扩展反而更慢)，直接使用tensor_kernel.h中的模板循环。
+ * 它们在本文件的SSE4.1区域内实例化，编译器可以用SSE4.1指令(如clip的blendv)向量化，结果与标量代码逐位相同
+ */
+static void sse4_div(float32 * out, const float32 * a, const float32 * b, int64_t n) { kernel_div<float32>(out, a, b, n); }
+static void sse4_mult_scalar(float32 * out, const float32 * a, float32 b, int64_t n) { kernel_mult<float32>(out, a, b, n); }
+static void sse4_clip(float32 * out, const float32 * a, int64_t n, float32 min, float32 max) { kernel_clip<float32>(out, a, n, min, max); }
+static void sse4_u8_to_f32(float32 * out, const uint8 * a, int64_t n) { kernel_cast<float32, uint8>(out, a, n); }
+
+static void sse4_relu(float32 * out, const float32 * a, int64_t n)
+{
+    for(int64_t i = 0; i<n; i++) {
+        out[i] = (a[i] > 0) ? a[i] : 0;
+    }
+}
+
+
+static void sse4_sqrt(float32 * out, const float32 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+4<=n; i+=4) {
+        _mm_storeu_ps(out+i, _mm_sqrt_ps(_mm_loadu_ps(a+i)));
+    }
+    for(; i<n; i++) {
+        out[i] = std::sqrt(a[i]);
+    }
+}
+
+static void sse4_clip_u8(uint8 * out, const uint8 * a, int64_t n, uint8 min, uint8 max)
+{
+    if(min > max) {     // max(min(...))与标量代码的比较顺序只在min<=max时一致
+        kernel_clip<uint8>(out, a, n, min, max);
+        return;
+    }
+    __m128i vmin = _mm_set1_epi8((char)min);
+    __m128i vmax = _mm_set1_epi8((char)max);
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a+i));
+        _mm_storeu_si128((__m128i*)(out+i), _mm_min_epu8(_mm_max_epu8(x, vmin), vmax));
+    }
+    for(; i<n; i++) {
+        out[i] = a[i] < min ? min : (a[i] > max ? max : a[i]);
+    }
+}
+
+static float32 sse4_max(const float32 * a, int64_t n)
+{
+    /*
+     * 每个通道按标量代码的方式比较(大于时替换)，最后按同样的方式合并各通道
+     */
+    __m128 acc = _mm_set1_ps(a[0]);
+    int64_t i = 0;
+    for(; i+4<=n; i+=4) {
+        __m128 x = _mm_loadu_ps(a+i);
+        acc = _mm_blendv_ps(acc, x, _mm_cmpgt_ps(x, acc));
+    }
+    float32 lane[4];
+    _mm_storeu_ps(lane, acc);
+    float32 tmax = a[0];
+    for(int k = 0; k<4; k++) {
+        if(lane[k] > tmax) {
+            tmax = lane[k];
+        }
+    }
+    for(; i<n; i++) {
+        if(a[i] > tmax) {
+            tmax = a[i];
+        }
+    }
+    return tmax;
+}
+
+static float32 sse4_min(const float32 * a, int64_t n)
+{
+    __m128 acc = _mm_set1_ps(a[0]);
+    int64_t i = 0;
+    for(; i+4<=n; i+=4) {
+        __m128 x = _mm_loadu_ps(a+i);
+        acc = _mm_blendv_ps(acc, x, _mm_cmplt_ps(x, acc));
+    }
+    float32 lane[4];
+    _mm_storeu_ps(lane, acc);
+    float32 tmin = a[0];
+    for(int k = 0; k<4; k++) {
+        if(lane[k] < tmin) {
+            tmin = lane[k];
+        }
+    }
+    for(; i<n; i++) {
+        if(a[i] < tmin) {
+            tmin = a[i];
+        }
+    }
+    return tmin;
+}
+
+static void sse4_minmax(const float32 * a, int64_t n, float32 * min, float32 * max)
+{
+    /*
+     * 与sse4_min、sse4_max相同，在同一次遍历中维护两组累加器
+     */
+    __m128 acc_min = _mm_set1_ps(a[0]);
+    __m128 acc_max = acc_min;
+    int64_t i = 0;
+    for(; i+4<=n; i+=4) {
+        __m128 x = _mm_loadu_ps(a+i);
+        acc_min = _mm_blendv_ps(acc_min, x, _mm_cmplt_ps(x, acc_min));
+        acc_max = _mm_blendv_ps(acc_max, x, _mm_cmpgt_ps(x, acc_max));
+    }
+    float32 lane_min[4];
+    float32 lane_max[4];
+    _mm_storeu_ps(lane_min, acc_min);
+    _mm_storeu_ps(lane_max, acc_max);
+    float32 tmin = a[0];
+    float32 tmax = a[0];
+    for(int k = 0; k<4; k++) {
+        if(lane_min[k] < tmin) {
+            tmin = lane_min[k];
+        }
+        if(lane_max[k] > tmax) {
+            tmax = lane_max[k];
+        }
+    }
+    for(; i<n; i++) {
+        if(a[i] < tmin) {
+            tmin = a[i];
+        }
+        if(a[i] > tmax) {
+            tmax = a[i];
+        }
+    }
+    *min = tmin;
+    *max = tmax;
+}
+
+static void sse4_f32_to_i32(int32 * out, const float32 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+4<=n; i+=4) {
+        _mm_storeu_si128((__m128i*)(out+i), _mm_cvttps_epi32(_mm_loadu_ps(a+i)));
+    }
+    for(; i<n; i++) {
+        out[i] = (int32)a[i];
+    }
+}
+
+static void sse4_f32_to_u8(uint8 * out, const float32 * a, int64_t n)
+{
+    /*
+     * 与标量代码相同：截断为int32后取低8位。先与0xff再做饱和压缩，饱和不会生效
+     */
+    __m128i mask = _mm_set1_epi32(0xff);
+    int64_t i = 0;
+    for(; i+16<=n; i+=16) {
+        __m128i i0 = _mm_and_si128(_mm_cvttps_epi32(_mm_loadu_ps(a+i)), mask);
+        __m128i i1 = _mm_and_si128(_mm_cvttps_epi32(_mm_loadu_ps(a+i+4)), mask);
+        __m128i i2 = _mm_and_si128(_mm_cvttps_epi32(_mm_loadu_ps(a+i+8)), mask);
+        __m128i i3 = _mm_and_si128(_mm_cvttps_epi32(_mm_loadu_ps(a+i+12)), mask);
+        __m128i p = _mm_packus_epi16(_mm_packus_epi32(i0, i1), _mm_packus_epi32(i2, i3));
+        _mm_storeu_si128((__m128i*)(out+i), p);
+    }
+    for(; i<n; i++) {
+        out[i] = (uint8)a[i];
+    }
+}
+
+static void sse4_i32_to_f32(float32 * out, const int32 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+4<=n; i+=4) {
+        _mm_storeu_ps(out+i, _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(a+i))));
+    }
+    for(; i<n; i++) {
+        out[i] = (float32)a[i];
+    }
+}
+
+static void sse4_f32_to_f16(fp16 * out, const float32 * a, int64_t n)
+{
+    /*
+     * SSE4.1没有fp16转换指令(F16C在AVX2一级使用)，逐个转换
+     */
+    for(int64_t i = 0; i<n; i++) {
+        out[i] = fp16(a[i]);
+    }
+}
+
+static void sse4_f16_to_f32(float32 * out, const fp16 * a, int64_t n)
+{
+    for(int64_t i = 0; i<n; i++) {
+        out[i] = (float32)a[i];
+    }
+}
+
+static inline __m128i sse4_bf16_round(__m128i x)
+{
+    /*
+     * 4个float32的位模式就近舍入为bfloat16(结果在每个32位的低16位)，NaN置quiet位。与float32_to_bfloat16_bits相同
+     */
+    __m128i lsb = _mm_and_si128(_mm_srli_epi32(x, 16), _mm_set1_epi32(1));
+    __m128i rounded = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(x, _mm_set1_epi32(0x7fff)), lsb), 16);
+    __m128i quiet = _mm_or_si128(_mm_srli_epi32(x, 16), _mm_set1_epi32(0x40));
+    __m128i nan = _mm_cmpgt_epi32(_mm_and_si128(x, _mm_set1_epi32(0x7fffffff)), _mm_set1_epi32(0x7f800000));
+    return _mm_blendv_epi8(rounded, quiet, nan);
+}
+
+static void sse4_f32_to_bf16(bf16 * out, const float32 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+8<=n; i+=8) {
+        __m128i r0 = sse4_bf16_round(_mm_castps_si128(_mm_loadu_ps(a+i)));
+        __m128i r1 = sse4_bf16_round(_mm_castps_si128(_mm_loadu_ps(a+i+4)));
+        _mm_storeu_si128((__m128i*)(out+i), _mm_packus_epi32(r0, r1));     // 都不超过0xffff，饱和不会生效
+    }
+    for(; i<n; i++) {
+        out[i] = bf16(a[i]);
+    }
+}
+
+static void sse4_bf16_to_f32(float32 * out, const bf16 * a, int64_t n)
+{
+    int64_t i = 0;
+    for(; i+8<=n; i+=8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a+i));
+        _mm_storeu_si128((__m128i*)(out+i), _mm_unpacklo_epi16(_mm_setzero_si128(), x));
+        _mm_storeu_si128((__m128i*)(out+i+4), _mm_unpackhi_epi16(_mm_setzero_si128(), x));
+    }
+    for(; i<n; i++) {
+        out[i] = (float32)a[i];
+    }
+}
+
+
+#pragma GCC pop_options
+
+
+const Tensor_kernels * tensor_kernels_sse4()
+{
+    static const Tensor_kernels kernels = {
+            "sse4",
+            sse4_add, sse4_sub, sse4_mult, sse4_div,
+            sse4_add_scalar, sse4_sub_scalar, sse4_mult_scalar, sse4_div_scalar,
+            sse4_scalar_sub, sse4_scalar_div,
+            sse4_sqrt, sse4_clip, sse4_relu, sse4_clip_u8,
+            sse4_max, sse4_min, sse4_minmax,
+            sse4_f32_to_i32, sse4_f32_to_u8, sse4_i32_to_f32, sse4_u8_to_f32,
+            sse4_f32_to_f16, sse4_f16_to_f32, sse4_f32_to_bf16, sse4_bf16_to_f32
+    };
+    return &kernels;
+}
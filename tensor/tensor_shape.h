@@ -0,0 +1,170 @@
+#ifndef QUANT_TENSOR_SHAPE_H
+#define QUANT_TENSOR_SHAPE_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <initializer_list>
+#include <type_traits>
+
+/*
+ * Tensor的尺寸和步长
+ * 设计思路：
+ * 张量的维度很少超过4，用std::vector<int>存储尺寸时，每次创建张量、截取([])、reshape都要在堆上申请一次内存。
+ * Tensor_dims把最多TENSOR_MAX_DIM个值直接存放在对象内部，复制就是一次定长的内存复制，不申请堆内存。
+ *      Tensor_shape  = Tensor_dims<int>      各维度的尺寸(每一维的长度不超过int)
+ *      Tensor_stride = Tensor_dims<int64_t>  各维度的步长(外层维度的步长是内层各维度之积，可能超过int)
+ * 两者可以互相隐式转换。
+ *
+ * 接口与std::vector<int>的常用部分相同(size、[]、push_back、insert、迭代器等)，原来使用vector的代码不需要修改。
+ * 与std::vector<int>可以互相隐式转换：接受vector参数的函数可以直接传入Tensor_shape(会构造一个vector)，反之亦然。
+ * 性能敏感的代码应直接使用Tensor_shape。
+ *
+ * 额外提供：
+ * 1. len(): 各维度之积(元素个数)，用int64_t计算
+ * 2. ==/!=: 先比较维度数，再比较各维度，不经过vector
+ * 超过TENSOR_MAX_DIM维时报错退出
+ */
+#define TENSOR_MAX_DIM 8
+
+
+template<typename V>
+class Tensor_dims {
+public:
+    typedef V value_type;
+    typedef V * iterator;
+    typedef const V * const_iterator;
+
+    Tensor_dims(): n_dim(0), dim() {}
+    Tensor_dims(std::initializer_list<V> list): n_dim(0), dim() { assign(list.begin(), list.end()); }
+    Tensor_dims(const std::vector<int> &vec): n_dim(0), dim() { assign(vec.begin(), vec.end()); }     // 允许隐式转换
+    template<typename U>
+    Tensor_dims(const Tensor_dims<U> &other): n_dim(0), dim() { assign(other.begin(), other.end()); }  // 尺寸与步长互相转换
+    Tensor_dims(size_t count, V value): n_dim(0), dim() { resize(count, value); }
+    template<typename It, typename = typename std::enable_if<!std::is_integral<It>::value>::type>
+    Tensor_dims(It first, It last): n_dim(0), dim() { assign(first, last); }
+
+    operator std::vector<int>() const { return std::vector<int>(begin(), end()); }            // 允许隐式转换
+
+    size_t size() const
+    {
+        if(n_dim > TENSOR_MAX_DIM) {    // 不会发生(check_capacity保证)。告知编译器维度数的上界，避免越界的误报警告
+            __builtin_unreachable();
+        }
+        return (size_t)n_dim;
+    }
+    bool empty() const { return n_dim == 0; }
+    void clear() { n_dim = 0; }
+
+    V & operator[](size_t i) { return dim[i]; }
+    const V & operator[](size_t i) const { return dim[i]; }
+    V & front() { return dim[0]; }
+    const V & front() const { return dim[0]; }
+    V & back() { return dim[n_dim-1]; }
+    const V & back() const { return dim[n_dim-1]; }
+
+    iterator begin() { return dim; }
+    iterator end() { return dim + n_dim; }
+    const_iterator begin() const { return dim; }
+    const_iterator end() const { return dim + n_dim; }
+
+    void push_back(V value)
+    {
+        check_capacity(n_dim + 1);
+        dim[n_dim++] = value;
+    }
+
+    void pop_back() { n_dim--; }
+
+    void resize(size_t count, V value = 0)
+    {
+        check_capacity((int)count);
+        for(int i = n_dim; i<(int)count; i++) {
+            dim[i] = value;
+        }
+        n_dim = (int)count;
+    }
+
+    void assign(size_t count, V value)
+    {
+        n_dim = 0;
+        resize(count, value);
+    }
+
+    template<typename It, typename = typename std::enable_if<!std::is_integral<It>::value>::type>
+    void assign(It first, It last)
+    {
+        n_dim = 0;
+        for(; first != last; ++first) {
+            push_back((V)*first);
+        }
+    }
+
+    iterator insert(const_iterator pos, V value)
+    {
+        /*
+         * 在pos前插入value，返回指向插入元素的迭代器
+         */
+        int p = (int)(pos - dim);
+        check_capacity(n_dim + 1);
+        memmove(dim + p + 1, dim + p, sizeof(V) * (n_dim - p));
+        dim[p] = value;
+        n_dim++;
+        return dim + p;
+    }
+
+    iterator erase(const_iterator pos)
+    {
+        /*
+         * 删除pos处的元素，返回指向其后一个元素的迭代器
+         */
+        int p = (int)(pos - dim);
+        memmove(dim + p, dim + p + 1, sizeof(V) * (n_dim - p - 1));
+        n_dim--;
+        return dim + p;
+    }
+
+    int64_t len() const
+    {
+        /*
+         * 各维度之积(元素个数)。0维时为1
+         */
+        int64_t result = 1;
+        for(int i = 0; i<(int)size(); i++) {
+            result *= dim[i];
+        }
+        return result;
+    }
+
+private:
+    int n_dim;                  // 维度数
+    V dim[TENSOR_MAX_DIM];      // 各维度的值，只有前n_dim个有效
+
+    static void check_capacity(int count)
+    {
+        if(count > TENSOR_MAX_DIM) {
+            fprintf(stderr, "File: tensor_shape.h, line: %d. Tensor cannot have more than %d dimensions\n",
+                    __LINE__, TENSOR_MAX_DIM);
+            exit(-1);
+        }
+    }
+
+    // 定义为友元(非模板函数)，与std::vector<int>比较时也可以隐式转换
+    friend bool operator==(const Tensor_dims &a, const Tensor_dims &b)
+    {
+        return a.size() == b.size() && memcmp(a.begin(), b.begin(), sizeof(V) * a.size()) == 0;
+    }
+
+    friend bool operator!=(const Tensor_dims &a, const Tensor_dims &b)
+    {
+        return !(a == b);
+    }
+};
+
+typedef Tensor_dims<int> Tensor_shape;
+typedef Tensor_dims<int64_t> Tensor_stride;
+
+
+#endif //QUANT_TENSOR_SHAPE_H
@@ -0,0 +1,145 @@
+#include "tensor_trace.h"
+
+#include <cstdio>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+
+struct Trace_site {
+    std::string name;
+    unsigned long long allocs;      // 本阶段申请次数
+    unsigned long long bytes;       // 本阶段申请字节数
+    unsigned long long live_bytes;  // 存活字节数
+};
+
+struct Trace_state {
+    std::mutex mutex;
+    std::vector<Trace_site> sites;
+    std::map<std::string, int> site_index;
+    unsigned long long allocs = 0;          // 本阶段申请次数
+    unsigned long long frees = 0;           // 本阶段释放次数
+    unsigned long long bytes = 0;           // 本阶段申请字节数
+    unsigned long long live_bytes = 0;      // 存活字节数
+    unsigned long long peak_bytes = 0;      // 本阶段存活字节数的峰值
+};
+
+static std::atomic<bool> trace_enabled(false);
+static thread_local const char * current_site = nullptr;
+
+static Trace_state * get_trace_state()
+{
+    static Trace_state * state = new Trace_state();     // 不析构，保证退出时仍可释放张量
+    return state;
+}
+
+
+Tensor_trace_site::Tensor_trace_site(const char * tag)
+{
+    prev = current_site;
+    current_site = tag;
+}
+
+Tensor_trace_site::~Tensor_trace_site()
+{
+    current_site = prev;
+}
+
+
+void set_tensor_trace_enabled(bool enabled)
+{
+    trace_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool tensor_trace_enabled()
+{
+    return trace_enabled.load(std::memory_order_relaxed);
+}
+
+int tensor_trace_alloc(size_t bytes)
+{
+    /*
+     * 记录一次申请，返回位置编号。位置第一次出现时加入位置表
+     */
+    if(!tensor_trace_enabled()) {
+        return -1;
+    }
+    Trace_state * state = get_trace_state();
+    std::string name = current_site == nullptr ? "(untagged)" : current_site;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    auto it = state->site_index.find(name);
+    int site;
+    if(it == state->site_index.end()) {
+        site = (int)state->sites.size();
+        state->sites.push_back(Trace_site{name, 0, 0, 0});
+        state->site_index[name] = site;
+    }
+    else {
+        site = it->second;
+    }
+    state->sites[site].allocs++;
+    state->sites[site].bytes += bytes;
+    state->sites[site].live_bytes += bytes;
+    state->allocs++;
+    state->bytes += bytes;
+    state->live_bytes += bytes;
+    state->peak_bytes = std::max(state->peak_bytes, state->live_bytes);
+    return site;
+}
+
+void tensor_trace_free(int site, size_t bytes)
+{
+    /*
+     * 记录一次释放。申请时未开启统计(site为-1)的不记录，因此存活字节数只包含统计过的申请
+     */
+    if(site < 0) {
+        return;
+    }
+    Trace_state * state = get_trace_state();
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->sites[site].live_bytes -= bytes;
+    state->frees++;
+    state->live_bytes -= bytes;
+}
+
+void print_tensor_trace(const char * phase)
+{
+    /*
+     * 打印本阶段的统计：总体数据，以及按申请字节数从大到小排列的分配位置
+     * 然后开始新的阶段
+     */
+    Trace_state * state = get_trace_state();
+    std::lock_guard<std::mutex> lock(state->mutex);
+    const double mb = 1024.0 * 1024.0;
+    printf("Tensor alloc [%s]: allocs: %llu, frees: %llu, allocated: %.2f MB, live: %.2f MB, peak: %.2f MB\n",
+           phase, state->allocs, state->frees, (double)state->bytes / mb,
+           (double)state->live_bytes / mb, (double)state->peak_bytes / mb);
+    std::vector<const Trace_site*> order;
+    for(const Trace_site &s: state->sites) {
+        if(s.allocs > 0 || s.live_bytes > 0) {
+            order.push_back(&s);
+        }
+    }
+    std::sort(order.begin(), order.end(), [](const Trace_site * a, const Trace_site * b) {
+        return a->bytes > b->bytes;
+    });
+    if(order.size() > TENSOR_TRACE_REPORT_SITES) {
+        order.resize(TENSOR_TRACE_REPORT_SITES);
+    }
+    for(const Trace_site * s: order) {
+        printf("    %-24s allocs: %10llu, allocated: %10.2f MB, live: %10.2f MB\n",
+               s->name.c_str(), s->allocs, (double)s->bytes / mb, (double)s->live_bytes / mb);
+    }
+    // 开始新的阶段
+    for(Trace_site &s: state->sites) {
+        s.allocs = 0;
+        s.bytes = 0;
+    }
+    state->allocs = 0;
+    state->frees = 0;
+    state->bytes = 0;
+    state->peak_bytes = state->live_bytes;
+}
@@ -0,0 +1,47 @@
+#ifndef QUANT_TENSOR_TRACE_H
+#define QUANT_TENSOR_TRACE_H
+
+/*
+ * 张量内存分配统计
+ * 设计思路：
+ * 每个张量数据空间都通过tensor_storage_alloc申请、tensor_storage_release释放，在这两处统计即可覆盖所有张量。
+ * 默认关闭，关闭时每次申请/释放只多一次原子读。开启后统计：
+ * 1. 当前存活字节数(live)、峰值字节数(peak)、申请次数、释放次数
+ * 2. 按分配位置(site)分别统计申请次数、申请字节数、存活字节数
+ *      分配位置是一个字符串标签，由Tensor_trace_site在当前线程设置(作用域结束时恢复为外层的标签)，
+ *      例如Node::forward用算子名作为标签，这样可以找出产生大量临时张量的算子。没有标签的申请记为"(untagged)"
+ *      控制块记录申请时的位置编号，释放时从对应位置的存活字节数中减去
+ * print_tensor_trace(phase)打印上一次打印以来(一个阶段)的统计，然后开始新的阶段：
+ * 申请/释放次数和各位置的申请字节数清零，峰值从当前存活字节数重新开始(存活字节数跨阶段保留)
+ * 统计数据用一个互斥锁保护，只用于分析，不追求开启时的性能
+ */
+
+#include <cstddef>
+
+
+#define TENSOR_TRACE_REPORT_SITES 20        // 报告中最多列出的分配位置数
+
+
+class Tensor_trace_site {
+    /*
+     * 在当前作用域内，把当前线程申请的张量记到标签tag下。tag在作用域内必须有效(统计时会复制)
+     */
+public:
+    explicit Tensor_trace_site(const char * tag);
+    ~Tensor_trace_site();
+    Tensor_trace_site(const Tensor_trace_site &) = delete;
+    Tensor_trace_site & operator=(const Tensor_trace_site &) = delete;
+
+private:
+    const char * prev;          // 外层的标签
+};
+
+
+void set_tensor_trace_enabled(bool enabled);            // 开关分配统计
+bool tensor_trace_enabled();
+int tensor_trace_alloc(size_t bytes);                   // 记录一次申请，返回位置编号(未开启时返回-1，不记录)
+void tensor_trace_free(int site, size_t bytes);         // 记录一次释放，site为申请时返回的编号
+void print_tensor_trace(const char * phase);            // 打印本阶段的统计并开始新的阶段
+
+
+#endif //QUANT_TENSOR_TRACE_H
@@ -0,0 +1,315 @@
+#include "thread_pool.h"
+
+#include <cstdio>
+#include <memory>
+#include <algorithm>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+
+struct Thread_pool_slot {
+    /*
+     * 一个线程的待处理范围[begin, end)。修改时持有mutex，窃取时先无锁读取估计剩余量
+     */
+    std::mutex mutex;
+    std::atomic<int64_t> begin;
+    std::atomic<int64_t> end;
+    char pad[64];                           // 避免相邻线程的队列在同一缓存行
+};
+
+struct Thread_pool_job {
+    Thread_pool_task task;
+    void * ctx;
+    int64_t grain;
+    int n_slot;                             // 队列数，等于线程池的线程数
+    int capacity;                           // slots的长度(不小于n_slot)
+    std::unique_ptr<Thread_pool_slot[]> slots;
+    std::atomic<int64_t> unclaimed;         // 未被领取的元素数，减到0时从任务表中移除
+    std::atomic<int64_t> unfinished;        // 未完成的元素数，减到0时通知提交任务的线程
+    std::atomic<int> active;                // 正在处理此任务的工作线程数
+    std::mutex mutex;
+    std::condition_variable done;
+};
+
+static thread_local const Thread_pool * current_pool = nullptr;    // 当前线程正在执行哪个线程池的任务
+// 当前线程提交的任务，复用以避免每次申请内存。在一个线程池的任务中向另一个线程池提交任务时，
+// 外层的任务仍在执行，所以每层嵌套使用单独的一个
+static thread_local std::vector<std::unique_ptr<Thread_pool_job> > local_jobs;
+static thread_local int run_depth = 0;
+
+
+Thread_pool::Thread_pool(int n_threads, const std::vector<int> &cpus):
+    n_threads(std::max(1, n_threads)), cpus(cpus), n_jobs(0), sleeping(0), stop(false)
+{
+    for(int i = 1; i<this->n_threads; i++) {    // 队列0属于调用parallel_for的线程
+        workers.push_back(std::thread(&Thread_pool::worker_loop, this, i));
+    }
+}
+
+Thread_pool::~Thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for(std::thread &t: workers) {
+        t.join();
+    }
+}
+
+void Thread_pool::worker_loop(int slot)
+{
+    /*
+     * 工作线程：取一个任务，处理到没有可领取/窃取的部分为止，然后取下一个任务
+     */
+    current_pool = this;
+    if(!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[slot % cpus.size()], &set);
+        if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            fprintf(stderr, "File: thread_pool.cpp, line: %d. Failed to pin worker thread to cpu %d\n",
+                    __LINE__, cpus[slot % cpus.size()]);
+        }
+    }
+    int next = 0;
+    while(true) {
+        for(int i = 0; i<THREAD_POOL_SPIN && n_jobs.load(std::memory_order_acquire) == 0; i++) {
+            std::this_thread::yield();
+        }
+        Thread_pool_job * job = acquire_job(next);
+        if(job == nullptr) {
+            return;
+        }
+        work(job, slot);
+        job->active.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+Thread_pool_job * Thread_pool::acquire_job(int &next)
+{
+    /*
+     * 从任务表中取一个任务(多个任务时轮流取)，没有任务时睡眠。线程池析构时返回nullptr
+     * 在持有锁时增加active：任务从表中移除后不会再有线程开始处理它
+     */
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        if(stop) {
+            return nullptr;
+        }
+        if(!jobs.empty()) {
+            Thread_pool_job * job = jobs[next++ % jobs.size()];
+            job->active.fetch_add(1, std::memory_order_relaxed);
+            return job;
+        }
+        sleeping++;
+        wake.wait(lock);
+        sleeping--;
+    }
+}
+
+void Thread_pool::work(Thread_pool_job * job, int slot)
+{
+    /*
+     * 处理自己队列中的部分，队列空了就窃取，直到所有队列都空
+     */
+    int64_t begin;
+    int64_t end;
+    while(true) {
+        if(!pop(job, slot, begin, end)) {
+            if(!steal(job, slot)) {
+                return;
+            }
+            continue;
+        }
+        job->task(job->ctx, begin, end);
+        if(job->unfinished.fetch_sub(end - begin, std::memory_order_acq_rel) == end - begin) {
+            std::lock_guard<std::mutex> lock(job->mutex);     // 持有锁再通知，避免提交线程错过通知
+            job->done.notify_all();
+        }
+    }
+}
+
+bool Thread_pool::pop(Thread_pool_job * job, int slot, int64_t &begin, int64_t &end)
+{
+    /*
+     * 从自己队列的前端领取最多grain个
+     */
+    Thread_pool_slot &s = job->slots[slot];
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        begin = s.begin.load(std::memory_order_relaxed);
+        int64_t slot_end = s.end.load(std::memory_order_relaxed);
+        if(begin >= slot_end) {
+            return false;
+        }
+        end = std::min(begin + job->grain, slot_end);
+        s.begin.store(end, std::memory_order_relaxed);
+    }
+    if(job->unclaimed.fetch_sub(end - begin, std::memory_order_acq_rel) == end - begin) {
+        retire(job);
+    }
+    return true;
+}
+
+bool Thread_pool::steal(Thread_pool_job * job, int slot)
+{
+    /*
+     * 从剩余最多的队列的后端窃取一半(不足grain时全部窃取)，放入自己的队列。所有队列都空时返回false
+     */
+    while(true) {
+        int victim = -1;
+        int64_t most = 0;
+        for(int i = 0; i<job->n_slot; i++) {
+            Thread_pool_slot &s = job->slots[i];
+            int64_t left = s.end.load(std::memory_order_relaxed) - s.begin.load(std::memory_order_relaxed);
+            if(i != slot && left > most) {
+                most = left;
+                victim = i;
+            }
+        }
+        if(victim < 0) {
+            return false;
+        }
+        int64_t begin;
+        int64_t end;
+        {
+            Thread_pool_slot &s = job->slots[victim];
+            std::lock_guard<std::mutex> lock(s.mutex);
+            int64_t left = s.end.load(std::memory_order_relaxed) - s.begin.load(std::memory_order_relaxed);
+            if(left <= 0) {                 // 读取之后被领取完了，重新选择
+                continue;
+            }
+            end = s.end.load(std::memory_order_relaxed);
+            begin = left <= job->grain ? end - left : end - left / 2;
+            s.end.store(begin, std::memory_order_relaxed);
+        }
+        Thread_pool_slot &own = job->slots[slot];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.begin.store(begin, std::memory_order_relaxed);
+        own.end.store(end, std::memory_order_relaxed);
+        return true;
+    }
+}
+
+void Thread_pool::retire(Thread_pool_job * job)
+{
+    /*
+     * 任务的所有部分都已被领取，从任务表中移除
+     */
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.erase(std::find(jobs.begin(), jobs.end(), job));
+    n_jobs.store((int)jobs.size(), std::memory_order_release);
+}
+
+void Thread_pool::run(int64_t begin, int64_t end, int64_t grain, Thread_pool_task task, void * ctx)
+{
+    /*
+     * 提交任务并参与计算，所有部分完成后返回
+     */
+    if(n_threads == 1 || current_pool == this) {
+        task(ctx, begin, end);
+        return;
+    }
+    if((int)local_jobs.size() <= run_depth) {
+        local_jobs.emplace_back(new Thread_pool_job());
+        local_jobs.back()->capacity = 0;
+    }
+    Thread_pool_job * job = local_jobs[run_depth].get();
+    if(job->capacity < n_threads) {
+        job->slots.reset(new Thread_pool_slot[n_threads]);
+        job->capacity = n_threads;
+    }
+    job->n_slot = n_threads;
+    job->task = task;
+    job->ctx = ctx;
+    job->grain = grain;
+    // 以grain为单位均分到各队列
+    int64_t len = end - begin;
+    int64_t n_chunk = (len + grain - 1) / grain;
+    int64_t parts = std::min<int64_t>(n_threads, n_chunk);
+    for(int i = 0; i<n_threads; i++) {
+        Thread_pool_slot &s = job->slots[i];
+        if(i < parts) {
+            s.begin.store(begin + n_chunk * i / parts * grain, std::memory_order_relaxed);
+            s.end.store(std::min(end, begin + n_chunk * (i+1) / parts * grain), std::memory_order_relaxed);
+        }
+        else {
+            s.begin.store(end, std::memory_order_relaxed);
+            s.end.store(end, std::memory_order_relaxed);
+        }
+    }
+    job->unclaimed.store(len, std::memory_order_relaxed);
+    job->unfinished.store(len, std::memory_order_relaxed);
+    job->active.store(0, std::memory_order_relaxed);
+    bool notify;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(job);
+        n_jobs.store((int)jobs.size(), std::memory_order_release);
+        notify = sleeping > 0;
+    }
+    if(notify) {
+        wake.notify_all();
+    }
+    const Thread_pool * outer_pool = current_pool;
+    current_pool = this;
+    run_depth++;
+    work(job, 0);
+    current_pool = outer_pool;
+    // 等待其他线程领取的部分完成
+    if(job->unfinished.load(std::memory_order_acquire) != 0) {
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->done.wait(lock, [job] { return job->unfinished.load(std::memory_order_acquire) == 0; });
+    }
+    // 任务已从任务表中移除，等待还在查看它的工作线程离开，之后才能复用
+    while(job->active.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+    run_depth--;
+}
+
+
+static std::mutex pool_mutex;
+static std::atomic<Thread_pool*> pool(nullptr);
+static int pool_size = 0;                   // 0表示使用处理器数
+static std::vector<int> pool_cpus;
+
+void set_thread_pool_size(int n_threads, const std::vector<int> &cpus)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    pool_size = n_threads;
+    pool_cpus = cpus;
+    Thread_pool * old = pool.exchange(nullptr);
+    delete old;
+}
+
+static int allowed_cpu_count()
+{
+    /*
+     * 调用线程的cpu亲和性掩码中的cpu数(例如taskset限制后的)，与get_allowed_cpus(见thread_budget.h)一致。
+     * 读取失败时返回处理器数
+     */
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) {
+        return CPU_COUNT(&set);
+    }
+    return (int)sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+Thread_pool * get_thread_pool()
+{
+    Thread_pool * p = pool.load(std::memory_order_acquire);
+    if(p != nullptr) {
+        return p;
+    }
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if(pool.load(std::memory_order_relaxed) == nullptr) {
+        int n = pool_size > 0 ? pool_size : allowed_cpu_count();
+        pool.store(new Thread_pool(n, pool_cpus), std::memory_order_release);      // 不析构，工作线程一直存在到进程退出
+    }
+    return pool.load(std::memory_order_relaxed);
+}
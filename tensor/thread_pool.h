@@ -0,0 +1,102 @@
+#ifndef QUANT_THREAD_POOL_H
+#define QUANT_THREAD_POOL_H
+
+/*
+ * 进程内共享的工作窃取线程池
+ * 设计思路：
+ * 原来relu、qconv2d(每张图片一次)、Tensor::dot每次调用都创建并join一组std::thread，
+ * mnist这类小模型中线程创建的开销超过了计算本身。现在所有内核都通过parallel_for把任务交给同一个线程池：
+ * 1. 线程池有n_threads-1个常驻工作线程，调用parallel_for的线程也参与计算，共n_threads个线程。
+ *    大小默认为进程允许使用的cpu数(sched_getaffinity)，由set_thread_budget(见thread_budget.h)与OpenBLAS的线程数一起设置。
+ *    可以把每个工作线程绑定到一个cpu(队列0属于调用线程，由调用者自己绑定)
+ * 2. parallel_for(begin, end, grain, f)把[begin, end)分给各线程，每个线程以grain为单位调用f(b, e)处理[b, e)。
+ *    范围先按块均分到每个线程的队列(slot)，线程从自己队列的前端每次取grain个；
+ *    自己的队列取完后，从剩余最多的队列的后端窃取一半放入自己的队列，因此各块耗时不均时也能保持负载均衡
+ * 3. 每次parallel_for是一个任务(job)，登记在线程池的任务表中，多个线程可以同时提交任务。
+ *    工作线程空闲时先自旋等待一段时间(连续的算子之间不必睡眠/唤醒)，之后在条件变量上睡眠
+ * 4. 以下情况不分发，直接在调用线程中执行f(begin, end)：范围不超过grain、线程池只有一个线程、
+ *    在同一线程池的任务内部再次调用(嵌套，避免工作线程等待自己)。
+ *    另一个线程池的任务内部可以正常分发(例如图调度器用单独的线程池同时执行多个节点，节点内的内核仍使用共享线程池)
+ * f只能按下标写互不重叠的输出，各块的划分和执行顺序不确定，需要确定结果的归约应按固定的块计算部分结果再合并
+ * f不能抛出异常(本项目出错时直接exit)
+ */
+
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+
+#define THREAD_POOL_SPIN 4096               // 工作线程睡眠前自旋(yield)等待新任务的次数
+
+
+typedef void (*Thread_pool_task)(void * ctx, int64_t begin, int64_t end);
+
+struct Thread_pool_job;
+
+
+class Thread_pool {
+public:
+    explicit Thread_pool(int n_threads, const std::vector<int> &cpus = std::vector<int>());
+    ~Thread_pool();                         // 通知工作线程退出并join。此时不能有正在执行的任务
+    Thread_pool(const Thread_pool &) = delete;
+    Thread_pool & operator=(const Thread_pool &) = delete;
+
+    int size() const { return n_threads; }  // 线程数(含调用线程)
+    void run(int64_t begin, int64_t end, int64_t grain, Thread_pool_task task, void * ctx);    // 见parallel_for
+
+private:
+    int n_threads;
+    std::vector<int> cpus;                  // 非空时队列i的工作线程绑定到cpus[i % cpus.size()]
+    std::vector<std::thread> workers;
+    std::mutex mutex;                       // 保护jobs、sleeping、stop
+    std::condition_variable wake;           // 有新任务或退出时通知睡眠的工作线程
+    std::vector<Thread_pool_job*> jobs;     // 还有未领取部分的任务
+    std::atomic<int> n_jobs;                // jobs.size()，供自旋时无锁读取
+    int sleeping;                           // 正在睡眠的工作线程数
+    bool stop;
+
+    void worker_loop(int slot);
+    Thread_pool_job * acquire_job(int &next);
+    void work(Thread_pool_job * job, int slot);
+    bool pop(Thread_pool_job * job, int slot, int64_t &begin, int64_t &end);
+    bool steal(Thread_pool_job * job, int slot);
+    void retire(Thread_pool_job * job);
+};
+
+
+// 设置线程数(含调用线程)和工作线程绑定的cpu(为空时不绑定)。已创建的线程池会被重建，不能在任务执行期间调用
+void set_thread_pool_size(int n_threads, const std::vector<int> &cpus = std::vector<int>());
+Thread_pool * get_thread_pool();            // 进程内共享的线程池，第一次使用时创建
+
+
+template<typename F>
+void parallel_for_task(void * ctx, int64_t begin, int64_t end)
+{
+    (*(const F*)ctx)(begin, end);
+}
+
+template<typename F>
+void parallel_for(int64_t begin, int64_t end, int64_t grain, const F &f)
+{
+    /*
+     * 多线程执行f(b, e)，各次调用的[b, e)不重叠且合起来正好是[begin, end)
+     * grain为分发时每次调用的最大长度(至少为1)，不分发时(见上)直接调用f(begin, end)
+     */
+    if(grain < 1) {
+        grain = 1;
+    }
+    if(end <= begin) {
+        return;
+    }
+    if(end - begin <= grain) {
+        f(begin, end);
+        return;
+    }
+    get_thread_pool()->run(begin, end, grain, parallel_for_task<F>, (void*)&f);
+}
+
+
+#endif //QUANT_THREAD_POOL_H
@@ -0,0 +1,48 @@
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "functional.h"
+#include "tensor.h"
+
+
+static void pool_in_thread(Tensor<float32> *small, Tensor<float32> *large)
+{
+    /*
+     * 带padding的maxpool2d使用线程内的workspace保存填充后的输入：先小后大，使workspace重新申请一次
+     * 输入在主线程中申请，线程中第一次从池申请内存时workspace已经构造，所以线程缓存在workspace之后构造、之前析构
+     */
+    functional::maxpool2d(small, std::vector<int>{3, 3}, std::vector<int>{1, 1}, std::vector<int>{1, 1});
+    functional::maxpool2d(large, std::vector<int>{3, 3}, std::vector<int>{1, 1}, std::vector<int>{1, 1});
+}
+
+int main()
+{
+    /*
+     * 线程退出时，workspace中(1, 1, 22, 22)的填充缓冲区应该还给全局池，之后在主线程申请同样大小的张量应命中池。
+     * 如果它被放进已经析构的线程缓存，这块内存就丢失了(并且是未定义行为，AddressSanitizer下报告泄漏)
+     * 输入和输出的尺寸都与填充缓冲区不在同一尺寸等级
+     */
+    if(!tensor_pool_enabled()) {
+        printf("workspace_thread: tensor pool disabled, skipped\n");
+        return 0;
+    }
+    Tensor<float32> small(std::vector<int>{1, 1, 8, 8});
+    Tensor<float32> large(std::vector<int>{1, 1, 20, 20});
+    small.set_zero();
+    large.set_zero();
+    Pool_allocator * pool = get_pool_allocator();
+    pool->trim();
+    std::thread t(pool_in_thread, &small, &large);
+    t.join();
+    pool->reset_stats();
+    Tensor<float32> padded(std::vector<int>{1, 1, 22, 22});
+    Tensor_pool_stats stats = pool->stats();
+    if(stats.hits != 1) {
+        fprintf(stderr, "workspace_thread: workspace block was not returned to the pool (hits %llu, misses %llu)\n",
+                stats.hits, stats.misses);
+        return 1;
+    }
+    printf("workspace_thread: passed\n");
+    return 0;
+}
@@ -20,6 +20,7 @@
 
 #include "tensor.h"
 #include "util.h"
+#include "image_loader.h"
 
 
 Tensor<unsigned char>* get_calib_set(const std::string& calib_set_path, 
@@ -0,0 +1,879 @@
+#include "benchmark.h"
+#include "preprocess.h"
+
+#include <map>
+#include <thread>
+#include <vector>
+
+extern System_info * sys_info;
+
+static void print_result(const std::string &item, unsigned long long n, unsigned long long cost)
+{
+    /*
+     * 打印一项测试结果：总次数、耗时、吞吐量
+     */
+    double per_sec = cost == 0 ? 0 : (double)n / ((double)cost / 1e6);
+    printf("  %-40s %12llu ops %10llu us %14.0f ops/s\n", item.c_str(), n, cost, per_sec);
+}
+
+/*
+ * 旧的引用计数方式：static std::map<T*, int> counter
+ * 这里只保留计数部分，用来作为"before"的对比
+ */
+static std::map<float32*, int> map_counter;
+
+static void map_retain(float32 * mem_addr)
+{
+    if(map_counter.find(mem_addr) != map_counter.end()) {
+        map_counter[mem_addr]++;
+    }
+    else {
+        fprintf(stderr, "File: benchmark.cpp, line: %d. Not found \'data\' in counter\n", __LINE__);
+        exit(-1);
+    }
+}
+
+static void map_release(float32 * mem_addr)
+{
+    if(map_counter.find(mem_addr) != map_counter.end()) {
+        map_counter[mem_addr]--;
+        if(map_counter[mem_addr] == 0) {
+            map_counter.erase(mem_addr);
+        }
+    }
+    else {
+        fprintf(stderr, "File: benchmark.cpp, line: %d. Not found \'data\' in counter\n", __LINE__);
+        exit(-1);
+    }
+}
+
+static void benchmark_tensor_copy()
+{
+    /*
+     * Tensor拷贝/切片吞吐量
+     * before: 旧的全局map计数(map中保留live_tensors个其他地址，模拟推理过程中存活的中间结果)
+     * after:  当前的控制块原子计数
+     */
+    const unsigned long long n = 2000000;
+    const int live_tensors = 256;
+    unsigned long long start_time, end_time;
+    printf("tensor_copy:\n");
+
+    // before
+    std::vector<float32*> live(live_tensors);
+    for(int i = 0; i < live_tensors; i++) {
+        live[i] = (float32*)malloc(sizeof(float32));
+        map_counter.insert(std::pair<float32*, int>(live[i], 1));
+    }
+    float32 * target = live[live_tensors / 2];
+    start_time = get_micro_sec_time();
+    for(unsigned long long i = 0; i < n; i++) {
+        map_retain(target);
+        map_release(target);
+    }
+    end_time = get_micro_sec_time();
+    print_result("before: map retain+release", n, end_time - start_time);
+    for(int i = 0; i < live_tensors; i++) {
+        map_release(live[i]);
+        free(live[i]);
+    }
+
+    // after
+    Tensor<float32> a({64, 3, 32, 32});
+    volatile float32 sink = 0;
+    start_time = get_micro_sec_time();
+    for(unsigned long long i = 0; i < n; i++) {
+        Tensor<float32> b(a);
+        sink = sink + b.size[0];
+    }
+    end_time = get_micro_sec_time();
+    print_result("after: copy construct", n, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(unsigned long long i = 0; i < n; i++) {
+        Tensor<float32> b = a[(int)(i % 64)];
+        sink = sink + b.size[0];
+    }
+    end_time = get_micro_sec_time();
+    print_result("after: operator[] slice", n, end_time - start_time);
+
+    Tensor<float32> c({1});
+    start_time = get_micro_sec_time();
+    for(unsigned long long i = 0; i < n; i++) {
+        c = (i & 1) ? a : Tensor<float32>({1});
+    }
+    end_time = get_micro_sec_time();
+    print_result("after: operator= (incl. 1/2 small alloc)", n, end_time - start_time);
+
+    // 多线程同时拷贝同一个Tensor(旧方式不是线程安全的，无法进行此项测试)
+    int n_threads = sys_info == nullptr ? 1 : sys_info->n_proc;
+    std::vector<std::thread> threads;
+    start_time = get_micro_sec_time();
+    for(int t = 0; t < n_threads; t++) {
+        threads.emplace_back([&a, n]() {
+            volatile int local_sink = 0;
+            for(unsigned long long i = 0; i < n; i++) {
+                Tensor<float32> b = a[(int)(i % 64)];
+                local_sink = local_sink + b.size[0];
+            }
+        });
+    }
+    for(auto &th: threads) {
+        th.join();
+    }
+    end_time = get_micro_sec_time();
+    print_result("after: operator[] slice, " + std::to_string(n_threads) + " threads",
+                 n * n_threads, end_time - start_time);
+    (void)sink;
+}
+
+static void benchmark_tensor_alloc()
+{
+    /*
+     * 张量申请/释放吞吐量：malloc分配器 vs 池分配器
+     * 模拟一次conv的临时张量：im2col矩阵、输出、padding后的输入
+     */
+    const int n = 2000;
+    std::vector<std::vector<int>> shapes = {
+            {1, 64, 58, 58}, {3136, 576}, {1, 64, 56, 56}, {1, 256, 56, 56}, {64}, {1, 1000}
+    };
+    unsigned long long start_time, end_time;
+    bool enabled = tensor_pool_enabled();
+    printf("tensor_alloc:\n");
+
+    for(int pool = 0; pool < 2; pool++) {
+        set_tensor_pool_enabled(pool == 1);
+        get_pool_allocator()->reset_stats();
+        volatile float32 sink = 0;
+        start_time = get_micro_sec_time();
+        for(int i = 0; i < n; i++) {
+            for(const auto &shape: shapes) {
+                Tensor<float32> t(shape);
+                t.data[0] = (float32)i;     // 触碰首页，避免只测到虚拟地址分配
+                sink = sink + t.data[0];
+            }
+        }
+        end_time = get_micro_sec_time();
+        print_result(pool == 1 ? "pool allocator" : "malloc allocator",
+                     (unsigned long long)n * shapes.size(), end_time - start_time);
+        (void)sink;
+    }
+    print_tensor_pool_stats();
+    set_tensor_pool_enabled(enabled);
+}
+
+static void benchmark_tensor_expr()
+{
+    /*
+     * batch_norm2d形式的运算：(x - mean) / std * weight + bias，按通道广播
+     * 逐个算子计算(每步一个临时张量) vs 表达式模板一次遍历计算
+     */
+    const int n = 50;
+    std::vector<int> channel_shape{1, -1, 1, 1};
+    Tensor<float32> x(std::vector<int>{1, 64, 112, 112});
+    Tensor<float32> mean(std::vector<int>{64});
+    Tensor<float32> std_x(std::vector<int>{64});
+    Tensor<float32> weight(std::vector<int>{64});
+    Tensor<float32> bias(std::vector<int>{64});
+    for(int i = 0; i < x.len(); i++) {
+        x.data[i] = (float32)(i % 255);
+    }
+    for(int i = 0; i < 64; i++) {
+        mean.data[i] = (float32)i;
+        std_x.data[i] = (float32)(i + 1);
+        weight.data[i] = 0.5f;
+        bias.data[i] = 1.0f;
+    }
+    Tensor<float32> m = mean.reshape(channel_shape);
+    Tensor<float32> s = std_x.reshape(channel_shape);
+    Tensor<float32> w = weight.reshape(channel_shape);
+    Tensor<float32> b = bias.reshape(channel_shape);
+    unsigned long long start_time, end_time;
+    volatile float32 sink = 0;
+    printf("tensor_expr:\n");
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n; i++) {
+        Tensor<float32> t1 = x - m;
+        Tensor<float32> t2 = t1 / s;
+        Tensor<float32> t3 = t2 * w;
+        Tensor<float32> y = t3 + b;
+        sink = sink + y.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("per operator", n, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n; i++) {
+        Tensor<float32> y = (x - m) / s * w + b;
+        sink = sink + y.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("fused expression", n, end_time - start_time);
+    (void)sink;
+}
+
+static void benchmark_tensor_broadcast()
+{
+    /*
+     * 广播运算：先broadcast_to并复制为完整尺寸再逐元素计算 vs 直接按步长0广播计算
+     * 操作数分别为数值(1)、按通道(1,C,1,1)、同尺寸(N,C,H,W)
+     */
+    const int n = 50;
+    std::vector<int> shape{1, 64, 112, 112};
+    Tensor<float32> x(shape);
+    for(int i = 0; i < x.len(); i++) {
+        x.data[i] = (float32)(i % 255);
+    }
+    std::vector<std::pair<std::string, std::vector<int>>> operands = {
+            {"scalar", {1}}, {"per-channel", {1, 64, 1, 1}}, {"same-shape", shape}
+    };
+    unsigned long long start_time, end_time;
+    volatile float32 sink = 0;
+    printf("tensor_broadcast:\n");
+
+    for(const auto &operand: operands) {
+        Tensor<float32> b(operand.second);
+        for(int i = 0; i < b.len(); i++) {
+            b.data[i] = (float32)(i % 7 + 1);
+        }
+        start_time = get_micro_sec_time();
+        for(int i = 0; i < n; i++) {
+            Tensor<float32> full = b.broadcast_to(shape).contiguous();
+            Tensor<float32> y = x * full;
+            sink = sink + y.data[i];
+        }
+        end_time = get_micro_sec_time();
+        print_result(operand.first + " materialized", n, end_time - start_time);
+
+        start_time = get_micro_sec_time();
+        for(int i = 0; i < n; i++) {
+            Tensor<float32> y = x * b;
+            sink = sink + y.data[i];
+        }
+        end_time = get_micro_sec_time();
+        print_result(operand.first + " stride-0", n, end_time - start_time);
+    }
+    (void)sink;
+}
+
+static void benchmark_tensor_kernel()
+{
+    /*
+     * 逐元素内核吞吐量：CPU支持的每种指令集分别测试
+     * 数据量64K个float(256KB)，基本在二级缓存中，主要测计算而不是内存带宽
+     */
+    const int len = 1 << 16;
+    const int n = 2000;
+    std::vector<float32> a(len), b(len), out(len);
+    std::vector<int32> i32(len);
+    std::vector<uint8> u8(len), u8_out(len);
+    for(int i = 0; i < len; i++) {
+        a[i] = (float32)(i % 255) - 100.0f;
+        b[i] = (float32)(i % 13) + 1.0f;
+        i32[i] = i % 1000;
+        u8[i] = (uint8)(i % 256);
+    }
+    unsigned long long start_time, end_time;
+    volatile float32 sink = 0;
+    printf("tensor_kernel: (detected %s)\n", get_tensor_kernels()->name);
+
+    for(int isa = 0; isa < TENSOR_ISA_NUM; isa++) {
+        const Tensor_kernels * k = get_tensor_kernels((Tensor_isa)isa);
+        if(k == nullptr) {
+            continue;
+        }
+        std::string prefix = std::string(k->name) + " ";
+        #define BENCH_KERNEL(item, call)                                                    \
+        start_time = get_micro_sec_time();                                                  \
+        for(int r = 0; r < n; r++) {                                                        \
+            call;                                                                           \
+        }                                                                                   \
+        end_time = get_micro_sec_time();                                                    \
+        print_result(prefix + item, (unsigned long long)n * len, end_time - start_time);
+
+        BENCH_KERNEL("add", k->add(out.data(), a.data(), b.data(), len))
+        BENCH_KERNEL("mult_scalar", k->mult_scalar(out.data(), a.data(), 0.5f, len))
+        BENCH_KERNEL("div", k->div(out.data(), a.data(), b.data(), len))
+        BENCH_KERNEL("sqrt", k->sqrt(out.data(), b.data(), len))
+        BENCH_KERNEL("clip", k->clip(out.data(), a.data(), len, -10.0f, 10.0f))
+        BENCH_KERNEL("relu", k->relu(out.data(), a.data(), len))
+        BENCH_KERNEL("clip_u8", k->clip_u8(u8_out.data(), u8.data(), len, 10, 200))
+        BENCH_KERNEL("max", sink = sink + k->max(a.data(), len))
+        BENCH_KERNEL("f32_to_u8", k->f32_to_u8(u8_out.data(), b.data(), len))
+        BENCH_KERNEL("u8_to_f32", k->u8_to_f32(out.data(), u8.data(), len))
+        BENCH_KERNEL("i32_to_f32", k->i32_to_f32(out.data(), i32.data(), len))
+        #undef BENCH_KERNEL
+    }
+    sink = sink + out[len-1] + u8_out[len-1];
+    (void)sink;
+}
+
+template<typename T>
+static void naive_transpose(T * dst, const T * src, const std::vector<int> &size, const std::vector<int> &new_order)
+{
+    /*
+     * 逐元素下标进位、重新计算偏移的转置(对比用)
+     */
+    int dim = (int)size.size();
+    std::vector<int> src_stride = contiguous_stride(size);
+    std::vector<int> index(dim, 0);
+    long long len = 1;
+    for(int k = 0; k < dim; k++) {
+        len *= size[k];
+    }
+    for(long long i = 0; i < len; i++) {
+        long long offset = 0;
+        for(int k = 0; k < dim; k++) {
+            offset += (long long)index[k] * src_stride[new_order[k]];
+        }
+        dst[i] = src[offset];
+        for(int k = dim-1; k >= 0; k--) {
+            if(++index[k] < size[new_order[k]]) {
+                break;
+            }
+            index[k] = 0;
+        }
+    }
+}
+
+static void benchmark_tensor_transpose()
+{
+    /*
+     * 转置：逐元素下标计算 vs 分块转置(contiguous) vs 专用的HWC->CHW
+     * 1. 224x224x3的uint8图像，HWC->CHW并BGR->RGB(图片读取时的处理)
+     * 2. 1x64x112x112的float32特征图，NCHW->NHWC
+     */
+    unsigned long long start_time, end_time;
+    volatile int sink = 0;
+    printf("tensor_transpose:\n");
+
+    const int n_img = 2000;
+    Tensor<uint8> img(std::vector<int>{224, 224, 3});
+    for(int i = 0; i < img.len(); i++) {
+        img.data[i] = (uint8)i;
+    }
+    std::vector<int> hwc_order{2, 0, 1};
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_img; i++) {
+        Tensor<uint8> chw(std::vector<int>{3, 224, 224});
+        naive_transpose(chw.data, img.data, img.size, hwc_order);
+        Tensor<uint8> rgb(chw.shape());
+        rgb[0] = chw[2];
+        rgb[1] = chw[1];
+        rgb[2] = chw[0];
+        sink = sink + rgb.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("hwc->chw+bgr naive", n_img, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_img; i++) {
+        Tensor<uint8> chw = img.transpose(hwc_order);
+        Tensor<uint8> rgb(chw.shape());
+        rgb[0] = chw[2];
+        rgb[1] = chw[1];
+        rgb[2] = chw[0];
+        sink = sink + rgb.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("hwc->chw+bgr transpose view", n_img, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_img; i++) {
+        Tensor<uint8> rgb = img.hwc_to_chw(true);
+        sink = sink + rgb.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("hwc->chw+bgr hwc_to_chw", n_img, end_time - start_time);
+
+    const int n_map = 100;
+    Tensor<float32> feature(std::vector<int>{1, 64, 112, 112});
+    for(int i = 0; i < feature.len(); i++) {
+        feature.data[i] = (float32)i;
+    }
+    std::vector<int> nhwc_order{0, 2, 3, 1};
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_map; i++) {
+        Tensor<float32> nhwc(std::vector<int>{1, 112, 112, 64});
+        naive_transpose(nhwc.data, feature.data, feature.size, nhwc_order);
+        sink = sink + (int)nhwc.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("nchw->nhwc naive", n_map, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_map; i++) {
+        Tensor<float32> nhwc = feature.transpose(nhwc_order).contiguous();
+        sink = sink + (int)nhwc.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("nchw->nhwc blocked", n_map, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_map; i++) {
+        Tensor<float32> nhwc = feature.chw_to_hwc();
+        sink = sink + (int)nhwc.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("nchw->nhwc chw_to_hwc", n_map, end_time - start_time);
+    (void)sink;
+}
+
+template<typename T>
+static Tensor<T> naive_concat(const Tensor<T> &a, const Tensor<T> &b, int dim)
+{
+    /*
+     * 逐元素下标进位、判断来自哪个输入的拼接(对比用，原Tensor::concat的做法)
+     */
+    std::vector<int> new_size = a.size;
+    new_size[dim] += b.size[dim];
+    Tensor<T> result(new_size);
+    int n_dim = (int)new_size.size();
+    std::vector<int> a_stride = contiguous_stride(a.size);
+    std::vector<int> b_stride = contiguous_stride(b.size);
+    std::vector<int> index(n_dim, 0);
+    for(int i = 0; i < result.len(); i++) {
+        long long offset = 0;
+        if(index[dim] < a.size[dim]) {
+            for(int k = 0; k < n_dim; k++) {
+                offset += (long long)index[k] * a_stride[k];
+            }
+            result.data[i] = a.data[offset];
+        }
+        else {
+            for(int k = 0; k < n_dim; k++) {
+                offset += (long long)(k == dim ? index[k] - a.size[dim] : index[k]) * b_stride[k];
+            }
+            result.data[i] = b.data[offset];
+        }
+        for(int k = n_dim-1; k >= 0; k--) {
+            if(++index[k] < new_size[k]) {
+                break;
+            }
+            index[k] = 0;
+        }
+    }
+    return result;
+}
+
+static void benchmark_tensor_concat()
+{
+    /*
+     * 拼接：逐元素下标计算 vs memcpy
+     * 1. 两个1x128x56x56的float32特征图按通道拼接
+     * 2. 四个1x64x28x28按通道一次拼接(两两拼接 vs tensor_concat)
+     */
+    unsigned long long start_time, end_time;
+    volatile int sink = 0;
+    printf("tensor_concat:\n");
+
+    const int n = 200;
+    Tensor<float32> a(std::vector<int>{1, 128, 56, 56});
+    Tensor<float32> b(std::vector<int>{1, 128, 56, 56});
+    for(int i = 0; i < a.len(); i++) {
+        a.data[i] = (float32)i;
+        b.data[i] = (float32)-i;
+    }
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n; i++) {
+        Tensor<float32> c = naive_concat(a, b, 1);
+        sink = sink + (int)c.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("channel concat naive", n, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n; i++) {
+        Tensor<float32> c = a.concat(b, 1);
+        sink = sink + (int)c.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("channel concat memcpy", n, end_time - start_time);
+
+    std::vector<Tensor<float32>> parts;
+    for(int k = 0; k < 4; k++) {
+        Tensor<float32> p(std::vector<int>{1, 64, 28, 28});
+        p.set_rand();
+        parts.push_back(p);
+    }
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n; i++) {
+        Tensor<float32> c = parts[0].concat(parts[1], 1).concat(parts[2], 1).concat(parts[3], 1);
+        sink = sink + (int)c.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("4-way concat pairwise", n, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n; i++) {
+        Tensor<float32> c = tensor_concat(parts, 1);
+        sink = sink + (int)c.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("4-way concat tensor_concat", n, end_time - start_time);
+    (void)sink;
+}
+
+static void naive_channel_moment(float32 * mean, float32 * var, const Tensor<float32> &x)
+{
+    /*
+     * NCHW在(0, 2, 3)上求均值和方差：逐元素计算下标，均值和方差各一遍(对比用，原Tensor::mean/var的做法)
+     */
+    int channel = x.size[1];
+    int axis_len = x.size[0] * x.size[2] * x.size[3];
+    std::vector<int> axis_size{x.size[0], x.size[2], x.size[3]};
+    for(int c = 0; c < channel; c++) {
+        for(int pass = 0; pass < 2; pass++) {
+            int axis_index[3] = {0, 0, 0};
+            float32 sum = 0;
+            for(int j = 0; j < axis_len; j++) {
+                int offset = ((axis_index[0] * channel + c) * x.size[2] + axis_index[1]) * x.size[3] + axis_index[2];
+                float32 d = (pass == 0) ? x.data[offset] : x.data[offset] - mean[c];
+                sum += (pass == 0) ? d : d * d;
+                array_add_1(axis_index, axis_size);
+            }
+            if(pass == 0) {
+                mean[c] = sum / axis_len;
+            }
+            else {
+                var[c] = sum / axis_len;
+            }
+        }
+    }
+}
+
+static void benchmark_tensor_reduce()
+{
+    /*
+     * 归约：
+     * 1. 8x64x56x56的float32特征图按通道求均值和方差(batch norm统计量)
+     * 2. 1x256x56x56的float32特征图求最大最小值(校准时每层输出都要统计)
+     */
+    unsigned long long start_time, end_time;
+    volatile float32 sink = 0;
+    printf("tensor_reduce:\n");
+
+    const int n_moment = 20;
+    Tensor<float32> x(std::vector<int>{8, 64, 56, 56});
+    x.set_rand();
+    std::vector<float32> mean(64);
+    std::vector<float32> var(64);
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_moment; i++) {
+        naive_channel_moment(mean.data(), var.data(), x);
+        sink = sink + var[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("channel mean+var naive", n_moment, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_moment; i++) {
+        Tensor<float32> m = x.mean(std::vector<int>{0, 2, 3});
+        Tensor<float32> v = x.var(std::vector<int>{0, 2, 3});
+        sink = sink + m.data[i] + v.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("channel mean+var single pass", n_moment, end_time - start_time);
+
+    const int n_range = 200;
+    Tensor<float32> y(std::vector<int>{1, 256, 56, 56});
+    y.set_rand();
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_range; i++) {
+        sink = sink + kernel_max(y.data, y.len()) - kernel_min(y.data, y.len());
+    }
+    end_time = get_micro_sec_time();
+    print_result("max + min single thread", n_range, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_range; i++) {
+        float32 min, max;
+        y.minmax(min, max);
+        sink = sink + max - min;
+    }
+    end_time = get_micro_sec_time();
+    print_result("minmax parallel", n_range, end_time - start_time);
+    (void)sink;
+}
+
+template<typename T>
+static int naive_top1_of_topk(const Tensor<T> &x, int k)
+{
+    /*
+     * 复制后选择排序，取前k个下标(对比用，原Tensor::topK的做法)
+     */
+    int len = x.size[x.size.size()-1];
+    std::vector<T> value(x.data, x.data + len);
+    std::vector<int> index(len);
+    for(int i = 0; i < len; i++) {
+        index[i] = i;
+    }
+    for(int i = 0; i < len; i++) {
+        int best = i;
+        for(int j = i+1; j < len; j++) {
+            if(value[j] > value[best]) {
+                best = j;
+            }
+        }
+        std::swap(value[i], value[best]);
+        std::swap(index[i], index[best]);
+    }
+    return index[k-1];
+}
+
+static void benchmark_tensor_topk()
+{
+    /*
+     * topK和排序：
+     * 1. 1x1000的float32分类输出取top5(验证时每张图片一次)
+     * 2. 2^20个int32/float32排序
+     */
+    unsigned long long start_time, end_time;
+    volatile int sink = 0;
+    printf("tensor_topk:\n");
+
+    const int n_topk = 2000;
+    Tensor<float32> logits(std::vector<int>{1, 1000});
+    logits.set_rand();
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_topk; i++) {
+        sink = sink + naive_top1_of_topk(logits, 5);
+    }
+    end_time = get_micro_sec_time();
+    print_result("top5 of 1000 selection sort", n_topk, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_topk; i++) {
+        Tensor<int> top5 = logits.topK(5);
+        sink = sink + top5.data[4];
+    }
+    end_time = get_micro_sec_time();
+    print_result("top5 of 1000 heap", n_topk, end_time - start_time);
+
+    const int n_sort = 10;
+    const int len = 1 << 20;
+    Tensor<int32> ints(std::vector<int>{len});
+    Tensor<float32> floats(std::vector<int>{len});
+    floats.set_rand();
+    for(int i = 0; i < len; i++) {
+        ints.data[i] = (int32)(floats.data[i] * 2e9f) - 1000000000;
+    }
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_sort; i++) {
+        Tensor<int32> t = ints.deep_copy();
+        std::sort(t.data, t.data + len);
+        sink = sink + t.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("sort 2^20 int32 std::sort", n_sort, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_sort; i++) {
+        Tensor<int32> t = ints.deep_copy();
+        t.sort(0);
+        sink = sink + t.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("sort 2^20 int32 radix", n_sort, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_sort; i++) {
+        Tensor<float32> t = floats.deep_copy();
+        t.sort(1);
+        sink = sink + (int)t.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("sort 2^20 float32 descending", n_sort, end_time - start_time);
+    (void)sink;
+}
+
+static void spawn_relu(float32 * R, float32 * I, int64_t len)
+{
+    get_tensor_kernels()->relu(R, I, len);
+}
+
+static void benchmark_thread_pool()
+{
+    /*
+     * 分发延迟：每次调用创建并join n_proc个std::thread(原relu/qconv2d/dot的方式) vs 线程池的parallel_for
+     * 1. 空任务：只有分发和等待的开销
+     * 2. 2^18个元素的relu(分成n_proc块)：小算子的情况
+     */
+    unsigned long long start_time, end_time;
+    printf("thread_pool:\n");
+    int n_proc = get_thread_pool()->size();
+    std::atomic<int64_t> sink(0);
+
+    const int n_empty = 2000;
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_empty; i++) {
+        std::vector<std::thread> threads;
+        for(int t = 0; t < n_proc; t++) {
+            threads.emplace_back([&sink, t]() {
+                sink.fetch_add(t, std::memory_order_relaxed);
+            });
+        }
+        for(auto &th: threads) {
+            th.join();
+        }
+    }
+    end_time = get_micro_sec_time();
+    print_result("before: empty task, spawn " + std::to_string(n_proc) + " threads", n_empty, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_empty; i++) {
+        parallel_for(0, n_proc, 1, [&sink](int64_t from, int64_t to) {
+            sink.fetch_add(to - from, std::memory_order_relaxed);
+        });
+    }
+    end_time = get_micro_sec_time();
+    print_result("after: empty task, thread pool", n_empty, end_time - start_time);
+
+    const int n_relu = 2000;
+    const int64_t len = 1 << 18;
+    Tensor<float32> input(std::vector<int>{(int)len});
+    Tensor<float32> output(std::vector<int>{(int)len});
+    input.set_rand();
+    input -= 0.5f;
+    int64_t len_per_proc = len / n_proc;
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_relu; i++) {
+        std::vector<std::thread> threads;
+        for(int t = 0; t < n_proc; t++) {
+            threads.emplace_back(spawn_relu, output.data + t * len_per_proc, input.data + t * len_per_proc, len_per_proc);
+        }
+        spawn_relu(output.data + n_proc * len_per_proc, input.data + n_proc * len_per_proc, len - n_proc * len_per_proc);
+        for(auto &th: threads) {
+            th.join();
+        }
+    }
+    end_time = get_micro_sec_time();
+    print_result("before: relu 2^18, spawn " + std::to_string(n_proc) + " threads", n_relu, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_relu; i++) {
+        parallel_for(0, len, (len + n_proc - 1) / n_proc, [&](int64_t from, int64_t to) {
+            spawn_relu(output.data + from, input.data + from, to - from);
+        });
+    }
+    end_time = get_micro_sec_time();
+    print_result("after: relu 2^18, thread pool", n_relu, end_time - start_time);
+    (void)sink;
+}
+
+static void benchmark_image_ingest()
+{
+    /*
+     * 图片输入的预处理(resize之后)：224x224x3的BGR uint8图片 -> 1x3x224x224的RGB归一化张量
+     * before: memcpy到Tensor、hwc_to_chw(true)、preprocess/qpreprocess(申请新张量)
+     * after: preprocess_image/qpreprocess_image一次遍历写入已有的张量
+     */
+    unsigned long long start_time, end_time;
+    volatile int sink = 0;
+    printf("image_ingest:\n");
+
+    const int n_img = 2000;
+    const int height = 224;
+    const int width = 224;
+    std::vector<uint8> bgr_hwc((size_t)height * width * 3);
+    for(size_t i = 0; i < bgr_hwc.size(); i++) {
+        bgr_hwc[i] = (uint8)(i * 7);
+    }
+    Tensor<float32> input(std::vector<int>{1, 3, height, width});
+    Tensor<uint8> qinput(std::vector<int>{1, 3, height, width});
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_img; i++) {
+        Tensor<uint8> img(std::vector<int>{height, width, 3});
+        memcpy(img.data, bgr_hwc.data(), bgr_hwc.size());
+        Tensor<uint8> rgb = img.hwc_to_chw(true).reshape(std::vector<int>{1, 3, height, width});
+        Tensor<float32> * processed = preprocess(&rgb);
+        sink = sink + (int)processed->data[i];
+        delete processed;
+    }
+    end_time = get_micro_sec_time();
+    print_result("before: float32, hwc_to_chw + preprocess", n_img, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_img; i++) {
+        preprocess_image(input.data, bgr_hwc.data(), height, width, 3);
+        sink = sink + (int)input.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("after: float32, preprocess_image", n_img, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_img; i++) {
+        Tensor<uint8> img(std::vector<int>{height, width, 3});
+        memcpy(img.data, bgr_hwc.data(), bgr_hwc.size());
+        Tensor<uint8> rgb = img.hwc_to_chw(true).reshape(std::vector<int>{1, 3, height, width});
+        Tensor<uint8> * processed = qpreprocess(&rgb);
+        sink = sink + processed->data[i];
+        delete processed;
+    }
+    end_time = get_micro_sec_time();
+    print_result("before: uint8, hwc_to_chw + qpreprocess", n_img, end_time - start_time);
+
+    start_time = get_micro_sec_time();
+    for(int i = 0; i < n_img; i++) {
+        qpreprocess_image(qinput.data, bgr_hwc.data(), height, width, 3);
+        sink = sink + qinput.data[i];
+    }
+    end_time = get_micro_sec_time();
+    print_result("after: uint8, qpreprocess_image", n_img, end_time - start_time);
+    (void)sink;
+}
+
+void run_benchmark(const std::string &name)
+{
+    bool found = false;
+    if(name == "tensor_copy" || name == "all") {
+        benchmark_tensor_copy();
+        found = true;
+    }
+    if(name == "tensor_alloc" || name == "all") {
+        benchmark_tensor_alloc();
+        found = true;
+    }
+    if(name == "tensor_expr" || name == "all") {
+        benchmark_tensor_expr();
+        found = true;
+    }
+    if(name == "tensor_broadcast" || name == "all") {
+        benchmark_tensor_broadcast();
+        found = true;
+    }
+    if(name == "tensor_kernel" || name == "all") {
+        benchmark_tensor_kernel();
+        found = true;
+    }
+    if(name == "tensor_transpose" || name == "all") {
+        benchmark_tensor_transpose();
+        found = true;
+    }
+    if(name == "tensor_concat" || name == "all") {
+        benchmark_tensor_concat();
+        found = true;
+    }
+    if(name == "tensor_reduce" || name == "all") {
+        benchmark_tensor_reduce();
+        found = true;
+    }
+    if(name == "tensor_topk" || name == "all") {
+        benchmark_tensor_topk();
+        found = true;
+    }
+    if(name == "thread_pool" || name == "all") {
+        benchmark_thread_pool();
+        found = true;
+    }
+    if(name == "image_ingest" || name == "all") {
+        benchmark_image_ingest();
+        found = true;
+    }
+    if(!found) {
+        fprintf(stderr, "Unknown benchmark: %s\n", name.c_str());
+        exit(-1);
+    }
+}
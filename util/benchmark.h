@@ -0,0 +1,26 @@
+#ifndef QUANT_BENCHMARK_H
+#define QUANT_BENCHMARK_H
+
+#include <string>
+
+#include "tensor.h"
+#include "util.h"
+
+/*
+ * 性能测试
+ * 通过 --benchmark <name> 运行，name为all时运行全部测试
+ * tensor_copy: Tensor拷贝构造、operator[]切片、operator=的吞吐量(与旧的全局map引用计数方式对比)
+ * tensor_alloc: 张量申请/释放的吞吐量(malloc分配器与池分配器对比)
+ * tensor_expr: 按通道广播的链式运算，逐个算子计算与表达式模板融合计算对比
+ * tensor_broadcast: 数值/按通道/同尺寸操作数的广播运算，复制为完整尺寸与直接按步长0计算对比
+ * tensor_kernel: 逐元素内核在每种指令集(标量/SSE4/AVX2/AVX-512)下的吞吐量
+ * tensor_transpose: 图片HWC->CHW(并BGR->RGB)、特征图NCHW->NHWC，逐元素转置与分块/专用转置对比
+ * tensor_concat: 特征图按通道拼接，逐元素下标计算与按连续段memcpy对比
+ * tensor_reduce: 按通道求均值/方差、整个张量求最大最小值，逐元素下标计算/分别求max和min与单遍多线程归约对比
+ * tensor_topk: 1000类输出的top5、排序，选择排序与堆筛选/std::sort/基数排序对比
+ * thread_pool: 空任务和小relu的分发延迟，每次调用创建线程与常驻线程池的parallel_for对比
+ * image_ingest: resize后图片的预处理，hwc_to_chw+preprocess与一次遍历的preprocess_image对比
+ */
+void run_benchmark(const std::string &name);
+
+#endif //QUANT_BENCHMARK_H
@@ -0,0 +1,177 @@
+#include "image_loader.h"
+
+#include <cstdio>
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "preprocess.h"
+
+
+static std::atomic<int> prefetch_depth(IMAGE_LOADER_DEFAULT_PREFETCH);
+
+
+void set_image_prefetch(int prefetch)
+{
+    prefetch_depth.store(std::max(0, prefetch), std::memory_order_relaxed);
+}
+
+int image_prefetch()
+{
+    return prefetch_depth.load(std::memory_order_relaxed);
+}
+
+
+Image_loader::Image_loader(const std::vector<std::string> &paths, const std::vector<int> &shape, int mode,
+                           int n_threads):
+    paths(paths), shape(shape), mode(mode), next_index(0), n_decoding(0), n_resizing(0), failed_index(-1),
+    decoded(std::max(1, image_prefetch())), resized(std::max(1, image_prefetch()))
+{
+    if(shape.size() != 4 || (shape[1] != 1 && shape[1] != 3)) {
+        fprintf(stderr, "File: image_loader.cpp, line: %d. Image shape should be (N, 1 or 3, H, W)\n", __LINE__);
+        exit(-1);
+    }
+    if(mode != IMAGE_LOADER_RAW && shape[1] != 3) {
+        fprintf(stderr, "File: image_loader.cpp, line: %d. preprocess and qpreprocess only support 3 channel images, "
+                        "got %d\n", __LINE__, shape[1]);
+        exit(-1);
+    }
+    if(image_prefetch() == 0) {
+        return;
+    }
+    n_threads = std::max(1, n_threads);
+    n_decoding = n_threads;
+    n_resizing = n_threads;
+    for(int i = 0; i<n_threads; i++) {
+        threads.push_back(std::thread(&Image_loader::decode_loop, this));
+        threads.push_back(std::thread(&Image_loader::resize_loop, this));
+    }
+}
+
+Image_loader::~Image_loader()
+{
+    /*
+     * 停止流水线(使用者可能没有取完所有图片，线程可能在等待队列)，等待线程结束。队列中剩余的图片随队列释放
+     */
+    stop();
+    for(std::thread &t: threads) {
+        t.join();
+    }
+}
+
+void Image_loader::stop()
+{
+    /*
+     * 唤醒所有等待队列的线程，之后push和pop都返回false。不再领取新的图片
+     */
+    next_index.store((int)paths.size(), std::memory_order_relaxed);
+    decoded.stop();
+    resized.stop();
+}
+
+cv::Mat Image_loader::decode(int index) const
+{
+    /*
+     * 读取并解码一张图片，单通道时读为灰度图
+     */
+    return cv::imread(paths[index], shape[1] == 1 ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
+}
+
+cv::Mat Image_loader::resize(const cv::Mat &img) const
+{
+    cv::Mat dst;
+    cv::resize(img, dst, cv::Size(shape[3], shape[2]), 0, 0, cv::INTER_LINEAR);
+    return dst;
+}
+
+void Image_loader::process(void * dst, const cv::Mat &img) const
+{
+    /*
+     * resize后的图片HWC转CHW(三通道时BGR转RGB)，再按mode归一化，由一个内核一次完成(见preprocess_image)，直接写入dst
+     */
+    if(mode == IMAGE_LOADER_PREPROCESS) {
+        preprocess_image((float32*)dst, img.data, shape[2], shape[3], shape[1]);
+    }
+    else if(mode == IMAGE_LOADER_QPREPROCESS) {
+        qpreprocess_image((uint8*)dst, img.data, shape[2], shape[3], shape[1]);
+    }
+    else {
+        // hwc to chw，三通道时同时bgr to rgb
+        tensor_hwc_to_chw((uint8*)dst, (const uint8*)img.data, shape[2], shape[3], shape[1], shape[1] == 3);
+    }
+}
+
+void Image_loader::decode_loop()
+{
+    /*
+     * 解码级：领取下一个下标并解码，直到所有图片都已领取或流水线停止
+     * 解码失败时记录下标并停止流水线，由使用者在next中报错(不在这里退出进程)
+     */
+    while(true) {
+        int index = next_index.fetch_add(1, std::memory_order_relaxed);
+        if(index >= (int)paths.size()) {
+            break;
+        }
+        cv::Mat img = decode(index);
+        if(img.empty()) {
+            int expected = -1;
+            failed_index.compare_exchange_strong(expected, index);
+            stop();
+            break;
+        }
+        if(!decoded.push(Decoded_image{index, img})) {
+            break;
+        }
+    }
+    if(n_decoding.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        decoded.close();
+    }
+}
+
+void Image_loader::resize_loop()
+{
+    /*
+     * resize级：resize解码队列中的图片，直到解码队列关闭且为空，或流水线停止
+     */
+    Decoded_image image;
+    while(decoded.pop(image)) {
+        Decoded_image small{image.index, resize(image.img)};
+        image.img = cv::Mat();             // 释放解码后的图片
+        if(!resized.push(small)) {
+            break;
+        }
+    }
+    if(n_resizing.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        resized.close();
+    }
+}
+
+bool Image_loader::next(int &index, void * dst)
+{
+    if(!threads.empty()) {
+        Decoded_image image;
+        if(resized.pop(image)) {
+            index = image.index;
+            process(dst, image.img);
+            return true;
+        }
+        index = failed_index.load(std::memory_order_relaxed);
+        if(index < 0) {
+            return false;
+        }
+    }
+    else {
+        // 不使用流水线：在调用线程中处理
+        index = next_index.fetch_add(1, std::memory_order_relaxed);
+        if(index >= (int)paths.size()) {
+            return false;
+        }
+        cv::Mat img = decode(index);
+        if(!img.empty()) {
+            process(dst, resize(img));
+            return true;
+        }
+    }
+    fprintf(stderr, "File: image_loader.cpp, line: %d. Read image %s failed\n", __LINE__, paths[index].c_str());
+    exit(-1);
+}
@@ -0,0 +1,158 @@
+#ifndef QUANT_IMAGE_LOADER_H
+#define QUANT_IMAGE_LOADER_H
+
+/*
+ * 图片的流水线读取
+ * 设计思路：
+ * 读取calib set和测试准确率时，每张图片依次经过：读取并解码(cv::imread) -> resize -> HWC转CHW(三通道时BGR转RGB)
+ * -> 归一化(preprocess/qpreprocess)。原来这些步骤与推理在同一个线程中串行执行，磁盘和解码的时间无法与计算重叠。
+ * 现在分为两级流水线，每级有n_threads个线程，级间用有界队列连接：
+ * 1. 解码级：线程依次领取下一个图片路径，cv::imread解码后放入解码队列
+ * 2. resize级：线程从解码队列取出图片，resize为输入尺寸后放入输出队列
+ * 3. 使用者(推理线程，可以有多个)调用next从输出队列取出resize后的图片，由一个内核完成转为CHW和按mode归一化
+ *    (见preprocess_image)，结果直接写入使用者提供的空间(如Input节点的中间结果，见Execution_context::input_result)。
+ *    这一步很快，放在使用者中可以不为每张图片申请输出张量，也不需要再复制一次
+ * 每个队列最多prefetch张图片，队列满时前一级等待，因此预先处理的图片数有上限，内存有界。
+ * 多个线程时图片完成的顺序不确定，next返回图片在路径列表中的下标。
+ * prefetch为0时不创建线程：next在调用线程中处理下一张图片(原来的方式)，多个使用者各自处理自己领取的图片
+ * 读取失败时流水线的线程不退出进程：记录失败的图片并停止流水线，由使用者在next中报错
+ * 流水线的线程不计入thread budget(见thread_budget.h)：它们大部分时间在等待磁盘或队列
+ */
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <opencv2/core.hpp>
+
+#include "tensor.h"
+
+
+#define IMAGE_LOADER_RAW 0                  // 输出resize后的RGB CHW图片，uint8
+#define IMAGE_LOADER_PREPROCESS 1           // 输出preprocess的结果，float32
+#define IMAGE_LOADER_QPREPROCESS 2          // 输出qpreprocess的结果，uint8
+
+#define IMAGE_LOADER_DEFAULT_PREFETCH 4
+
+
+// 设置流水线每个队列的长度(预读的图片数)，0表示不使用流水线
+void set_image_prefetch(int prefetch);
+int image_prefetch();
+
+
+template<typename T>
+class Bounded_queue {
+    /*
+     * 有界阻塞队列。所有生产者结束后调用close，之后pop取完剩余元素后返回false
+     * stop用于提前结束：唤醒所有等待的线程，之后push和pop都立即返回false，剩余元素随队列析构
+     */
+public:
+    explicit Bounded_queue(int capacity): capacity(capacity), closed(false), stopped(false) {}
+
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return (int)items.size() < capacity || stopped; });
+        if(stopped) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        lock.unlock();
+        not_empty.notify_one();
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return !items.empty() || closed || stopped; });
+        if(items.empty() || stopped) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        not_empty.notify_all();
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+private:
+    int capacity;
+    bool closed;
+    bool stopped;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+};
+
+
+class Image_loader {
+public:
+    /*
+     * paths: 图片路径，shape: 输入尺寸(N, C, H, W)，只使用C H W。IMAGE_LOADER_RAW时C可以为1或3，
+     * IMAGE_LOADER_PREPROCESS和IMAGE_LOADER_QPREPROCESS按RGB三个通道归一化，C只能为3
+     * mode: IMAGE_LOADER_*，n_threads: 每一级流水线的线程数
+     * 创建后立即开始在后台读取(prefetch大于0时)
+     */
+    Image_loader(const std::vector<std::string> &paths, const std::vector<int> &shape, int mode, int n_threads = 1);
+    ~Image_loader();                        // 可以在取完所有图片之前析构：停止流水线，队列中的图片随队列释放
+    Image_loader(const Image_loader &) = delete;
+    Image_loader & operator=(const Image_loader &) = delete;
+
+    /*
+     * 取下一张图片，按mode处理后以CHW写入dst(C*H*W个元素，类型见IMAGE_LOADER_*)，index为它在路径列表中的下标
+     * 全部取完后返回false。可以多个线程同时调用(各自的dst)。读取图片失败时在调用线程中报错退出
+     */
+    bool next(int &index, void * dst);
+    int size() const { return (int)paths.size(); }
+
+private:
+    struct Decoded_image {
+        int index;
+        cv::Mat img;
+    };
+
+    std::vector<std::string> paths;
+    std::vector<int> shape;
+    int mode;
+    std::atomic<int> next_index;            // 下一个要解码的图片下标
+    std::atomic<int> n_decoding;            // 还在运行的解码线程数，最后一个结束时关闭解码队列
+    std::atomic<int> n_resizing;            // 还在运行的resize线程数，最后一个结束时关闭输出队列
+    std::atomic<int> failed_index;          // 流水线中第一张读取失败的图片下标，-1表示没有
+    Bounded_queue<Decoded_image> decoded;
+    Bounded_queue<Decoded_image> resized;
+    std::vector<std::thread> threads;
+
+    cv::Mat decode(int index) const;        // 失败时返回空的cv::Mat
+    cv::Mat resize(const cv::Mat &img) const;
+    void process(void * dst, const cv::Mat &img) const;
+    void stop();
+    void decode_loop();
+    void resize_loop();
+};
+
+
+#endif //QUANT_IMAGE_LOADER_H
@@ -32,6 +32,12 @@
 
 
 
+static const float32 preprocess_mean[3] = {123.15f, 115.90f, 103.06f};    // RGB各通道的均值
+static const float32 preprocess_std[3] = {58.395f, 57.12f, 57.375f};      // RGB各通道的标准差
+static const float32 qpreprocess_scale = 0.016631f;                        // 输入节点的量化参数
+static const float32 qpreprocess_zero = 104.0f;
+
+
 Tensor<float32>* preprocess(Tensor<uint8>* src)
 {
     /*
@@ -43,12 +49,13 @@ Tensor<float32>* preprocess(Tensor<uint8>* src)
         return nullptr;
     }
 
+    Tensor_trace_site trace_site("preprocess");
     Tensor<float32> *dst = new Tensor<float32>{src->size};
     int img_num = dst->size[0];
-    for(int i = 0; i<img_num; i++) {
-        (*dst)[i][0] = ((*src)[i][0].astype_float32() - 123.15) / 58.395;
-        (*dst)[i][1] = ((*src)[i][1].astype_float32() - 115.90) / 57.12;
-        (*dst)[i][2] = ((*src)[i][2].astype_float32() - 103.06) / 57.375;
+    for(int i = 0; i<img_num; i++) {       // 表达式一次遍历算出结果，直接写入dst
+        for(int c = 0; c<3; c++) {
+            (*dst)[i][c] = (as_expr((*src)[i][c]).astype_float32() - preprocess_mean[c]) / preprocess_std[c];
+        }
     }
     return dst;
 }
@@ -64,15 +71,40 @@ Tensor<uint8>* qpreprocess(Tensor<uint8>* src)
         return nullptr;
     }
 
-    Tensor<float32> *dst = new Tensor<float32>{src->size};
-    int img_num = dst->size[0];
-    for(int i = 0; i<img_num; i++) {
-        (*dst)[i][0] = ((*src)[i][0].astype_float32() - 123.15) / 58.395 / 0.016631 + 104;
-        (*dst)[i][1] = ((*src)[i][1].astype_float32() - 115.90) / 57.12 / 0.016631 + 104;
-        (*dst)[i][2] = ((*src)[i][2].astype_float32() - 103.06) / 57.375 / 0.016631 + 104;
+    Tensor_trace_site trace_site("qpreprocess");
+    Tensor<uint8>* ret = new Tensor<uint8>{src->size};
+    int img_num = ret->size[0];
+    for(int i = 0; i<img_num; i++) {       // 归一化、量化、clip、转uint8在一次遍历中完成，不申请float中间张量
+        for(int c = 0; c<3; c++) {
+            (*ret)[i][c] = clip((as_expr((*src)[i][c]).astype_float32() - preprocess_mean[c]) / preprocess_std[c]
+                                / qpreprocess_scale + qpreprocess_zero, 0.0f, 255.0f).astype_uint8();
+        }
     }
-    dst->clip(0, 255);
-    Tensor<uint8>* ret = new Tensor<uint8>{dst->size};
-    *ret = dst->astype_uint8();
     return ret;
-}
\ No newline at end of file
+}
+
+void preprocess_image(float32 * dst, const uint8 * bgr_hwc, int height, int width, int channel)
+{
+    /*
+     * 与preprocess相同的预处理，输入为resize后的OpenCV图片(HWC，BGR)，结果按CHW(RGB)写入dst
+     * 不经过hwc_to_chw和中间张量，见tensor_normalize_hwc_to_chw
+     */
+    if(channel != 3) {
+        fprintf(stderr, "File: preprocess.cpp, line: %d. preprocess_image only supports 3 channel images\n", __LINE__);
+        exit(-1);
+    }
+    tensor_normalize_hwc_to_chw(dst, bgr_hwc, height, width, channel, true, preprocess_mean, preprocess_std);
+}
+
+void qpreprocess_image(uint8 * dst, const uint8 * bgr_hwc, int height, int width, int channel)
+{
+    /*
+     * 与qpreprocess相同的预处理，输入为resize后的OpenCV图片(HWC，BGR)，结果按CHW(RGB)写入dst
+     */
+    if(channel != 3) {
+        fprintf(stderr, "File: preprocess.cpp, line: %d. qpreprocess_image only supports 3 channel images\n", __LINE__);
+        exit(-1);
+    }
+    tensor_quantize_hwc_to_chw(dst, bgr_hwc, height, width, channel, true, preprocess_mean, preprocess_std,
+                               qpreprocess_scale, qpreprocess_zero);
+}
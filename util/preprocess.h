@@ -14,4 +14,11 @@
 Tensor<float32>* preprocess(Tensor<uint8>* src);
 Tensor<uint8>* qpreprocess(Tensor<uint8>* src);
 
+/*
+ * 直接从resize后的OpenCV图片(HWC，BGR)预处理，结果按CHW(RGB)写入调用者提供的dst(channel*height*width个元素，
+ * 例如Input节点预先申请的中间结果，见Image_loader::next)。只支持三通道。结果与hwc_to_chw(true)后再preprocess/qpreprocess逐位相同
+ */
+void preprocess_image(float32 * dst, const uint8 * bgr_hwc, int height, int width, int channel);
+void qpreprocess_image(uint8 * dst, const uint8 * bgr_hwc, int height, int width, int channel);
+
 #endif //QUANT_PREPROCESS_H
@@ -0,0 +1,105 @@
+#include "thread_budget.h"
+
+#include <cstdio>
+#include <algorithm>
+#include <sched.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "cblas.h"
+#include "thread_pool.h"
+
+
+static int budget = 0;          // 当前的线程数，0表示未设置
+
+
+static std::vector<int> read_allowed_cpus()
+{
+    /*
+     * 调用线程的cpu亲和性掩码中的cpu编号。读取失败时返回0到处理器数-1
+     */
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for(int i = 0; i<CPU_SETSIZE; i++) {
+            if(CPU_ISSET(i, &set)) {
+                cpus.push_back(i);
+            }
+        }
+    }
+    if(cpus.empty()) {
+        int n_proc = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        for(int i = 0; i<n_proc; i++) {
+            cpus.push_back(i);
+        }
+    }
+    return cpus;
+}
+
+std::vector<int> get_allowed_cpus()
+{
+    /*
+     * 第一次调用时(System_info的构造，早于任何绑定)读取并保存，之后返回同一结果。
+     * 绑定只修改工作线程的亲和性，但保存下来可以保证在任何线程中调用结果都相同
+     */
+    static const std::vector<int> cpus = read_allowed_cpus();
+    return cpus;
+}
+
+void set_thread_budget(int n_threads, bool pin_threads, int n_callers)
+{
+    /*
+     * 设置OpenBLAS、OpenMP和内部线程池的线程数，pin_threads为true时绑定cpu。不能在计算期间调用
+     * n_callers个线程同时推理时，OpenBLAS和OpenMP的线程数按调用线程均分
+     */
+    std::vector<int> allowed = get_allowed_cpus();
+    if(n_threads <= 0) {
+        n_threads = (int)allowed.size();
+    }
+    if(n_callers <= 0) {
+        n_callers = n_threads;
+    }
+    budget = n_threads;
+    int blas_threads = std::max(1, n_threads / n_callers);
+    openblas_set_num_threads(blas_threads);
+#ifdef _OPENMP
+    omp_set_num_threads(blas_threads);
+#endif
+    std::vector<int> cpus;
+    if(pin_threads) {
+        if(n_threads > (int)allowed.size()) {
+            fprintf(stderr, "File: thread_budget.cpp, line: %d. %d threads on %d cpus, some cpus are shared\n",
+                    __LINE__, n_threads, (int)allowed.size());
+        }
+        for(int i = 0; i<n_threads; i++) {
+            cpus.push_back(allowed[i % allowed.size()]);
+        }
+#if defined(OPENBLAS_OS_LINUX) && defined(OPENBLAS_THREAD)
+        // OpenBLAS的工作线程(不含调用线程)依次绑定到第1、2...个cpu，OpenMP版的OpenBLAS由OpenMP管理线程，不绑定
+        if(openblas_get_parallel() == OPENBLAS_THREAD) {
+            cpu_set_t set;
+            for(int i = 0; i<openblas_get_num_threads() - 1; i++) {
+                CPU_ZERO(&set);
+                CPU_SET(cpus[(i + 1) % cpus.size()], &set);
+                openblas_setaffinity(i, sizeof(set), &set);
+            }
+        }
+        else if(openblas_get_parallel() == OPENBLAS_OPENMP) {
+            fprintf(stderr, "File: thread_budget.cpp, line: %d. OpenBLAS uses OpenMP threads, they are not pinned\n",
+                    __LINE__);
+        }
+#else
+        fprintf(stderr, "File: thread_budget.cpp, line: %d. cblas.h has no openblas_setaffinity, "
+                        "OpenBLAS threads are not pinned\n", __LINE__);
+#endif
+    }
+    set_thread_pool_size(n_threads, cpus);
+}
+
+int get_thread_budget()
+{
+    return budget > 0 ? budget : get_thread_pool()->size();
+}
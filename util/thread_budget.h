@@ -0,0 +1,34 @@
+#ifndef QUANT_THREAD_BUDGET_H
+#define QUANT_THREAD_BUDGET_H
+
+/*
+ * 统一的线程数设置
+ * 设计思路：
+ * 进程中有三组计算线程：OpenBLAS自己的线程(cblas_sgemm)、OpenMP的线程(-fopenmp编译的代码)、
+ * 内部线程池(parallel_for，见thread_pool.h)。三者分别按处理器数创建线程，同时运行时会超额使用cpu，
+ * 多个quant进程共用一台机器时更严重。set_thread_budget用一个线程数同时设置三者。
+ * 只有一个线程推理时三者不会同时计算(调用cblas_sgemm或parallel_for的线程等待其完成)，各自使用n_threads个线程即可。
+ * n_callers为同时推理(调用cblas_sgemm)的线程数，例如--eval_workers的线程、dag调度器同时执行节点的线程。
+ *      线程池是共享的，多个线程的parallel_for分到同一组线程上，仍为n_threads个；
+ *      而OpenBLAS在每个调用线程中各自使用它的全部线程，所以OpenBLAS和OpenMP的线程数设为n_threads/n_callers(至少为1)。
+ *      n_callers不大于0时按n_threads个线程同时推理计算(dag调度器的执行线程数最多为线程池的大小)
+ *
+ * pin_threads为true时绑定cpu：从进程启动时允许的cpu(sched_getaffinity，例如taskset指定的)中取前n_threads个，
+ *      线程池的第i个工作线程和OpenBLAS的第i个工作线程绑定到第i个cpu(第0个cpu留给调用线程)。
+ *      只绑定这些工作线程，不修改进程和调用线程的亲和性，所以调用线程之后创建的线程(如--eval_workers)不受影响，
+ *      再次调用时仍从启动时的cpu集合中选择。多个进程共用一台机器时，用taskset给每个进程不同的cpu集合
+ *      OpenBLAS的线程只有在cblas.h提供openblas_setaffinity(OPENBLAS_OS_LINUX和OPENBLAS_THREAD有定义，
+ *      较新的OpenBLAS)且OpenBLAS使用pthread版本时才能绑定，否则打印提示，OpenBLAS的线程不绑定。OpenMP的线程不绑定
+ * n_threads不大于0时使用进程允许的cpu数
+ * 选项全部读取后调用一次(quant.cpp中--threads、--pin_threads、--eval_workers和--scheduler的顺序不影响结果)
+ */
+
+#include <vector>
+
+
+void set_thread_budget(int n_threads, bool pin_threads, int n_callers = 1);
+int get_thread_budget();                            // 当前的线程数
+std::vector<int> get_allowed_cpus();                // 进程启动时允许使用的cpu编号
+
+
+#endif //QUANT_THREAD_BUDGET_H
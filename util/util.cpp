@@ -3,6 +3,7 @@
 //
 
 #include "util.h"
+#include "thread_budget.h"
 
 bool string_to_bool(const std::string &value)
 {
@@ -94,7 +95,10 @@ std::string delete_annotation(const std::string &s, const std::string &annotatio
 }
 
 System_info::System_info() {
-    n_proc = sysconf(_SC_NPROCESSORS_ONLN);
+    /*
+     * 可用cpu数取进程的cpu亲和性掩码中的cpu数(例如用taskset限制时)，读取失败时取在线处理器数
+     */
+    n_proc = (int)get_allowed_cpus().size();
 }
 
 void clear_log()